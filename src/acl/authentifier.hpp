@@ -25,6 +25,8 @@
 #ifndef _REDEMPTION_ACL_AUTHENTIFIER_HPP_
 #define _REDEMPTION_ACL_AUTHENTIFIER_HPP_
 
+#include <algorithm>
+
 #include "log.hpp"
 #include "config.hpp"
 #include "activity_checker.hpp"
@@ -63,9 +65,14 @@ public:
         }
     }
 
-    bool is_started() {
+    bool is_started() const {
         return this->connected;
     }
+
+    // Next time check() has something to do (renew request or timeout).
+    time_t next_check_time() const {
+        return (this->wait_answer ? this->timeout : this->renew_time) + 1;
+    }
     void start(time_t now) {
         this->connected = true;
         if (this->verbose & 0x10) {
@@ -145,6 +152,10 @@ public:
         }
     }
 
+    time_t next_check_time() const {
+        return this->last_activity_time + this->inactivity_timeout + 1;
+    }
+
     bool check(time_t now) {
         if (!this->checker.check_and_reset_activity()) {
             if (now > this->last_activity_time + this->inactivity_timeout) {
@@ -202,6 +213,19 @@ public:
     }
 
 public:
+    // Earliest time check() must be called even if no event occurs.
+    time_t next_check_time() const {
+        time_t next_time = this->inactivity.next_check_time();
+        if (this->keepalive.is_started()) {
+            next_time = std::min(next_time, this->keepalive.next_check_time());
+        }
+        const uint32_t enddate = this->ini.context.end_date_cnx.get();
+        if (enddate != 0) {
+            next_time = std::min(next_time, static_cast<time_t>(enddate) + 1);
+        }
+        return next_time;
+    }
+
     bool check(MMApi & mm, time_t now, BackEvent_t & signal) {
         //LOG(LOG_INFO, "================> ACL check: now=%u, signal=%u",
         //    (unsigned)now, static_cast<unsigned>(signal));
@@ -428,6 +452,15 @@ public:
 
     ~PauseRecord() {}
 
+    // Recording is paused by check() after this time without traffic,
+    //  returns 0 when already paused (traffic resumes it).
+    time_t next_check_time() const {
+        if (this->stop_record_inactivity || !this->last_record_activity_time) {
+            return 0;
+        }
+        return this->last_record_activity_time + this->stop_record_time + 1;
+    }
+
     void check(time_t now, Front & front) {
         // Procedure which stops the recording on inactivity
         if (this->last_record_activity_time == 0) this->last_record_activity_time = now;
@@ -345,6 +345,7 @@ class ModuleManager : public MMIni
         , mm(mm)
         {
             mm.mod_transport = this;
+            ++mm.mod_transport_generation;
         }
 
         bool targer_info_is_shown = false;
@@ -433,6 +434,8 @@ public:
     Front & front;
     null_mod no_mod;
     SocketTransport * mod_transport = nullptr;
+    // changes with each module socket, which may reuse the number of the previous one
+    uint64_t mod_transport_generation = 0;
 
     ModuleManager(Front & front, Inifile & ini)
         : MMIni(ini)
@@ -170,6 +170,9 @@ public:
 
     bool ignore_frame_in_timeval;
 
+    // after a seek, the breakpoint of the consumers waits for the image of the keyframe
+    bool keyframe_breakpoint_delayed;
+
     struct Statistics {
         uint32_t DstBlt;
         uint32_t MultiDstBlt;
@@ -269,6 +272,7 @@ public:
         , info_cache_4_persistent(false)
         , info_compression_algorithm(0)
         , ignore_frame_in_timeval(false)
+        , keyframe_breakpoint_delayed(false)
         , statistics()
     {
         while (this->next_order()){
@@ -799,10 +803,8 @@ public:
                     }
                 }
 
-                for (size_t i = 0; i < this->nbconsumers; i++) {
-                    if (this->consumers[i].capture_device) {
-                        this->consumers[i].capture_device->external_breakpoint();
-                    }
+                if (!this->keyframe_breakpoint_delayed) {
+                    this->external_breakpoint();
                 }
             }
             break;
@@ -1074,6 +1076,11 @@ public:
                     this->stream.p = this->stream.end;
                 }
                 this->remaining_order_count = 0;
+
+                if (this->keyframe_breakpoint_delayed) {
+                    this->keyframe_breakpoint_delayed = false;
+                    this->external_breakpoint();
+                }
             }
             break;
             case RDP_UPDATE_BITMAP:
@@ -1225,6 +1232,31 @@ public:
         }
     }
 
+    REDOC("Restarts reading at the last keyframe before t (the beginning of a file of the recording: "
+          "meta, save state, image and caches chunks). The orders of the skipped files are not read.")
+    void seek_to_keyframe(const timeval & t)
+    {
+        this->trans_source->seek_to_time(t.tv_sec);
+
+        // the META chunk of the file selects the compression again
+        this->trans                   = this->trans_source;
+        this->chunk_type              = 0;
+        this->remaining_order_count   = 0;
+        this->stream.reset();
+        this->timestamp_ok            = false;
+        this->ignore_frame_in_timeval = false;
+        // the consumers did not get the screen before the seek, their breakpoint
+        // (new wrm file...) is made with the image of the keyframe
+        this->keyframe_breakpoint_delayed = true;
+
+        while (this->next_order()) {
+            this->interpret_order();
+            if (this->timestamp_ok) {
+                break;
+            }
+        }
+    }
+
     void play(bool const & requested_to_stop) {
         this->privplay([](time_t){}, requested_to_stop);
     }
@@ -1241,8 +1273,28 @@ public:
     }
 
 private:
+    void external_breakpoint() {
+        for (size_t i = 0; i < this->nbconsumers; i++) {
+            if (this->consumers[i].capture_device) {
+                this->consumers[i].capture_device->external_breakpoint();
+            }
+        }
+    }
+
     template<class CbUpdateProgress>
     void privplay(CbUpdateProgress update_progess, bool const & requested_to_stop) {
+        if (this->begin_capture.tv_sec && this->record_now < this->begin_capture) {
+            try {
+                this->seek_to_keyframe(this->begin_capture);
+            }
+            catch (Error const & e) {
+                // not a recording (single wrm file) or begin after the end of the recording
+                if (e.id != ERR_TRANSPORT_SEEK_NOT_AVAILABLE && e.id != ERR_TRANSPORT_NO_MORE_DATA) {
+                    throw;
+                }
+            }
+        }
+
         while (!requested_to_stop && this->next_order()) {
             if (this->verbose > 8) {
                 LOG( LOG_INFO, "replay TIMESTAMP (first timestamp) = %u order=%u\n"
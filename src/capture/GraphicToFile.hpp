@@ -69,8 +69,7 @@ public:
         if (this->stream.size() > 0) {
             BStream header(8);
             WRMChunk_Send(header, LAST_IMAGE_CHUNK, this->stream.size(), 1);
-            this->trans.send(header);
-            this->trans.send(this->stream);
+            this->trans.send(header, this->stream);
         }
     }
 
@@ -80,10 +79,13 @@ private:
         while (this->stream.size() + to_buffer_len > max) {
             BStream header(8);
             WRMChunk_Send(header, PARTIAL_IMAGE_CHUNK, max, 1);
-            this->trans.send(header);
-            this->trans.send(this->stream);
             size_t to_send = max - this->stream.size();
-            this->trans.send(buffer + len - to_buffer_len, to_send);
+            const iovec iov[] = {
+                { header.get_data(), header.size() },
+                { this->stream.get_data(), this->stream.size() },
+                { const_cast<char *>(buffer + len - to_buffer_len), to_send },
+            };
+            this->trans.send(iov, 3);
             to_buffer_len -= to_send;
             this->stream.reset();
         }
@@ -255,8 +257,7 @@ public:
 
         WRMChunk_Send chunk(header, META_FILE, payload.size(), 1);
 
-        this->trans_target.send(header);
-        this->trans_target.send(payload);
+        this->trans_target.send(header, payload);
     }
 
     // this one is used to store some embedded image inside WRM
@@ -301,8 +302,7 @@ public:
 
         BStream header(8);
         WRMChunk_Send chunk(header, TIMESTAMP, payload.size(), 1);
-        this->trans.send(header);
-        this->trans.send(payload);
+        this->trans.send(header, payload);
 
         this->last_sent_timer = this->timer;
     }
@@ -497,8 +497,7 @@ public:
 
         BStream header(8);
         WRMChunk_Send chunk(header, SAVE_STATE, payload.size(), 1);
-        this->trans.send(header);
-        this->trans.send(payload);
+        this->trans.send(header, payload);
     }
 
     void save_bmp_caches()
@@ -575,8 +574,7 @@ public:
         this->stream_orders.mark_end();
         BStream header(8);
         WRMChunk_Send chunk(header, RDP_UPDATE_ORDERS, this->stream_orders.size(), this->order_count);
-        this->trans.send(header);
-        this->trans.send(this->stream_orders);
+        this->trans.send(header, this->stream_orders);
         this->order_count = 0;
         this->stream_orders.reset();
     }
@@ -721,8 +719,7 @@ public:
         this->stream_bitmaps.mark_end();
         BStream header(8);
         WRMChunk_Send chunk(header, RDP_UPDATE_BITMAP, this->stream_bitmaps.size(), this->bitmap_count);
-        this->trans.send(header);
-        this->trans.send(this->stream_bitmaps);
+        this->trans.send(header, this->stream_bitmaps);
         this->bitmap_count = 0;
         this->stream_bitmaps.reset();
     }
@@ -744,7 +741,6 @@ protected:
                       + 128         // mask
                       ;
         WRMChunk_Send chunk(header, POINTER, size, 0);
-        this->trans.send(header);
 
         BStream payload(16);
         payload.out_uint16_le(this->mouse_x);
@@ -753,10 +749,14 @@ protected:
         payload.out_uint8(cursor.x);
         payload.out_uint8(cursor.y);
         payload.mark_end();
-        this->trans.send(payload);
 
-        this->trans.send(cursor.data, cursor.data_size());
-        this->trans.send(cursor.mask, cursor.mask_size());
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { payload.get_data(), payload.size() },
+            { const_cast<uint8_t *>(cursor.data), cursor.data_size() },
+            { const_cast<uint8_t *>(cursor.mask), cursor.mask_size() },
+        };
+        this->trans.send(iov, 4);
     }
 
     virtual void set_pointer(int cache_idx) {
@@ -766,14 +766,13 @@ protected:
                       + 1                   // cache index
                       ;
         WRMChunk_Send chunk(header, POINTER, size, 0);
-        this->trans.send(header);
 
         BStream payload(16);
         payload.out_uint16_le(this->mouse_x);
         payload.out_uint16_le(this->mouse_y);
         payload.out_uint8(cache_idx);
         payload.mark_end();
-        this->trans.send(payload);
+        this->trans.send(header, payload);
     }
 
 public:
@@ -788,9 +787,12 @@ public:
 
         BStream header(8);
         WRMChunk_Send chunk(header, SESSION_UPDATE, payload.size() + message_length, 1);
-        this->trans.send(header);
-        this->trans.send(payload);
-        this->trans.send(message, message_length);
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { payload.get_data(), payload.size() },
+            { const_cast<char *>(message), message_length },
+        };
+        this->trans.send(iov, 3);
 
         this->last_sent_timer = this->timer;
     }
@@ -34,6 +34,12 @@
 
 #include "wait_obj.hpp"
 
+#include "capture_queue.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
 class Capture : public RDPGraphicDevice, public RDPCaptureDevice {
 public:
     const bool capture_wrm;
@@ -55,6 +61,13 @@ private:
 
     RDPDrawable * drawable;
 
+    // Drawing orders and snapshots are run by this worker thread when ini.video.capture_queue_size is set.
+    CaptureQueue * queue;
+    GlyphCache   * queue_gly_cache;
+
+    // Time to wait given by the last snapshot done by the worker thread (-1: none yet).
+    std::atomic<int64_t> snapshot_wait;
+
 public:
     wait_obj capture_event;
 
@@ -78,6 +91,9 @@ private:
 
     const BGRPalette & mod_palette_rgb = BGRPalette::classic_332_rgb();
 
+    // reused by every bitmap update compressed for the recording
+    BStream compressed_bitmap_stream {65535};
+
 public:
     Capture( const timeval & now, int width, int height, int order_bpp, int capture_bpp, const char * wrm_path
            , const char * png_path, const char * hash_path, const char * basename
@@ -94,6 +110,9 @@ public:
     , pnc_ptr_cache(nullptr)
     , pnc(nullptr)
     , drawable(nullptr)
+    , queue(nullptr)
+    , queue_gly_cache(nullptr)
+    , snapshot_wait(-1)
     , png_path(png_path)
     , basename(basename)
     , gd(nullptr)
@@ -105,7 +124,15 @@ public:
     , capture_bpp(capture_bpp)
     {
         if (this->capture_drawable) {
-            this->drawable = new RDPDrawable(width, height, capture_bpp);
+            this->drawable = new RDPDrawable(width, height, capture_bpp,
+                (ini.video.drawable_color_depth == 32) ? DepthColor::color32 : DepthColor::color24);
+
+            if (ini.video.capture_queue_size) {
+                // transports report to the queue, reports are forwarded by the session thread
+                this->queue = new CaptureQueue(ini.video.capture_queue_size * 1024, authentifier);
+                this->queue_gly_cache = new GlyphCache();
+                authentifier = this->queue;
+            }
         }
 
         if (this->capture_png) {
@@ -134,6 +161,8 @@ public:
             memset(&this->crypto_ctx, 0, sizeof(this->crypto_ctx));
             memcpy(this->crypto_ctx.crypto_key, ini.crypto.key0, sizeof(this->crypto_ctx.crypto_key));
             memcpy(this->crypto_ctx.hmac_key,   ini.crypto.key1, sizeof(this->crypto_ctx.hmac_key  ));
+            this->crypto_ctx.file_version = ini.video.wrm_encryption_version;
+            this->crypto_ctx.block_size   = ini.video.wrm_encryption_block_size * 1024;
 
             TODO("there should only be one outmeta, not two. Capture code should not really care if file is encrypted or not."
                  "Here is not the right level to manage anything related to encryption.")
@@ -173,15 +202,32 @@ public:
     }
 
     virtual ~Capture() {
-        delete this->psc;
-        delete this->png_trans;
-
         if (this->pnc) {
-            timeval now = tvtime();
-            this->pnc->recorder.timestamp(now);
-            this->pnc->recorder.send_timestamp_chunk(false);
-            delete this->pnc;
+            auto end_of_record = [this]() {
+                // a replayed movie (redrec) ends with its last snapshot, not at the current time
+                timeval now = this->pnc->externally_generated_breakpoint ? this->last_now : tvtime();
+                this->pnc->recorder.timestamp(now);
+                this->pnc->recorder.send_timestamp_chunk(false);
+            };
+            if (this->queue) {
+                try {
+                    this->queue->push(0, end_of_record);
+                }
+                catch (Error const & e) {
+                    LOG(LOG_ERR, "Capture: end of record failed (%d)", e.id);
+                }
+            }
+            else {
+                end_of_record();
+            }
         }
+        // waits for the remaining jobs
+        delete this->queue;
+        delete this->queue_gly_cache;
+
+        delete this->psc;
+        delete this->png_trans;
+        delete this->pnc;
         delete this->wrm_trans;
         delete this->pnc_bmp_cache;
         delete this->pnc_gly_cache;
@@ -195,26 +241,35 @@ public:
 
     void request_full_cleaning()
     {
-        this->wrm_trans->request_full_cleaning();
+        this->run(0, [this]() {
+            this->wrm_trans->request_full_cleaning();
+        });
     }
 
     void pause() {
         if (this->capture_png) {
             timeval now = tvtime();
-            this->psc->pause_snapshot(now);
+            this->run(0, [this, now]() {
+                this->psc->pause_snapshot(now);
+            });
         }
     }
 
     void resume() {
         if (this->capture_wrm){
-            this->wrm_trans->next();
-            timeval now = tvtime();
-            this->pnc->recorder.timestamp(now);
-            this->pnc->recorder.send_timestamp_chunk(true);
+            this->run(0, [this]() {
+                this->wrm_trans->next();
+                timeval now = tvtime();
+                this->pnc->recorder.timestamp(now);
+                this->pnc->recorder.send_timestamp_chunk(true);
+            });
         }
     }
 
     void update_config(const Inifile & ini) {
+        if (this->queue) {
+            this->queue->wait();
+        }
         if (this->capture_png) {
             this->psc->update_config(ini);
         }
@@ -226,6 +281,9 @@ public:
     virtual void set_row(size_t rownum, const uint8_t * data)
     {
         if (this->capture_drawable){
+            if (this->queue) {
+                this->queue->wait();
+            }
             this->drawable->set_row(rownum, data);
         }
     }
@@ -234,14 +292,19 @@ public:
                           bool const & requested_to_stop) override {
         this->capture_event.reset();
 
-        if (this->capture_drawable) {
-            this->drawable->set_mouse_cursor_pos(x, y);
-        }
-
         this->last_now = now;
         this->last_x   = x;
         this->last_y   = y;
 
+        if (this->queue) {
+            this->queue_snapshot(now, x, y, ignore_frame_in_timeval, requested_to_stop);
+            return;
+        }
+
+        if (this->capture_drawable) {
+            this->drawable->set_mouse_cursor_pos(x, y);
+        }
+
         if (this->capture_png) {
             this->psc->snapshot(now, x, y, ignore_frame_in_timeval, requested_to_stop);
             this->capture_event.update(this->psc->time_to_wait);
@@ -252,14 +315,160 @@ public:
         }
     }
 
+private:
+    void queue_snapshot(const timeval & now, int x, int y, bool ignore_frame_in_timeval,
+                        bool requested_to_stop) {
+        this->queue->push(0, [this, now, x, y, ignore_frame_in_timeval, requested_to_stop]() {
+            uint64_t time_to_wait = 0;
+            this->drawable->set_mouse_cursor_pos(x, y);
+            if (this->capture_png) {
+                this->psc->snapshot(now, x, y, ignore_frame_in_timeval, requested_to_stop);
+                time_to_wait = this->psc->time_to_wait;
+            }
+            if (this->capture_wrm) {
+                this->pnc->snapshot(now, x, y, ignore_frame_in_timeval, requested_to_stop);
+                if (this->pnc->time_to_wait && (!time_to_wait || this->pnc->time_to_wait < time_to_wait)) {
+                    time_to_wait = this->pnc->time_to_wait;
+                }
+            }
+            this->snapshot_wait = time_to_wait;
+        });
+
+        // the delay given by the previous snapshot, the first one is not done yet
+        const int64_t  time_to_wait = this->snapshot_wait;
+        const uint64_t retry_delay  = 10000; // us
+        this->capture_event.update((time_to_wait < 0) ? retry_delay : time_to_wait);
+    }
+
+    // Runs job in the worker thread if any, size is the memory held by job.
+    template<class Job>
+    void run(size_t size, Job job) {
+        if (this->queue) {
+            this->queue->push(size, std::move(job));
+        }
+        else {
+            job();
+        }
+    }
+
+    // The orders, bitmaps and glyphs of the session may change before the worker thread
+    //  draws them, queued jobs keep a copy.
+    template<class Cmd>
+    void gd_draw(const Cmd & cmd) {
+        if (this->queue) {
+            RDPGraphicDevice * gd = this->gd;
+            this->queue->push(sizeof(Cmd), [gd, cmd]() {
+                gd->draw(cmd);
+            });
+        }
+        else {
+            this->gd->draw(cmd);
+        }
+    }
+
+    template<class Cmd>
+    void gd_draw(const Cmd & cmd, const Rect & clip) {
+        if (this->queue) {
+            RDPGraphicDevice * gd = this->gd;
+            this->queue->push(sizeof(Cmd), [gd, cmd, clip]() {
+                gd->draw(cmd, clip);
+            });
+        }
+        else {
+            this->gd->draw(cmd, clip);
+        }
+    }
+
+    template<class Cmd>
+    void gd_draw(const Cmd & cmd, const Rect & clip, const Bitmap & bmp) {
+        if (this->queue) {
+            RDPGraphicDevice * gd = this->gd;
+            // Bitmap reference counter is not thread safe
+            auto capture_bmp = std::make_shared<Bitmap>(bmp.clone());
+            this->queue->push(sizeof(Cmd) + bmp.bmp_size(), [gd, cmd, clip, capture_bmp]() {
+                gd->draw(cmd, clip, *capture_bmp);
+            });
+        }
+        else {
+            this->gd->draw(cmd, clip, bmp);
+        }
+    }
+
+    void gd_draw(const RDPGlyphIndex & cmd, const Rect & clip, const GlyphCache * gly_cache) {
+        if (this->queue && gly_cache && cmd.cache_id < NUMBER_OF_GLYPH_CACHES) {
+            // copy of the glyphs that cmd may use (every byte of data is considered as a glyph index)
+            auto glyphs = std::make_shared<std::vector<std::pair<uint8_t, FontChar>>>();
+            size_t size = sizeof(cmd);
+            bool used[NUMBER_OF_GLYPH_CACHE_ENTRIES] = {};
+            for (uint8_t i = 0; i < cmd.data_len; ++i) {
+                const uint8_t index = cmd.data[i];
+                if (index < NUMBER_OF_GLYPH_CACHE_ENTRIES && !used[index]) {
+                    used[index] = true;
+                    FontChar const & fc = gly_cache->glyphs[cmd.cache_id][index].font_item;
+                    if (fc) {
+                        glyphs->emplace_back(index, fc.clone());
+                        size += fc.datasize();
+                    }
+                }
+            }
+
+            RDPGraphicDevice * gd = this->gd;
+            GlyphCache * capture_gly_cache = this->queue_gly_cache;
+            this->queue->push(size, [gd, cmd, clip, glyphs, capture_gly_cache]() {
+                for (auto & glyph : *glyphs) {
+                    capture_gly_cache->set_glyph(std::move(glyph.second), cmd.cache_id, glyph.first);
+                }
+                gd->draw(cmd, clip, capture_gly_cache);
+            });
+        }
+        else {
+            this->gd->draw(cmd, clip, gly_cache);
+        }
+    }
+
+    void draw_bitmap_update(const RDPBitmapData & bitmap_data, const uint8_t * data , size_t size, const Bitmap & bmp) {
+        if (this->capture_wrm) {
+            if (bmp.bpp() > this->capture_bpp) {
+                // reducing the color depth of image.
+                Bitmap capture_bmp(this->capture_bpp, bmp);
+
+                ::compress_and_draw_bitmap_update(bitmap_data, capture_bmp, this->capture_bpp, *this->gd
+                                                  , this->compressed_bitmap_stream);
+            }
+            else if (!(bitmap_data.flags & BITMAP_COMPRESSION)) {
+                ::compress_and_draw_bitmap_update(bitmap_data, bmp, this->capture_bpp, *this->gd
+                                                  , this->compressed_bitmap_stream);
+            }
+            else {
+                this->gd->draw(bitmap_data, data, size, bmp);
+            }
+        }
+        else {
+            this->gd->draw(bitmap_data, data, size, bmp);
+        }
+    }
+
+public:
     void flush() {
         if (this->capture_wrm) {
-            this->pnc->flush();
+            this->run(0, [this]() {
+                this->pnc->flush();
+            });
         }
     }
 
     virtual bool input(const timeval & now, Stream & input_data_32) override {
         if (this->capture_wrm) {
+            if (this->queue) {
+                auto data = std::make_shared<std::vector<uint8_t>>(
+                    input_data_32.get_data(), input_data_32.get_data() + input_data_32.size());
+                this->queue->push(data->size(), [this, now, data]() {
+                    StaticStream input_data(data->data(), data->size());
+                    this->pnc->input(now, input_data);
+                });
+                // NativeCapture::input() always accepts the input
+                return true;
+            }
             return this->pnc->input(now, input_data_32);
         }
 
@@ -268,19 +477,19 @@ public:
 
     void draw(const RDPScrBlt & cmd, const Rect & clip) {
         if (this->gd) {
-            this->gd->draw(cmd, clip);
+            this->gd_draw(cmd, clip);
         }
     }
 
     void draw(const RDPDestBlt & cmd, const Rect &clip) {
         if (this->gd) {
-            this->gd->draw(cmd, clip);
+            this->gd_draw(cmd, clip);
         }
     }
 
     void draw(const RDPMultiDstBlt & cmd, const Rect & clip) {
         if (this->gd) {
-            this->gd->draw(cmd, clip);
+            this->gd_draw(cmd, clip);
         }
     }
 
@@ -294,10 +503,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -316,17 +525,17 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
 
     void draw(const RDP::RDPMultiScrBlt & cmd, const Rect & clip) {
         if (this->gd) {
-            this->gd->draw(cmd, clip);
+            this->gd_draw(cmd, clip);
         }
     }
 
@@ -344,17 +553,17 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
 
     void draw(const RDPMemBlt & cmd, const Rect & clip, const Bitmap & bmp) {
         if (this->gd) {
-            this->gd->draw(cmd, clip, bmp);
+            this->gd_draw(cmd, clip, bmp);
         }
     }
 
@@ -372,10 +581,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip, bmp);
+                this->gd_draw(capture_cmd, clip, bmp);
             }
             else {
-                this->gd->draw(cmd, clip, bmp);
+                this->gd_draw(cmd, clip, bmp);
             }
         }
     }
@@ -390,10 +599,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -412,23 +621,34 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
 
     void draw(const RDPBrushCache & cmd) {
         if (this->gd) {
-            this->gd->draw(cmd);
+            if (this->queue) {
+                RDPGraphicDevice * gd = this->gd;
+                // RDPBrushCache cannot be copied
+                std::shared_ptr<RDPBrushCache> capture_cmd(new RDPBrushCache(
+                    cmd.cacheIndex, cmd.bpp, cmd.width, cmd.height, cmd.type, cmd.size, cmd.data));
+                this->queue->push(sizeof(cmd) + cmd.size, [gd, capture_cmd]() {
+                    gd->draw(*capture_cmd);
+                });
+            }
+            else {
+                this->gd->draw(cmd);
+            }
         }
     }
 
     void draw(const RDPColCache & cmd) {
         if (this->gd) {
-            this->gd->draw(cmd);
+            this->gd_draw(cmd);
         }
     }
 
@@ -446,45 +666,45 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip, gly_cache);
+                this->gd_draw(capture_cmd, clip, gly_cache);
             }
             else {
-                this->gd->draw(cmd, clip, gly_cache);
+                this->gd_draw(cmd, clip, gly_cache);
             }
         }
     }
 
     void draw(const RDPBitmapData & bitmap_data, const uint8_t * data , size_t size, const Bitmap & bmp) {
         if (this->gd) {
-            if (this->capture_wrm) {
-                if (bmp.bpp() > this->capture_bpp) {
-                    // reducing the color depth of image.
-                    Bitmap capture_bmp(this->capture_bpp, bmp);
-
-                    ::compress_and_draw_bitmap_update(bitmap_data, capture_bmp, this->capture_bpp, *this->gd);
-                }
-                else if (!(bitmap_data.flags & BITMAP_COMPRESSION)) {
-                    ::compress_and_draw_bitmap_update(bitmap_data, bmp, this->capture_bpp, *this->gd);
-                }
-                else {
-                    this->gd->draw(bitmap_data, data, size, bmp);
-                }
+            if (this->queue) {
+                auto capture_data = std::make_shared<std::vector<uint8_t>>(data, data + size);
+                auto capture_bmp  = std::make_shared<Bitmap>(bmp.clone());
+                this->queue->push( sizeof(bitmap_data) + size + bmp.bmp_size()
+                                 , [this, bitmap_data, capture_data, capture_bmp]() {
+                    this->draw_bitmap_update( bitmap_data, capture_data->data(), capture_data->size()
+                                            , *capture_bmp);
+                });
             }
             else {
-                this->gd->draw(bitmap_data, data, size, bmp);
+                this->draw_bitmap_update(bitmap_data, data, size, bmp);
             }
         }
     }
 
     virtual void draw(const RDP::FrameMarker & order) {
         if (this->gd) {
-            this->gd->draw(order);
+            this->gd_draw(order);
         }
 
         if (order.action == RDP::FrameMarker::FrameEnd) {
             if (this->capture_png) {
-                bool requested_to_stop = false;
-                this->psc->snapshot(this->last_now, this->last_x, this->last_y, false, requested_to_stop);
+                const timeval now = this->last_now;
+                const int     x   = this->last_x;
+                const int     y   = this->last_y;
+                this->run(0, [this, now, x, y]() {
+                    bool requested_to_stop = false;
+                    this->psc->snapshot(now, x, y, false, requested_to_stop);
+                });
             }
         }
     }
@@ -499,10 +719,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -521,10 +741,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -539,10 +759,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -557,10 +777,10 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
@@ -579,73 +799,87 @@ public:
                     , this->capture_bpp
                     );
 
-                this->gd->draw(capture_cmd, clip);
+                this->gd_draw(capture_cmd, clip);
             }
             else {
-                this->gd->draw(cmd, clip);
+                this->gd_draw(cmd, clip);
             }
         }
     }
 
     virtual void draw(const RDP::RAIL::NewOrExistingWindow & order) {
         if (this->gd) {
-            this->gd->draw(order);
+            this->gd_draw(order);
         }
     }
 
     virtual void draw(const RDP::RAIL::WindowIcon & order) {
         if (this->gd) {
-            this->gd->draw(order);
+            this->gd_draw(order);
         }
     }
 
     virtual void draw(const RDP::RAIL::CachedIcon & order) {
         if (this->gd) {
-            this->gd->draw(order);
+            this->gd_draw(order);
         }
     }
 
     virtual void draw(const RDP::RAIL::DeletedWindow & order) {
         if (this->gd) {
-            this->gd->draw(order);
+            this->gd_draw(order);
         }
     }
 
     virtual void server_set_pointer(const Pointer & cursor)
     {
         if (this->gd) {
-            this->gd->server_set_pointer(cursor);
+            RDPGraphicDevice * gd = this->gd;
+            this->run(sizeof(cursor), [gd, cursor]() {
+                gd->server_set_pointer(cursor);
+            });
         }
     }
 
     virtual void set_mod_palette(const BGRPalette & palette) {
         if (this->capture_drawable) {
-            this->drawable->set_mod_palette(palette);
+            this->run(sizeof(palette), [this, palette]() {
+                this->drawable->set_mod_palette(palette);
+            });
         }
     }
 
     virtual void set_pointer_display() {
         if (this->capture_drawable) {
-            this->drawable->show_mouse_cursor(false);
+            this->run(0, [this]() {
+                this->drawable->show_mouse_cursor(false);
+            });
         }
     }
 
     // toggles externally genareted breakpoint.
     virtual void external_breakpoint() {
         if (this->capture_wrm) {
-            this->pnc->external_breakpoint();
+            this->run(0, [this]() {
+                this->pnc->external_breakpoint();
+            });
         }
     }
 
     virtual void external_time(const timeval & now) {
         if (this->capture_wrm) {
-            this->pnc->external_time(now);
+            this->run(0, [this, now]() {
+                this->pnc->external_time(now);
+            });
         }
     }
 
     virtual void session_update(const timeval & now, const char * message) override {
         if (this->capture_wrm) {
-            this->pnc->session_update(now, message);
+            const std::string capture_message = message;
+            this->run(capture_message.size(), [this, now, capture_message]() {
+                this->pnc->session_update(now, capture_message.c_str());
+            });
         }
     }
 };
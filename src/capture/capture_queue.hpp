@@ -0,0 +1,208 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Bounded job queue running the capture (drawable rendering, WRM
+   serialization, PNG snapshots, file output) on a worker thread.
+*/
+
+#ifndef _REDEMPTION_CAPTURE_CAPTURE_QUEUE_HPP_
+#define _REDEMPTION_CAPTURE_CAPTURE_QUEUE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "auth_api.hpp"
+#include "noncopyable.hpp"
+
+// Jobs are run in order by one worker thread. push() blocks while the jobs
+// waiting (or running) hold more than max_size bytes, so a slow disk slows
+// the session down instead of making the queue grow without limit.
+//
+// An Error thrown by a job stops the capture: the remaining jobs are dropped
+// and the error is thrown again on the session thread by the next push() or
+// wait(). The queue is the authentifier of the capture transports, their
+// reports (FILESYSTEM_FULL...) are forwarded to the session authentifier by
+// push() and wait() as well.
+class CaptureQueue : public auth_api, noncopyable
+{
+    typedef std::pair<size_t, std::function<void()>> Job;
+
+    auth_api   * authentifier;
+    const size_t max_size;
+
+    std::mutex              mutex;
+    std::condition_variable job_pushed;
+    std::condition_variable job_done;
+
+    std::deque<Job> jobs;
+    size_t          count        = 0;   // jobs not done yet
+    size_t          size         = 0;   // memory held by these jobs
+    bool            stop         = false;
+    int             error_id     = NO_ERROR;
+    int             error_errnum = 0;
+
+    std::vector<std::pair<std::string, std::string>> reports;
+
+    std::thread worker;
+
+public:
+    CaptureQueue(size_t max_size, auth_api * authentifier)
+    : authentifier(authentifier)
+    , max_size(max_size)
+    , worker(&CaptureQueue::run, this)
+    {}
+
+    virtual ~CaptureQueue() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stop = true;
+        }
+        this->job_pushed.notify_one();
+        this->worker.join();
+
+        try {
+            this->forward_reports();
+        }
+        catch (...) {
+        }
+        if (this->error_id != NO_ERROR) {
+            LOG(LOG_ERR, "CaptureQueue: capture stopped by error %d", this->error_id);
+        }
+    }
+
+    // size: memory held by the job (order, bitmap...), accounted until the job is done.
+    void push(size_t size, std::function<void()> job) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->job_done.wait(lock, [this, size]() {
+                return this->error_id != NO_ERROR
+                    || this->size == 0
+                    || this->size + size <= this->max_size;
+            });
+            if (this->error_id == NO_ERROR) {
+                this->jobs.emplace_back(size, std::move(job));
+                this->count++;
+                this->size += size;
+            }
+        }
+        this->job_pushed.notify_one();
+        this->check();
+    }
+
+    // Waits until all the pushed jobs are done.
+    void wait() {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->job_done.wait(lock, [this]() {
+                return this->error_id != NO_ERROR || this->count == 0;
+            });
+        }
+        this->check();
+    }
+
+    virtual void set_auth_channel_target(const char * target) override {
+        // Never called by transports, session thread only.
+        if (this->authentifier) {
+            this->authentifier->set_auth_channel_target(target);
+        }
+    }
+
+    virtual void report(const char * reason, const char * message) override {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->reports.emplace_back(reason, message);
+    }
+
+private:
+    void check() {
+        this->forward_reports();
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->error_id != NO_ERROR) {
+            throw Error(this->error_id, this->error_errnum);
+        }
+    }
+
+    void forward_reports() {
+        std::vector<std::pair<std::string, std::string>> reports;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            reports.swap(this->reports);
+        }
+        if (this->authentifier) {
+            for (auto & r : reports) {
+                this->authentifier->report(r.first.c_str(), r.second.c_str());
+            }
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (;;) {
+            this->job_pushed.wait(lock, [this]() { return this->stop || !this->jobs.empty(); });
+            if (this->jobs.empty()) {
+                break;
+            }
+
+            Job job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+
+            if (this->error_id == NO_ERROR) {
+                lock.unlock();
+                int id     = NO_ERROR;
+                int errnum = 0;
+                try {
+                    job.second();
+                }
+                catch (Error const & e) {
+                    id     = e.id;
+                    errnum = e.errnum;
+                }
+                catch (std::bad_alloc const &) {
+                    id = ERR_RECORDER_ALLOCATION_FAILED;
+                }
+                catch (...) {
+                    id = ERR_RECORDER_JOB_FAILED;
+                }
+                // release the data of the job outside of the lock
+                job.second = nullptr;
+                lock.lock();
+                if (id != NO_ERROR) {
+                    LOG(LOG_ERR, "CaptureQueue: capture job failed with error %d", id);
+                    this->error_id     = id;
+                    this->error_errnum = errnum;
+                }
+            }
+
+            this->count--;
+            this->size -= job.first;
+            this->job_done.notify_all();
+        }
+    }
+};
+
+#endif
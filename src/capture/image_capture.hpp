@@ -38,6 +38,7 @@ public:
     unsigned scaled_width;
     unsigned scaled_height;
     const Drawable & drawable;
+    PngEncoding png_encoding;
 
     ImageCapture(Transport & trans, unsigned width, unsigned height, const Drawable & drawable)
     : trans(trans)
@@ -70,7 +71,7 @@ public:
         ::transport_dump_png24(this->trans, this->drawable.data(),
             this->drawable.width(), this->drawable.height(),
             this->drawable.rowsize(),
-            true);
+            true, this->png_encoding, this->drawable.nbbytes_color());
     }
 
     void scale_dump24() const {
@@ -78,22 +79,22 @@ public:
         scale_data(scaled_data.get(), this->drawable.data(),
                    this->scaled_width, this->drawable.width(),
                    this->scaled_height, this->drawable.height(),
-                   this->drawable.rowsize());
+                   this->drawable.rowsize(), this->drawable.nbbytes_color());
         ::transport_dump_png24(this->trans, scaled_data.get(),
                      this->scaled_width, this->scaled_height,
-                     this->scaled_width * 3, false);
+                     this->scaled_width * 3, false, this->png_encoding);
     }
 
     static void scale_data(uint8_t *dest, const uint8_t *src,
                            unsigned int dest_width, unsigned int src_width,
                            unsigned int dest_height, unsigned int src_height,
-                           unsigned int src_rowsize) {
+                           unsigned int src_rowsize, unsigned int src_Bpp = 3) {
         const uint32_t Bpp = 3;
         unsigned int y_pixels = dest_height;
         unsigned int y_int_part = src_height / dest_height * src_rowsize;
         unsigned int y_fract_part = src_height % dest_height;
         unsigned int yE = 0;
-        unsigned int x_int_part = src_width / dest_width * Bpp;
+        unsigned int x_int_part = src_width / dest_width * src_Bpp;
         unsigned int x_fract_part = src_width % dest_width;
 
         while (y_pixels-- > 0) {
@@ -110,7 +111,7 @@ public:
                 xE += x_fract_part;
                 if (xE >= dest_width) {
                     xE -= dest_width;
-                    x_src += Bpp;
+                    x_src += src_Bpp;
                 }
             }
             src += y_int_part;
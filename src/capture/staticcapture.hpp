@@ -105,6 +105,17 @@ public:
         if (displayed && (this->rt_display == 0)) {
             this->unlink_filegen(0);
         }
+        if (!displayed && this->rt_display) {
+            // images were removed (or never written), the next snapshot is written even if
+            // the screen did not change
+            this->invalidate_png();
+        }
+
+        static const int filters[] = {
+            PNG_ALL_FILTERS, PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH
+        };
+        this->png_encoding.compression_level = std::min<unsigned>(ini.video.png_compression_level, 9);
+        this->png_encoding.filters = filters[std::min<unsigned>(ini.video.png_filter, 5)];
     }
 
     virtual void snapshot(const timeval & now, int x, int y, bool ignore_frame_in_timeval,
@@ -119,10 +130,14 @@ public:
             if (   this->drawable.logical_frame_ended
                 // Force snapshot if diff_time_val >= 1,5 x inter_frame_interval_static_capture.
                 || (diff_time_val >= static_cast<unsigned>(this->inter_frame_interval_static_capture) * 3 / 2)) {
-                const_cast<Drawable&>(this->drawable).trace_mouse();
-                this->breakpoint(now);
+                // Nothing was drawn and the mouse did not move since the last image: it is
+                // kept instead of encoding the same screen again.
+                if (!this->drawable.dirty_area.isempty()) {
+                    const_cast<Drawable&>(this->drawable).trace_mouse();
+                    this->breakpoint(now);
+                    const_cast<Drawable&>(this->drawable).clear_mouse();
+                }
                 this->start_static_capture = addusectimeval(this->inter_frame_interval_static_capture, this->start_static_capture);
-                const_cast<Drawable&>(this->drawable).clear_mouse();
             }
             else {
                 if (this->first_picture_capture_delayed) {
@@ -159,6 +174,8 @@ public:
         this->flush_png();
         const_cast<Drawable&>(this->drawable).clear_pausetimestamp();
         this->start_static_capture = now;
+        // the pause message is not on screen, the next snapshot replaces this image
+        this->invalidate_png();
     }
 
     void breakpoint(const timeval & now)
@@ -171,6 +188,14 @@ public:
         const_cast<Drawable&>(this->drawable).trace_timestamp(ptm);
         this->flush_png();
         const_cast<Drawable&>(this->drawable).clear_timestamp();
+        const_cast<Drawable&>(this->drawable).reset_dirty_area();
+    }
+
+private:
+    void invalidate_png()
+    {
+        Drawable & drawable = const_cast<Drawable&>(this->drawable);
+        drawable.dirty_area = Rect(0, 0, drawable.width(), drawable.height());
     }
 };
 
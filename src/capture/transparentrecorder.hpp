@@ -42,24 +42,30 @@ public:
 
         this->make_chunk_header(header, CHUNK_TYPE_SLOWPATH, payload.size() + stream.size());
 
-        this->t->send(header);
-        this->t->send(payload);
-        this->t->send(stream);
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { payload.get_data(), payload.size() },
+            { stream.get_data(), stream.size() },
+        };
+        this->t->send(iov, 3);
     }
 
     void send_fastpath_data(InStream & data) {
         BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
         this->make_chunk_header(header, CHUNK_TYPE_FASTPATH, data.size());
 
-        this->t->send(header);
-        this->t->send(data);
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { data.get_data(), data.size() },
+        };
+        this->t->send(iov, 2);
     }
 
     void send_to_front_channel( const char * const mod_channel_name
                               , uint8_t * data, size_t length
                               , size_t chunk_size, int flags) {
         BStream header(TRANSPARENT_CHUNT_HEADER_SIZE);
-        BStream payload(65535);
+        BStream payload(16);
 
         uint8_t mod_channel_name_length = strlen(mod_channel_name);
         payload.out_uint8(mod_channel_name_length);
@@ -70,10 +76,13 @@ public:
 
         this->make_chunk_header(header, CHUNK_TYPE_FRONTCHANNEL, payload.size() + mod_channel_name_length + length);
 
-        this->t->send(header);
-        this->t->send(payload);
-        this->t->send(reinterpret_cast<const uint8_t *>(mod_channel_name), mod_channel_name_length);
-        this->t->send(reinterpret_cast<const uint8_t *>(data), length);
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { payload.get_data(), payload.size() },
+            { const_cast<char *>(mod_channel_name), mod_channel_name_length },
+            { data, length },
+        };
+        this->t->send(iov, 4);
     }
 
     void server_resize(uint16_t width, uint16_t height, uint8_t bpp) {
@@ -87,8 +96,7 @@ public:
 
         this->make_chunk_header(header, CHUNK_TYPE_RESIZE, payload.size());
 
-        this->t->send(header);
-        this->t->send(payload);
+        this->t->send(header, payload);
     }
 
 private:
@@ -111,8 +119,7 @@ private:
 
         this->make_chunk_header(header, CHUNK_TYPE_META, payload.size());
 
-        this->t->send(header);
-        this->t->send(payload);
+        this->t->send(header, payload);
     }
 };
 
@@ -23,6 +23,7 @@
 #define _REDEMPTION_CORE_RDP_RDPDRAWABLE_HPP_
 
 #include <utility>
+#include <vector>
 
 #include "font.hpp"
 
@@ -72,11 +73,21 @@ class RDPDrawable : public RDPGraphicDevice, public RDPCaptureDevice
     int order_bpp;
     BGRPalette mod_palette_rgb;
 
-    uint8_t fragment_cache[MAXIMUM_NUMBER_OF_FRAGMENT_CACHE_ENTRIES][1 /* size */ + MAXIMUM_SIZE_OF_FRAGMENT_CACHE_ENTRIE];
+    // glyphs of a GlyphIndex fragment, already parsed
+    struct GlyphLayoutItem {
+        uint8_t  cache_index;
+        uint16_t delta;
+    };
+
+    std::vector<GlyphLayoutItem> fragment_layouts[MAXIMUM_NUMBER_OF_FRAGMENT_CACHE_ENTRIES];
+
+    // glyphs since the beginning of the order or the last fragment operation
+    std::vector<GlyphLayoutItem> current_fragment_layout;
 
 public:
-    RDPDrawable(const uint16_t width, const uint16_t height, int order_bpp)
-    : drawable(width, height)
+    RDPDrawable(const uint16_t width, const uint16_t height, int order_bpp,
+                DepthColor drawable_depth = DepthColor::color24)
+    : drawable(width, height, drawable_depth)
     , frame_start_count(0)
     , order_bpp(order_bpp)
     , mod_palette_rgb(BGRPalette::classic_332())
@@ -416,55 +427,54 @@ private:
     }
 
 private:
-    void draw_glyph( FontChar const & fc, size_t draw_pos, int16_t offset_y, Color color
-                   , int16_t bmp_pos_x, int16_t bmp_pos_y, Rect const & clip)
+    void draw_glyph( FontChar const & fc, std::vector<GlyphSpan> const & spans, size_t draw_pos
+                   , int16_t offset_y, Color color, int16_t bmp_pos_x, int16_t bmp_pos_y, Rect const & clip)
     {
-        const int16_t   local_offset_x     = draw_pos + fc.offset;
-        const int16_t   local_offset_y     = offset_y + fc.baseline;
+        const int pos_x = bmp_pos_x + int16_t(draw_pos + fc.offset);
+        const int pos_y = bmp_pos_y + int16_t(offset_y + fc.baseline);
 
-              uint8_t   fc_bit_mask        = 128;
-        const uint8_t * fc_data            = fc.data.get();
-        const bool      skip_padding_pixel = (fc.width % 8);
+        if (pos_x >= clip.right() || pos_x + fc.width <= clip.x
+         || pos_y >= clip.bottom() || pos_y + fc.height <= clip.y) {
+            return;
+        }
 
-        for (int y = 0; y < fc.height; y++)
-        {
-            const int pt_y = bmp_pos_y + local_offset_y + y;
-//            if (!(clip.y <= pt_y && pt_y < clip.bottom())) {
-//                break;
-//            }
+        for (GlyphSpan const & span : spans) {
+            const int y = pos_y + span.y;
+            if (y < clip.y || y >= clip.bottom()) {
+                continue;
+            }
+            const int x     = std::max<int>(pos_x + span.x, clip.x);
+            const int right = std::min<int>(pos_x + span.x + span.cx, clip.right());
+            if (x < right) {
+                this->drawable.opaquerect(Rect(x, y, right - x, 1), color);
+            }
+        }
+    }
 
-            for (int x = 0; x < fc.width; x++)
-            {
-                if (fc_bit_mask & (*fc_data))
-                {
-                    const int pt_x = bmp_pos_x + local_offset_x + x;
-                    if (clip.x <= pt_x && pt_x < clip.right() &&
-                        clip.y <= pt_y && pt_y < clip.bottom()) {
-                        this->drawable.draw_pixel(pt_x, pt_y, color);
-                    }
-                    //printf("X");
-                }
-                //else
-                //{
-                //    printf(".");
-                //}
+    void draw_glyph_layout_item( GlyphLayoutItem const & item, bool has_delta_bytes
+                               , uint16_t & draw_pos_ref, int16_t offset_y, Color color
+                               , int16_t bmp_pos_x, int16_t bmp_pos_y, Rect const & clip
+                               , uint8_t cache_id, const GlyphCache * gly_cache)
+    {
+        FontChar const & fc = gly_cache->glyphs[cache_id][item.cache_index].font_item;
+        if (!fc)
+        {
+            LOG( LOG_INFO
+               , "RDPDrawable::draw_VariableBytes: Unknown glyph, cacheId=%u cacheIndex=%u"
+               , cache_id, item.cache_index);
+            REDASSERT(fc);
+        }
 
-                fc_bit_mask >>= 1;
-                if (!fc_bit_mask)
-                {
-                    fc_data++;
-                    fc_bit_mask = 128;
-                }
-            }
+        if (has_delta_bytes)
+        {
+            draw_pos_ref += item.delta;
+        }
 
-            if (skip_padding_pixel) {
-                fc_data++;
-                fc_bit_mask = 128;
-                //printf("_");
-            }
-            //printf("\n");
+        if (fc)
+        {
+            this->draw_glyph( fc, gly_cache->glyphs[cache_id][item.cache_index].spans, draw_pos_ref
+                            , offset_y, color, bmp_pos_x, bmp_pos_y, clip);
         }
-        //printf("\n");
     }
 
 public:
@@ -475,39 +485,31 @@ public:
         StaticStream variable_bytes(data, size);
 
         uint8_t * fragment_begin_position = variable_bytes.p;
+        this->current_fragment_layout.clear();
 
         while (variable_bytes.in_remain())
         {
             uint8_t data = variable_bytes.in_uint8();
             if (data <= 0xFD)
             {
-                FontChar const & fc = gly_cache->glyphs[cache_id][data].font_item;
-                if (!fc)
-                {
-                    LOG( LOG_INFO
-                       , "RDPDrawable::draw_VariableBytes: Unknown glyph, cacheId=%u cacheIndex=%u"
-                       , cache_id, data);
-                    REDASSERT(fc);
-                }
+                GlyphLayoutItem item = { data, 0 };
 
                 if (has_delta_bytes)
                 {
                     data = variable_bytes.in_uint8();
                     if (data == 0x80)
                     {
-                        draw_pos_ref += variable_bytes.in_uint16_le();
+                        item.delta = variable_bytes.in_uint16_le();
                     }
                     else
                     {
-                        draw_pos_ref += data;
+                        item.delta = data;
                     }
                 }
 
-                if (fc)
-                {
-                    this->draw_glyph( fc, draw_pos_ref, offset_y, color, bmp_pos_x, bmp_pos_y
-                                    , clip);
-                }
+                this->current_fragment_layout.push_back(item);
+                this->draw_glyph_layout_item( item, has_delta_bytes, draw_pos_ref, offset_y, color
+                                            , bmp_pos_x, bmp_pos_y, clip, cache_id, gly_cache);
             }
             else if (data == 0xFE)
             {
@@ -528,15 +530,16 @@ public:
                     "RDPDrawable::draw_VariableBytes: "
                         "Experimental support of USE (0xFE) operation byte in "
                         "GlyphIndex Primary Drawing Order. "
-                        "fragment_index=%u fragment_size=%u delta=%u",
-                    fragment_index, this->fragment_cache[fragment_index][0], delta);
+                        "fragment_index=%u fragment_glyph_count=%zu delta=%u",
+                    fragment_index, this->fragment_layouts[fragment_index].size(), delta);
 
                 fragment_begin_position = variable_bytes.p;
+                this->current_fragment_layout.clear();
 
-                this->draw_VariableBytes(&this->fragment_cache[fragment_index][1],
-                    this->fragment_cache[fragment_index][0], has_delta_bytes,
-                    draw_pos_ref, offset_y, color, bmp_pos_x, bmp_pos_y, clip,
-                    cache_id, gly_cache);
+                for (GlyphLayoutItem const & item : this->fragment_layouts[fragment_index]) {
+                    this->draw_glyph_layout_item( item, has_delta_bytes, draw_pos_ref, offset_y, color
+                                                , bmp_pos_x, bmp_pos_y, clip, cache_id, gly_cache);
+                }
             }
             else if (data == 0xFF)
             {
@@ -554,11 +557,8 @@ public:
 
                 REDASSERT(fragment_begin_position + fragment_size + 3 == variable_bytes.p);
 
-                this->fragment_cache[fragment_index][0] = fragment_size;
-                ::memcpy(&this->fragment_cache[fragment_index][1],
-                         fragment_begin_position,
-                         fragment_size
-                        );
+                this->fragment_layouts[fragment_index] = this->current_fragment_layout;
+                this->current_fragment_layout.clear();
 
                 fragment_begin_position = variable_bytes.p;
             }
@@ -864,7 +864,7 @@ public:
         ::transport_dump_png24(trans, this->drawable.data(),
             this->drawable.width(), this->drawable.height(),
             this->drawable.rowsize(),
-            bgr);
+            bgr, PngEncoding(), this->drawable.nbbytes_color());
     }
 };
 
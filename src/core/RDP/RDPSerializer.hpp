@@ -720,6 +720,11 @@ public:
 
     virtual void draw( const RDPBitmapData & bitmap_data, const uint8_t * data
                      , size_t size, const Bitmap & bmp) {
+        this->draw_bitmap_data(bitmap_data, data, size);
+    }
+
+    // Emit an already encoded bitmap update, the decoded pixels are not needed.
+    void draw_bitmap_data(const RDPBitmapData & bitmap_data, const uint8_t * data, size_t size) {
         this->reserve_bitmap(bitmap_data.struct_size() + size);
 
         bitmap_data.emit(this->stream_bitmaps);
@@ -21,7 +21,6 @@
 #ifndef _REDEMPTION_CORE_RDP_CACHES_BMPCACHE_HPP_
 #define _REDEMPTION_CORE_RDP_CACHES_BMPCACHE_HPP_
 
-#include <set>
 #include <memory>
 #include <algorithm>
 
@@ -44,55 +43,53 @@ private:
     static const uint16_t MAXIMUM_NUMBER_OF_CACHE_ENTRIES = 8192;
 
     // For Persistent Disk Bitmap Cache's Wait List.
+    // The bitmap is not kept, a fingerprint collision only puts a bitmap in the
+    // persistent cache the first time it is seen.
     struct cache_lite_element {
-        uint_fast32_t stamp;
-        uint8_t sha1[20];
+        Fingerprint fingerprint;
         bool is_valid;
 
         cache_lite_element()
-        : stamp(0)
-        , sha1()
+        : fingerprint()
         , is_valid(false) {}
 
-        cache_lite_element(const uint8_t (& sha1_)[20])
-        : stamp(0)
-        , is_valid(true) {
-            memcpy(this->sha1, sha1_, sizeof(this->sha1));
-        }
+        cache_lite_element(const Fingerprint & fingerprint)
+        : fingerprint(fingerprint)
+        , is_valid(true) {}
 
         cache_lite_element(cache_lite_element const &) = delete;
         cache_lite_element&operator=(cache_lite_element const &) = delete;
 
         void reset() {
-            this->stamp = 0;
             this->is_valid = false;
         }
 
         operator bool() const {
             return this->is_valid;
         }
+
+        bool same_as(const cache_lite_element & other) const {
+            return this->fingerprint == other.fingerprint;
+        }
     };
 
     // For all other Bitmap Caches.
     struct cache_element
     {
         Bitmap bmp;
-        uint_fast32_t stamp;
         union {
             uint8_t  sig_8[8];
             uint32_t sig_32[2];
-        } sig;
-        uint8_t sha1[20];
+        } sig;                      // SHA-1 of the bitmap, persistent caches only
+        Fingerprint fingerprint;
         bool cached;
 
         cache_element()
-        : stamp(0)
-        , cached(false)
+        : cached(false)
         {}
 
         cache_element(Bitmap const & bmp)
         : bmp(bmp)
-        , stamp(0)
         , cached(false)
         {}
 
@@ -100,7 +97,6 @@ private:
         cache_element&operator=(cache_element const &) = delete;
 
         void reset() {
-            this->stamp = 0;
             this->bmp.reset();
             this->cached = false;
         }
@@ -108,133 +104,107 @@ private:
         operator bool() const {
             return this->bmp.is_valid();
         }
-    };
-
-    class storage_value_set {
-        size_t elem_size;
-        std::unique_ptr<uint8_t[]> data;
-        std::unique_ptr<void*[]> free_list;
-        void* * free_list_cur;
-
-        storage_value_set(storage_value_set const &);
-        storage_value_set& operator=(storage_value_set const &);
-
-    public:
-        storage_value_set()
-        : elem_size(0)
-        , free_list_cur(nullptr)
-        {}
 
-        template<class T>
-        void update() {
-            this->elem_size = std::max(
-                this->elem_size, sizeof(typename std::aligned_storage<sizeof(T), alignof(T)>::type)
-            );
-        }
-
-        void reserve(size_t sz) {
-            REDASSERT(!this->data.get());
-            this->data.reset(new uint8_t[sz * this->elem_size]);
-            this->free_list.reset(new void*[sz]);
-            this->free_list_cur = this->free_list.get();
-
-            uint8_t * p = this->data.get();
-            uint8_t * pe = p + sz * this->elem_size;
-            for (; p != pe; p += this->elem_size, ++this->free_list_cur) {
-                *this->free_list_cur = p;
+        // the fingerprint is checked with the pixels
+        bool same_as(const cache_element & other) const {
+            if (this->fingerprint != other.fingerprint) {
+                return false;
             }
-        }
-
-        void * pop() {
-            REDASSERT(this->free_list_cur != this->free_list.get());
-            return *--this->free_list_cur;
-        }
-
-        void push(void * p) {
-            *this->free_list_cur = p;
-            ++this->free_list_cur;
+            const Bitmap & a = this->bmp;
+            const Bitmap & b = other.bmp;
+            if (a.data() == b.data()) {
+                return true;
+            }
+            return a.bpp() == b.bpp() && a.cx() == b.cx() && a.cy() == b.cy()
+                && (a.bpp() != 8 || !memcmp(&a.palette(), &b.palette(), sizeof(BGRPalette)))
+                && !memcmp(a.data(), b.data(), a.bmp_size());
         }
     };
 
-    template<class T>
-    class aligned_set_allocator
-    : public std::allocator<T>
-    {
-    public:
-        storage_value_set & storage;
-
-        typedef typename std::allocator<T>::pointer pointer;
-        typedef typename std::allocator<T>::size_type size_type;
+    // Elements of a cache are indexed by fingerprint in an open addressing hash table
+    // (linear probing, backward shift deletion) and chained in least recently
+    // used order. Free elements stay at the head of the chain sorted by index,
+    // so lookup, insertion and eviction are constant time.
+    template <typename T>
+    class cache_range {
+        T * first;
+        T * last;
 
-        template<class U>
-        struct rebind {
-            typedef aligned_set_allocator<U> other;
+        struct lru_link {
+            uint16_t prev;
+            uint16_t next;
         };
 
-        aligned_set_allocator(storage_value_set & storage)
-        : storage(storage)
-        {
-            this->storage.template update<T>();
-        }
-
-        aligned_set_allocator(aligned_set_allocator const & other)
-        : std::allocator<T>(other)
-        , storage(other.storage)
-        {}
+        // size() + 1 links, the last one is the head of the chain
+        std::unique_ptr<lru_link[]> links;
+        // element index + 1, 0 for an empty slot
+        std::unique_ptr<uint16_t[]> slots;
+        size_t slots_mask;
 
-        template<class U>
-        aligned_set_allocator(aligned_set_allocator<U> const & other)
-        : std::allocator<T>(other)
-        , storage(other.storage)
-        {
-            this->storage.template update<T>();
+        uint16_t head() const {
+            return this->size();
         }
 
-        T * allocate(size_type /*n*/, std::allocator<void>::const_pointer /*hint*/ = 0)
-        {
-            return static_cast<T*>(this->storage.pop());
+        static size_t hash(const Fingerprint & fingerprint) {
+            const uint64_t h = fingerprint.h[0];
+            return h ^ (h >> 32);
         }
 
-        void deallocate(pointer p, size_type /*n*/)
-        {
-            this->storage.push(p);
+        void unlink(uint16_t i) {
+            lru_link & link = this->links[i];
+            this->links[link.prev].next = link.next;
+            this->links[link.next].prev = link.prev;
         }
-    };
-
-    template <typename T>
-    struct value_set
-    {
-        T const & elem;
-
-        value_set(T const & elem)
-        : elem(elem)
-        {}
 
-        bool operator<(value_set const & other) const {
-            typedef std::pair<const uint8_t *, const uint8_t *> iterator_pair;
-            const uint8_t * e = this->elem.sha1 + sizeof(this->elem.sha1);
-            iterator_pair p = std::mismatch(this->elem.sha1 + 0, e, other.elem.sha1 + 0);
-            return p.first == e ? false : *p.first < *p.second;
+        void link_before(uint16_t i, uint16_t pos) {
+            lru_link & link = this->links[i];
+            link.next = pos;
+            link.prev = this->links[pos].prev;
+            this->links[link.prev].next = i;
+            this->links[pos].prev = i;
         }
-    };
-
-    template <typename T>
-    class cache_range {
-        T * first;
-        T * last;
 
-        typedef aligned_set_allocator<value_set<T> > set_allocator;
-        typedef std::less<value_set<T> > set_compare;
-        typedef std::set<value_set<T>, set_compare, set_allocator> set_type;
+        void index(uint16_t i) {
+            size_t pos = hash(this->first[i].fingerprint) & this->slots_mask;
+            while (this->slots[pos]) {
+                pos = (pos + 1) & this->slots_mask;
+            }
+            this->slots[pos] = i + 1;
+        }
 
-        set_type sorted_elements;
+        void unindex(uint16_t i) {
+            size_t pos = hash(this->first[i].fingerprint) & this->slots_mask;
+            while (this->slots[pos] != i + 1) {
+                REDASSERT(this->slots[pos]);
+                pos = (pos + 1) & this->slots_mask;
+            }
+            for (size_t next = (pos + 1) & this->slots_mask; this->slots[next]; next = (next + 1) & this->slots_mask) {
+                const size_t home = hash(this->first[this->slots[next] - 1].fingerprint) & this->slots_mask;
+                if (((next - home) & this->slots_mask) >= ((next - pos) & this->slots_mask)) {
+                    this->slots[pos] = this->slots[next];
+                    pos = next;
+                }
+            }
+            this->slots[pos] = 0;
+        }
 
     public:
-        cache_range(T * first, size_t sz, storage_value_set & storage)
+        cache_range(T * first, size_t sz)
         : first(first)
         , last(first + sz)
-        , sorted_elements(set_compare(), storage)
-        {}
+        , links(new lru_link[sz + 1])
+        , slots_mask(0)
+        {
+            if (sz) {
+                size_t slots_size = 1;
+                while (slots_size < sz * 2) {
+                    slots_size *= 2;
+                }
+                this->slots.reset(new uint16_t[slots_size]);
+                this->slots_mask = slots_size - 1;
+            }
+            this->clear_index();
+        }
 
         T & operator[](size_t i) {
             return this->first[i];
@@ -248,53 +218,83 @@ private:
             return this->last - this->first;
         }
 
+    private:
+        void clear_index() {
+            const uint16_t sz = this->size();
+            for (uint16_t i = 0; i <= sz; ++i) {
+                this->links[i].prev = (i ? i : sz + 1) - 1;
+                this->links[i].next = (i == sz) ? 0 : i + 1;
+            }
+            if (sz) {
+                std::fill(this->slots.get(), this->slots.get() + this->slots_mask + 1, 0);
+            }
+        }
+
+    public:
         void clear() {
-            this->sorted_elements.clear();
             for (T * p = this->first; p != this->last; ++p) {
                 p->reset();
             }
+            this->clear_index();
         }
 
         static const uint32_t invalid_cache_index = 0xFFFFFFFF;
 
         uint16_t get_old_index() const {
-            return this->priv_get_old_index(this->size());
+            return this->links[this->head()].next;
         }
 
+        // With waiting list, last element is reserved.
         uint16_t get_old_index(bool use_waiting_list) const {
-            const int_fast16_t entries_max = this->size();
-            return this->priv_get_old_index(use_waiting_list ? entries_max - 1 : entries_max);
-        }
-
-    private:
-        inline uint16_t priv_get_old_index(int_fast16_t entries_max) const {
-            T * first = this->first;
-            T * last = first + entries_max;
-            T * current = first;
-            while (++first < last) {
-                if (first->stamp < current->stamp) {
-                    current = first;
-                }
+            const uint16_t oldest = this->get_old_index();
+            if (use_waiting_list && (oldest == this->size() - 1) && (this->links[oldest].next != this->head())) {
+                return this->links[oldest].next;
             }
-            return current - this->first;
+            return oldest;
         }
 
-    public:
         uint32_t get_cache_index(const T & e) const {
-            typename set_type::const_iterator it = this->sorted_elements.find(e);
-            if (it == this->sorted_elements.end()) {
+            if (!this->slots_mask) {
                 return invalid_cache_index;
             }
+            for (size_t pos = hash(e.fingerprint) & this->slots_mask; this->slots[pos]; pos = (pos + 1) & this->slots_mask) {
+                const uint16_t i = this->slots[pos] - 1;
+                if (this->first[i].same_as(e)) {
+                    return i;
+                }
+            }
+            return invalid_cache_index;
+        }
 
-            return &it->elem - this->first;
+        // e becomes the most recently used element
+        void touch(T const & e) {
+            const uint16_t i = &e - this->first;
+            this->unlink(i);
+            this->link_before(i, this->head());
         }
 
+        // e is an element of this cache
         void remove(T const & e) {
-            this->sorted_elements.erase(e);
+            this->unindex(&e - this->first);
         }
 
+        // e is an element of this cache, it becomes the most recently used element
         void add(T const & e) {
-            this->sorted_elements.insert(e);
+            this->index(&e - this->first);
+            this->touch(e);
+        }
+
+        // resets a valid element, it is the next one to be reused
+        void release(T & e) {
+            const uint16_t i = &e - this->first;
+            this->unindex(i);
+            e.reset();
+            this->unlink(i);
+            uint16_t pos = this->links[this->head()].next;
+            while ((pos != this->head()) && !this->first[pos] && (pos < i)) {
+                pos = this->links[pos].next;
+            }
+            this->link_before(i, pos);
         }
 
         cache_range(cache_range &&) = default; // FIXME g++ (4.8, 4.9, other ?)
@@ -321,8 +321,8 @@ public:
         bool is_persistent_;
 
     public:
-        Cache(T * pdata, const CacheOption & opt, storage_value_set & storage)
-        : cache_range<T>(pdata, opt.entries, storage)
+        Cache(T * pdata, const CacheOption & opt)
+        : cache_range<T>(pdata, opt.entries)
         , bmp_size_(opt.bmp_size)
         , is_persistent_(opt.is_persistent)
         {}
@@ -358,18 +358,15 @@ public:
 private:
     const size_t size_elements;
     const std::unique_ptr<cache_element[]> elements;
-    storage_value_set storage;
 
     Cache<cache_element> caches[MAXIMUM_NUMBER_OF_CACHES];
 
     const size_t size_lite_elements;
     const std::unique_ptr<cache_lite_element[]> lite_elements;
-    storage_value_set lite_storage;
 
     Cache<cache_lite_element> waiting_list;
     Bitmap waiting_list_bitmap;
 
-          uint32_t stamp;
     const uint32_t verbose;
 
 public:
@@ -390,16 +387,15 @@ public:
     , size_elements(c0.entries + c1.entries + c2.entries + c3.entries + c4.entries)
     , elements(new cache_element[this->size_elements])
     , caches{
-        {this->elements.get(), c0, this->storage},
-        {this->elements.get() + c0.entries, c1, this->storage},
-        {this->elements.get() + c0.entries + c1.entries, c2, this->storage},
-        {this->elements.get() + c0.entries + c1.entries + c2.entries, c3, this->storage},
-        {this->elements.get() + c0.entries + c1.entries + c2.entries + c3.entries, c4, this->storage}
+        {this->elements.get(), c0},
+        {this->elements.get() + c0.entries, c1},
+        {this->elements.get() + c0.entries + c1.entries, c2},
+        {this->elements.get() + c0.entries + c1.entries + c2.entries, c3},
+        {this->elements.get() + c0.entries + c1.entries + c2.entries + c3.entries, c4}
     }
     , size_lite_elements(use_waiting_list ? MAXIMUM_NUMBER_OF_CACHE_ENTRIES : 0)
     , lite_elements(new cache_lite_element[this->size_lite_elements])
-    , waiting_list(this->lite_elements.get(), (use_waiting_list ? MAXIMUM_NUMBER_OF_CACHE_ENTRIES : 0), this->lite_storage)
-    , stamp(0)
+    , waiting_list(this->lite_elements.get(), (use_waiting_list ? MAXIMUM_NUMBER_OF_CACHE_ENTRIES : 0))
     , verbose(verbose)
     {
         REDASSERT(
@@ -418,9 +414,6 @@ public:
         //    ) : true)
         );
 
-        this->storage.reserve(this->size_elements);
-        this->lite_storage.reserve(this->size_lite_elements);
-
         if (this->verbose) {
             LOG( LOG_INFO
                 , "BmpCache: %s bpp=%u number_of_cache=%u use_waiting_list=%s "
@@ -487,7 +480,6 @@ public:
         if (this->verbose) {
             this->log();
         }
-        this->stamp = 0;
         for (Cache<cache_element> & cache : this->caches) {
             cache.clear();
         }
@@ -507,8 +499,7 @@ public:
             r.remove(e);
         }
         e.bmp = bmp;
-        e.bmp.compute_sha1(e.sha1);
-        e.stamp = ++this->stamp;
+        e.fingerprint = e.bmp.compute_fingerprint();
         e.cached = true;
 
         if (r.persistent()) {
@@ -645,20 +636,20 @@ public:
         const bool persistent = cache.persistent();
 
         cache_element e_compare(bmp);
-        bmp.compute_sha1(e_compare.sha1);
+        e_compare.fingerprint = bmp.compute_fingerprint();
 
         const uint32_t cache_index_32 = cache.get_cache_index(e_compare);
         if (cache_index_32 != cache_range<cache_element>::invalid_cache_index) {
             if (this->verbose & 512) {
                 if (persistent) {
+                    const uint8_t (& sig)[8] = cache[cache_index_32].sig.sig_8;
                     LOG( LOG_INFO
                         , "BmpCache: %s use bitmap %02X%02X%02X%02X%02X%02X%02X%02X stored in persistent disk bitmap cache"
                         , ((this->owner == Front) ? "Front" : ((this->owner == Mod_rdp) ? "Mod_rdp" : "Recorder"))
-                        , e_compare.sha1[0], e_compare.sha1[1], e_compare.sha1[2], e_compare.sha1[3]
-                        , e_compare.sha1[4], e_compare.sha1[5], e_compare.sha1[6], e_compare.sha1[7]);
+                        , sig[0], sig[1], sig[2], sig[3], sig[4], sig[5], sig[6], sig[7]);
                 }
             }
-            cache[cache_index_32].stamp = ++this->stamp;
+            cache.touch(cache[cache_index_32]);
             // Generating source code for unit test.
             //if (this->verbose & 8192) {
             //    LOG(LOG_INFO, "cache_id    = %u;", id_real);
@@ -679,7 +670,7 @@ public:
         if (persistent && this->use_waiting_list) {
             // The bitmap cache is persistent.
 
-            cache_lite_element le_compare(e_compare.sha1);
+            cache_lite_element le_compare(e_compare.fingerprint);
 
             const uint32_t cache_index_32 = this->waiting_list.get_cache_index(le_compare);
             if (cache_index_32 == cache_range<cache_lite_element>::invalid_cache_index) {
@@ -688,37 +679,38 @@ public:
                 id          |= IN_WAIT_LIST;
 
                 if (this->verbose & 512) {
-                    LOG( LOG_INFO, "BmpCache: %s Put bitmap %02X%02X%02X%02X%02X%02X%02X%02X into wait list."
+                    LOG( LOG_INFO, "BmpCache: %s Put bitmap %08X%08X into wait list."
                         , ((this->owner == Front) ? "Front" : ((this->owner == Mod_rdp) ? "Mod_rdp" : "Recorder"))
-                        , le_compare.sha1[0], le_compare.sha1[1], le_compare.sha1[2], le_compare.sha1[3]
-                        , le_compare.sha1[4], le_compare.sha1[5], le_compare.sha1[6], le_compare.sha1[7]);
+                        , unsigned(le_compare.fingerprint.h[0] >> 32), unsigned(le_compare.fingerprint.h[0]));
                 }
             }
             else {
-                this->waiting_list.remove(le_compare);
-                this->waiting_list[cache_index_32].reset();
+                this->waiting_list.release(this->waiting_list[cache_index_32]);
 
                 if (this->verbose & 512) {
                     LOG( LOG_INFO
-                        , "BmpCache: %s Put bitmap %02X%02X%02X%02X%02X%02X%02X%02X into persistent cache, cache_index=%u"
+                        , "BmpCache: %s Put bitmap %08X%08X into persistent cache, cache_index=%u"
                         , ((this->owner == Front) ? "Front" : ((this->owner == Mod_rdp) ? "Mod_rdp" : "Recorder"))
-                        , le_compare.sha1[0], le_compare.sha1[1], le_compare.sha1[2], le_compare.sha1[3]
-                        , le_compare.sha1[4], le_compare.sha1[5], le_compare.sha1[6], le_compare.sha1[7], oldest_cidx);
+                        , unsigned(le_compare.fingerprint.h[0] >> 32), unsigned(le_compare.fingerprint.h[0]), oldest_cidx);
                 }
             }
         }
 
-        // find oldest stamp (or 0) and replace bitmap
+        // replace least recently used (or free) bitmap
         if (id_real == id) {
             Cache<cache_element> & cache_real = this->caches[id_real];
             cache_element & e = cache_real[oldest_cidx];
             if (e) {
                 cache_real.remove(e);
             }
-           ::memcpy(e.sig.sig_8, e_compare.sha1, sizeof(e.sig.sig_8));
-            ::memcpy(e.sha1, e_compare.sha1, 20);
+            if (persistent) {
+                // the signature of the persistent caches goes on the wire and to disk
+                uint8_t sha1[20];
+                bmp.compute_sha1(sha1);
+                ::memcpy(e.sig.sig_8, sha1, sizeof(e.sig.sig_8));
+            }
+            e.fingerprint = e_compare.fingerprint;
             e.bmp = bmp;
-            e.stamp = ++this->stamp;
             e.cached = true;
             cache_real.add(e);
         }
@@ -727,10 +719,9 @@ public:
             if (e) {
                 this->waiting_list.remove(e);
             }
-            ::memcpy(e.sha1, e_compare.sha1, 20);
+            e.fingerprint = e_compare.fingerprint;
             e.is_valid = true;
             this->waiting_list_bitmap = std::move(e_compare.bmp);
-            e.stamp = ++this->stamp;
             this->waiting_list.add(e);
         }
 
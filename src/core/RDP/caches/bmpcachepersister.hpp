@@ -23,6 +23,7 @@
 
 #include <map>
 #include "bmpcache.hpp"
+#include "bmpcachestore.hpp"
 #include "transport.hpp"
 
 namespace RDP {
@@ -33,6 +34,8 @@ class BmpCachePersister
 {
 private:
     static const uint8_t CURRENT_VERSION = 1;
+    // only the signatures, the bitmaps are in a BmpCacheStore
+    static const uint8_t KEY_LIST_VERSION = 2;
 
     typedef Bitmap map_value;
 
@@ -82,12 +85,16 @@ private:
 
     BmpCache & bmp_cache;
 
+    // bitmaps are looked up in the store rather than in bmp_map
+    const BmpCacheStore * store;
+
     uint32_t verbose;
 
 public:
     // Preloads bitmap from file to be used later with Client Persistent Key List PDUs.
     BmpCachePersister(BmpCache & bmp_cache, Transport & t, const char * filename, uint32_t verbose = 0)
     : bmp_cache(bmp_cache)
+    , store(nullptr)
     , verbose(verbose) {
         BStream stream(16);
 
@@ -121,6 +128,14 @@ public:
         }
     }
 
+    // Bitmaps of Client Persistent Key List PDUs are decoded from the shared bitmap store
+    //  when they are asked for, nothing is preloaded.
+    BmpCachePersister(BmpCache & bmp_cache, const BmpCacheStore & store, uint32_t verbose = 0)
+    : bmp_cache(bmp_cache)
+    , store(&store)
+    , verbose(verbose) {
+    }
+
 private:
     void preload_from_disk(Transport & t, const char * filename, uint8_t version, uint8_t cache_id) {
         BStream stream(65536);
@@ -207,17 +222,15 @@ public:
 
             map_key key(sig->sig_8);
 
-            container_type::iterator it = this->bmp_map[cache_id].find(key);
-            if (it != this->bmp_map[cache_id].end()) {
+            Bitmap bmp;
+            if (this->find_bitmap(cache_id, sig->sig_8, bmp)) {
                 if (this->verbose & 0x100000) {
                     LOG(LOG_INFO, "BmpCachePersister: bitmap found. key=\"%s\"", key.str().c_str());
                 }
 
                 if (this->bmp_cache.get_cache(cache_id).size() > cache_index) {
-                    this->bmp_cache.put(cache_id, cache_index, it->second, sig->sig_32[0], sig->sig_32[1]);
+                    this->bmp_cache.put(cache_id, cache_index, bmp, sig->sig_32[0], sig->sig_32[1]);
                 }
-
-                this->bmp_map[cache_id].erase(it);
             }
             else if (this->verbose & 0x100000) {
                 LOG(LOG_WARNING, "BmpCachePersister: bitmap not found!!! key=\"%s\"", key.str().c_str());
@@ -225,9 +238,50 @@ public:
         }
     }
 
+private:
+    bool find_bitmap(uint8_t cache_id, const uint8_t (& sig)[8], Bitmap & bmp) {
+        if (!this->store) {
+            container_type::iterator it = this->bmp_map[cache_id].find(map_key(sig));
+            if (it == this->bmp_map[cache_id].end()) {
+                return false;
+            }
+            bmp = std::move(it->second);
+            this->bmp_map[cache_id].erase(it);
+            return true;
+        }
+
+        if (!this->bmp_cache.get_cache(cache_id).persistent()
+         || !this->store->get(sig, this->bmp_cache.bpp, bmp)) {
+            return false;
+        }
+
+        uint8_t sha1[20];
+        bmp.compute_sha1(sha1);
+        if (memcmp(sig, sha1, sizeof(sig))) {
+            LOG( LOG_ERR
+               , "BmpCachePersister::find_bitmap: Load failed. Cause: bitmap or key corruption.");
+            return false;
+        }
+        return true;
+    }
+
+public:
+
     // Loads bitmap from file to be placed immediately into the cache.
     static void load_all_from_disk( BmpCache & bmp_cache, Transport & t, const char * filename
                                   , uint32_t verbose = 0) {
+        load_all_from_disk(bmp_cache, nullptr, t, filename, verbose);
+    }
+
+    // Also reads the signature lists written with a bitmap store.
+    static void load_all_from_disk( BmpCache & bmp_cache, const BmpCacheStore & store, Transport & t
+                                  , const char * filename, uint32_t verbose = 0) {
+        load_all_from_disk(bmp_cache, &store, t, filename, verbose);
+    }
+
+private:
+    static void load_all_from_disk( BmpCache & bmp_cache, const BmpCacheStore * store, Transport & t
+                                  , const char * filename, uint32_t verbose) {
         BStream stream(16);
 
         t.recv(&stream.end, 5);  /* magic(4) + version(1) */
@@ -247,7 +301,7 @@ public:
             throw Error(ERR_PDBC_LOAD);
         }
 
-        if (version != CURRENT_VERSION) {
+        if ((version != CURRENT_VERSION) && ((version != KEY_LIST_VERSION) || !store)) {
             LOG( LOG_ERR
                , "BmpCachePersister::load_all_from_disk: "
                  "Unsupported persistent bitmap cache file version(%u). filename=\"%s\""
@@ -256,11 +310,48 @@ public:
         }
 
         for (uint8_t cache_id = 0; cache_id < bmp_cache.number_of_cache; cache_id++) {
-            load_from_disk(bmp_cache, t, filename, cache_id, version, verbose);
+            if (version == KEY_LIST_VERSION) {
+                load_keys_from_disk(bmp_cache, *store, t, cache_id, verbose);
+            }
+            else {
+                load_from_disk(bmp_cache, t, filename, cache_id, version, verbose);
+            }
+        }
+    }
+
+    static void load_keys_from_disk( BmpCache & bmp_cache, const BmpCacheStore & store, Transport & t
+                                   , uint8_t cache_id, uint32_t verbose) {
+        BStream stream(16);
+        t.recv(&stream.end, 2);
+
+        uint16_t bitmap_count = stream.in_uint16_le();
+        if (verbose & 1) {
+            LOG(LOG_INFO, "BmpCachePersister::load_keys_from_disk: bitmap_count=%u", bitmap_count);
+        }
+
+        BmpCache::cache_ const & cache = bmp_cache.get_cache(cache_id);
+        for (uint16_t i = 0; i < bitmap_count; i++) {
+            stream.reset();
+            t.recv(&stream.end, 8);
+
+            union {
+                uint8_t  sig_8[8];
+                uint32_t sig_32[2];
+            } sig;
+
+            stream.in_copy_bytes(sig.sig_8, 8); // sig(8);
+
+            Bitmap bmp;
+            if (cache.persistent() && (i < cache.size()) && store.get(sig.sig_8, bmp_cache.bpp, bmp)) {
+                bmp_cache.put(cache_id, i, bmp, sig.sig_32[0], sig.sig_32[1]);
+            }
+            else if (verbose & 0x100000) {
+                LOG( LOG_WARNING, "BmpCachePersister::load_keys_from_disk: bitmap not found!!! key=\"%s\""
+                   , map_key(sig.sig_8).str().c_str());
+            }
         }
     }
 
-private:
     static void load_from_disk( BmpCache & bmp_cache, Transport & t, const char * filename
                               , uint8_t cache_id, uint8_t version, uint32_t verbose) {
         BStream stream(65536);
@@ -342,6 +433,57 @@ public:
         }
     }
 
+    // Appends the bitmaps to the store, the file only gets the signatures, in cache order.
+    static void save_all_to_disk( const BmpCache & bmp_cache, BmpCacheStore & store, Transport & t
+                                , uint32_t verbose = 0) {
+        if (verbose & 1) {
+            bmp_cache.log();
+        }
+
+        store.append(bmp_cache);
+
+        BStream stream(65536);
+
+        stream.out_copy_bytes("PDBC", 4);  // Magic(4)
+        stream.out_uint8(KEY_LIST_VERSION);
+
+        for (uint8_t cache_id = 0; cache_id < bmp_cache.number_of_cache; cache_id++) {
+            BmpCache::cache_ const & cache = bmp_cache.get_cache(cache_id);
+
+            uint16_t bitmap_count = 0;
+            if (cache.persistent()) {
+                for (uint16_t cache_index = 0; cache_index < cache.size(); cache_index++) {
+                    if (cache[cache_index]) {
+                        bitmap_count++;
+                    }
+                }
+            }
+
+            if (!stream.has_room(2)) {
+                stream.mark_end();
+                t.send(stream);
+                stream.reset();
+            }
+            stream.out_uint16_le(bitmap_count);
+            if (!bitmap_count) {
+                continue;
+            }
+
+            for (uint16_t cache_index = 0; cache_index < cache.size(); cache_index++) {
+                if (cache[cache_index]) {
+                    if (!stream.has_room(8)) {
+                        stream.mark_end();
+                        t.send(stream);
+                        stream.reset();
+                    }
+                    stream.out_copy_bytes(cache[cache_index].sig.sig_8, 8);
+                }
+            }
+        }
+        stream.mark_end();
+        t.send(stream);
+    }
+
 private:
     static void save_to_disk(const BmpCache & bmp_cache, uint8_t cache_id, Transport & t, uint32_t verbose) {
         uint16_t bitmap_count = 0;
@@ -0,0 +1,520 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Persistent bitmap store shared by the sessions of the node.
+
+    The store is one file of bitmaps addressed by their 8 bytes signature:
+
+        magic "PBST"(4) + version(1) + padding(3)
+        records: sig(8) + original_bpp(1) + cx(2) + cy(2)
+               + [palette(1024) if original_bpp is 8] + bmp_size(2) + data(bmp_size)
+
+    Every session maps the file read-only and only keeps the offsets of the
+    records, the bitmaps stay in the page cache shared by all the processes.
+    Records are only appended, under an exclusive lock of the file, so that
+    the sessions writing at the same time do not interleave their
+    records. A record torn by a crashed writer is ignored by the readers and
+    overwritten by the next writer.
+
+    When the file would grow beyond its maximum size, the writer copies the
+    most recent records (up to half of the maximum size) and its own ones to
+    a new file renamed over the old one. The other sessions keep reading the
+    file they mapped and open the new one when they append.
+*/
+
+#ifndef _REDEMPTION_CORE_RDP_CACHES_BMPCACHESTORE_HPP_
+#define _REDEMPTION_CORE_RDP_CACHES_BMPCACHESTORE_HPP_
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "bmpcache.hpp"
+#include "stream.hpp"
+#include "fileutils.hpp"
+
+class BmpCacheStore
+{
+public:
+    enum {
+        // the file is compacted beyond
+        DEFAULT_MAX_FILE_SIZE = 512 * 1024 * 1024
+    };
+
+private:
+    static const uint8_t CURRENT_VERSION = 1;
+
+    enum {
+        HEADER_SIZE        = 8,
+        RECORD_HEADER_SIZE = 13     // sig(8) + original_bpp(1) + cx(2) + cy(2)
+    };
+
+    const std::string filename;
+    const size_t      max_file_size;
+
+    int fd;
+
+    const uint8_t * map;
+    size_t          map_size;
+    // end of the last complete record
+    size_t          valid_size;
+
+    // signature -> offset of the record
+    std::unordered_map<uint64_t, uint32_t> index;
+
+    uint32_t verbose;
+
+    static uint64_t key(const uint8_t * sig) {
+        uint64_t k;
+        memcpy(&k, sig, sizeof(k));
+        return k;
+    }
+
+public:
+    struct Record {
+        uint8_t         original_bpp;
+        uint16_t        cx;
+        uint16_t        cy;
+        const uint8_t * palette;    // nullptr if original_bpp is not 8
+        const uint8_t * data;
+        uint16_t        bmp_size;
+    };
+
+    BmpCacheStore(const char * filename, uint32_t verbose = 0, size_t max_file_size = DEFAULT_MAX_FILE_SIZE)
+    : filename(filename)
+    , max_file_size(max_file_size)
+    , fd(::open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP))
+    , map(nullptr)
+    , map_size(0)
+    , valid_size(HEADER_SIZE)
+    , verbose(verbose) {
+        if (this->fd == -1) {
+            this->fd = ::open(filename, O_RDONLY);
+        }
+        if (this->fd == -1) {
+            LOG( LOG_ERR
+               , "BmpCacheStore::BmpCacheStore: failed to open bitmap store. filename=\"%s\" errno=%d"
+               , filename, errno);
+            throw Error(ERR_PDBC_LOAD);
+        }
+
+        try {
+            struct stat st;
+            if (::fstat(this->fd, &st) == 0 && st.st_size == 0 && ::flock(this->fd, LOCK_EX) == 0) {
+                // the first session writes the header
+                if (::fstat(this->fd, &st) == 0 && st.st_size == 0) {
+                    const uint8_t header[HEADER_SIZE] = { 'P', 'B', 'S', 'T', CURRENT_VERSION, 0, 0, 0 };
+                    if (::pwrite(this->fd, header, sizeof(header), 0) != sizeof(header)) {
+                        ::ftruncate(this->fd, 0);
+                    }
+                }
+                ::flock(this->fd, LOCK_UN);
+            }
+
+            this->refresh();
+
+            if ((this->map_size < HEADER_SIZE) || ::memcmp(this->map, "PBST", 4)
+             || (this->map[4] != CURRENT_VERSION)) {
+                LOG( LOG_ERR
+                   , "BmpCacheStore::BmpCacheStore: "
+                     "File is not a bitmap store or has an unsupported version. filename=\"%s\""
+                   , filename);
+                throw Error(ERR_PDBC_LOAD);
+            }
+        }
+        catch (...) {
+            this->close();
+            throw;
+        }
+
+        if (this->verbose & 1) {
+            LOG( LOG_INFO, "BmpCacheStore: filename=\"%s\" bitmap_count=%zu size=%zu"
+               , filename, this->index.size(), this->valid_size);
+        }
+    }
+
+    ~BmpCacheStore() {
+        this->close();
+    }
+
+    // Opens the store of the bitmaps of <bpp> bits per pixel in <directory>,
+    //  returns nullptr if it can not be used.
+    static std::unique_ptr<BmpCacheStore> open_store(const char * directory, uint8_t bpp, uint32_t verbose = 0) {
+        if (::recursive_create_directory(directory, S_IRWXU | S_IRWXG, 0) != 0) {
+            LOG( LOG_ERR
+               , "BmpCacheStore::open_store: failed to create directory \"%s\"."
+               , directory);
+            return std::unique_ptr<BmpCacheStore>();
+        }
+
+        char filename[2048];
+        ::snprintf(filename, sizeof(filename) - 1, "%s/PBST-%d", directory, bpp);
+        filename[sizeof(filename) - 1] = '\0';
+
+        try {
+            return std::unique_ptr<BmpCacheStore>(new BmpCacheStore(filename, verbose));
+        }
+        catch (const Error & e) {
+            if (e.id != ERR_PDBC_LOAD) {
+                throw;
+            }
+        }
+        return std::unique_ptr<BmpCacheStore>();
+    }
+
+private:
+    BmpCacheStore(BmpCacheStore const &) /* = delete*/;
+    BmpCacheStore& operator=(BmpCacheStore const &) /* = delete*/;
+
+    void close() {
+        if (this->map) {
+            ::munmap(const_cast<uint8_t *>(this->map), this->map_size);
+            this->map = nullptr;
+        }
+        if (this->fd != -1) {
+            ::close(this->fd);
+            this->fd = -1;
+        }
+    }
+
+    // size of the complete record at <record>
+    static size_t record_size(const uint8_t * record) {
+        const size_t palette_size = (record[8] == 8) ? BGRPalette::data_size() : 0;
+        const uint8_t * bmp_size = record + RECORD_HEADER_SIZE + palette_size;
+        return RECORD_HEADER_SIZE + palette_size + 2 + (bmp_size[0] | (bmp_size[1] << 8));
+    }
+
+    static bool write_all(int fd, const uint8_t * p, size_t len, size_t offset) {
+        while (len) {
+            const ssize_t res = ::pwrite(fd, p, len, offset);
+            if (res <= 0) {
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                LOG(LOG_WARNING, "BmpCacheStore: write failed. errno=%d", errno);
+                return false;
+            }
+            p      += res;
+            offset += res;
+            len    -= res;
+        }
+        return true;
+    }
+
+    // Uses <new_fd>, the file which replaced ours.
+    void reopen(int new_fd) {
+        this->close();
+        this->fd         = new_fd;
+        this->index.clear();
+        this->valid_size = HEADER_SIZE;
+        this->refresh();
+    }
+
+    // Locks the file, the file renamed over ours by a compaction is opened
+    //  and locked instead.
+    bool lock() {
+        for (;;) {
+            if (::flock(this->fd, LOCK_EX) == -1) {
+                LOG(LOG_WARNING, "BmpCacheStore::lock: flock failed. errno=%d", errno);
+                return false;
+            }
+
+            struct stat path_st;
+            struct stat fd_st;
+            if ((::stat(this->filename.c_str(), &path_st) == -1) || (::fstat(this->fd, &fd_st) == -1)
+             || ((path_st.st_dev == fd_st.st_dev) && (path_st.st_ino == fd_st.st_ino))) {
+                return true;
+            }
+
+            const int new_fd = ::open(this->filename.c_str(), O_RDWR);
+            if (new_fd == -1) {
+                return true;
+            }
+            if (this->verbose & 1) {
+                LOG(LOG_INFO, "BmpCacheStore::lock: bitmap store was compacted");
+            }
+            this->reopen(new_fd);
+        }
+    }
+
+    // Writes the most recent records fitting in half of max_file_size then
+    //  <records> to a new file renamed over ours. Called with the lock held.
+    bool compact(const std::vector<uint8_t> & records) {
+        // offset and size of the records, the duplicates of a signature are dropped
+        std::vector<std::pair<size_t, size_t>> live;
+        for (size_t offset = HEADER_SIZE; offset < this->valid_size; ) {
+            const size_t size = record_size(this->map + offset);
+            const std::unordered_map<uint64_t, uint32_t>::const_iterator it =
+                this->index.find(key(this->map + offset));
+            if ((it != this->index.end()) && (it->second == offset)) {
+                live.push_back(std::make_pair(offset, size));
+            }
+            offset += size;
+        }
+
+        size_t new_size = HEADER_SIZE + records.size();
+        size_t first    = live.size();
+        while ((first > 0) && (new_size + live[first - 1].second <= this->max_file_size / 2)) {
+            --first;
+            new_size += live[first].second;
+        }
+
+        std::string tmp_filename = this->filename + ".XXXXXX";
+        const int new_fd = ::mkstemp(&tmp_filename[0]);
+        if (new_fd == -1) {
+            LOG(LOG_WARNING, "BmpCacheStore::compact: failed to create \"%s\". errno=%d"
+               , tmp_filename.c_str(), errno);
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(this->fd, &st) == 0) {
+            ::fchmod(new_fd, st.st_mode & 0777);
+        }
+
+        bool ok = write_all(new_fd, this->map, HEADER_SIZE, 0);
+        size_t offset = HEADER_SIZE;
+        for (size_t i = first; ok && (i < live.size()); ++i) {
+            ok = write_all(new_fd, this->map + live[i].first, live[i].second, offset);
+            offset += live[i].second;
+        }
+        ok = ok && write_all(new_fd, records.data(), records.size(), offset)
+                && (::rename(tmp_filename.c_str(), this->filename.c_str()) == 0);
+        if (!ok) {
+            LOG(LOG_WARNING, "BmpCacheStore::compact: failed to replace bitmap store. errno=%d", errno);
+            ::close(new_fd);
+            ::unlink(tmp_filename.c_str());
+            return false;
+        }
+
+        if (this->verbose & 1) {
+            LOG( LOG_INFO, "BmpCacheStore::compact: bitmap_count=%zu dropped_bitmap_count=%zu size=%zu"
+               , live.size() - first, first, new_size);
+        }
+
+        this->reopen(new_fd);
+        return true;
+    }
+
+    // Maps the records appended by the other sessions.
+    void refresh() {
+        struct stat st;
+        if ((::fstat(this->fd, &st) == -1) || (static_cast<size_t>(st.st_size) == this->map_size)) {
+            return;
+        }
+        if (static_cast<size_t>(st.st_size) < this->valid_size) {
+            // truncated behind our back, everything is read again
+            this->index.clear();
+            this->valid_size = HEADER_SIZE;
+        }
+        if (st.st_size == 0) {
+            if (this->map) {
+                ::munmap(const_cast<uint8_t *>(this->map), this->map_size);
+            }
+            this->map      = nullptr;
+            this->map_size = 0;
+            return;
+        }
+
+        void * new_map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, this->fd, 0);
+        if (new_map == MAP_FAILED) {
+            LOG(LOG_WARNING, "BmpCacheStore::refresh: mmap failed. errno=%d", errno);
+            return;
+        }
+        if (this->map) {
+            ::munmap(const_cast<uint8_t *>(this->map), this->map_size);
+        }
+        this->map      = static_cast<const uint8_t *>(new_map);
+        this->map_size = st.st_size;
+
+        if (this->map_size < HEADER_SIZE) {
+            return;
+        }
+
+        while (this->valid_size + RECORD_HEADER_SIZE <= this->map_size) {
+            StaticStream stream(this->map + this->valid_size, this->map_size - this->valid_size);
+
+            uint8_t sig[8];
+            stream.in_copy_bytes(sig, 8);
+            const uint8_t original_bpp = stream.in_uint8();
+            if ((original_bpp != 8) && (original_bpp != 15) && (original_bpp != 16)
+             && (original_bpp != 24) && (original_bpp != 32)) {
+                LOG(LOG_WARNING, "BmpCacheStore::refresh: corrupted record at offset %zu", this->valid_size);
+                break;
+            }
+            stream.in_skip_bytes(4);    // cx(2) + cy(2)
+
+            const size_t palette_size = (original_bpp == 8) ? BGRPalette::data_size() : 0;
+            if (!stream.in_check_rem(palette_size + 2)) {
+                break;
+            }
+            stream.in_skip_bytes(palette_size);
+            const uint16_t bmp_size = stream.in_uint16_le();
+            if (!stream.in_check_rem(bmp_size)) {
+                break;
+            }
+
+            // the first record of a signature is kept
+            this->index.insert(std::make_pair(key(sig), static_cast<uint32_t>(this->valid_size)));
+            this->valid_size += RECORD_HEADER_SIZE + palette_size + 2 + bmp_size;
+        }
+    }
+
+public:
+    size_t size() const {
+        return this->index.size();
+    }
+
+    bool contains(const uint8_t (& sig)[8]) const {
+        return this->index.count(key(sig));
+    }
+
+    bool find(const uint8_t (& sig)[8], Record & record) const {
+        std::unordered_map<uint64_t, uint32_t>::const_iterator it = this->index.find(key(sig));
+        if (it == this->index.end()) {
+            return false;
+        }
+
+        StaticStream stream(this->map + it->second + 8, this->valid_size - it->second - 8);
+        record.original_bpp = stream.in_uint8();
+        record.cx           = stream.in_uint16_le();
+        record.cy           = stream.in_uint16_le();
+        record.palette      = nullptr;
+        if (record.original_bpp == 8) {
+            record.palette = stream.p;
+            stream.in_skip_bytes(BGRPalette::data_size());
+        }
+        record.bmp_size     = stream.in_uint16_le();
+        record.data         = stream.p;
+        return true;
+    }
+
+    // Decodes the bitmap of the signature, straight from the mapped file.
+    bool get(const uint8_t (& sig)[8], uint8_t session_bpp, Bitmap & bmp) const {
+        Record record;
+        if (!this->find(sig, record)) {
+            return false;
+        }
+
+        BGRPalette original_palette{BGRPalette::no_init()};
+        if (record.palette) {
+            original_palette.set_data(record.palette);
+        }
+        bmp = Bitmap( session_bpp, record.original_bpp, &original_palette, record.cx, record.cy
+                    , record.data, record.bmp_size);
+        return true;
+    }
+
+    // Appends the bitmaps of the persistent caches which are not in the store yet.
+    // Returns the number of appended bitmaps.
+    unsigned append(const BmpCache & bmp_cache) {
+        if (!this->lock()) {
+            return 0;
+        }
+
+        this->refresh();
+
+        std::vector<uint8_t> records;
+        std::unordered_set<uint64_t> appended;
+
+        for (uint8_t cache_id = 0; cache_id < bmp_cache.number_of_cache; cache_id++) {
+            BmpCache::cache_ const & cache = bmp_cache.get_cache(cache_id);
+            if (!cache.persistent()) {
+                continue;
+            }
+
+            for (uint16_t cache_index = 0; cache_index < cache.size(); cache_index++) {
+                if (!cache[cache_index]) {
+                    continue;
+                }
+
+                const uint8_t (& sig)[8] = cache[cache_index].sig.sig_8;
+                if (this->contains(sig) || appended.count(key(sig))) {
+                    continue;
+                }
+
+                const Bitmap & bmp      = cache[cache_index].bmp;
+                const uint16_t bmp_size = bmp.bmp_size();
+
+                appended.insert(key(sig));
+
+                uint8_t header[RECORD_HEADER_SIZE];
+                StaticStream stream(header, sizeof(header));
+                stream.out_copy_bytes(sig, 8);
+                stream.out_uint8(bmp.bpp());
+                stream.out_uint16_le(bmp.cx());
+                stream.out_uint16_le(bmp.cy());
+                records.insert(records.end(), header, header + sizeof(header));
+                if (bmp.bpp() == 8) {
+                    const uint8_t * palette = reinterpret_cast<const uint8_t *>(bmp.palette().data());
+                    records.insert(records.end(), palette, palette + BGRPalette::data_size());
+                }
+                records.push_back(bmp_size & 0xFF);
+                records.push_back(bmp_size >> 8);
+                records.insert(records.end(), bmp.data(), bmp.data() + bmp_size);
+            }
+        }
+
+        unsigned count = 0;
+        if (!records.empty()) {
+            if (HEADER_SIZE + records.size() > this->max_file_size) {
+                LOG( LOG_WARNING, "BmpCacheStore::append: too many bitmaps for the bitmap store (%zu bytes)"
+                   , records.size());
+            }
+            else if (this->valid_size + records.size() > this->max_file_size) {
+                if (this->compact(records)) {
+                    count = appended.size();
+                }
+            }
+            else {
+                // a torn record is overwritten
+                if (this->map_size > this->valid_size) {
+                    ::ftruncate(this->fd, this->valid_size);
+                }
+                if (write_all(this->fd, records.data(), records.size(), this->valid_size)) {
+                    count = appended.size();
+                }
+                else {
+                    ::ftruncate(this->fd, this->valid_size);
+                }
+            }
+        }
+
+        this->refresh();
+
+        ::flock(this->fd, LOCK_UN);
+
+        if (this->verbose & 1) {
+            LOG( LOG_INFO, "BmpCacheStore::append: bitmap_count=%u store_bitmap_count=%zu"
+               , count, this->index.size());
+        }
+
+        return count;
+    }
+};
+
+#endif  // #ifndef _REDEMPTION_CORE_RDP_CACHES_BMPCACHESTORE_HPP_
@@ -21,10 +21,39 @@
 #ifndef _REDEMPTION_CORE_RDP_CACHES_GLYPHCACHE_HPP_
 #define _REDEMPTION_CORE_RDP_CACHES_GLYPHCACHE_HPP_
 
+#include <vector>
+
 #include "font.hpp"
 #include "noncopyable.hpp"
 #include "RDP/capabilities/glyphcache.hpp"
 
+// horizontal run of set pixels of a glyph, in glyph coordinates
+struct GlyphSpan {
+    int16_t x;
+    int16_t y;
+    int16_t cx;
+};
+
+// glyph bits (rows of nbbytes(width) bytes, most significant bit first) to runs of pixels
+static inline void make_glyph_spans(FontChar const & fc, std::vector<GlyphSpan> & spans)
+{
+    spans.clear();
+    const uint8_t * row = fc.data.get();
+    const int row_size = nbbytes(fc.width);
+    for (int y = 0; y < fc.height; y++, row += row_size) {
+        for (int x = 0; x < fc.width; ) {
+            if (!(row[x / 8] & (0x80 >> (x % 8)))) {
+                x++;
+                continue;
+            }
+            const int start = x;
+            while (++x < fc.width && (row[x / 8] & (0x80 >> (x % 8)))) {
+            }
+            spans.push_back({int16_t(start), int16_t(y), int16_t(x - start)});
+        }
+    }
+}
+
 /* difference caches */
 class GlyphCache : noncopyable {
     class Glyph {
@@ -34,8 +63,20 @@ class GlyphCache : noncopyable {
 
         bool cached = false;
 
+        void update_spans() {
+            if (this->font_item) {
+                make_glyph_spans(this->font_item, this->spans);
+            }
+            else {
+                this->spans.clear();
+            }
+        }
+
     public:
         FontChar font_item;
+
+        // the pixels of font_item, computed when the glyph is put in the cache
+        std::vector<GlyphSpan> spans;
     };
 
     /* font */
@@ -70,6 +111,7 @@ public:
         const t_glyph_cache_result ret = priv_add_glyph(font_item, cacheid, cacheidx);
         if (ret == GLYPH_ADDED_TO_CACHE) {
             this->glyphs[cacheid][cacheidx].font_item = font_item.clone();
+            this->glyphs[cacheid][cacheidx].update_spans();
         }
         return ret;
     }
@@ -78,6 +120,7 @@ public:
         const t_glyph_cache_result ret = priv_add_glyph(font_item, cacheid, cacheidx);
         if (ret == GLYPH_ADDED_TO_CACHE) {
             this->glyphs[cacheid][cacheidx].font_item = std::move(font_item);
+            this->glyphs[cacheid][cacheidx].update_spans();
         }
         return ret;
     }
@@ -119,6 +162,7 @@ public:
         this->glyph_stamp++;
         this->glyphs[cacheid][cacheidx].font_item = std::move(fc);
         this->glyphs[cacheid][cacheidx].stamp     = this->glyph_stamp;
+        this->glyphs[cacheid][cacheidx].update_spans();
     }
 
 /*
@@ -0,0 +1,411 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Read and write requests of the proxy managed drives, run by a small pool
+    of threads with pread/pwrite.
+*/
+
+#ifndef REDEMPTION_CORE_RDP_CHANNELS_RDPDRDRIVEIOENGINE_HPP
+#define REDEMPTION_CORE_RDP_CHANNELS_RDPDRDRIVEIOENGINE_HPP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "channel_list.hpp"
+#include "log.hpp"
+#include "noncopyable.hpp"
+#include "rdpdr.hpp"
+#include "stream.hpp"
+#include "to_server_sender.hpp"
+
+// Several read and write requests (IRP) of the server are run at the same
+// time by the threads, the requests of a file are independent of each other
+// since they carry their own offset. The completions are queued and sent back
+// by the session thread (send_completions()) when get_completion_fd() is
+// readable, all the completed requests in one go.
+//
+// Sequential reads of a file ask the kernel to read ahead of the server with
+// a window doubling up to MAX_READ_AHEAD bytes.
+//
+// The Length of the requests comes from the server: a read is cut at the end
+// of the file and at MAX_IO_LENGTH bytes (the server gets the number of bytes
+// read), the data of a write is checked by the caller.
+//
+// The threads are started by the first request. Files are given by their
+// descriptor, close_file() must be called before closing it.
+class RdpdrDriveIOEngine : noncopyable
+{
+public:
+    enum {
+          DEFAULT_THREAD_COUNT = 4
+        , MIN_READ_AHEAD       = 128 * 1024
+        , MAX_READ_AHEAD       = 4 * 1024 * 1024
+        , MAX_IO_LENGTH        = 16 * 1024 * 1024
+    };
+
+private:
+    // DR_CORE_DEVICE_IOCOMPLETION: SharedHeader(4) + DeviceIOResponse(12) + Length(4)
+    enum { RESPONSE_HEADER_LENGTH = 20 };
+
+    struct Job {
+        bool     write;
+        int      fd;
+        uint32_t DeviceId;
+        uint32_t CompletionId;
+        uint64_t Offset;
+        uint32_t Length;
+
+        uint64_t read_ahead_offset = 0;
+        uint64_t read_ahead_length = 0;
+
+        // read: room for the response header followed by the data read
+        // write: data to write
+        std::vector<uint8_t> data;
+
+        uint32_t IoStatus          = 0x00000000;    // STATUS_SUCCESS
+        uint32_t number_of_bytes   = 0;
+
+        Job(bool write, int fd, uint32_t DeviceId, uint32_t CompletionId, uint64_t Offset,
+            uint32_t Length)
+        : write(write)
+        , fd(fd)
+        , DeviceId(DeviceId)
+        , CompletionId(CompletionId)
+        , Offset(Offset)
+        , Length(Length)
+        {}
+    };
+
+    struct ReadAhead {
+        uint64_t next_offset  = 0;  // end of the last read
+        uint64_t window       = 0;
+        uint64_t advised_end  = 0;  // end of the data the kernel was asked for
+    };
+
+    const unsigned thread_count;
+
+    std::mutex              mutex;
+    std::condition_variable job_pushed;
+    std::condition_variable job_done;
+
+    std::deque<std::unique_ptr<Job>> jobs;
+    std::deque<std::unique_ptr<Job>> completed_jobs;
+    std::map<int, unsigned>          busy_files;    // fd, jobs not done yet
+    bool                             stop = false;
+
+    std::vector<std::thread> threads;
+    size_t                   idle_thread_count = 0;
+
+    // session thread only
+    std::map<int, ReadAhead> read_aheads;
+    size_t                   pending_count = 0;     // jobs not sent back yet
+
+    int completion_fd = -1;
+
+public:
+    explicit RdpdrDriveIOEngine(unsigned thread_count = DEFAULT_THREAD_COUNT)
+    : thread_count(std::max(thread_count, 1u))
+    {}
+
+    ~RdpdrDriveIOEngine() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stop = true;
+        }
+        this->job_pushed.notify_all();
+        for (std::thread & thread : this->threads) {
+            thread.join();
+        }
+        if (this->completion_fd > -1) {
+            ::close(this->completion_fd);
+        }
+    }
+
+    // Readable while completed requests wait for send_completions(), -1 before the first request.
+    int get_completion_fd() const {
+        return this->completion_fd;
+    }
+
+    // Requests not sent back yet.
+    bool has_pending_io() const {
+        return (this->pending_count != 0);
+    }
+
+    void read(int fd, uint32_t DeviceId, uint32_t CompletionId, uint32_t Length, uint64_t Offset) {
+        Length = std::min<uint32_t>(Length, MAX_IO_LENGTH);
+
+        std::unique_ptr<Job> job(new Job(false, fd, DeviceId, CompletionId, Offset, Length));
+
+        ReadAhead & read_ahead = this->read_aheads[fd];
+        if (Offset == read_ahead.next_offset) {
+            read_ahead.window = std::min<uint64_t>(
+                std::max<uint64_t>(read_ahead.window * 2, MIN_READ_AHEAD), MAX_READ_AHEAD);
+        }
+        else {
+            read_ahead.window      = 0;
+            read_ahead.advised_end = 0;
+        }
+        read_ahead.next_offset = Offset + Length;
+
+        if (read_ahead.window) {
+            const uint64_t begin = std::max(read_ahead.next_offset, read_ahead.advised_end);
+            const uint64_t end   = read_ahead.next_offset + read_ahead.window;
+            // the kernel is asked again when half of the window was read
+            if (begin < end && end - begin >= read_ahead.window / 2) {
+                job->read_ahead_offset = begin;
+                job->read_ahead_length = end - begin;
+                read_ahead.advised_end = end;
+            }
+        }
+
+        this->push(std::move(job));
+    }
+
+    void write(int fd, uint32_t DeviceId, uint32_t CompletionId, uint64_t Offset,
+               std::vector<uint8_t> && data) {
+        std::unique_ptr<Job> job(new Job(true, fd, DeviceId, CompletionId, Offset,
+            static_cast<uint32_t>(data.size())));
+        job->data = std::move(data);
+
+        this->push(std::move(job));
+    }
+
+    // Waits until the requests on fd are done (their completions may not be sent yet).
+    void wait_file(int fd) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->job_done.wait(lock, [this, fd]() {
+            return !this->busy_files.count(fd);
+        });
+    }
+
+    // Waits until the requests on fd are done, fd can be closed after.
+    void close_file(int fd) {
+        this->wait_file(fd);
+        this->read_aheads.erase(fd);
+    }
+
+    // Sends the completions of the requests done so far.
+    void send_completions(ToServerSender & to_server_sender, uint32_t verbose) {
+        if (this->completion_fd < 0) {
+            return;
+        }
+
+        uint64_t counter;
+        if (::read(this->completion_fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+            LOG(LOG_WARNING, "RdpdrDriveIOEngine::send_completions: read failed with error %s",
+                ::strerror(errno));
+        }
+
+        std::deque<std::unique_ptr<Job>> completed_jobs;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            completed_jobs.swap(this->completed_jobs);
+        }
+
+        for (std::unique_ptr<Job> & job : completed_jobs) {
+            this->send_completion(*job, to_server_sender, verbose);
+            this->pending_count--;
+        }
+    }
+
+private:
+    void push(std::unique_ptr<Job> && job) {
+        if (this->completion_fd < 0) {
+            this->completion_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (this->completion_fd < 0) {
+                LOG(LOG_ERR, "RdpdrDriveIOEngine: eventfd failed with error %s", ::strerror(errno));
+                throw Error(ERR_RDPDR_IO_ENGINE_FAILED, errno);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->busy_files[job->fd]++;
+            this->jobs.push_back(std::move(job));
+            if (this->jobs.size() > this->idle_thread_count &&
+                this->threads.size() < this->thread_count) {
+                this->threads.emplace_back(&RdpdrDriveIOEngine::run, this);
+            }
+        }
+        this->pending_count++;
+        this->job_pushed.notify_one();
+    }
+
+    void send_completion(Job & job, ToServerSender & to_server_sender, uint32_t verbose) {
+        BStream header(64);
+
+        const rdpdr::SharedHeader sh_s(rdpdr::Component::RDPDR_CTYP_CORE,
+                                       rdpdr::PacketId::PAKID_CORE_DEVICE_IOCOMPLETION);
+        sh_s.emit(header);
+
+        const rdpdr::DeviceIOResponse device_io_response(job.DeviceId, job.CompletionId,
+                                                         job.IoStatus);
+        if (verbose) {
+            LOG(LOG_INFO, "RdpdrDriveIOEngine::send_completion: %s Length=%u",
+                (job.write ? "Write" : "Read"), job.number_of_bytes);
+            device_io_response.log(LOG_INFO);
+        }
+        device_io_response.emit(header);
+
+        header.out_uint32_le(job.number_of_bytes);  // Length(4)
+
+        if (job.write) {
+            header.out_uint8(0);                    // Padding(1), optional
+        }
+
+        header.mark_end();
+
+        const uint8_t * data   = header.get_data();
+        size_t          length = header.size();
+        if (!job.write) {
+            REDASSERT(length == RESPONSE_HEADER_LENGTH);
+            ::memcpy(job.data.data(), header.get_data(), RESPONSE_HEADER_LENGTH);
+            data   = job.data.data();
+            length = RESPONSE_HEADER_LENGTH + job.number_of_bytes;
+        }
+
+        for (size_t offset = 0; offset < length; offset += CHANNELS::CHANNEL_CHUNK_LENGTH) {
+            const size_t chunk_length =
+                std::min<size_t>(length - offset, CHANNELS::CHANNEL_CHUNK_LENGTH);
+            const uint32_t flags =
+                  (offset ? 0 : CHANNELS::CHANNEL_FLAG_FIRST)
+                | ((offset + chunk_length == length) ? CHANNELS::CHANNEL_FLAG_LAST : 0);
+            to_server_sender(length, flags, data + offset, chunk_length);
+        }
+    }
+
+    static void do_read(Job & job) {
+        struct stat64 sb;
+        if (::fstat64(job.fd, &sb) == 0) {
+            const uint64_t file_size = sb.st_size;
+            job.Length = (job.Offset < file_size)
+                       ? std::min<uint64_t>(job.Length, file_size - job.Offset)
+                       : 0;
+        }
+
+        try {
+            job.data.resize(RESPONSE_HEADER_LENGTH + job.Length);
+        }
+        catch (std::bad_alloc const &) {
+            job.IoStatus = 0xC000009A;  // STATUS_INSUFFICIENT_RESOURCES
+            job.data.resize(RESPONSE_HEADER_LENGTH);
+            return;
+        }
+
+        uint8_t * p = job.data.data() + RESPONSE_HEADER_LENGTH;
+        while (job.number_of_bytes < job.Length) {
+            const ssize_t res = ::pread64(job.fd, p + job.number_of_bytes,
+                job.Length - job.number_of_bytes, job.Offset + job.number_of_bytes);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(LOG_WARNING, "RdpdrDriveIOEngine: pread failed on file %d with error %s",
+                    job.fd, ::strerror(errno));
+                job.IoStatus        = 0xC0000001;   // STATUS_UNSUCCESSFUL
+                job.number_of_bytes = 0;
+                break;
+            }
+            if (res == 0) {
+                break;
+            }
+            job.number_of_bytes += res;
+        }
+
+        if (job.read_ahead_length) {
+            ::posix_fadvise64(job.fd, job.read_ahead_offset, job.read_ahead_length,
+                POSIX_FADV_WILLNEED);
+        }
+    }
+
+    static void do_write(Job & job) {
+        while (job.number_of_bytes < job.Length) {
+            const ssize_t res = ::pwrite64(job.fd, job.data.data() + job.number_of_bytes,
+                job.Length - job.number_of_bytes, job.Offset + job.number_of_bytes);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(LOG_WARNING, "RdpdrDriveIOEngine: pwrite failed on file %d with error %s",
+                    job.fd, ::strerror(errno));
+                job.IoStatus = ((errno == ENOSPC) || (errno == EDQUOT))
+                             ? 0xC000007F   // STATUS_DISK_FULL
+                             : 0xC0000001;  // STATUS_UNSUCCESSFUL
+                break;
+            }
+            job.number_of_bytes += res;
+        }
+
+        // the data is not sent back
+        job.data.clear();
+        job.data.shrink_to_fit();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (;;) {
+            this->idle_thread_count++;
+            this->job_pushed.wait(lock, [this]() { return this->stop || !this->jobs.empty(); });
+            this->idle_thread_count--;
+            if (this->stop) {
+                break;
+            }
+
+            std::unique_ptr<Job> job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+
+            lock.unlock();
+            if (job->write) {
+                do_write(*job);
+            }
+            else {
+                do_read(*job);
+            }
+            lock.lock();
+
+            auto busy_file = this->busy_files.find(job->fd);
+            if (!--busy_file->second) {
+                this->busy_files.erase(busy_file);
+            }
+            this->completed_jobs.push_back(std::move(job));
+
+            const uint64_t counter = 1;
+            if (::write(this->completion_fd, &counter, sizeof(counter)) < 0) {
+                LOG(LOG_WARNING, "RdpdrDriveIOEngine: write failed with error %s",
+                    ::strerror(errno));
+            }
+
+            this->job_done.notify_all();
+        }
+    }
+};
+
+#endif  // #ifndef REDEMPTION_CORE_RDP_CHANNELS_RDPDRDRIVEIOENGINE_HPP
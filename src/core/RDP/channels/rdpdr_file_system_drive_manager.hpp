@@ -31,6 +31,7 @@
 #include "fileutils.hpp"
 #include "rdp/rdp_asynchronous_task.hpp"
 #include "rdpdr.hpp"
+#include "rdpdr_drive_io_engine.hpp"
 #include "defines.hpp"
 #include "FSCC/FileInformation.hpp"
 #include "make_unique.hpp"
@@ -1152,22 +1153,29 @@ public:
 };  // ManagedDirectory
 
 class ManagedFile : public ManagedFileSystemObject {
-    std::unique_ptr<InFileTransport> in_file_transport; // For read operations only.
+    RdpdrDriveIOEngine & io_engine;
 
-    off64_t size = 0;
+    // Write request received in several chunks.
+    uint32_t             write_length   = 0;
+    uint64_t             write_offset   = 0;
+    uint32_t             write_received = 0;
+    bool                 write_refused  = false;  // Length larger than MAX_IO_LENGTH
+    std::vector<uint8_t> write_data;
 
 public:
-    //ManagedFile() {
-    //    LOG(LOG_INFO, "ManagedFile::ManagedFile(): <%p>", this);
-    //}
+    explicit ManagedFile(RdpdrDriveIOEngine & io_engine)
+    : io_engine(io_engine) {
+        //LOG(LOG_INFO, "ManagedFile::ManagedFile(): <%p>", this);
+    }
 
     virtual ~ManagedFile() {
         //LOG(LOG_INFO, "ManagedFile::~ManagedFile(): <%p> fd=%d",
         //    this, this->fd);
 
-        // File descriptor will be closed when in_file_transport is destroyed.
-
-        REDASSERT((this->fd <= -1) || in_file_transport);
+        if (this->fd > -1) {
+            this->io_engine.close_file(this->fd);
+            ::close(this->fd);
+        }
 
         if (this->delete_pending) {
             ::unlink(this->full_path.c_str());
@@ -1208,10 +1216,8 @@ public:
                                    int drive_access_mode,
                                    void * log_this,
                                    uint32_t verbose,
-                                   int & out_fd,
-                                   off64_t & out_size) -> int {
+                                   int & out_fd) -> int {
             out_fd = -1;
-            out_size = 0;
 
             if (((drive_access_mode != O_RDWR) && (drive_access_mode != O_RDONLY) &&
                  smb2::read_access_is_required(DesiredAccess, /*strict_check = */false)) ||
@@ -1263,23 +1269,9 @@ public:
             }
 
             out_fd = ::open(path, open_flags, S_IRUSR | S_IWUSR | S_IRGRP);
-            if (out_fd > -1) {
-                struct stat64 st;
-                if (fstat64(out_fd, &st)) {
-                    ::close(out_fd);
-                    out_fd = -1;
-                }
-                else {
-                    out_size = st.st_size;
-                }
-            }
             return ((out_fd > -1) ? 0 : errno);
         } (this->full_path.c_str(), DesiredAccess, CreateDisposition, drive_access_mode,
-           this, verbose, this->fd, this->size);
-
-        if (this->fd > -1) {
-            this->in_file_transport = std::make_unique<InFileTransport>(this->fd);
-        }
+           this, verbose, this->fd);
 
         if (verbose) {
             LOG(LOG_INFO,
@@ -1347,6 +1339,7 @@ public:
         //LOG(LOG_INFO, "ManagedFile::ProcessServerCloseDriveRequest(): <%p> fd=%d",
         //    this, this->fd);
 
+        this->io_engine.close_file(this->fd);
         ::close(this->fd);
 
         this->fd = -1;
@@ -1383,17 +1376,10 @@ public:
             uint32_t verbose) {
         REDASSERT(this->fd > -1);
 
-        const uint32_t Length = device_read_request.Length();
-
-        const uint64_t Offset = device_read_request.Offset();
-
-        off64_t remaining_number_of_bytes_to_read = std::min<off64_t>(this->size - Offset, Length);
-
-
-        out_asynchronous_task = std::make_unique<RdpdrDriveReadTask>(this->in_file_transport.get(),
-            this->fd, device_io_request.DeviceId(), device_io_request.CompletionId(),
-            static_cast<uint32_t>(remaining_number_of_bytes_to_read), Offset, to_server_sender,
-            verbose);
+        // The completion is sent by FileSystemDriveManager::SendCompletedIO().
+        this->io_engine.read(this->fd, device_io_request.DeviceId(),
+            device_io_request.CompletionId(), device_read_request.Length(),
+            device_read_request.Offset());
     }
 
     virtual void ProcessServerDriveControlRequest(
@@ -1438,55 +1424,59 @@ public:
             uint32_t verbose) override {
         REDASSERT(this->fd > -1);
 
-        static uint32_t Length = 0;
-        static uint64_t Offset = 0;
-
-        static uint32_t remaining_number_of_bytes_to_write = 0;
-        static uint32_t current_offset                     = 0;
-
         if (first_chunk) {
-            Length = in_stream.in_uint32_le();
-            Offset = in_stream.in_uint64_le();
-
-            remaining_number_of_bytes_to_write = Length;
-            current_offset                     = Offset;
+            this->write_length = in_stream.in_uint32_le();
+            this->write_offset = in_stream.in_uint64_le();
 
             in_stream.in_skip_bytes(20);  // Padding(20)
 
-            LOG(LOG_INFO,
-                "ManagedFile::ProcessServerDriveWriteRequest(): "
-                    "Length=%u Offset=%" PRIu64,
-                Length, Offset);
-        }
-
-        REDASSERT(remaining_number_of_bytes_to_write >= in_stream.in_remain());
+            this->write_received = 0;
+            this->write_refused  = (this->write_length > RdpdrDriveIOEngine::MAX_IO_LENGTH);
 
-        LOG(LOG_INFO,
-            "ManagedFile::ProcessServerDriveWriteRequest(): "
-                "CurrentOffset=%" PRIu64 " InRemain=%" PRIu64 " RemainingNumberOfBytesToWrite=%" PRIu64,
-            current_offset, in_stream.in_remain(), remaining_number_of_bytes_to_write);
+            this->write_data.clear();
+            if (this->write_refused) {
+                LOG(LOG_WARNING,
+                    "ManagedFile::ProcessServerDriveWriteRequest(): "
+                        "Length=%u is too large",
+                    this->write_length);
+            }
+            else {
+                this->write_data.reserve(this->write_length);
+            }
 
-        off64_t seek_result = ::lseek64(this->fd, current_offset, SEEK_SET);
-        REDASSERT(seek_result == current_offset);
-        int write_result = ::write(this->fd, in_stream.p, in_stream.in_remain());
-        (void)write_result;
+            if (verbose) {
+                LOG(LOG_INFO,
+                    "ManagedFile::ProcessServerDriveWriteRequest(): "
+                        "Length=%u Offset=%" PRIu64,
+                    this->write_length, this->write_offset);
+            }
+        }
 
-        remaining_number_of_bytes_to_write -= in_stream.in_remain();
-        current_offset                     += in_stream.in_remain();
+        const size_t number_of_bytes =
+            std::min<size_t>(in_stream.in_remain(), this->write_length - this->write_received);
+        if (!this->write_refused) {
+            this->write_data.insert(this->write_data.end(), in_stream.p, in_stream.p + number_of_bytes);
+        }
+        in_stream.in_skip_bytes(number_of_bytes);
+        this->write_received += number_of_bytes;
 
+        if (this->write_received < this->write_length) {
+            return;
+        }
 
-        if (!remaining_number_of_bytes_to_write) {
+        if (this->write_refused) {
+            // The data of the request is skipped.
             BStream out_stream(65536);
 
             this->MakeClientDriveIoResponse(
                 out_stream,
                 device_io_request,
-                "ManagedFile::ProcessServerDriveQueryInformationRequest",
-                0x00000000, // STATUS_SUCCESS
+                "ManagedFile::ProcessServerDriveWriteRequest",
+                0xC000000D, // STATUS_INVALID_PARAMETER
                 verbose);
 
-            out_stream.out_uint32_le(Length);   // Length(4)
-            out_stream.out_uint8(0);            // Padding(1), optional
+            out_stream.out_uint32_le(0);    // Length(4)
+            out_stream.out_uint8(0);        // Padding(1)
 
             out_stream.mark_end();
 
@@ -1496,6 +1486,13 @@ public:
                 out_flags, out_stream.get_data(), out_stream.size(), to_server_sender,
                 verbose);
         }
+        else {
+            // The completion is sent by FileSystemDriveManager::SendCompletedIO().
+            this->io_engine.write(this->fd, device_io_request.DeviceId(),
+                device_io_request.CompletionId(), this->write_offset,
+                std::move(this->write_data));
+            this->write_data = std::vector<uint8_t>();
+        }
     }
 
     virtual void ProcessServerDriveQueryDirectoryRequest(
@@ -1550,6 +1547,10 @@ class FileSystemDriveManager {
         managed_file_system_object_type;    // FileId, object.
     typedef std::vector<managed_file_system_object_type>
         managed_file_system_object_collection_type;
+
+    // Declared before the files, which wait for their requests when destroyed.
+    RdpdrDriveIOEngine io_engine;
+
     managed_file_system_object_collection_type managed_file_system_objects;
 
     uint32_t wab_agent_drive_id = INVALID_MANAGED_DRIVE_ID;
@@ -1701,6 +1702,19 @@ public:
         return false;
     }
 
+    // Readable when read or write requests are completed.
+    int GetIOCompletionFileDescriptor() const {
+        return this->io_engine.get_completion_fd();
+    }
+
+    bool HasPendingIO() const {
+        return this->io_engine.has_pending_io();
+    }
+
+    void SendCompletedIO(ToServerSender & to_server_sender, uint32_t verbose) {
+        this->io_engine.send_completions(to_server_sender, verbose);
+    }
+
 private:
     void ProcessServerCreateDriveRequest(
             rdpdr::DeviceIORequest const & device_io_request,
@@ -1747,7 +1761,7 @@ private:
             managed_file_system_object = std::make_unique<ManagedDirectory>();
         }
         else {
-            managed_file_system_object = std::make_unique<ManagedFile>();
+            managed_file_system_object = std::make_unique<ManagedFile>(this->io_engine);
         }
         bool drive_created = false;
         managed_file_system_object->ProcessServerCreateDriveRequest(
@@ -1803,6 +1817,13 @@ public:
                     device_io_request.FileId());
                 return;
             }
+
+            // Other requests (query information, truncation...) see the result of
+            //  the reads and writes received before them.
+            if ((device_io_request.MajorFunction() != rdpdr::IRP_MJ_READ) &&
+                (device_io_request.MajorFunction() != rdpdr::IRP_MJ_WRITE)) {
+                this->io_engine.wait_file(device_io_request.FileId());
+            }
         }
 
         switch (device_io_request.MajorFunction()) {
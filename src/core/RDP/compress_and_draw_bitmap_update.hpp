@@ -25,10 +25,11 @@
 #include "bitmapupdate.hpp"
 #include "RDPGraphicDevice.hpp"
 
+// bmp_stream is a buffer of 65535 bytes kept by the caller between calls
 inline
 void compress_and_draw_bitmap_update( const RDPBitmapData & bitmap_data, const Bitmap & bmp
-                                    , uint8_t target_bpp, RDPGraphicDevice & gd) {
-    BStream bmp_stream(65535);
+                                    , uint8_t target_bpp, RDPGraphicDevice & gd, BStream & bmp_stream) {
+    bmp_stream.reset();
     bmp.compress(target_bpp, bmp_stream);
     bmp_stream.mark_end();
 
@@ -41,4 +42,11 @@ void compress_and_draw_bitmap_update( const RDPBitmapData & bitmap_data, const B
     gd.draw(target_bitmap_data, bmp_stream.get_data(), bmp_stream.size(), bmp);
 }
 
+inline
+void compress_and_draw_bitmap_update( const RDPBitmapData & bitmap_data, const Bitmap & bmp
+                                    , uint8_t target_bpp, RDPGraphicDevice & gd) {
+    BStream bmp_stream(65535);
+    compress_and_draw_bitmap_update(bitmap_data, bmp, target_bpp, gd, bmp_stream);
+}
+
 #endif
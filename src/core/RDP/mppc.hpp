@@ -669,6 +669,43 @@ template<typename T> struct rdp_mppc_enc_hash_table_manager {
         this->hash_table[hash] = offset;
     }
 
+    /**
+     * Looks for the longest match of the data at offset in history, the
+     *  offsets covered by the match are signed as well.
+     *
+     * @param max_length   maximum length of match (at least
+     *                      length_of_data_to_sign)
+     * @param match_offset offset of the match in history
+     *
+     * @return             length of match, 0 if no match
+     */
+    inline unsigned find_match(const uint8_t * history, T offset, unsigned max_length, T & match_offset) {
+        const uint8_t * data           = history + offset;
+        hash_type       hash           = this->sign(data);
+        T               previous_match = this->get_offset(hash);
+
+        this->update(hash, offset);
+
+        // check that we have a pattern match, hash is not enough
+        if (0 != ::memcmp(data, history + previous_match, this->length_of_data_to_sign)) {
+            return 0;
+        }
+
+        // we have a match - compute hash and Length of Match for triplets
+        this->update_indirect(history, offset + 1);
+
+        unsigned length_of_match = this->length_of_data_to_sign;
+        for (; length_of_match < max_length; length_of_match++) {
+            this->update_indirect(history, offset + length_of_match - 1);
+            if (data[length_of_match] != history[previous_match + length_of_match]) {
+                break;
+            }
+        }
+
+        match_offset = previous_match;
+        return length_of_match;
+    }
+
     inline void reset() {
         ::memset(this->hash_table, 0, get_table_size());
 
@@ -692,6 +729,191 @@ template<typename T> struct rdp_mppc_enc_hash_table_manager {
 };
 
 
+// Same interface as rdp_mppc_enc_hash_table_manager, but each bucket is the
+//  head of a chain of offsets with the same hash: find_match() checks up to
+//  MaxChainLength candidates and keeps the longest match instead of the last
+//  one. The chain links are stored in a ring indexed by the low bits of the
+//  offset, older offsets of the history are only reachable through the bucket
+//  heads.
+template<typename T, unsigned MaxChainLength>
+struct rdp_mppc_enc_hash_chain_manager {
+    static const uint32_t MAX_HASH_TABLE_ELEMENT = 65536;
+    static const uint32_t CHAIN_LENGTH           = 65536;
+
+    typedef uint16_t hash_type;
+
+    T * hash_table;
+    T * chain;
+
+    const unsigned int length_of_data_to_sign;
+
+    // range of the offsets given to find_match() since clear_undo_history(),
+    //  the last offset of each match is in the range but is not signed
+    const uint8_t * undo_history;
+    T               undo_begin;
+    T               undo_end;
+    bool            undo_empty;
+
+    rdp_mppc_enc_hash_chain_manager(unsigned int length_of_data_to_sign, unsigned int /*max_undo_element*/)
+        : hash_table(static_cast<T *>(calloc(MAX_HASH_TABLE_ELEMENT, sizeof(T))))
+        , chain(static_cast<T *>(calloc(CHAIN_LENGTH, sizeof(T))))
+        , length_of_data_to_sign(length_of_data_to_sign)
+        , undo_history(nullptr)
+        , undo_begin(0)
+        , undo_end(0)
+        , undo_empty(true)
+    {}
+
+    ~rdp_mppc_enc_hash_chain_manager() {
+        free(this->hash_table);
+        free(this->chain);
+    }
+
+    inline void clear_undo_history() {
+        this->undo_empty = true;
+    }
+
+    void dump(bool mini_dump) const {
+        LOG(LOG_INFO, "Type=RDP X.X bulk compressor hash chain manager (chain length=%u)", MaxChainLength);
+        LOG(LOG_INFO, "hashTable");
+        hexdump_d(reinterpret_cast<const char *>(this->hash_table),
+            (mini_dump ? 16 : get_table_size()));
+    }
+
+    constexpr static size_t get_table_size() {
+        return MAX_HASH_TABLE_ELEMENT * sizeof(T);
+    }
+
+    // multiplicative hash of the first length_of_data_to_sign bytes, 4 bytes at a time
+    inline hash_type sign(const uint8_t * data) const {
+        uint64_t     h     = 0;
+        unsigned int index = 0;
+        for (; index + sizeof(uint32_t) <= this->length_of_data_to_sign; index += sizeof(uint32_t)) {
+            uint32_t w;
+            ::memcpy(&w, data + index, sizeof(w));
+            h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+        }
+        for (; index < this->length_of_data_to_sign; index++) {
+            h = (h ^ data[index]) * 0x9E3779B97F4A7C15ull;
+        }
+        return h >> 48;
+    }
+
+    inline void update_indirect(const uint8_t * data, T offset) {
+        this->update(data, this->sign(data + offset), offset);
+    }
+
+private:
+    inline void update(const uint8_t * data, hash_type hash, T offset) {
+        if (this->undo_empty) {
+            this->undo_history = data;
+            this->undo_begin   = offset;
+            this->undo_empty   = false;
+        }
+        this->undo_end = offset + 1;
+
+        this->chain[offset % CHAIN_LENGTH] = this->hash_table[hash];
+        this->hash_table[hash] = offset;
+    }
+
+public:
+
+    // number of identical bytes of a and b, at most max_length, compared by words
+    static inline unsigned match_length(const uint8_t * a, const uint8_t * b, unsigned max_length) {
+        unsigned length = 0;
+        for (; length + sizeof(uint64_t) <= max_length; length += sizeof(uint64_t)) {
+            uint64_t wa;
+            uint64_t wb;
+            ::memcpy(&wa, a + length, sizeof(wa));
+            ::memcpy(&wb, b + length, sizeof(wb));
+            if (wa != wb) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                return length + (__builtin_ctzll(wa ^ wb) >> 3);
+#else
+                return length + (__builtin_clzll(wa ^ wb) >> 3);
+#endif
+            }
+        }
+        for (; (length < max_length) && (a[length] == b[length]); length++) {
+        }
+        return length;
+    }
+
+    /**
+     * Looks for the longest match of the data at offset in history, the
+     *  offsets covered by the match are added as well.
+     *
+     * @param max_length   maximum length of match (at least
+     *                      length_of_data_to_sign)
+     * @param match_offset offset of the match in history
+     *
+     * @return             length of match, 0 if no match
+     */
+    inline unsigned find_match(const uint8_t * history, T offset, unsigned max_length, T & match_offset) {
+        const uint8_t * data            = history + offset;
+        const hash_type hash            = this->sign(data);
+        unsigned        length_of_match = this->length_of_data_to_sign - 1;
+        T               candidate       = this->hash_table[hash];
+
+        for (unsigned n = 0; (n < MaxChainLength) && (candidate < offset); n++) {
+            // a longer match must at least extend the current one
+            if (history[candidate + length_of_match] == data[length_of_match]) {
+                const unsigned length = match_length(data, history + candidate, max_length);
+                if (length > length_of_match) {
+                    length_of_match = length;
+                    match_offset    = candidate;
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+            }
+
+            const T next = this->chain[candidate % CHAIN_LENGTH];
+            if (next >= candidate) {
+                break;
+            }
+            candidate = next;
+        }
+
+        this->update(history, hash, offset);
+
+        if (length_of_match < this->length_of_data_to_sign) {
+            return 0;
+        }
+
+        // like rdp_mppc_enc_hash_table_manager, the last offset of the match is not signed
+        for (unsigned i = 1; i + 1 < length_of_match; i++) {
+            this->update_indirect(history, offset + i);
+        }
+        return length_of_match;
+    }
+
+    inline void reset() {
+        ::memset(this->hash_table, 0, get_table_size());
+        ::memset(this->chain, 0, CHAIN_LENGTH * sizeof(T));
+
+        this->undo_empty = true;
+    }
+
+    // The chain link of an offset holds the previous head of its bucket, the
+    //  changes can always be undone. Going backward, a signed offset is the
+    //  head of its bucket again when it is reached, an offset that was not
+    //  signed never is (offsets only grow until reset()) and is left alone.
+    inline bool undo_last_changes() {
+        if (!this->undo_empty) {
+            for (T offset = this->undo_end; offset != this->undo_begin; ) {
+                --offset;
+                T & head = this->hash_table[this->sign(this->undo_history + offset)];
+                if (head == offset) {
+                    head = this->chain[offset % CHAIN_LENGTH];
+                }
+            }
+            this->undo_empty = true;
+        }
+        return true;
+    }
+};
+
 static const size_t RDP_40_50_COMPRESSOR_MINIMUM_MATCH_LENGTH = 3;
 
 #endif  /* _REDEMPTION_CORE_RDP_MPPC_HPP_ */
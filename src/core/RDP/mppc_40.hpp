@@ -435,12 +435,12 @@ struct rdp_mppc_40_dec : public rdp_mppc_dec {
 };  // struct rdp_mppc_40_dec
 
 
-struct rdp_mppc_40_enc : public rdp_mppc_enc {
+template<class HashTableManager>
+struct basic_rdp_mppc_40_enc : public rdp_mppc_enc {
     static const size_t MAXIMUM_HASH_BUFFER_UNDO_ELEMENT = 256;
 
-    typedef uint16_t                                     offset_type;
-    typedef rdp_mppc_enc_hash_table_manager<offset_type> hash_table_manager;
-    typedef hash_table_manager::hash_type                hash_type;
+    typedef uint16_t         offset_type;
+    typedef HashTableManager hash_table_manager;
 
     TODO("making it static and large enough should be good for both RDP4 and RDP5")
     uint8_t    historyBuffer[RDP_40_HIST_BUF_LEN];       /* contains uncompressed data */
@@ -458,7 +458,7 @@ struct rdp_mppc_40_enc : public rdp_mppc_enc {
     /**
      * Initialize rdp_mppc_40_enc structure
      */
-    rdp_mppc_40_enc(uint32_t verbose = 0)
+    basic_rdp_mppc_40_enc(uint32_t verbose = 0)
         : rdp_mppc_enc(verbose)
         , historyBuffer{0}
         , outputBuffer(this->outputBufferPlus + 64)
@@ -475,7 +475,7 @@ struct rdp_mppc_40_enc : public rdp_mppc_enc {
     /**
      * Deinitialize rdp_mppc_40_enc structure
      */
-    virtual ~rdp_mppc_40_enc() {
+    virtual ~basic_rdp_mppc_40_enc() {
     }
 
     virtual void dump(bool mini_dump) const {
@@ -624,33 +624,18 @@ private:
             uint16_t lom = 0;
             for (; ctr + (RDP_40_50_COMPRESSOR_MINIMUM_MATCH_LENGTH - 1) < uncompressed_data_size;
                  ctr += lom) { // we need at least 3 bytes to look for match
-                offset_type     offset         = this->historyOffset + ctr;
-                const uint8_t * data           = this->historyBuffer + offset;
-                hash_type       hash           = this->hash_tab_mgr.sign(data);
-                offset_type     previous_match = this->hash_tab_mgr.get_offset(hash);
+                offset_type offset         = this->historyOffset + ctr;
+                offset_type previous_match = 0;
 
-                this->hash_tab_mgr.update(hash, offset);
-
-                /* check that we have a pattern match, hash is not enough */
-                if (0 != memcmp(data, this->historyBuffer + previous_match,
-                                RDP_40_50_COMPRESSOR_MINIMUM_MATCH_LENGTH)) {
+                lom = this->hash_tab_mgr.find_match(this->historyBuffer, offset,
+                                                    uncompressed_data_size - ctr, previous_match);
+                if (!lom) {
                     /* no match found; encode literal uint8_t */
-                    ::encode_literal_40_50(*data, this->outputBuffer, bits_left,
+                    ::encode_literal_40_50(this->historyBuffer[offset], this->outputBuffer, bits_left,
                                            opb_index, this->outputBufferSize);
                     lom = 1;
                 }
                 else {
-                    /* we have a match - compute hash and Length of Match for triplets */
-                    this->hash_tab_mgr.update_indirect(this->historyBuffer, offset + 1);
-
-                    for (lom = RDP_40_50_COMPRESSOR_MINIMUM_MATCH_LENGTH; ctr + lom < uncompressed_data_size; lom++) {
-                        this->hash_tab_mgr.update_indirect(this->historyBuffer, offset + lom - 1);
-                        if (this->historyBuffer[offset + lom] !=
-                            this->historyBuffer[previous_match + lom]) {
-                            break;
-                        }
-                    }
-
                     /* encode copy_offset and insert into output buffer */
                     offset_type copy_offset = this->historyOffset + ctr - previous_match;
                     const int nbbits[3]   = { 10, 12, 16 };
@@ -735,4 +720,9 @@ public:
     }
 };
 
+typedef basic_rdp_mppc_40_enc<rdp_mppc_enc_hash_table_manager<uint16_t>> rdp_mppc_40_enc;
+
+template<unsigned MaxChainLength>
+using rdp_mppc_40_enc_hash_chain = basic_rdp_mppc_40_enc<rdp_mppc_enc_hash_chain_manager<uint16_t, MaxChainLength>>;
+
 #endif  // #ifndef _REDEMPTION_CORE_RDP_MPPC_40_HPP_
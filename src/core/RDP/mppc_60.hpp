@@ -661,15 +661,15 @@ static inline void encode_literal_60(uint16_t c, uint8_t * outputBuffer,
         outputBuffer, bits_left, opb_index, verbose);
 }
 
-struct rdp_mppc_60_enc : public rdp_mppc_enc {
+template<class HashTableManager>
+struct basic_rdp_mppc_60_enc : public rdp_mppc_enc {
     static const size_t MINIMUM_MATCH_LENGTH             = 3;
     static const size_t MAXIMUM_MATCH_LENGTH             = 514;
     static const size_t MAXIMUM_HASH_BUFFER_UNDO_ELEMENT = 256;
     static const size_t CACHED_OFFSET_COUNT              = 4;
 
-    typedef uint16_t                                     offset_type;
-    typedef rdp_mppc_enc_hash_table_manager<offset_type> hash_table_manager;
-    typedef hash_table_manager::hash_type                hash_type;
+    typedef uint16_t         offset_type;
+    typedef HashTableManager hash_table_manager;
 
     // The shared state necessary to support the transmission and reception
     //     of RDP6.0-BC compressed data between a client and server requires
@@ -698,7 +698,7 @@ struct rdp_mppc_60_enc : public rdp_mppc_enc {
 
     hash_table_manager hash_tab_mgr;
 
-    rdp_mppc_60_enc(uint32_t verbose = 0)
+    basic_rdp_mppc_60_enc(uint32_t verbose = 0)
         : rdp_mppc_enc(verbose)
         // The HistoryOffset MUST start initialized to zero, while the
         //     history buffer MUST be filled with zeros. After it has been
@@ -716,7 +716,7 @@ struct rdp_mppc_60_enc : public rdp_mppc_enc {
         , hash_tab_mgr(MINIMUM_MATCH_LENGTH, MAXIMUM_HASH_BUFFER_UNDO_ELEMENT)
     {}
 
-    virtual ~rdp_mppc_60_enc()
+    virtual ~basic_rdp_mppc_60_enc()
     {}
 
     virtual void dump(bool mini_dump) const {
@@ -818,32 +818,18 @@ private:
         uint16_t lom = 0;
         // we need at least 3 bytes to look for match
         for (; ctr + (MINIMUM_MATCH_LENGTH - 1) < uncompressed_data_size; ctr += lom) {
-            offset_type     offset         = this->historyOffset + ctr;
-            const uint8_t * data           = this->historyBuffer + offset;
-            hash_type       hash           = this->hash_tab_mgr.sign(data);
-            offset_type     previous_match = this->hash_tab_mgr.get_offset(hash);
+            offset_type offset         = this->historyOffset + ctr;
+            offset_type previous_match = 0;
 
-            this->hash_tab_mgr.update(hash, offset);
-
-            // check that we have a pattern match, hash is not enough
-
-            if (0 != ::memcmp(data, this->historyBuffer + previous_match, MINIMUM_MATCH_LENGTH)) {
+            const unsigned max_length = uncompressed_data_size - ctr;
+            lom = this->hash_tab_mgr.find_match(this->historyBuffer, offset,
+                (max_length < MAXIMUM_MATCH_LENGTH) ? max_length : MAXIMUM_MATCH_LENGTH, previous_match);
+            if (!lom) {
                 // no match found; encode literal uint8_t
-                ::encode_literal_60(*data, this->outputBuffer, bits_left, opb_index, this->verbose);
+                ::encode_literal_60(this->historyBuffer[offset], this->outputBuffer, bits_left, opb_index, this->verbose);
                 lom = 1;
             }
             else {
-                // we have a match - compute hash and Length of Match for triplets
-                this->hash_tab_mgr.update_indirect(this->historyBuffer, offset + 1);
-
-                for (lom = MINIMUM_MATCH_LENGTH;
-                     (ctr + lom < uncompressed_data_size) && (lom < MAXIMUM_MATCH_LENGTH); lom++) {
-                    this->hash_tab_mgr.update_indirect(this->historyBuffer, offset + lom - 1);
-                    if (this->historyBuffer[offset + lom] !=
-                        this->historyBuffer[previous_match + lom]) {
-                        break;
-                    }
-                }
 
                 REDASSERT(!::memcmp(this->historyBuffer + previous_match, this->historyBuffer + offset, lom));
 
@@ -1008,7 +994,12 @@ public:
 
         stream.out_copy_bytes(this->outputBuffer, this->bytes_in_opb);
     }
-};  // struct rdp_mppc_60_enc
+};  // struct basic_rdp_mppc_60_enc
+
+typedef basic_rdp_mppc_60_enc<rdp_mppc_enc_hash_table_manager<uint16_t>> rdp_mppc_60_enc;
+
+template<unsigned MaxChainLength>
+using rdp_mppc_60_enc_hash_chain = basic_rdp_mppc_60_enc<rdp_mppc_enc_hash_chain_manager<uint16_t, MaxChainLength>>;
 
 #endif  // #ifndef _REDEMPTION_CORE_RDP_MPPC_60_HPP_
 
@@ -462,23 +462,23 @@ struct rdp_mppc_61_enc_sequential_search_match_finder : public rdp_mppc_enc_matc
     }
 };
 
-struct rdp_mppc_61_enc_hash_based_match_finder : public rdp_mppc_enc_match_finder
+template<class HashTableManager>
+struct basic_rdp_mppc_61_enc_hash_based_match_finder : public rdp_mppc_enc_match_finder
 {
     static const size_t MAXIMUM_HASH_BUFFER_UNDO_ELEMENT = 256;
 
-    typedef uint32_t                                     offset_type;
-    typedef rdp_mppc_enc_hash_table_manager<offset_type> hash_table_manager;
-    typedef hash_table_manager::hash_type                hash_type;
+    typedef uint32_t         offset_type;
+    typedef HashTableManager hash_table_manager;
 
     hash_table_manager hash_tab_mgr;
 
-    rdp_mppc_61_enc_hash_based_match_finder()
+    basic_rdp_mppc_61_enc_hash_based_match_finder()
         : rdp_mppc_enc_match_finder()
         , hash_tab_mgr(RDP_61_COMPRESSOR_MINIMUM_MATCH_LENGTH,
               MAXIMUM_HASH_BUFFER_UNDO_ELEMENT)
     {}
 
-    virtual ~rdp_mppc_61_enc_hash_based_match_finder() {
+    virtual ~basic_rdp_mppc_61_enc_hash_based_match_finder() {
     }
 
     virtual void dump(bool mini_dump) const  {
@@ -512,36 +512,18 @@ struct rdp_mppc_61_enc_hash_based_match_finder : public rdp_mppc_enc_match_finde
         //  (> sizeof(RDP61_MATCH_DETAILS) = RDP_61_COMPRESSOR_MINIMUM_MATCH_LENGTH - 1).
         for (; counter + (RDP_61_COMPRESSOR_MINIMUM_MATCH_LENGTH - 1) < uncompressed_data_size;
              counter += length_of_match) {
-            offset_type     offset         = historyOffset + counter;
-            const uint8_t * data           = historyBuffer + offset;
-            hash_type       hash           = this->hash_tab_mgr.sign(data);
-            offset_type     previous_match = this->hash_tab_mgr.get_offset(hash);
-
-            this->hash_tab_mgr.update(hash, offset);
-
-            // Check that we have a pattern match, hash is not enough.
-
-            if (0 != ::memcmp(data, historyBuffer + previous_match,
-                              RDP_61_COMPRESSOR_MINIMUM_MATCH_LENGTH)) {
+            offset_type offset         = historyOffset + counter;
+            offset_type previous_match = 0;
+
+            // Maximum LOM is RDP_61_MAX_DATA_BLOCK_SIZE bytes.
+            const unsigned max_length = uncompressed_data_size - counter;
+            length_of_match = this->hash_tab_mgr.find_match(historyBuffer, offset,
+                (max_length < RDP_61_MAX_DATA_BLOCK_SIZE) ? max_length : RDP_61_MAX_DATA_BLOCK_SIZE,
+                previous_match);
+            if (!length_of_match) {
                 length_of_match = 1;
             }
             else {
-                // We have a match, compute hash and Length of Match for triplets.
-                this->hash_tab_mgr.update_indirect(historyBuffer, offset + 1);
-
-                // Maximum LOM is RDP_61_MAX_DATA_BLOCK_SIZE bytes.
-                for (length_of_match = RDP_61_COMPRESSOR_MINIMUM_MATCH_LENGTH;
-                     (counter + length_of_match < uncompressed_data_size) &&
-                         (length_of_match < RDP_61_MAX_DATA_BLOCK_SIZE);
-                     length_of_match++) {
-                    this->hash_tab_mgr.update_indirect(historyBuffer, offset + length_of_match - 1);
-                    if (historyBuffer[offset + length_of_match] !=
-                        historyBuffer[previous_match + length_of_match])
-                    {
-                        break;
-                    }
-                }
-
                 this->match_details_stream.out_uint16_le(length_of_match);
                 this->match_details_stream.out_uint16_le(counter);
                 this->match_details_stream.out_uint32_le(previous_match);
@@ -561,6 +543,13 @@ public:
     }
 };
 
+typedef basic_rdp_mppc_61_enc_hash_based_match_finder<rdp_mppc_enc_hash_table_manager<uint32_t>>
+    rdp_mppc_61_enc_hash_based_match_finder;
+
+template<unsigned MaxChainLength>
+using rdp_mppc_61_enc_hash_chain_match_finder =
+    basic_rdp_mppc_61_enc_hash_based_match_finder<rdp_mppc_enc_hash_chain_manager<uint32_t, MaxChainLength>>;
+
 template<class MatchFinder>
 class rdp_mppc_61_enc : public rdp_mppc_enc {
     static_assert(
@@ -805,4 +794,7 @@ public:
 
 typedef rdp_mppc_61_enc<rdp_mppc_61_enc_hash_based_match_finder> rdp_mppc_61_enc_hash_based;
 
+template<unsigned MaxChainLength>
+using rdp_mppc_61_enc_hash_chain = rdp_mppc_61_enc<rdp_mppc_61_enc_hash_chain_match_finder<MaxChainLength>>;
+
 #endif  // #ifndef _REDEMPTION_CORE_RDP_MPPC_61_HPP_
@@ -600,6 +600,7 @@ public:
         BoolField disable_tsk_switch_shortcuts; // AUTHID_DISABLE_TSK_SWITCH_SHORTCUTS //
 
         int rdp_compression = 4; // 0 - Disabled, 1 - RDP 4.0, 2 - RDP 5.0, 3 - RDP 6.0, 4 - RDP 6.1
+        unsigned rdp_compression_effort = 0; // 0 - Hash table, 1 - Hash chain 4, 2 - Hash chain 16, 3 - Hash chain 64
 
         uint32_t max_color_depth = 24; // 8-bit, 15-bit, 16-bit, 24-bit, 32-bit (not yet supported) Default (24-bit)
 
@@ -686,6 +687,7 @@ public:
 
     struct Inifile_mod_replay {
         int on_end_of_data = 0; // 0 - Wait for Escape, 1 - End session
+        unsigned speed = 1;     // 1 - Real time, 2 to 32 - Faster (Up and Down arrows during the replay)
 
         Inifile_mod_replay() = default;
     } mod_replay;
@@ -712,6 +714,8 @@ public:
         unsigned frame_interval     = 40;   // time between 2 frame captures (in 1/100 seconds) (default: 2,5 frame per second)
         unsigned break_interval     = 600;  // time between 2 wrm movies (in seconds)
         unsigned png_limit          = 5;    // number of png captures to keep
+        unsigned png_compression_level = 6; // zlib level of png captures (0: none, 1: fastest, 9: smallest)
+        unsigned png_filter            = 0; // 0: adaptive, 1: none, 2: sub, 3: up, 4: average, 5: paeth
 
         uint64_t flv_break_interval = 0;  // time between 2 flv movies captures (in seconds)
 
@@ -763,6 +767,19 @@ public:
 
         unsigned wrm_compression_algorithm = 0; // 0: uncompressed, 1: GZip, 2: Snappy
 
+        // Format of the encrypted wrm and mwrm (1: AES-256-CBC, 2: AES-256-GCM) and block size
+        //  (in KiB, from 4 to 1024) of the version 2.
+        unsigned wrm_encryption_version    = 2;
+        unsigned wrm_encryption_block_size = 64;
+
+        // Memory (in KiB) of the drawing orders waiting for the capture worker thread
+        //  (0: the capture runs in the session thread).
+        unsigned capture_queue_size = 0;
+
+        // Color depth of the image drawn for the wrm and png captures (24 or 32). The captures
+        //  are 24-bit in both cases, 32-bit uses a third more memory but draws faster.
+        unsigned drawable_color_depth = 24;
+
         Inifile_video() = default;
     } video;
 
@@ -1324,6 +1341,11 @@ public:
                 else if (this->client.rdp_compression > 4)
                     this->client.rdp_compression = 4;
             }
+            else if (0 == strcmp(key, "rdp_compression_effort")) {
+                this->client.rdp_compression_effort = ulong_from_cstr(value);
+                if (this->client.rdp_compression_effort > 3)
+                    this->client.rdp_compression_effort = 3;
+            }
             else if (0 == strcmp(key, "disable_tsk_switch_shortcuts")) {
                 this->client.disable_tsk_switch_shortcuts.set_from_cstr(value);
             }
@@ -1442,6 +1464,9 @@ public:
             if (0 == strcmp(key, "on_end_of_data")) {
                 this->mod_replay.on_end_of_data = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "speed")) {
+                this->mod_replay.speed = ulong_from_cstr(value);
+            }
             else if (this->debug.config) {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
@@ -1482,6 +1507,12 @@ public:
             else if (0 == strcmp(key, "png_limit")) {
                 this->video.png_limit   = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "png_compression_level")) {
+                this->video.png_compression_level = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "png_filter")) {
+                this->video.png_filter = ulong_from_cstr(value);
+            }
             else if (0 == strcmp(key, "replay_path")) {
                 this->video.replay_path = value;
             }
@@ -1561,6 +1592,18 @@ public:
             else if (0 == strcmp(key, "wrm_compression_algorithm")) {
                 this->video.wrm_compression_algorithm = ulong_from_cstr(value);
             }
+            else if (0 == strcmp(key, "wrm_encryption_version")) {
+                this->video.wrm_encryption_version = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "wrm_encryption_block_size")) {
+                this->video.wrm_encryption_block_size = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "capture_queue_size")) {
+                this->video.capture_queue_size = ulong_from_cstr(value);
+            }
+            else if (0 == strcmp(key, "drawable_color_depth")) {
+                this->video.drawable_color_depth = ulong_from_cstr(value);
+            }
             else if (this->debug.config) {
                 LOG(LOG_ERR, "unknown parameter %s in section [%s]", key, context);
             }
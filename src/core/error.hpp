@@ -198,6 +198,8 @@ enum error_type {
     ERR_VNC_ZRLE_DATA_TRUNCATED,
     ERR_VNC_ZRLE_PROTOCOL,
     ERR_VNC_NEED_MORE_DATA,
+    ERR_VNC_TIGHT_PROTOCOL,
+    ERR_VNC_JPEG_DECOMPRESSION,
 
     ERR_XUP_BAD_BPP = 11000,
 
@@ -240,6 +242,7 @@ enum error_type {
     ERR_RECORDER_FILE_CRYPTED,
 
     ERR_RECORDER_SNAPSHOT_FAILED,
+    ERR_RECORDER_JOB_FAILED,
 
     ERR_BITMAP_LOAD_FAILED = 17000,
     ERR_BITMAP_LOAD_UNKNOWN_TYPE_FILE,
@@ -289,6 +292,7 @@ enum error_type {
 
     ERR_RDPDR_PDU_TRUNCATED = 22300,
     ERR_RDPDR_READ_REQUEST,
+    ERR_RDPDR_IO_ENGINE_FAILED,
 
     ERR_FSCC_DATA_TRUNCATED = 22400,
 
@@ -77,6 +77,15 @@ class FrontAPI : public DrawApi {
     virtual void session_update(const char * message) {}
 
     virtual bool disable_input_event_and_graphics_update(bool disable) { return false; }
+
+    ////////////////////////////////
+    // Bitmap update pass-through.
+
+    // Sends a compressed bitmap update from the server as is, without decoding
+    //  it. Returns false if the decoded bitmap is needed (color depth or codec
+    //  mismatch, capture in progress...), draw() must then be called instead.
+    virtual bool forward_bitmap_update(const RDPBitmapData & bitmap_data, const uint8_t * data
+                                      , std::size_t size) { return false; }
 };
 
 #endif
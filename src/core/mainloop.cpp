@@ -235,10 +235,20 @@ void redemption_new_session()
 
 }
 
-void redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, parameters_holder & parametersHldr)
+int redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, parameters_holder & parametersHldr)
 {
     init_signals();
 
+    if (ini.client.tls_support) {
+        // sessions inherit server TLS context (and its session ticket keys)
+        SSL_library_init();
+        SSL_load_error_strings();
+        if (!SocketTransport::server_tls_context(ini.globals.certificate_password)) {
+            LOG(LOG_ERR, "Failed to load server TLS context, exiting");
+            return 1;
+        }
+    }
+
     SessionServer ss(uid, gid, parametersHldr, ini.debug.config == Inifile::ENABLE_DEBUG_CONFIG);
     //    Inifile ini(CFG_PATH "/" RDPPROXY_INI);
     uint32_t s_addr = inet_addr(ini.globals.listen_address);
@@ -252,4 +262,5 @@ void redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, parameters_
                      , ini.globals.enable_ip_transparent
                      );
     listener.run();
+    return 0;
 }
@@ -28,7 +28,7 @@ class Inifile;
 class parameters_holder;
 
 int g_is_term(void);
-void redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, parameters_holder & parametersHldr);
+int redemption_main_loop(Inifile & ini, unsigned uid, unsigned gid, parameters_holder & parametersHldr);
 void redemption_new_session();
 
 #endif
@@ -46,6 +46,8 @@
 
 #include "config.hpp"
 #include "wait_obj.hpp"
+#include "epoll_reactor.hpp"
+#include "timer_wheel.hpp"
 #include "transport.hpp"
 #include "bitmap.hpp"
 
@@ -111,12 +113,12 @@ class Session {
         )
         {}
 
-        bool is_set(fd_set & rfds) {
-            return ::is_set(this->auth_event, &this->auth_trans, rfds);
+        bool is_set(EpollReactor & reactor, unsigned slot) {
+            return ::is_set(this->auth_event, reactor, slot);
         }
 
-        void add_to_fd_set(fd_set & rfds, unsigned & max, timeval & timeout) {
-            return ::add_to_fd_set(this->auth_event, &this->auth_trans, rfds, max, timeout);
+        void add_to_reactor(EpollReactor & reactor, unsigned slot, uint64_t generation, timeval & timeout) {
+            return ::add_to_reactor(this->auth_event, &this->auth_trans, reactor, slot, generation, timeout);
         }
     };
 
@@ -128,6 +130,30 @@ class Session {
 
     static const time_t select_timeout_tv_sec = 3;
 
+    // Upper bound of the wait when no timer is pending.
+    static const time_t select_timeout_max_tv_sec = 60 * 60;
+
+    // descriptors watched by the reactor, the slots without descriptor only
+    //  give the time of their wait_obj
+    enum {
+        SLOT_FRONT,
+        SLOT_CAPTURE,
+        SLOT_ACL,
+        SLOT_MOD,
+        SLOT_MOD_SECONDARY,
+        SLOT_ASYNCHRONOUS_TASK,
+        NB_SLOTS
+    };
+
+    // deadlines kept in the timer wheel
+    enum {
+        TIMER_ACL,              // keepalive, inactivity and end of session
+        TIMER_PAUSE_RECORD,
+        TIMER_OSD,
+        TIMER_PERFORMANCE_LOG,
+        NB_TIMERS
+    };
+
 public:
     Session(int sck, Inifile & ini)
             : ini(ini)
@@ -145,7 +171,7 @@ public:
 
             const bool mem3blt_support = true;
 
-            this->front = new Front( front_trans, SHARE_PATH "/" DEFAULT_FONT_NAME, this->gen
+            this->front = new Front( front_trans, this->gen
                                    , this->ini, this->ini.client.fast_path, mem3blt_support);
 
             ModuleManager mm(*this->front, this->ini);
@@ -163,8 +189,6 @@ public:
                 this->write_performance_log(start_time);
             }
 
-            const timeval time_mark = { this->select_timeout_tv_sec, 0 };
-
             bool run_session = true;
 
             constexpr std::array<unsigned, 4> timers{{ 30*60, 10*60, 5*60, 1*60, }};
@@ -173,49 +197,91 @@ public:
             unsigned osd_state = OSD_STATE_NOT_YET_COMPUTED;
             const bool enable_osd = this->ini.globals.enable_osd;
 
-            while (run_session) {
-                unsigned max = 0;
-                fd_set rfds;
-                fd_set wfds;
+            // The descriptors are registered once and stay registered while
+            //  they do not change, the deadlines are kept in a timer wheel.
+            EpollReactor reactor(NB_SLOTS);
+            TimerWheel   deadlines(NB_TIMERS, start_time);
+            uint64_t     acl_generation = 0;
 
-                FD_ZERO(&rfds);
-                FD_ZERO(&wfds);
-                timeval timeout = time_mark;
+            while (run_session) {
+                // No periodic wake up: sleep until the nearest deadline of
+                //  keepalive, inactivity, end of session, OSD or record pause.
+                //  A past deadline which did not change state is retried next second.
+                deadlines.rearm(TIMER_ACL, this->client ? this->client->acl.next_check_time() : 0);
+                deadlines.rearm(TIMER_PAUSE_RECORD,
+                    (this->ini.video.inactivity_pause && mm.connected && this->front->capture)
+                  ? pause_record.next_check_time() : 0);
+                {
+                    time_t osd_deadline = 0;
+                    if (enable_osd && (osd_state < OSD_STATE_INVALID)) {
+                        const uint32_t enddate = this->ini.context.end_date_cnx.get();
+                        if (enddate) {
+                            osd_deadline = enddate - timers[osd_state];
+                        }
+                    }
+                    deadlines.rearm(TIMER_OSD, osd_deadline);
+                }
+                deadlines.rearm(TIMER_PERFORMANCE_LOG,
+                    (this->ini.debug.performance & 0x8000)
+                  ? this->perf_last_info_collect_time + this->select_timeout_tv_sec : 0);
+
+                timeval timeout = { this->select_timeout_max_tv_sec, 0 };
+                if (const time_t next_expiry = deadlines.next_expiry()) {
+                    const timeval alarm = { next_expiry, 0 };
+                    const timeval remain = how_long_to_wait(alarm, tvtime());
+                    if (lessthantimeval(remain, timeout)) {
+                        timeout = remain;
+                    }
+                }
 
-                add_to_fd_set(front_event, &front_trans, rfds, max, timeout);
+                add_to_reactor(front_event, &front_trans, reactor, SLOT_FRONT, 0, timeout);
                 if (this->front->capture) {
-                    add_to_fd_set(this->front->capture->capture_event, nullptr, rfds, max, timeout);
+                    add_to_reactor(this->front->capture->capture_event, -1, reactor, SLOT_CAPTURE, 0, timeout);
                 }
                 if (this->client) {
-                    this->client->add_to_fd_set(rfds, max, timeout);
+                    this->client->add_to_reactor(reactor, SLOT_ACL, acl_generation, timeout);
+                }
+                else {
+                    reactor.watch(SLOT_ACL, -1);
                 }
-                add_to_fd_set(mm.mod->get_event(), mm.mod_transport, rfds, max, timeout);
+                const uint64_t mod_transport_generation = mm.mod_transport_generation;
+                add_to_reactor(mm.mod->get_event(), mm.mod_transport, reactor, SLOT_MOD,
+                               mod_transport_generation, timeout);
                 wait_obj * secondary_event = mm.mod->get_secondary_event();
                 if (secondary_event) {
-                    add_to_fd_set(*secondary_event, -1, rfds, max, timeout);
+                    add_to_reactor(*secondary_event, -1, reactor, SLOT_MOD_SECONDARY, 0, timeout);
                 }
 
                 int        asynchronous_task_fd    = -1;
                 wait_obj * asynchronous_task_event = mm.mod->get_asynchronous_task_event(asynchronous_task_fd);
                 if (asynchronous_task_event) {
-                    add_to_fd_set(*asynchronous_task_event, asynchronous_task_fd, rfds, max, timeout);
+                    add_to_reactor(*asynchronous_task_event, asynchronous_task_fd, reactor,
+                                   SLOT_ASYNCHRONOUS_TASK, mod_transport_generation, timeout);
+                }
+                else {
+                    reactor.watch(SLOT_ASYNCHRONOUS_TASK, -1);
                 }
 
-                const bool has_pending_data = (front_trans.tls && SSL_pending(front_trans.allocated_ssl));
-                if (has_pending_data)
+                // the data buffered by OpenSSL do not wake up the reactor
+                const bool front_has_pending_data = (front_trans.tls && SSL_pending(front_trans.allocated_ssl));
+                const bool mod_has_pending_data = (mm.mod_transport && mm.mod_transport->tls
+                                                && mm.mod->is_reading_rdp_pdus()
+                                                && SSL_pending(mm.mod_transport->allocated_ssl));
+                if (front_has_pending_data || mod_has_pending_data) {
                     memset(&timeout, 0, sizeof(timeout));
+                }
 
-
-                int num = select(max + 1, &rfds, &wfds, nullptr, &timeout);
+                // rounded up, an early wake up would find nothing to do
+                const int timeout_ms = timeout.tv_sec * 1000 + (timeout.tv_usec + 999) / 1000;
+                int num = reactor.wait(timeout_ms);
 
                 if (num < 0) {
                     if (errno == EINTR) {
                         continue;
                     }
-                    // Cope with EBADF, EINVAL, ENOMEM : none of these should ever happen
-                    // EBADF: means fd has been closed (by me) or as already returned an error on another call
-                    // EINVAL: invalid value in timeout (my fault again)
-                    // ENOMEM: no enough memory in kernel (unlikely fort 3 sockets)
+                    // Cope with EBADF, EFAULT, EINVAL : none of these should ever happen
+                    // EBADF, EINVAL: the epoll descriptor is not valid (my fault)
+                    // EFAULT: the events buffer is not writable (my fault again)
 
                     LOG(LOG_ERR, "Proxy data wait loop raised error %u : %s", errno, strerror(errno));
                     run_session = false;
@@ -223,13 +289,19 @@ public:
                 }
 
                 time_t now = time(nullptr);
-                if (this->ini.debug.performance & 0x8000) {
-                    this->write_performance_log(now);
-                }
+                deadlines.advance(now, [&](unsigned timer) {
+                    if (timer == TIMER_PERFORMANCE_LOG) {
+                        this->write_performance_log(now);
+                    }
+                });
 
-                if (is_set(front_event, &front_trans, rfds) || (front_trans.tls && SSL_pending(front_trans.allocated_ssl))) {
+                if (is_set(front_event, reactor, SLOT_FRONT) || front_has_pending_data) {
                     try {
-                        this->front->incoming(*mm.mod);
+                        // a PDU is processed once whole, the session does not
+                        //  wait inside incoming() for the rest of it
+                        if (front_trans.gather_pdu()) {
+                            this->front->incoming(*mm.mod);
+                        }
                     } catch (Error & e) {
                         if (e.id != ERR_TRANSPORT_NO_MORE_DATA) {
                             // Can be caused by wabwatchdog.
@@ -261,8 +333,8 @@ public:
                                    asynchronous_task_event = mm.mod->get_asynchronous_task_event(asynchronous_task_fd);
                         const bool asynchronous_task_event_is_set = (asynchronous_task_event &&
                                                                      is_set(*asynchronous_task_event,
-                                                                            asynchronous_task_fd,
-                                                                            rfds));
+                                                                            reactor,
+                                                                            SLOT_ASYNCHRONOUS_TASK));
                         if (asynchronous_task_event_is_set) {
                             mm.mod->process_asynchronous_task();
                         }
@@ -270,9 +342,15 @@ public:
                         // Process incoming module trafic
                                    secondary_event        = mm.mod->get_secondary_event();
                         const bool secondary_event_is_set = (secondary_event &&
-                                                             is_set(*secondary_event, nullptr, rfds));
-                        if (is_set(mm.mod->get_event(), mm.mod_transport, rfds) ||
-                            secondary_event_is_set) {
+                                                             is_set(*secondary_event, reactor, SLOT_MOD_SECONDARY));
+                        // the readiness of the previous module socket says nothing of a new one
+                        bool mod_event_is_set = (mod_transport_generation == mm.mod_transport_generation)
+                                             && (is_set(mm.mod->get_event(), reactor, SLOT_MOD) || mod_has_pending_data);
+                        if (mod_event_is_set && !mm.mod->get_event().waked_up_by_time && !secondary_event_is_set
+                         && mm.mod_transport && mm.mod->is_reading_rdp_pdus()) {
+                            mod_event_is_set = mm.mod_transport->gather_pdu();
+                        }
+                        if (mod_event_is_set || secondary_event_is_set) {
                             mm.mod->draw_event(now);
 
                             if (mm.mod->get_event().signal != BACK_EVENT_NONE) {
@@ -280,7 +358,7 @@ public:
                                 mm.mod->get_event().reset();
                             }
                         }
-                        if (this->front->capture && is_set(this->front->capture->capture_event, nullptr, rfds)) {
+                        if (this->front->capture && is_set(this->front->capture->capture_event, reactor, SLOT_CAPTURE)) {
                             this->front->periodic_snapshot();
                         }
                         // Incoming data from ACL, or opening acl
@@ -300,6 +378,7 @@ public:
                                     }
 
                                     this->client = new Client(client_sck, ini, *this->front, start_time, now);
+                                    ++acl_generation;
                                     signal = BACK_EVENT_NEXT;
                                 }
                                 catch (...) {
@@ -308,7 +387,7 @@ public:
                             }
                         }
                         else {
-                            if (this->client->is_set(rfds)) {
+                            if (this->client->is_set(reactor, SLOT_ACL)) {
                                 // acl received updated values
                                 this->client->acl.receive();
                             }
@@ -434,7 +513,8 @@ private:
                 "time_t;"
                 "ru_utime.tv_sec;ru_utime.tv_usec;ru_stime.tv_sec;ru_stime.tv_usec;"
                 "ru_maxrss;ru_ixrss;ru_idrss;ru_isrss;ru_minflt;ru_majflt;ru_nswap;"
-                "ru_inblock;ru_oublock;ru_msgsnd;ru_msgrcv;ru_nsignals;ru_nvcsw;ru_nivcsw\n");
+                "ru_inblock;ru_oublock;ru_msgsnd;ru_msgrcv;ru_nsignals;ru_nvcsw;ru_nivcsw;"
+                "stream_alloc;stream_reused;stream_heap_alloc;stream_heap_release;stream_free_bytes\n");
 
         }
         else if (this->perf_last_info_collect_time + this->select_timeout_tv_sec > now) {
@@ -445,6 +525,9 @@ private:
 
         getrusage(RUSAGE_SELF, &resource_usage);
 
+        const aux_::StreamBufferAlloc::Counters stream_counters
+          = aux_::stream_buffer_allocator().get_counters();
+
         do {
             this->perf_last_info_collect_time += this->select_timeout_tv_sec;
 
@@ -455,7 +538,8 @@ private:
             ::fprintf(
                   this->perf_file
                 , "%lu;"
-                  "%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu\n"
+                  "%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;%lu;"
+                  "%llu;%llu;%llu;%llu;%llu\n"
                 , now
                 , resource_usage.ru_utime.tv_sec, resource_usage.ru_utime.tv_usec   /* user CPU time used               */
                 , resource_usage.ru_stime.tv_sec, resource_usage.ru_stime.tv_usec   /* system CPU time used             */
@@ -473,6 +557,11 @@ private:
                 , resource_usage.ru_nsignals                                        /* signals received                 */
                 , resource_usage.ru_nvcsw                                           /* voluntary context switches       */
                 , resource_usage.ru_nivcsw                                          /* involuntary context switches     */
+                , static_cast<unsigned long long>(stream_counters.allocations)      /* stream buffers given             */
+                , static_cast<unsigned long long>(stream_counters.reused)           /* ... taken from a free list       */
+                , static_cast<unsigned long long>(stream_counters.heap_allocations) /* ... allocated on the heap        */
+                , static_cast<unsigned long long>(stream_counters.heap_releases)    /* stream buffers freed             */
+                , static_cast<unsigned long long>(stream_counters.free_bytes)       /* bytes kept in the free lists     */
             );
             ::fflush(this->perf_file);
         }
@@ -21,6 +21,10 @@
 #ifndef _REDEMPTION_CORE_SESSION_SERVER_HPP_
 #define _REDEMPTION_CORE_SESSION_SERVER_HPP_
 
+#include <sys/stat.h>
+
+#include <memory>
+
 #include "config.hpp"
 #include "server.hpp"
 #include "session.hpp"
@@ -36,12 +40,52 @@ class SessionServer : public Server
 
     parameters_holder & parametersHldr;
 
+    // Configuration (and font) loaded by the listening process, inherited
+    // copy on write by the sessions it forks instead of loaded by each one.
+    std::unique_ptr<Inifile> ini;
+    struct timespec ini_mtime;
+
+    // Returns the loaded configuration, loaded again only when rdpproxy.ini
+    // was changed.
+    Inifile & loaded_config()
+    {
+        struct stat st;
+        struct timespec mtime = {0, 0};
+        if (0 == stat(CFG_PATH "/" RDPPROXY_INI, &st)) {
+            mtime = st.st_mtim;
+        }
+        if (!this->ini
+         || (mtime.tv_sec != this->ini_mtime.tv_sec)
+         || (mtime.tv_nsec != this->ini_mtime.tv_nsec)) {
+            // old font released before the new one is loaded
+            this->ini.reset();
+            this->ini.reset(new Inifile);
+
+            Inifile & ini = *this->ini;
+            ini.debug.config = this->debug_config;
+            ConfigurationLoader cfg_loader(ini, CFG_PATH "/" RDPPROXY_INI);
+
+            if (ini.globals.wab_agent_alternate_shell.empty()) {
+                ini.globals.wab_agent_alternate_shell =
+                    this->parametersHldr.get_agent_alternate_shell();
+            }
+
+            ini.crypto.key0.setmem(this->parametersHldr.get_crypto_key_0());
+            ini.crypto.key1.setmem(this->parametersHldr.get_crypto_key_1());
+
+            this->ini_mtime = mtime;
+        }
+        return *this->ini;
+    }
+
 public:
     SessionServer(unsigned uid, unsigned gid, parameters_holder & parametersHldr, bool debug_config = true)
         : uid(uid)
         , gid(gid)
         , debug_config(debug_config)
         , parametersHldr(parametersHldr) {
+        this->ini_mtime.tv_sec  = 0;
+        this->ini_mtime.tv_nsec = 0;
     }
 
     virtual Server_status start(int incoming_sck)
@@ -65,6 +109,7 @@ public:
         char source_ip[256];
         strcpy(source_ip, inet_ntoa(u.s4.sin_addr));
         const int source_port = ntohs(u.s4.sin_port);
+        Inifile & loaded_ini = this->loaded_config();
         /* start new process */
         const pid_t pid = fork();
         switch (pid) {
@@ -72,17 +117,8 @@ public:
             {
                 close(incoming_sck);
 
-                Inifile ini;
-                ini.debug.config = this->debug_config;
-                ConfigurationLoader cfg_loader(ini, CFG_PATH "/" RDPPROXY_INI);
-
-                if (ini.globals.wab_agent_alternate_shell.empty()) {
-                    ini.globals.wab_agent_alternate_shell =
-                        this->parametersHldr.get_agent_alternate_shell();
-                }
-
-                ini.crypto.key0.setmem(this->parametersHldr.get_crypto_key_0());
-                ini.crypto.key1.setmem(this->parametersHldr.get_crypto_key_1());
+                // the copy of the configuration of this process
+                Inifile & ini = loaded_ini;
 
                 if (ini.debug.session){
                     LOG(LOG_INFO, "Setting new session socket to %d\n", sck);
@@ -124,6 +124,7 @@ private:
     struct Graphics
     {
         BmpCache bmp_cache;
+        std::unique_ptr<BmpCacheStore> bmp_cache_store;
         BmpCachePersister * bmp_cache_persister;
         BrushCache brush_cache;
         PointerCache pointer_cache;
@@ -170,38 +171,23 @@ private:
               , client_info.cache5_persistent),
             ini.debug.cache
           )
-        , bmp_cache_persister([&ini, verbose, this]() {
-            BmpCachePersister * bmp_cache_persister = nullptr;
+        , bmp_cache_store([&ini, verbose, this]() {
+            std::unique_ptr<BmpCacheStore> bmp_cache_store;
 
+            // The bitmaps of the Persistent Key List PDUs are taken from the store
+            //  shared by all the sessions.
             if (ini.client.persistent_disk_bitmap_cache &&
                 ini.client.persist_bitmap_cache_on_disk &&
                 bmp_cache.has_cache_persistent()) {
-                // Generates the name of file.
-                char cache_filename[2048];
-                ::snprintf(cache_filename, sizeof(cache_filename) - 1, "%s/PDBC-%s-%d",
-                    PERSISTENT_PATH "/client", ini.globals.host.get_cstr(), this->bmp_cache.bpp);
-                cache_filename[sizeof(cache_filename) - 1] = '\0';
-
-                int fd = ::open(cache_filename, O_RDONLY);
-                if (fd != -1) {
-                    try {
-                        InFileTransport ift(fd);
-
-                        bmp_cache_persister = new BmpCachePersister(
-                            this->bmp_cache, ift, cache_filename, verbose
-                        );
-                    }
-                    catch (const Error & e) {
-                        ::close(fd);
-                        if (e.id != ERR_PDBC_LOAD) {
-                            throw;
-                        }
-                    }
-                }
+                bmp_cache_store = BmpCacheStore::open_store(
+                    PERSISTENT_PATH "/client", this->bmp_cache.bpp, verbose);
             }
 
-            return bmp_cache_persister;
+            return bmp_cache_store;
         }())
+        , bmp_cache_persister(this->bmp_cache_store
+            ? new BmpCachePersister(this->bmp_cache, *this->bmp_cache_store, verbose)
+            : nullptr)
         , pointer_cache(client_info.pointer_cache_entries)
         , glyph_cache(client_info.number_of_entries_in_glyph_cache)
         , graphics_update_pdu(
@@ -272,10 +258,11 @@ private:
         void clear_bmp_cache_persister() {
             delete this->p->bmp_cache_persister;
             this->p->bmp_cache_persister = nullptr;
+            this->p->bmp_cache_store.reset();
         }
 
-        bool has_bmp_cache_persister() const {
-            return this->p && this->p->bmp_cache_persister;
+        bool has_persistent_bmp_cache() const {
+            return this->p && this->p->bmp_cache.has_cache_persistent();
         }
 
         BmpCachePersister * bmp_cache_persister() const
@@ -326,7 +313,6 @@ private:
     Inifile & ini;
     uint32_t verbose;
 
-    Font font;
 
     bool palette_sent;
     bool palette_memblt_sent[6];
@@ -378,13 +364,15 @@ private:
 
     size_t max_bitmap_size = 1024 * 64;
 
+    // reused by every bitmap update compressed for the client or the capture
+    BStream compressed_bitmap_stream {65535};
+
     bool focus_on_password_textbox = false;
 
     bool input_event_and_graphics_update_disabled = false;
 
 public:
     Front ( Transport & trans
-          , const char * default_font_name // SHARE_PATH "/" DEFAULT_FONT_NAME
           , Random & gen
           , Inifile & ini
           , bool fp_support // If true, fast-path must be supported
@@ -403,7 +391,6 @@ public:
     , order_level(0)
     , ini(ini)
     , verbose(this->ini.debug.front)
-    , font(default_font_name)
     , mod_bpp(0)
     , capture_bpp(0)
     , state(CONNECTION_INITIATION)
@@ -487,7 +474,7 @@ public:
         ERR_free_strings();
         delete this->mppc_enc;
 
-        if (this->orders.has_bmp_cache_persister()) {
+        if (this->orders.has_persistent_bmp_cache()) {
             this->save_persistent_disk_bitmap_cache();
         }
 
@@ -736,58 +723,25 @@ public:
         if (!this->ini.client.persistent_disk_bitmap_cache || !this->ini.client.persist_bitmap_cache_on_disk)
             return;
 
-        const char * persistent_path = PERSISTENT_PATH "/client";
-
-        // Ensures that the directory exists.
-        if (::recursive_create_directory(persistent_path, S_IRWXU | S_IRWXG, 0) != 0) {
-            LOG( LOG_ERR
-               , "front::save_persistent_disk_bitmap_cache: failed to create directory \"%s\"."
-               , persistent_path);
-            throw Error(ERR_BITMAP_CACHE_PERSISTENT, 0);
+        std::unique_ptr<BmpCacheStore> store = BmpCacheStore::open_store(
+            PERSISTENT_PATH "/client", this->orders.bpp(), this->verbose);
+        if (store) {
+            store->append(this->orders.p->bmp_cache);
         }
+    }
 
-        // Generates the name of file.
-        char filename[2048];
-        ::snprintf(filename, sizeof(filename) - 1, "%s/PDBC-%s-%d",
-            persistent_path, this->ini.globals.host.get_cstr(), this->orders.bpp());
-        filename[sizeof(filename) - 1] = '\0';
-
-        char filename_temporary[2048];
-        ::snprintf(filename_temporary, sizeof(filename_temporary) - 1, "%s/PDBC-%s-%d-XXXXXX.tmp",
-            persistent_path, this->ini.globals.host.get_cstr(), this->orders.bpp());
-        filename_temporary[sizeof(filename_temporary) - 1] = '\0';
-
-        int fd = ::mkostemps(filename_temporary, 4, O_CREAT | O_WRONLY);
-        if (fd == -1) {
-            LOG( LOG_ERR
-               , "front::save_persistent_disk_bitmap_cache: "
-                 "failed to open (temporary) file for writing. filename=\"%s\""
-               , filename_temporary);
-            throw Error(ERR_PDBC_SAVE);
-        }
-
-        try {
-            OutFileTransport oft(fd);
-
-            BmpCachePersister::save_all_to_disk(this->orders.p->bmp_cache, oft, this->verbose);
-
-            ::close(fd);
-
-            if (::rename(filename_temporary, filename) == -1) {
-                LOG( LOG_WARNING
-                   , "front::save_persistent_disk_bitmap_cache: failed to rename the (temporary) file. "
-                     "old_filename=\"%s\" new_filename=\"%s\""
-                   , filename_temporary, filename);
-                ::unlink(filename_temporary);
-            }
-        }
-        catch (...) {
-            ::close(fd);
-            ::unlink(filename_temporary);
+private:
+    // effort: 0 - hash table (historical match finder), 1..3 - hash chain of 4, 16 or 64 candidates
+    template<class HashTableEncoder, template<unsigned> class HashChainEncoder>
+    static rdp_mppc_enc * new_mppc_enc(unsigned effort, uint32_t verbose) {
+        switch (effort) {
+        case 0:  return new HashTableEncoder(verbose);
+        case 1:  return new HashChainEncoder<4>(verbose);
+        case 2:  return new HashChainEncoder<16>(verbose);
+        default: return new HashChainEncoder<64>(verbose);
         }
     }
 
-private:
     void reset() {
         if (this->verbose & 1) {
             LOG(LOG_INFO, "Front::reset::use_bitmap_comp=%u", this->ini.client.bitmap_compression ? 1 : 0);
@@ -809,30 +763,34 @@ private:
                 LOG(LOG_INFO, "Front: Use RDP 6.1 Bulk compression");
             }
             //this->mppc_enc_match_finder = new rdp_mppc_61_enc_sequential_search_match_finder();
-            this->mppc_enc = new rdp_mppc_61_enc_hash_based(this->ini.debug.compression);
+            this->mppc_enc = Front::new_mppc_enc<rdp_mppc_61_enc_hash_based, rdp_mppc_61_enc_hash_chain>(
+                this->ini.client.rdp_compression_effort, this->ini.debug.compression);
             break;
         case PACKET_COMPR_TYPE_RDP6:
             if (this->verbose & 1) {
                 LOG(LOG_INFO, "Front: Use RDP 6.0 Bulk compression");
             }
-            this->mppc_enc = new rdp_mppc_60_enc(this->ini.debug.compression);
+            this->mppc_enc = Front::new_mppc_enc<rdp_mppc_60_enc, rdp_mppc_60_enc_hash_chain>(
+                this->ini.client.rdp_compression_effort, this->ini.debug.compression);
             break;
         case PACKET_COMPR_TYPE_64K:
             if (this->verbose & 1) {
                 LOG(LOG_INFO, "Front: Use RDP 5.0 Bulk compression");
             }
-            this->mppc_enc = new rdp_mppc_50_enc(this->ini.debug.compression);
+            this->mppc_enc = Front::new_mppc_enc<rdp_mppc_50_enc, rdp_mppc_50_enc_hash_chain>(
+                this->ini.client.rdp_compression_effort, this->ini.debug.compression);
             break;
         case PACKET_COMPR_TYPE_8K:
             if (this->verbose & 1) {
                 LOG(LOG_INFO, "Front: Use RDP 4.0 Bulk compression");
             }
-            this->mppc_enc = new rdp_mppc_40_enc(this->ini.debug.compression);
+            this->mppc_enc = Front::new_mppc_enc<rdp_mppc_40_enc, rdp_mppc_40_enc_hash_chain>(
+                this->ini.client.rdp_compression_effort, this->ini.debug.compression);
             this->max_bitmap_size = 1024 * 8;
             break;
         }
 
-        if (this->orders.has_bmp_cache_persister()) {
+        if (this->orders.has_persistent_bmp_cache()) {
             this->save_persistent_disk_bitmap_cache();
         }
         this->orders.initialize(
@@ -2431,22 +2389,30 @@ public:
     }
 
     virtual void send_fastpath_data(InStream & data) {
-        HStream stream(1024, 1024 + 65536);
-
-        stream.out_copy_bytes(data.get_data(), data.size());
-        stream.mark_end();
-
         if (this->verbose & 4) {
             LOG(LOG_INFO, "Front::send_data: fast-path");
         }
 
         BStream fastpath_header(256);
 
+        // without encryption the data is sent as is after the header
+        if (this->encryptionLevel <= 1) {
+            SubStream stream(data);
+            FastPath::ServerUpdatePDU_Send SvrUpdPDU(fastpath_header, stream, 0, this->encrypt);
+            this->trans.send(fastpath_header, stream);
+            return;
+        }
+
+        // encrypted in place
+        HStream stream(1024, 1024 + 65536);
+
+        stream.out_copy_bytes(data.get_data(), data.size());
+        stream.mark_end();
+
         FastPath::ServerUpdatePDU_Send SvrUpdPDU(
             fastpath_header,
             stream,
-            ((this->encryptionLevel > 1) ?
-             FastPath::FASTPATH_OUTPUT_ENCRYPTED : 0),
+            FastPath::FASTPATH_OUTPUT_ENCRYPTED,
             this->encrypt);
         this->trans.send(fastpath_header, stream);
     }
@@ -4612,6 +4578,42 @@ public:
         order_caps.orderSupportExFlags &= this->client_order_caps.orderSupportExFlags;
     }
 
+private:
+    // Server compressed data can be sent unchanged to the client.
+    bool is_bitmap_update_pass_through(const RDPBitmapData & bitmap_data) const {
+        return this->ini.globals.enable_bitmap_update
+            && (bitmap_data.flags & BITMAP_COMPRESSION)
+            && (bitmap_data.bits_per_pixel == this->client_info.bpp)
+            && (bitmap_data.bitmap_size() <= this->max_bitmap_size);
+    }
+
+    void send_compressed_bitmap_update(const RDPBitmapData & bitmap_data, const uint8_t * data
+                                      , size_t size) {
+        // Same header as compress_and_draw_bitmap_update() would produce.
+        RDPBitmapData target_bitmap_data = bitmap_data;
+
+        target_bitmap_data.flags         = BITMAP_COMPRESSION | NO_BITMAP_COMPRESSION_HDR;
+        target_bitmap_data.bitmap_length = size;
+
+        this->orders.p->graphics_update_pdu.draw_bitmap_data(target_bitmap_data, data, size);
+    }
+
+public:
+    virtual bool forward_bitmap_update(const RDPBitmapData & bitmap_data, const uint8_t * data
+                                      , size_t size) override {
+        if (   !this->is_bitmap_update_pass_through(bitmap_data)
+            // Capture needs the decoded bitmap.
+            || (this->capture && (this->capture_state == CAPTURE_STATE_STARTED))) {
+            return false;
+        }
+
+        if (!this->input_event_and_graphics_update_disabled) {
+            this->send_compressed_bitmap_update(bitmap_data, data, size);
+        }
+
+        return true;
+    }
+
     virtual void draw(const RDPBitmapData & bitmap_data, const uint8_t * data
                      , size_t size, const Bitmap & bmp) {
         //LOG(LOG_INFO, "Front::draw(BitmapUpdate)");
@@ -4632,10 +4634,16 @@ public:
         }
 
         if (!this->input_event_and_graphics_update_disabled) {
-            ::compress_and_draw_bitmap_update(bitmap_data,
-                                              Bitmap(this->client_info.bpp, bmp),
-                                              this->client_info.bpp,
-                                              this->orders.p->graphics_update_pdu);
+            if (this->is_bitmap_update_pass_through(bitmap_data)) {
+                this->send_compressed_bitmap_update(bitmap_data, data, size);
+            }
+            else {
+                ::compress_and_draw_bitmap_update(bitmap_data,
+                                                  Bitmap(this->client_info.bpp, bmp),
+                                                  this->client_info.bpp,
+                                                  this->orders.p->graphics_update_pdu,
+                                                  this->compressed_bitmap_stream);
+            }
         }
         //bitmap_data.log(LOG_INFO, "Front");
         //hexdump_d(data, size);
@@ -4644,11 +4652,13 @@ public:
             if ((bmp.bpp() > this->capture_bpp) || (bmp.bpp() == 8)) {
                 Bitmap capture_bmp(this->capture_bpp, bmp);
 
-                ::compress_and_draw_bitmap_update(bitmap_data, capture_bmp, this->capture_bpp, *this->capture);
+                ::compress_and_draw_bitmap_update(bitmap_data, capture_bmp, this->capture_bpp, *this->capture
+                                                  , this->compressed_bitmap_stream);
             }
             else {
                 if (!(bitmap_data.flags & BITMAP_COMPRESSION)) {
-                    ::compress_and_draw_bitmap_update(bitmap_data, bmp, this->capture_bpp, *this->capture);
+                    ::compress_and_draw_bitmap_update(bitmap_data, bmp, this->capture_bpp, *this->capture
+                                                      , this->compressed_bitmap_stream);
                 }
                 else {
                     this->capture->draw(bitmap_data, data, size, bmp);
@@ -0,0 +1,173 @@
+/* Bulk compression benchmark
+   Compresses recorded PDU streams with each RDP bulk compressor and match finder,
+   checks the result with the decompressor and prints compression ratio and speed.
+
+   Input files are WRM movies (one packet per chunk) or any other file (cut in
+   packets of the given size). Packets larger than the size are split.
+
+   usage: mppc_benchmark [-s packet_size] file...
+*/
+
+#define LOGNULL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <memory>
+#include <vector>
+
+#include "RDP/mppc_unified_dec.hpp"
+
+typedef std::vector<std::vector<uint8_t>> Packets;
+
+static void load_packets(const char * filename, size_t packet_size, Packets & packets)
+{
+    FILE * f = fopen(filename, "rb");
+    if (!f) {
+        perror(filename);
+        exit(1);
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    auto add = [&](const uint8_t * p, size_t len) {
+        for (; len > 0; ) {
+            const size_t l = std::min(len, packet_size);
+            packets.emplace_back(p, p + l);
+            p   += l;
+            len -= l;
+        }
+    };
+
+    // WRM chunk header: type (2 bytes), size (4 bytes, header included), count (2 bytes)
+    bool is_wrm = data.size() >= 8;
+    for (size_t pos = 0; is_wrm && pos < data.size(); ) {
+        const size_t size = (pos + 8 <= data.size())
+                          ? data[pos + 2] | (data[pos + 3] << 8) | (data[pos + 4] << 16) | (data[pos + 5] << 24)
+                          : 0;
+        is_wrm = (size >= 8) && (size <= 65536) && (pos + size <= data.size());
+        pos += size;
+    }
+
+    if (is_wrm) {
+        for (size_t pos = 0; pos < data.size(); ) {
+            const size_t size = data[pos + 2] | (data[pos + 3] << 8) | (data[pos + 4] << 16) | (data[pos + 5] << 24);
+            add(&data[pos + 8], size - 8);
+            pos += size;
+        }
+    }
+    else {
+        add(data.data(), data.size());
+    }
+}
+
+template<class Encoder>
+static void run(const char * name, Packets const & packets)
+{
+    enum { ROUNDS = 5 };
+
+    double elapsed = 0;
+    uint64_t compressed_size = 0;
+    uint64_t uncompressed_size = 0;
+    unsigned errors = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        std::unique_ptr<Encoder> enc(new Encoder);
+        std::vector<std::pair<uint8_t, std::vector<uint8_t>>> outputs;
+        outputs.reserve(packets.size());
+        BStream compressed(65536);
+
+        timeval start;
+        gettimeofday(&start, nullptr);
+        for (auto & packet : packets) {
+            uint8_t  compressedType = 0;
+            uint16_t compressed_data_size = 0;
+            enc->compress(packet.data(), packet.size(), compressedType, compressed_data_size,
+                rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+            compressed.reset();
+            if (compressedType & PACKET_COMPRESSED) {
+                enc->get_compressed_data(compressed);
+            }
+            outputs.emplace_back(compressedType,
+                std::vector<uint8_t>(compressed.get_data(), compressed.get_data() + compressed.get_offset()));
+        }
+        timeval end;
+        gettimeofday(&end, nullptr);
+        const double t = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.;
+        if (round == 0 || t < elapsed) {
+            elapsed = t;
+        }
+        compressed_size   = enc->total_compressed_data_size;
+        uncompressed_size = enc->total_uncompressed_data_size;
+
+        // uncompressed packets are not given to the decompressor
+        rdp_mppc_unified_dec dec;
+        errors = 0;
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (!(outputs[i].first & PACKET_COMPRESSED)) {
+                continue;
+            }
+            const uint8_t * rdata = nullptr;
+            uint32_t        rlen  = 0;
+            if (!dec.decompress(outputs[i].second.data(), outputs[i].second.size(), outputs[i].first, rdata, rlen)
+             || rlen != packets[i].size() || memcmp(rdata, packets[i].data(), rlen)) {
+                errors++;
+            }
+        }
+    }
+
+    printf("%-24s %6.2f%% %8.1f MB/s%s\n", name,
+           compressed_size * 100. / uncompressed_size,
+           uncompressed_size / elapsed / 1000000.,
+           errors ? " DECOMPRESSION ERRORS" : "");
+}
+
+int main(int argc, char ** argv)
+{
+    size_t packet_size = 8000;
+    int i = 1;
+    if (argc > 2 && !strcmp(argv[1], "-s")) {
+        packet_size = atoi(argv[2]);
+        i = 3;
+    }
+    if (i >= argc || packet_size == 0 || packet_size > 8000) {
+        fprintf(stderr, "usage: %s [-s packet_size (1..8000)] file...\n", argv[0]);
+        return 1;
+    }
+
+    Packets packets;
+    for (; i < argc; i++) {
+        load_packets(argv[i], packet_size, packets);
+    }
+    size_t total = 0;
+    for (auto & packet : packets) {
+        total += packet.size();
+    }
+    printf("%zu packets, %zu bytes\n", packets.size(), total);
+
+    run<rdp_mppc_40_enc>("RDP 4.0",                  packets);
+    run<rdp_mppc_40_enc_hash_chain<4>>("RDP 4.0 hash chain 4",     packets);
+    run<rdp_mppc_40_enc_hash_chain<16>>("RDP 4.0 hash chain 16",    packets);
+    run<rdp_mppc_40_enc_hash_chain<64>>("RDP 4.0 hash chain 64",    packets);
+    run<rdp_mppc_50_enc>("RDP 5.0",                  packets);
+    run<rdp_mppc_50_enc_hash_chain<4>>("RDP 5.0 hash chain 4",     packets);
+    run<rdp_mppc_50_enc_hash_chain<16>>("RDP 5.0 hash chain 16",    packets);
+    run<rdp_mppc_50_enc_hash_chain<64>>("RDP 5.0 hash chain 64",    packets);
+    run<rdp_mppc_60_enc>("RDP 6.0",                  packets);
+    run<rdp_mppc_60_enc_hash_chain<4>>("RDP 6.0 hash chain 4",     packets);
+    run<rdp_mppc_60_enc_hash_chain<16>>("RDP 6.0 hash chain 16",    packets);
+    run<rdp_mppc_60_enc_hash_chain<64>>("RDP 6.0 hash chain 64",    packets);
+    run<rdp_mppc_61_enc_hash_based>("RDP 6.1",                  packets);
+    run<rdp_mppc_61_enc_hash_chain<4>>("RDP 6.1 hash chain 4",     packets);
+    run<rdp_mppc_61_enc_hash_chain<16>>("RDP 6.1 hash chain 16",    packets);
+    run<rdp_mppc_61_enc_hash_chain<64>>("RDP 6.1 hash chain 64",    packets);
+
+    return 0;
+}
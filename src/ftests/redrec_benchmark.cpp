@@ -0,0 +1,139 @@
+/* redrec --jobs benchmark
+   Writes a movie of the given duration (one wrm file every 10 minutes, rectangles drawn every
+   second over a background changing every minute), then transcodes it to wrm and png (one
+   image every minute) with 1 to max_jobs processes and prints the time of each run.
+
+   usage: redrec_benchmark [-d hours] [-j max_jobs] directory
+*/
+
+#define LOGNULL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <string>
+
+#include "capture.hpp"
+#include "apps/app_recorder.hpp"
+
+struct CaptureMaker {
+    Capture capture;
+
+    CaptureMaker( const timeval & now, uint16_t width, uint16_t height, int order_bpp
+                , const char * path, const char * basename, const char * /*extension*/
+                , Inifile & ini, bool /*clear*/, uint32_t /*verbose*/)
+    : capture( now, width, height, order_bpp
+             , ini.video.wrm_color_depth_selection_strategy
+             , path, path, ini.video.hash_path, basename
+             , false, false, nullptr, ini, true)
+    {}
+};
+
+static void write_movie(const char * path, unsigned hours)
+{
+    Inifile ini;
+    ini.video.frame_interval = 100;     // one timestamp every second
+    ini.video.break_interval = 600;     // one wrm file every 10 minutes
+    ini.video.png_limit      = 0;
+    ini.video.capture_wrm    = true;
+    ini.video.capture_png    = false;
+    ini.globals.enable_file_encryption.set(false);
+
+    const Rect scr(0, 0, 1024, 768);
+    timeval now = { 1400000000, 0 };
+
+    Capture capture(now, scr.cx, scr.cy, 24, 24, path, path, "/tmp/", "movie", false, false, nullptr, ini);
+
+    bool ignore_frame_in_timeval = false;
+    bool requested_to_stop       = false;
+
+    uint32_t seed = 1;
+    auto random = [&seed](uint32_t max) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % max;
+    };
+
+    for (unsigned sec = 0; sec < hours * 3600; sec++) {
+        if (sec % 60 == 0) {
+            capture.draw(RDPOpaqueRect(scr, random(0x1000000)), scr);
+        }
+        for (int i = 0; i < 50; i++) {
+            const Rect r(random(scr.cx - 100), random(scr.cy - 50), 1 + random(100), 1 + random(50));
+            capture.draw(RDPOpaqueRect(r, random(0x1000000)), scr);
+        }
+        now.tv_sec++;
+        capture.snapshot(now, random(scr.cx), random(scr.cy), ignore_frame_in_timeval, requested_to_stop);
+    }
+}
+
+static double transcode(const std::string & input_filename, std::string output_filename, unsigned jobs)
+{
+    Inifile ini;
+    ini.video.frame_interval = 100;
+    ini.video.break_interval = 86400;
+    ini.video.png_limit      = 10;
+    ini.video.png_interval   = 600;     // one image every minute
+    ini.video.capture_wrm    = true;
+    ini.video.capture_png    = true;
+    ini.video.rt_display.set(1);
+    ini.video.wrm_compression_algorithm          = USE_ORIGINAL_COMPRESSION_ALGORITHM;
+    ini.video.wrm_color_depth_selection_strategy = USE_ORIGINAL_COLOR_DEPTH;
+    ini.globals.enable_file_encryption.set(false);
+
+    timeval start;
+    gettimeofday(&start, nullptr);
+    const int res = recompress_or_record<CaptureMaker>(
+        input_filename, output_filename, ini, false, false, false, 0, 0, 0, 1, 100, false, false, true, jobs, 0);
+    timeval end;
+    gettimeofday(&end, nullptr);
+
+    if (res) {
+        fprintf(stderr, "transcoding with %u processes failed\n", jobs);
+        exit(1);
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned hours    = 3;
+    unsigned max_jobs = 4;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (!strcmp(argv[i], "-d")) {
+            hours = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-j")) {
+            max_jobs = atoi(argv[i + 1]);
+        }
+        else {
+            break;
+        }
+    }
+    if (i + 1 != argc || hours == 0 || max_jobs == 0) {
+        fprintf(stderr, "usage: %s [-d hours] [-j max_jobs] directory\n", argv[0]);
+        return 1;
+    }
+
+    std::string path = argv[i];
+    if (path.back() != '/') {
+        path += '/';
+    }
+
+    timeval start;
+    gettimeofday(&start, nullptr);
+    write_movie(path.c_str(), hours);
+    timeval end;
+    gettimeofday(&end, nullptr);
+    printf("%u hours movie written in %.2f s\n", hours,
+           (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.);
+
+    for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+        const double t = transcode(path + "movie.mwrm", path + "redrec.mwrm", jobs);
+        printf("%u processes: %8.2f s\n", jobs, t);
+    }
+
+    return 0;
+}
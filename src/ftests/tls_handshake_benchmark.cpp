@@ -0,0 +1,151 @@
+/* TLS server handshake benchmark
+   A forked client performs handshakes over socket pairs while the server side
+   measures handshakes per second with:
+   - a new context for each connection (certificate, key and DH parameters loaded each time)
+   - the process wide context, full handshakes
+   - the process wide context, client resuming the first session
+
+   usage: tls_handshake_benchmark [count] [certificate_password]
+*/
+
+#define LOGNULL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "openssl_tls.hpp"
+
+#include "socket_transport.hpp"
+
+enum BenchMode {
+    NEW_CONTEXT,
+    SHARED_CONTEXT,
+    SHARED_CONTEXT_RESUMED
+};
+
+static void client_handshakes(std::vector<int> const & socks, bool resume)
+{
+    SSL_CTX * ctx = SSL_CTX_new(SSLv23_client_method());
+    SSL_CTX_set_options(ctx, SSL_OP_ALL);
+    SSL_SESSION * session = nullptr;
+
+    for (int sock : socks) {
+        SSL * ssl = SSL_new(ctx);
+        BIO * bio = BIO_new_socket(sock, BIO_NOCLOSE);
+        SSL_set_bio(ssl, bio, bio);
+        if (session) {
+            SSL_set_session(ssl, session);
+        }
+        if (SSL_connect(ssl) <= 0) {
+            fprintf(stderr, "SSL connect error\n");
+            _exit(1);
+        }
+        // server answers one byte, session ticket (if any) is received before it
+        char c;
+        SSL_read(ssl, &c, 1);
+        if (resume && !session) {
+            session = SSL_get1_session(ssl);
+        }
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(sock);
+    }
+
+    if (session) {
+        SSL_SESSION_free(session);
+    }
+    SSL_CTX_free(ctx);
+    _exit(0);
+}
+
+static void run(BenchMode mode, const char * name, unsigned count, const char * certificate_password)
+{
+    std::vector<int> server_socks;
+    std::vector<int> client_socks;
+    for (unsigned i = 0; i < count; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+            perror("socketpair");
+            exit(1);
+        }
+        server_socks.push_back(sv[0]);
+        client_socks.push_back(sv[1]);
+    }
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        for (int sock : server_socks) {
+            close(sock);
+        }
+        client_handshakes(client_socks, mode == SHARED_CONTEXT_RESUMED);
+    }
+    for (int sock : client_socks) {
+        close(sock);
+    }
+
+    if (mode != NEW_CONTEXT) {
+        // built at proxy startup
+        SocketTransport::server_tls_context(certificate_password);
+    }
+
+    unsigned reused = 0;
+    timeval start;
+    gettimeofday(&start, nullptr);
+
+    for (int sock : server_socks) {
+        SSL_CTX * ctx = (mode == NEW_CONTEXT)
+                      ? SocketTransport::new_server_tls_context(certificate_password)
+                      : SocketTransport::server_tls_context(certificate_password);
+        if (!ctx) {
+            fprintf(stderr, "Cannot load server TLS context\n");
+            exit(1);
+        }
+        SSL * ssl = SSL_new(ctx);
+        BIO * bio = BIO_new_socket(sock, BIO_NOCLOSE);
+        SSL_set_bio(ssl, bio, bio);
+        if (SSL_accept(ssl) <= 0) {
+            fprintf(stderr, "SSL accept error\n");
+            exit(1);
+        }
+        SSL_write(ssl, "!", 1);
+        reused += SSL_session_reused(ssl);
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(sock);
+        if (mode == NEW_CONTEXT) {
+            SSL_CTX_free(ctx);
+        }
+    }
+
+    timeval end;
+    gettimeofday(&end, nullptr);
+    waitpid(pid, nullptr, 0);
+
+    const double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.;
+    printf("%-28s %u handshakes (%u resumed) in %.3f s: %.1f handshakes/s\n",
+           name, count, reused, elapsed, count / elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned count = (argc > 1) ? atoi(argv[1]) : 200;
+    const char * certificate_password = (argc > 2) ? argv[2] : "inquisition";
+
+    SSL_library_init();
+    SSL_load_error_strings();
+    signal(SIGPIPE, SIG_IGN);
+
+    run(NEW_CONTEXT, "new context per connection", count, certificate_password);
+    run(SHARED_CONTEXT, "shared context", count, certificate_password);
+    run(SHARED_CONTEXT_RESUMED, "shared context, resumed", count, certificate_password);
+
+    return 0;
+}
@@ -28,15 +28,57 @@
 #include "FileToGraphic.hpp"
 #include "RDP/RDPGraphicDevice.hpp"
 #include "in_meta_sequence_transport.hpp"
+#include "crypto_in_meta_sequence_transport.hpp"
+#include "read_ahead_transport.hpp"
+#include "difftimeval.hpp"
+#include "replay_pacer.hpp"
 #include "internal_mod.hpp"
 
+#include <memory>
+
 class ReplayMod : public InternalMod {
     char movie[1024];
 
     std::string & auth_error_message;
 
-    InMetaSequenceTransport * in_trans;
-    FileToGraphic           * reader;
+    // Each file of the recording starts with a keyframe, its screen image is
+    // not made of orders. Draws it on the front when a file is opened.
+    struct KeyframeImage : public RDPCaptureDevice {
+        FrontAPI & front;
+        const uint16_t width;
+        const uint16_t height;
+        std::unique_ptr<uint8_t[]> data;
+
+        KeyframeImage(FrontAPI & front, uint16_t width, uint16_t height)
+        : front(front)
+        , width(width)
+        , height(height)
+        , data(new uint8_t[width * height * 3])
+        {}
+
+        virtual void set_row(size_t rownum, const uint8_t * data) override {
+            const size_t rowsize = this->width * 3;
+            memcpy(this->data.get() + rownum * rowsize, data, rowsize);
+            if (rownum + 1 == this->height) {
+                const Rect rect(0, 0, this->width, this->height);
+                const Bitmap bmp(this->data.get(), this->width, this->height, 24, rect);
+                this->front.draw(RDPMemBlt(0, rect, 0xCC, 0, 0, 0), rect, bmp);
+            }
+        }
+    };
+
+    CryptoContext cctx;
+
+    // the files of the recording are read (and decrypted) by a worker thread
+    ReadAheadTransportBase * in_trans;
+    FileToGraphic          * reader;
+    KeyframeImage          * keyframe_image;
+
+    // the orders are drawn when their timestamp is due, at the replay speed
+    ReplayPacer pacer;
+    uint32_t    skipped_keyframes;
+    // the timestamp last read is not due yet, no order is read before it is
+    bool        timestamp_pending;
 
     bool end_of_data;
 
@@ -52,6 +94,9 @@ public:
              , Inifile & ini)
     : InternalMod(front, width, height, ini.font)
     , auth_error_message(auth_error_message)
+    , pacer(ini.mod_replay.speed)
+    , skipped_keyframes(0)
+    , timestamp_pending(false)
     , end_of_data(false)
     , ini(ini)
     {
@@ -77,10 +122,22 @@ public:
         }
         snprintf(prefix,  sizeof(prefix), "%s%s", path, basename);
 
-        this->in_trans = new InMetaSequenceTransport(prefix, extension);
+        char meta_filename[4096];
+        snprintf(meta_filename, sizeof(meta_filename), "%s%s", prefix, extension);
+        memset(&this->cctx, 0, sizeof(this->cctx));
+        if (is_encrypted_file(meta_filename)) {
+            memcpy(this->cctx.crypto_key, this->ini.crypto.key0, sizeof(this->cctx.crypto_key));
+            memcpy(this->cctx.hmac_key,   this->ini.crypto.key1, sizeof(this->cctx.hmac_key  ));
+            this->in_trans = new ReadAheadTransport<CryptoInMetaSequenceTransport>(
+                &this->cctx, prefix, extension);
+        }
+        else {
+            this->in_trans = new ReadAheadTransport<InMetaSequenceTransport>(prefix, extension);
+        }
         timeval begin_capture; begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
         timeval end_capture; end_capture.tv_sec = 0; end_capture.tv_usec = 0;
-        this->reader = new FileToGraphic( this->in_trans, begin_capture, end_capture, true
+        // not real time: draw_event() waits for the timestamps without blocking the session
+        this->reader = new FileToGraphic( this->in_trans, begin_capture, end_capture, false
                                         , this->ini.debug.capture);
 
         switch (this->front.server_resize( this->reader->info_width
@@ -105,12 +162,19 @@ public:
             throw Error(ERR_VNC_OLDER_RDP_CLIENT_CANT_RESIZE);
         }
 
-        this->reader->add_consumer(&this->front, nullptr);
+        this->keyframe_image = new KeyframeImage( this->front, this->reader->info_width
+                                                , this->reader->info_height);
+        this->reader->add_consumer(&this->front, this->keyframe_image);
         this->front.send_global_palette();
     }
 
     virtual ~ReplayMod()
     {
+        if (this->ini.debug.capture) {
+            LOG(LOG_INFO, "ReplayMod: %u keyframe(s) skipped to catch up with the replay speed",
+                this->skipped_keyframes);
+        }
+        delete keyframe_image;
         delete reader;
         delete in_trans;
         this->screen.clear();
@@ -127,13 +191,134 @@ public:
     virtual void rdp_input_scancode(long /*param1*/, long /*param2*/,
                                     long /*param3*/, long /*param4*/, Keymap2 * keymap)
     {
-        if (keymap->nb_kevent_available() > 0
-         && keymap->get_kevent() == Keymap2::KEVENT_ESC) {
-            this->event.signal = BACK_EVENT_STOP;
-            this->event.set();
+        while (keymap->nb_kevent_available() > 0) {
+            switch (keymap->get_kevent()) {
+            case Keymap2::KEVENT_ESC:
+                this->event.signal = BACK_EVENT_STOP;
+                this->event.set();
+                break;
+            case Keymap2::KEVENT_LEFT_ARROW:
+                // start of the current file, or of the previous one when the
+                // current one just started
+                this->seek(
+                    (static_cast<unsigned>(this->reader->record_now.tv_sec) > this->in_trans->begin_chunk_time() + 2)
+                    ? this->in_trans->begin_chunk_time()
+                    : this->in_trans->begin_chunk_time() - 1);
+                break;
+            case Keymap2::KEVENT_RIGHT_ARROW:
+                this->seek(this->in_trans->end_chunk_time());
+                break;
+            case Keymap2::KEVENT_UP_ARROW:
+                this->set_speed(this->pacer.speed() * 2);
+                break;
+            case Keymap2::KEVENT_DOWN_ARROW:
+                this->set_speed(this->pacer.speed() / 2);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+private:
+    static bool is_encrypted_file(const char * filename)
+    {
+        bool encrypted = false;
+        const int fd = open(filename, O_RDONLY);
+        if (fd != -1) {
+            uint8_t magic[4];
+            if ((read(fd, magic, sizeof(magic)) == sizeof(magic)) &&
+                (magic[0] == (WABCRYPTOFILE_MAGIC & 0xFF)) &&
+                (magic[1] == ((WABCRYPTOFILE_MAGIC >> 8) & 0xFF)) &&
+                (magic[2] == ((WABCRYPTOFILE_MAGIC >> 16) & 0xFF)) &&
+                (magic[3] == ((WABCRYPTOFILE_MAGIC >> 24) & 0xFF))) {
+                encrypted = true;
+            }
+            close(fd);
+        }
+        return encrypted;
+    }
+
+    void set_speed(unsigned speed)
+    {
+        this->pacer.set_speed(speed, ustime());
+        LOG(LOG_INFO, "Replay speed x%u", this->pacer.speed());
+        if (!this->end_of_data) {
+            // the order waiting for its timestamp may be due sooner or later
+            this->event.set(1);
         }
     }
 
+    // goes to the last keyframe before sec
+    void seek(time_t sec)
+    {
+        timeval t;
+        t.tv_sec  = sec;
+        t.tv_usec = 0;
+        try {
+            this->reader->seek_to_keyframe(t);
+        }
+        catch (Error & e) {
+            if (e.id != ERR_TRANSPORT_NO_MORE_DATA) {
+                throw;
+            }
+            // after the end of the recording
+            return;
+        }
+        this->pacer.restart(ustime(this->reader->record_now), ustime());
+        this->timestamp_pending = false;
+        this->end_of_data = false;
+        this->event.set(1);
+    }
+
+    // returns true when the orders which follow the timestamp just read are not due yet
+    bool wait_timestamp()
+    {
+        const uint64_t record_now = ustime(this->reader->record_now);
+        const uint64_t now        = ustime();
+
+        if (!this->pacer.is_started()) {
+            this->pacer.restart(record_now, now);
+            return false;
+        }
+
+        const uint64_t due = this->pacer.due(record_now);
+        this->timestamp_pending = (due > now);
+        if (this->timestamp_pending) {
+            this->front.flush();
+            this->event.set(due - now);
+            return true;
+        }
+
+        // Too late: the orders are incremental, the replay can only jump to
+        // the keyframe of a next file of the recording.
+        if (this->pacer.lateness(record_now, now) > ReplayPacer::LATE_THRESHOLD) {
+            timeval scheduled;
+            scheduled.tv_sec  = this->pacer.record_time_at(now) / 1000000;
+            scheduled.tv_usec = 0;
+            if (static_cast<unsigned>(scheduled.tv_sec) >= this->in_trans->end_chunk_time()) {
+                try {
+                    this->reader->seek_to_keyframe(scheduled);
+                    this->skipped_keyframes++;
+                    if (this->ini.debug.capture) {
+                        LOG(LOG_INFO, "ReplayMod: late replay, skipped to the keyframe before %u",
+                            static_cast<unsigned>(scheduled.tv_sec));
+                    }
+                }
+                catch (Error & e) {
+                    if (e.id != ERR_TRANSPORT_NO_MORE_DATA) {
+                        throw;
+                    }
+                    // last file of the recording, the replay goes on from here
+                    this->pacer.restart(record_now, now);
+                }
+            }
+        }
+        return false;
+    }
+
+public:
+
     virtual void rdp_input_synchronize(uint32_t /*time*/, uint16_t /*device_flags*/,
                                        int16_t /*param1*/, int16_t /*param2*/)
     {
@@ -145,14 +330,20 @@ public:
     virtual void draw_event(time_t now)
     {
         TODO("use system constants for sizes");
-        TODO("RZ: Support encrypted recorded file.");
         if (!this->end_of_data) {
             try
             {
+                // woken up before the pending timestamp (speed changed...)
+                if (this->timestamp_pending && this->wait_timestamp()) {
+                    return;
+                }
+
                 int i;
                 for (i = 0; (i < 500) && this->reader->next_order(); i++) {
                     this->reader->interpret_order();
-                    //sleep(1);
+                    if ((this->reader->chunk_type == TIMESTAMP) && this->wait_timestamp()) {
+                        return;
+                    }
                 }
                 if (i == 500) {
                     this->event.set(1);
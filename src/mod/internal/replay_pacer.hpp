@@ -0,0 +1,117 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Schedule of a replayed recording: the wall clock time when each
+   timestamp of the recording is due, at the given speed.
+*/
+
+#ifndef REDEMPTION_MOD_INTERNAL_REPLAY_PACER_HPP
+#define REDEMPTION_MOD_INTERNAL_REPLAY_PACER_HPP
+
+#include <cstdint>
+
+// All the times are in microseconds. The schedule starts (restart()) at the
+// first timestamp read and again after a seek, a change of speed keeps the
+// record time reached so far.
+class ReplayPacer
+{
+public:
+    enum {
+        MIN_SPEED = 1,
+        MAX_SPEED = 32
+    };
+
+    // a replay later than that may skip to a keyframe
+    static const uint64_t LATE_THRESHOLD = 2000000;
+
+private:
+    unsigned speed_;
+
+    bool     started       = false;
+    uint64_t record_origin = 0;
+    uint64_t real_origin   = 0;
+
+public:
+    explicit ReplayPacer(unsigned speed)
+    : speed_(clamp_speed(speed))
+    {}
+
+    static unsigned clamp_speed(unsigned speed)
+    {
+        return (speed < MIN_SPEED) ? MIN_SPEED
+             : (speed > MAX_SPEED) ? MAX_SPEED
+             : speed;
+    }
+
+    unsigned speed() const
+    { return this->speed_; }
+
+    bool is_started() const
+    { return this->started; }
+
+    // the record time <record_now> is played at the wall clock time <now>
+    void restart(uint64_t record_now, uint64_t now)
+    {
+        this->started       = true;
+        this->record_origin = record_now;
+        this->real_origin   = now;
+    }
+
+    // the schedule starts again at the next timestamp
+    void stop()
+    {
+        this->started = false;
+    }
+
+    void set_speed(unsigned speed, uint64_t now)
+    {
+        speed = clamp_speed(speed);
+        if (this->started) {
+            this->restart(this->record_time_at(now), now);
+        }
+        this->speed_ = speed;
+    }
+
+    // wall clock time when <record_time> is due
+    uint64_t due(uint64_t record_time) const
+    {
+        if (record_time <= this->record_origin) {
+            return this->real_origin;
+        }
+        return this->real_origin + (record_time - this->record_origin) / this->speed_;
+    }
+
+    // record time which should be played at the wall clock time <now>
+    uint64_t record_time_at(uint64_t now) const
+    {
+        if (now <= this->real_origin) {
+            return this->record_origin;
+        }
+        return this->record_origin + (now - this->real_origin) * this->speed_;
+    }
+
+    // time the replay of <record_time> is late at <now>, 0 if not late
+    uint64_t lateness(uint64_t record_time, uint64_t now) const
+    {
+        const uint64_t due = this->due(record_time);
+        return (now > due) ? now - due : 0;
+    }
+};
+
+#endif
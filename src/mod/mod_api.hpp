@@ -69,6 +69,10 @@ public:
 
     virtual void process_asynchronous_task() {}
 
+    // true when draw_event() reads one TPKT or fast-path PDU from the module
+    //  transport, the session gathers it without blocking before the call
+    virtual bool is_reading_rdp_pdus() { return false; }
+
     uint16_t get_front_width() const { return this->front_width; }
     uint16_t get_front_height() const { return this->front_height; }
 
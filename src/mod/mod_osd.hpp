@@ -401,6 +401,11 @@ public:
         this->mod.draw_event(now);
     }
 
+    virtual bool is_reading_rdp_pdus()
+    {
+        return this->mod.is_reading_rdp_pdus();
+    }
+
     virtual void rdp_input_invalidate(const Rect & r)
     {
         if (r.has_intersection(this->fg_rect)) {
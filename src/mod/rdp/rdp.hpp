@@ -269,6 +269,7 @@ class mod_rdp : public mod_api {
 
     std::deque<std::unique_ptr<AsynchronousTask>> asynchronous_tasks;
     wait_obj                                      asynchronous_task_event;
+    wait_obj                                      drive_io_completion_event;  // file descriptor only
 
     class RdpdrToServerSender : public ToServerSender {
         Transport    & transport;
@@ -833,6 +834,11 @@ private:
 public:
     virtual wait_obj * get_asynchronous_task_event(int & out_fd) override {
         if (this->asynchronous_tasks.empty()) {
+            if (this->file_system_drive_manager.HasPendingIO()) {
+                out_fd = this->file_system_drive_manager.GetIOCompletionFileDescriptor();
+                return &this->drive_io_completion_event;
+            }
+
             out_fd = -1;
             return nullptr;
         }
@@ -843,8 +849,18 @@ public:
     }
 
     virtual void process_asynchronous_task() override {
+        // Completed drive reads and writes are sent all together, between two
+        //  tasks: the chunks of their PDUs must not interleave with the ones of
+        //  a task which is sending its PDU.
+        if (this->asynchronous_tasks.empty()) {
+            this->send_completed_drive_io();
+            return;
+        }
+
         if (!this->asynchronous_tasks.front()->run(this->asynchronous_task_event)) {
             this->asynchronous_tasks.pop_front();
+
+            this->send_completed_drive_io();
         }
 
         this->asynchronous_task_event.~wait_obj();
@@ -855,6 +871,15 @@ public:
         }
     }
 
+private:
+    void send_completed_drive_io() {
+        if (this->file_system_drive_manager.HasPendingIO()) {
+            this->file_system_drive_manager.SendCompletedIO(*(this->to_server_sender.get()),
+                this->verbose);
+        }
+    }
+
+public:
     virtual void send_to_mod_channel( const char * const front_channel_name
                                     , Stream & chunk
                                     , size_t length
@@ -3560,6 +3585,10 @@ public:
         }
     }   // draw_event
 
+    virtual bool is_reading_rdp_pdus() override {
+        return (this->state == MOD_RDP_CONNECTED);
+    }
+
     virtual wait_obj * get_secondary_event() {
         if (this->wab_agent_event.set_state) {
             return &this->wab_agent_event;
@@ -6205,6 +6234,14 @@ public:
                 //                    bufsize, bitmap.bmp_size, width, height, bpp);
                 //            }
                 const uint8_t * data = stream.in_uint8p(bmpdata.bitmap_size());
+
+            // Without OSD, the front may send the compressed data as is, then
+            //  the bitmap is never decoded.
+            if (   (this->gd == this)
+                && this->front.forward_bitmap_update(bmpdata, data, bmpdata.bitmap_size())) {
+                continue;
+            }
+
             Bitmap bitmap( this->bpp
                            , bmpdata.bits_per_pixel
                            , &this->orders.global_palette
@@ -28,148 +28,6 @@
 #include "transport.hpp"
 #include "wait_obj.hpp"
 
-class RdpdrDriveReadTask : public AsynchronousTask {
-    Transport * transport;
-
-    const int file_descriptor;
-
-    const uint32_t DeviceId;
-    const uint32_t CompletionId;
-
-    const uint32_t total_number_of_bytes_to_read;
-          uint32_t remaining_number_of_bytes_to_read = 0;
-
-    uint32_t length = 0;
-
-    off64_t Offset;
-
-    ToServerSender & to_server_sender;
-
-    const uint32_t verbose;
-
-public:
-    RdpdrDriveReadTask(Transport * transport,
-                       int file_descriptor,
-                       uint32_t DeviceId,
-                       uint32_t CompletionId,
-                       uint32_t number_of_bytes_to_read,
-                       off64_t Offset,
-                       ToServerSender & to_server_sender,
-                       uint32_t verbose = 0)
-    : AsynchronousTask()
-    , transport(transport)
-    , file_descriptor(file_descriptor)
-    , DeviceId(DeviceId)
-    , CompletionId(CompletionId)
-    , total_number_of_bytes_to_read(number_of_bytes_to_read)
-    , remaining_number_of_bytes_to_read(number_of_bytes_to_read)
-    , Offset(Offset)
-    , to_server_sender(to_server_sender)
-    , verbose(verbose) {}
-
-    virtual void configure_wait_object(wait_obj & wait_object) const override {
-        REDASSERT(!wait_object.waked_up_by_time);
-
-        wait_object.object_and_time = true;
-
-        wait_object.set(1000000);
-    }
-
-    virtual int get_file_descriptor() const override { return this->file_descriptor; }
-
-    virtual bool run(const wait_obj & wait_object) override {
-        if (wait_object.waked_up_by_time) {
-            LOG(LOG_WARNING, "RdpdrDriveReadTask::run: File (%d) is not ready!",
-                this->file_descriptor);
-            return true;
-        }
-
-        BStream out_stream(CHANNELS::CHANNEL_CHUNK_LENGTH);
-
-        uint32_t out_flags = 0;
-
-        if (this->remaining_number_of_bytes_to_read == this->total_number_of_bytes_to_read) {
-            const rdpdr::SharedHeader sh_s(rdpdr::Component::RDPDR_CTYP_CORE,
-                                           rdpdr::PacketId::PAKID_CORE_DEVICE_IOCOMPLETION);
-            sh_s.emit(out_stream);
-
-            const rdpdr::DeviceIOResponse device_io_response(
-                    DeviceId,
-                    CompletionId,
-                    0x00000000 /* STATUS_SUCCESS */
-                );
-            if (this->verbose) {
-                LOG(LOG_INFO, "RdpdrDriveReadTask::run");
-                device_io_response.log(LOG_INFO);
-            }
-            device_io_response.emit(out_stream);
-
-            out_stream.out_uint32_le(this->total_number_of_bytes_to_read);  // length(4)
-
-            if (this->verbose) {
-                LOG(LOG_INFO, "RdpdrDriveReadTask::run: Length=%u",
-                    this->remaining_number_of_bytes_to_read);
-            }
-
-            out_stream.mark_end();
-
-            out_flags |= CHANNELS::CHANNEL_FLAG_FIRST;
-
-            REDASSERT(!this->length);
-
-            this->length = out_stream.size() + this->total_number_of_bytes_to_read;
-        }
-
-        const uint8_t * const saved_out_stream_p = out_stream.p;
-
-        const uint32_t number_of_bytes_to_read =
-            std::min<uint32_t>(out_stream.tailroom(), this->remaining_number_of_bytes_to_read);
-
-        if (this->verbose) {
-            LOG(LOG_INFO, "RdpdrDriveReadTask::run: NumberOfBytesToRead=%u",
-                number_of_bytes_to_read);
-        }
-
-        this->transport->seek(this->Offset, SEEK_SET);
-
-        try {
-            this->transport->recv(&out_stream.p, number_of_bytes_to_read);
-        }
-        catch (const Error & e) {
-            if (e.id != ERR_TRANSPORT_NO_MORE_DATA) {
-                LOG(LOG_INFO, "RdpdrDriveReadTask::run: Exception=%d",
-                    e.id);
-                throw;
-            }
-            else {
-                LOG(LOG_WARNING, "RdpdrDriveReadTask::run: ERR_TRANSPORT_NO_MORE_DATA(%d)",
-                    e.id);
-            }
-        }
-        out_stream.mark_end();
-
-        const uint32_t number_of_bytes_read = out_stream.p - saved_out_stream_p;
-
-        if (this->verbose) {
-            LOG(LOG_INFO, "RdpdrDriveReadTask::run: NumberOfBytesRead=%u",
-                number_of_bytes_read);
-        }
-
-        this->Offset += number_of_bytes_read;
-
-        this->remaining_number_of_bytes_to_read -= number_of_bytes_read;
-        if (!this->remaining_number_of_bytes_to_read) {
-            out_flags |= CHANNELS::CHANNEL_FLAG_LAST;
-        }
-
-        REDASSERT(this->length);
-
-        this->to_server_sender(this->length, out_flags, out_stream.get_data(), out_stream.size());
-
-        return (this->remaining_number_of_bytes_to_read != 0);
-    }
-};  // RdpdrDriveReadTask
-
 class RdpdrSendDriveIOResponseTask : public AsynchronousTask {
     const uint32_t flags;
     std::unique_ptr<uint8_t[]> data;
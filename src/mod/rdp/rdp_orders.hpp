@@ -166,6 +166,11 @@ private:
             throw Error(ERR_BITMAP_CACHE_PERSISTENT, 0);
         }
 
+        // The bitmaps go to the store shared by the sessions, the file only keeps the
+        //  signatures of the cache of the target.
+        std::unique_ptr<BmpCacheStore> store = BmpCacheStore::open_store(
+            persistent_path, this->bmp_cache->bpp, this->verbose);
+
         // Generates the name of file.
         char filename[2048];
         ::snprintf(filename, sizeof(filename) - 1, "%s/PDBC-%s-%d",
@@ -190,7 +195,12 @@ private:
         {
             OutFileTransport oft(fd);
 
-            BmpCachePersister::save_all_to_disk(*this->bmp_cache, oft, this->verbose);
+            if (store) {
+                BmpCachePersister::save_all_to_disk(*this->bmp_cache, *store, oft, this->verbose);
+            }
+            else {
+                BmpCachePersister::save_all_to_disk(*this->bmp_cache, oft, this->verbose);
+            }
 
             ::close(fd);
 
@@ -251,7 +261,14 @@ public:
                 if (this->verbose & 1) {
                     LOG(LOG_INFO, "rdp_orders::create_cache_bitmap: filename=\"%s\"", filename);
                 }
-                BmpCachePersister::load_all_from_disk(*this->bmp_cache, ift, filename, this->verbose);
+                std::unique_ptr<BmpCacheStore> store = BmpCacheStore::open_store(
+                    PERSISTENT_PATH "/mod_rdp", this->bmp_cache->bpp, this->verbose);
+                if (store) {
+                    BmpCachePersister::load_all_from_disk(*this->bmp_cache, *store, ift, filename, this->verbose);
+                }
+                else {
+                    BmpCachePersister::load_all_from_disk(*this->bmp_cache, ift, filename, this->verbose);
+                }
             }
             catch (...) {
             }
@@ -0,0 +1,243 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Shadow of the screen sent to the front by a VNC session.
+
+    The screen is divided in tiles of 32x32 pixels aligned on the screen. The
+     last content drawn is kept for each tile with its fingerprint: a decoded
+     rectangle is sliced along the tiles, the tiles which did not change are
+     dropped (same fingerprint, then same pixels), the solid tiles are drawn with the solid tiles which follow them
+     on the same row as one rectangle of colour. A part of tile is always
+     drawn and makes the tile unknown, like any drawing which does not come
+     through the shadow (copy rect, refresh asked by the client...).
+*/
+
+#ifndef _REDEMPTION_MOD_VNC_SCREEN_TILE_SHADOW_HPP_
+#define _REDEMPTION_MOD_VNC_SCREEN_TILE_SHADOW_HPP_
+
+#include "log.hpp"
+#include "rect.hpp"
+#include "bitfu.hpp"
+#include "fingerprint.hpp"
+#include "noncopyable.hpp"
+
+#include <vector>
+#include <string.h>
+
+struct ScreenTileShadowApi
+{
+    virtual ~ScreenTileShadowApi() {}
+
+    // <tile_data> holds rect.cy lines of rect.cx pixels
+    virtual void draw_tile_bitmap(const Rect & rect, const uint8_t * tile_data) = 0;
+
+    // <color> is a pixel of the session
+    virtual void draw_solid_rect(const Rect & rect, uint32_t color) = 0;
+};
+
+class ScreenTileShadow : noncopyable
+{
+public:
+    enum {
+        TILE_CX = 32,
+        TILE_CY = 32
+    };
+
+private:
+    struct Tile
+    {
+        Fingerprint fingerprint;
+        bool        known;
+    };
+
+    uint16_t width   = 0;
+    uint16_t height  = 0;
+    uint16_t columns = 0;
+    uint8_t  Bpp     = 0;
+
+    std::vector<Tile> tiles;
+
+    // last content of the known tiles, TILE_CX * TILE_CY pixels by tile
+    std::vector<uint8_t> tile_pixels;
+
+    // solid tiles waiting for the next ones of the row
+    Rect     solid_rect;
+    uint32_t solid_color = 0;
+
+    uint8_t tile_data[TILE_CX * TILE_CY * 4];
+
+public:
+    uint32_t tiles_drawn   = 0;
+    uint32_t tiles_solid   = 0;
+    uint32_t tiles_dropped = 0;
+
+    // all the tiles are unknown
+    void reset(uint16_t width, uint16_t height, uint8_t bpp)
+    {
+        this->width   = width;
+        this->height  = height;
+        this->columns = (width + TILE_CX - 1) / TILE_CX;
+        this->Bpp     = nbbytes(bpp);
+
+        Tile unknown;
+        unknown.known = false;
+        this->tiles.assign(this->columns * ((height + TILE_CY - 1) / TILE_CY), unknown);
+        this->tile_pixels.resize(this->tiles.size() * TILE_CX * TILE_CY * this->Bpp);
+    }
+
+    // the tiles of <rect> changed without the shadow
+    void invalidate(const Rect & rect)
+    {
+        const Rect screen_rect = rect.intersect(Rect(0, 0, this->width, this->height));
+        if (screen_rect.isempty()) {
+            return;
+        }
+
+        for (int row = screen_rect.y / TILE_CY; row <= (screen_rect.bottom() - 1) / TILE_CY; row++) {
+            for (int column = screen_rect.x / TILE_CX; column <= (screen_rect.right() - 1) / TILE_CX; column++) {
+                this->tiles[row * this->columns + column].known = false;
+            }
+        }
+    }
+
+    // <raw> holds rect.cy lines of rect.cx pixels
+    void draw(const Rect & rect, const uint8_t * raw, ScreenTileShadowApi & api)
+    {
+        const size_t raw_line_size = rect.cx * this->Bpp;
+
+        for (int y = rect.y; y < rect.bottom(); ) {
+            const uint16_t cy = std::min<int>(TILE_CY - offset_in_tile(y, TILE_CY), rect.bottom() - y);
+
+            for (int x = rect.x; x < rect.right(); ) {
+                const uint16_t cx = std::min<int>(TILE_CX - offset_in_tile(x, TILE_CX), rect.right() - x);
+
+                const Rect    dst_tile(x, y, cx, cy);
+                const size_t  line_size = cx * this->Bpp;
+                const uint8_t * src = raw + (y - rect.y) * raw_line_size + (x - rect.x) * this->Bpp;
+
+                bool solid = true;
+                uint8_t * dst = this->tile_data;
+                for (uint16_t i = 0; i < cy; i++, src += raw_line_size, dst += line_size) {
+                    memcpy(dst, src, line_size);
+                    if (solid) {
+                        solid = (i ? !memcmp(dst, this->tile_data, line_size)
+                                   : this->is_solid_line(dst, cx));
+                    }
+                }
+
+                if (this->record(dst_tile)) {
+                    this->tiles_dropped++;
+                }
+                else if (solid) {
+                    this->tiles_solid++;
+                    this->add_solid_tile(dst_tile, this->read_pixel(this->tile_data), api);
+                }
+                else {
+                    this->tiles_drawn++;
+                    api.draw_tile_bitmap(dst_tile, this->tile_data);
+                }
+
+                x += cx;
+            }
+
+            this->flush_solid_rect(api);
+
+            y += cy;
+        }
+    }
+
+private:
+    static int offset_in_tile(int position, int tile_size)
+    {
+        return ((position % tile_size) + tile_size) % tile_size;
+    }
+
+    bool is_solid_line(const uint8_t * line, uint16_t cx) const
+    {
+        for (const uint8_t * pixel = line + this->Bpp, * end = line + cx * this->Bpp;
+             pixel < end; pixel += this->Bpp) {
+            if (memcmp(pixel, line, this->Bpp)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t read_pixel(const uint8_t * p) const
+    {
+        uint32_t pixel = 0;
+        for (uint8_t i = 0; i < this->Bpp; i++) {
+            pixel |= p[i] << (8 * i);
+        }
+        return pixel;
+    }
+
+    // keeps the fingerprint of <dst_tile> (in tile_data), returns true if the tile did not change
+    bool record(const Rect & dst_tile)
+    {
+        // a whole tile of the screen (cut at the right and at the bottom of the screen)
+        if ((dst_tile.x < 0) || (dst_tile.y < 0) ||
+            (dst_tile.x % TILE_CX) || (dst_tile.y % TILE_CY) ||
+            (dst_tile.cx != std::min<int>(TILE_CX, this->width - dst_tile.x)) ||
+            (dst_tile.cy != std::min<int>(TILE_CY, this->height - dst_tile.y))) {
+            this->invalidate(dst_tile);
+            return false;
+        }
+
+        const size_t index  = (dst_tile.y / TILE_CY) * this->columns + dst_tile.x / TILE_CX;
+        Tile &       tile   = this->tiles[index];
+        uint8_t *    pixels = &this->tile_pixels[index * TILE_CX * TILE_CY * this->Bpp];
+        const size_t size   = dst_tile.cx * dst_tile.cy * this->Bpp;
+
+        // a fingerprint is not a cryptographic hash, equal ones may hide a change
+        const Fingerprint fingerprint = compute_fingerprint(this->tile_data, size);
+        if (tile.known && (tile.fingerprint == fingerprint) && !memcmp(pixels, this->tile_data, size)) {
+            return true;
+        }
+        memcpy(pixels, this->tile_data, size);
+        tile.fingerprint = fingerprint;
+        tile.known       = true;
+        return false;
+    }
+
+    void add_solid_tile(const Rect & dst_tile, uint32_t color, ScreenTileShadowApi & api)
+    {
+        if (!this->solid_rect.isempty()) {
+            if ((color == this->solid_color) &&
+                (dst_tile.x == this->solid_rect.right()) &&
+                (dst_tile.y == this->solid_rect.y) && (dst_tile.cy == this->solid_rect.cy)) {
+                this->solid_rect.cx += dst_tile.cx;
+                return;
+            }
+            this->flush_solid_rect(api);
+        }
+        this->solid_rect  = dst_tile;
+        this->solid_color = color;
+    }
+
+    void flush_solid_rect(ScreenTileShadowApi & api)
+    {
+        if (!this->solid_rect.isempty()) {
+            api.draw_solid_rect(this->solid_rect, this->solid_color);
+            this->solid_rect = Rect();
+        }
+    }
+};
+
+#endif
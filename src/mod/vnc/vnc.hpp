@@ -39,6 +39,8 @@
 #include "RDP/orders/RDPOrdersPrimaryScrBlt.hpp"
 #include "RDP/orders/RDPOrdersSecondaryColorCache.hpp"
 #include "update_lock.hpp"
+#include "vnc/vnc_framebuffer_update.hpp"
+#include "vnc/screen_tile_shadow.hpp"
 #include "socket_transport.hpp"
 #include "channel_names.hpp"
 #include "apply_for_delim.hpp"
@@ -48,7 +50,7 @@
 // got extracts of VNC documentation from
 // http://tigervnc.sourceforge.net/cgi-bin/rfbproto
 
-struct mod_vnc : public InternalMod, private NotifyApi {
+struct mod_vnc : public InternalMod, private NotifyApi, private FrameBufferUpdateApi, private ScreenTileShadowApi {
     static const uint32_t MAX_CLIPBOARD_DATA_SIZE = 1024 * 64;
 
     FlatVNCAuthentification challenge;
@@ -140,7 +142,27 @@ private:
     const bool enable_clipboard_up;   // true clipboard available, false clipboard unavailable
     const bool enable_clipboard_down; // true clipboard available, false clipboard unavailable
 
-    z_stream zstrm;
+    FrameBufferUpdateDecoder framebuffer_update;
+
+    // fingerprints of the tiles sent to the front, unchanged tiles are not sent again
+    ScreenTileShadow tile_shadow;
+
+    // bytes received from the server and not decoded yet
+    BStream server_data;
+
+    // server to client message being received
+    enum {
+        WAIT_SERVER_MESSAGE,
+        FRAMEBUFFER_UPDATE,
+        SET_COLOUR_MAP_ENTRIES,
+        SERVER_CUT_TEXT,
+        SERVER_CUT_TEXT_DATA,
+        SERVER_CUT_TEXT_DROP
+    };
+
+    int server_message = WAIT_SERVER_MESSAGE;
+
+    uint32_t server_cut_text_remaining = 0;
 
     enum {
         ASK_PASSWORD,
@@ -227,6 +249,8 @@ public:
     , to_vnc_clipboard_data_size(0)
     , enable_clipboard_up(clipboard_up)
     , enable_clipboard_down(clipboard_down)
+    , framebuffer_update(verbose)
+    , server_data(65536)
     , encodings(encodings)
     , state(WAIT_SECURITY_TYPES)
     , ini(ini)
@@ -240,13 +264,6 @@ public:
     //--------------------------------------------------------------------------------------------------------------
         LOG(LOG_INFO, "Creation of new mod 'VNC'");
 
-        memset(&zstrm, 0, sizeof(zstrm));
-        if (inflateInit(&this->zstrm) != Z_OK)
-        {
-            LOG(LOG_ERR, "vnc zlib initialization failed");
-            throw Error(ERR_VNC_ZLIB_INITIALIZATION);
-        }
-
         keymapSym.init_layout_sym(keylayout);
         // Initial state of keys (at least lock keys) is copied from Keymap2
         keymapSym.key_flags = key_flags;
@@ -260,8 +277,6 @@ public:
     //==============================================================================================================
     virtual ~mod_vnc()
     {
-        inflateEnd(&this->zstrm);
-
         TODO("mod_vnc isn't owner of sck")
         if (this->is_socket_transport) {
             auto & st = static_cast<SocketTransport&>(this->t);
@@ -270,6 +285,12 @@ public:
             }
         }
 
+        if (this->verbose) {
+            LOG(LOG_INFO, "mod_vnc: tiles drawn=%u solid=%u dropped=%u",
+                this->tile_shadow.tiles_drawn, this->tile_shadow.tiles_solid,
+                this->tile_shadow.tiles_dropped);
+        }
+
         this->screen.clear();
     }
     //==============================================================================================================
@@ -568,6 +589,8 @@ public:
         }
 
         if (!r.isempty()) {
+            // the client lost this part of the screen, the tiles must be sent again
+            this->tile_shadow.invalidate(r);
             this->update_screen(r, 0);
         }
     } // rdp_input_invalidate
@@ -639,6 +662,14 @@ public:
 
                 this->state = UP_AND_RUNNING;
 
+                this->server_data.reset();
+                this->server_message = WAIT_SERVER_MESSAGE;
+
+                this->tile_shadow.reset(this->width, this->height, this->bpp);
+
+                // one more request is kept pending at the server, each update asks for
+                //  the next one as soon as its message-type is received
+                this->update_screen(Rect(0, 0, this->width, this->height));
                 this->update_screen(Rect(0, 0, this->width, this->height));
 
                 this->lib_open_clip_channel();
@@ -724,26 +755,11 @@ public:
                 LOG(LOG_INFO, "state=UP_AND_RUNNING");
             }
             if (this->is_socket_transport && static_cast<SocketTransport&>(this->t).can_recv()) {
-                uint8_t data[1];
-                FixedSizeStream stream(data, 1);
-                stream.end = stream.p;
                 try {
-                    this->t.recv(&stream.end, 1);
-                    char type = stream.in_uint8();  /* message-type */
-                    switch (type) {
-                        case 0: /* framebuffer update */
-                            this->lib_framebuffer_update();
-                        break;
-                        case 1: /* palette */
-                            this->lib_palette_update();
-                        break;
-                        case 3: /* clipboard */ /* ServerCutText */
-                            this->lib_clip_data();
-                        break;
-                        default:
-                            LOG(LOG_INFO, "unknown in vnc_lib_draw_event %d\n", type);
-                        break;
-                    }
+                    this->recv_server_data();
+
+                    update_lock<FrontAPI> lock(this->front);
+                    this->process_server_data();
                 }
                 catch (const Error & e) {
                     LOG(LOG_INFO, "VNC Stopped [reason id=%u]", e.id);
@@ -1110,6 +1126,10 @@ public:
                     this->blue_shift    = 0;
                 }
 
+                this->framebuffer_update.set_pixel_format(
+                    this->depth, this->red_max, this->green_max, this->blue_max,
+                    this->red_shift, this->green_shift, this->blue_shift);
+
                 // 7.4.2   SetEncodings
                 // --------------------
 
@@ -1145,14 +1165,15 @@ public:
                     if (!number_of_encodings)
                     {
                         if (this->verbose) {
-                            LOG(LOG_WARNING, "mdo_vnc: using default encoding types - RRE(2),Raw(0),CopyRect(1),Cursor pseudo-encoding(-239)");
+                            LOG(LOG_WARNING, "mdo_vnc: using default encoding types - Tight(7),Raw(0),CopyRect(1),RRE(2),Cursor pseudo-encoding(-239)");
                         }
 
+                        stream.out_uint32_be(7);            // Tight
                         stream.out_uint32_be(0);            // raw
                         stream.out_uint32_be(1);            // copy rect
                         stream.out_uint32_be(2);            // RRE
                         stream.out_uint32_be(0xffffff11);   // (-239) cursor
-                        number_of_encodings = 4;
+                        number_of_encodings = 5;
                     }
 
                     stream.set_out_uint16_be(number_of_encodings, number_of_encodings_offset);
@@ -1238,722 +1259,229 @@ public:
     } // draw_event
 
 private:
-    struct ZRLEUpdateContext
-    {
-        uint8_t Bpp;
-
-        uint16_t x;
-        uint16_t cx;
-
-        uint16_t cx_remain;
-        uint16_t cy_remain;
-
-        uint16_t tile_x;
-        uint16_t tile_y;
-
-        BStream data_remain;
-
-        ZRLEUpdateContext() : data_remain(16384) {}
-    };
-
-    void lib_framebuffer_update_zrle(HStream & uncompressed_data_buffer, ZRLEUpdateContext & update_context)
+    // reads what the server sent, at most one buffer, without waiting for the rest of the message
+    void recv_server_data()
     {
-        if (this->verbose) {
-            LOG(LOG_INFO,
-                "VNC Encoding: ZRLE, uncompressed length=%lu remaining data size=%lu",
-                uncompressed_data_buffer.in_remain(),
-                update_context.data_remain.size());
+        Stream & stream = this->server_data;
+
+        // the decoded bytes are dropped
+        const size_t remain = stream.in_remain();
+        if (stream.p != stream.get_data()) {
+            memmove(stream.get_data(), stream.p, remain);
+            stream.p   = stream.get_data();
+            stream.end = stream.p + remain;
         }
 
-        if (update_context.data_remain.size())
-        {
-            uncompressed_data_buffer.copy_to_head(
-                update_context.data_remain.get_data(),
-                update_context.data_remain.size());
-            uncompressed_data_buffer.p = uncompressed_data_buffer.get_data();
-
-            update_context.data_remain.reset();
+        // the next unit to decode is received whole
+        const size_t needed = this->server_message_needed();
+        if (needed > stream.get_capacity()) {
+            BStream data(remain);
+            data.out_copy_bytes(stream.get_data(), remain);
+            stream.init(needed);
+            stream.out_copy_bytes(data.get_data(), remain);
+            stream.mark_end();
+            stream.rewind();
         }
 
-        uint8_t    tile_data[16384];    // max size with 16 bpp
-
-        uint8_t  * remaining_data        = nullptr;
-        uint16_t   remaining_data_length = 0;
-
-        try
-        {
-            while (uncompressed_data_buffer.in_remain())
-            {
-                uint16_t tile_cx = std::min<uint16_t>(update_context.cx_remain, 64);
-                uint16_t tile_cy = std::min<uint16_t>(update_context.cy_remain, 64);
-
-                const uint8_t * tile_data_p = tile_data;
-
-                uint16_t tile_data_length = tile_cx * tile_cy * update_context.Bpp;
-                if (tile_data_length > sizeof(tile_data))
-                {
-                    LOG(LOG_ERR,
-                        "VNC Encoding: ZRLE, tile buffer too small (%u < %u)",
-                        sizeof(tile_data), tile_data_length);
-                    throw Error(ERR_BUFFER_TOO_SMALL);
-                }
-
-                remaining_data        = uncompressed_data_buffer.p;
-                remaining_data_length = uncompressed_data_buffer.in_remain();
-
-                uint8_t   subencoding = uncompressed_data_buffer.in_uint8();
-
-                if (this->verbose) {
-                    LOG(LOG_INFO, "VNC Encoding: ZRLE, subencoding = %d",
-                        subencoding);
-                }
-
-                if (!subencoding)
-                {
-                    if (this->verbose) {
-                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Raw pixel data");
-                    }
-
-                    if (uncompressed_data_buffer.in_remain() < tile_data_length)
-                    {
-                        throw Error(ERR_VNC_NEED_MORE_DATA);
-                    }
-
-                    tile_data_p = uncompressed_data_buffer.in_uint8p(tile_data_length);
-                }
-                else if (subencoding == 1)
-                {
-                    if (this->verbose) {
-                        LOG(LOG_INFO,
-                            "VNC Encoding: ZRLE, Solid tile (single color)");
-                    }
-
-                    if (uncompressed_data_buffer.in_remain() < update_context.Bpp)
-                    {
-                        throw Error(ERR_VNC_NEED_MORE_DATA);
-                    }
-
-                    const uint8_t * cpixel_pattern = uncompressed_data_buffer.in_uint8p(update_context.Bpp);
-
-                    uint8_t * tmp_tile_data = tile_data;
-
-                    for (int i = 0; i < tile_cx; i++, tmp_tile_data += update_context.Bpp)
-                        memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
-
-                    uint16_t line_size = tile_cx * update_context.Bpp;
-
-                    for (int i = 1; i < tile_cy; i++, tmp_tile_data += line_size)
-                        memcpy(tmp_tile_data, tile_data, line_size);
-                }
-                else if ((subencoding >= 2) && (subencoding <= 16))
-                {
-                    if (this->verbose) {
-                        LOG(LOG_INFO,
-                            "VNC Encoding: ZRLE, Packed palette types, "
-                                "palette size=%d",
-                            subencoding);
-                    }
-
-                    const uint8_t  * palette;
-                    const uint8_t    palette_count = subencoding;
-                    const uint16_t   palette_size  = palette_count * update_context.Bpp;
-
-                    if (uncompressed_data_buffer.in_remain() < palette_size)
-                    {
-                        throw Error(ERR_VNC_NEED_MORE_DATA);
-                    }
-
-                    palette = uncompressed_data_buffer.in_uint8p(palette_size);
-
-                    uint16_t   packed_pixels_length;
-
-                    if (palette_count == 2)
-                    {
-                        packed_pixels_length = (tile_cx + 7) / 8 * tile_cy;
-                    }
-                    else if ((palette_count == 3) || (palette_count == 4))
-                    {
-                        packed_pixels_length = (tile_cx + 3) / 4 * tile_cy;
-                    }
-                    else// if ((palette_count >= 5) && (palette_count <= 16))
-                    {
-                        packed_pixels_length = (tile_cx + 1) / 2 * tile_cy;
-                    }
-
-                    if (uncompressed_data_buffer.in_remain() < packed_pixels_length)
-                    {
-                        throw Error(ERR_VNC_NEED_MORE_DATA);
-                    }
-
-                    const uint8_t * packed_pixels = uncompressed_data_buffer.in_uint8p(packed_pixels_length);
-
-                    uint8_t * tmp_tile_data = tile_data;
-
-                    uint16_t  tile_data_length_remain = tile_data_length;
-
-                    uint8_t         pixel_remain         = tile_cx;
-                    const uint8_t * packed_pixels_remain = packed_pixels;
-                    uint8_t         current              = 0;
-                    uint8_t         index                = 0;
-
-                    uint8_t palette_index;
-
-                    while (tile_data_length_remain >= update_context.Bpp)
-                    {
-                        pixel_remain--;
-
-                        if (!index)
-                        {
-                            current = *packed_pixels_remain;
-                            packed_pixels_remain++;
-                        }
-
-                        if (palette_count == 2)
-                        {
-                            palette_index = (current & 0x80) >> 7;
-                            current <<= 1;
-                            index++;
-
-                            if (!pixel_remain || (index > 7))
-                            {
-                                index = 0;
-                            }
-                        }
-                        else if ((palette_count == 3) || (palette_count == 4))
-                        {
-                            palette_index = (current & 0xC0) >> 6;
-                            current <<= 2;
-                            index++;
-
-                            if (!pixel_remain || (index > 3))
-                            {
-                                index = 0;
-                            }
-                        }
-                        else// if ((palette_count >= 5) && (palette_count <= 16))
-                        {
-                            palette_index = (current & 0xF0) >> 4;
-                            current <<= 4;
-                            index++;
-
-                            if (!pixel_remain || (index > 1))
-                            {
-                                index = 0;
-                            }
-                        }
-
-                        if (!pixel_remain)
-                        {
-                            pixel_remain = tile_cx;
-                        }
-
-                        const uint8_t * cpixel_pattern = palette + palette_index * update_context.Bpp;
-
-                        memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
-
-                        tmp_tile_data           += update_context.Bpp;
-                        tile_data_length_remain -= update_context.Bpp;
-                    }
-                }
-                else if ((subencoding >= 17) && (subencoding <= 127))
-                {
-                    LOG(LOG_ERR, "VNC Encoding: ZRLE, unused");
-                    throw Error(ERR_VNC_ZRLE_PROTOCOL);
-                }
-                else if (subencoding == 128)
-                {
-                    if (this->verbose) {
-                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Plain RLE");
-                    }
-
-                    uint16_t   tile_data_length_remain = tile_data_length;
-
-                    uint16_t   run_length    = 0;
-                    uint8_t  * tmp_tile_data = tile_data;
-
-                    while (tile_data_length_remain >= update_context.Bpp)
-                    {
-
-                        if (uncompressed_data_buffer.in_remain() < update_context.Bpp)
-                        {
-                            throw Error(ERR_VNC_NEED_MORE_DATA);
-                        }
-
-                        const uint8_t * cpixel_pattern = uncompressed_data_buffer.in_uint8p(update_context.Bpp);
-
-                        run_length = 1;
-
-                        while (true)
-                        {
-                            if (uncompressed_data_buffer.in_remain() < 1)
-                            {
-                                throw Error(ERR_VNC_NEED_MORE_DATA);
-                            }
-
-                            uint8_t byte_value = uncompressed_data_buffer.in_uint8();
-                            run_length += byte_value;
-
-                            if (byte_value != 255)
-                                break;
-                        }
-
-                        // LOG(LOG_INFO, "VNC Encoding: ZRLE, run length=%u", run_length);
-
-                        while ((tile_data_length_remain >= update_context.Bpp) && run_length)
-                        {
-                            memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
-
-                            tmp_tile_data           += update_context.Bpp;
-                            tile_data_length_remain -= update_context.Bpp;
-
-                            run_length--;
-                        }
-                    }
-
-                    // LOG(LOG_INFO, "VNC Encoding: ZRLE, run_length=%u", run_length);
-
-                    REDASSERT(!run_length);
-                    REDASSERT(!tile_data_length_remain);
-                }
-                else if (subencoding == 129)
-                {
-                    LOG(LOG_ERR, "VNC Encoding: ZRLE, unused");
-                    throw Error(ERR_VNC_ZRLE_PROTOCOL);
-                }
-                else
-                {
-                    if (this->verbose) {
-                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Palette RLE");
-                    }
-
-                    const uint8_t  * palette;
-                    const uint8_t    palette_count = subencoding - 128;
-                    const uint16_t   palette_size  = palette_count * update_context.Bpp;
-
-                    if (uncompressed_data_buffer.in_remain() < palette_size)
-                    {
-                        throw Error(ERR_VNC_NEED_MORE_DATA);
-                    }
-
-                    palette = uncompressed_data_buffer.in_uint8p(palette_size);
-
-                    uint16_t   tile_data_length_remain = tile_data_length;
-
-                    uint16_t   run_length    = 0;
-                    uint8_t  * tmp_tile_data = tile_data;
-
-                    while (tile_data_length_remain >= update_context.Bpp)
-                    {
-                        if (uncompressed_data_buffer.in_remain() < 1)
-                        {
-                            throw Error(ERR_VNC_NEED_MORE_DATA);
-                        }
-
-                        uint8_t         palette_index  = uncompressed_data_buffer.in_uint8();
-                        const uint8_t * cpixel_pattern = palette + (palette_index & 0x7F) * update_context.Bpp;
-
-                        run_length = 1;
-
-                        if (palette_index & 0x80)
-                        {
-                            while (true)
-                            {
-                                if (uncompressed_data_buffer.in_remain() < 1)
-                                {
-                                    throw Error(ERR_VNC_NEED_MORE_DATA);
-                                }
-
-                                uint8_t byte_value = uncompressed_data_buffer.in_uint8();
-                                run_length += byte_value;
-
-                                if (byte_value != 255)
-                                    break;
-                            }
-                        }
-
-                        // LOG(LOG_INFO, "VNC Encoding: ZRLE, run length=%u", run_length);
-
-                        while ((tile_data_length_remain >= update_context.Bpp) && run_length)
-                        {
-                            memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
-
-                            tmp_tile_data           += update_context.Bpp;
-                            tile_data_length_remain -= update_context.Bpp;
-
-                            run_length--;
-                        }
-                    }
-
-                    // LOG(LOG_INFO, "VNC Encoding: ZRLE, run_length=%u", run_length);
-
-                    REDASSERT(!run_length);
-                    REDASSERT(!tile_data_length_remain);
-                }
-
-                this->front.begin_update();
-                this->draw_tile(Rect(update_context.tile_x, update_context.tile_y,
-                                     tile_cx, tile_cy),
-                                tile_data_p);
-                this->front.end_update();
-
-                update_context.cx_remain -= tile_cx;
-                update_context.tile_x    += tile_cx;
-
-                if (!update_context.cx_remain)
-                {
-                    update_context.cx_remain =  update_context.cx;
-                    update_context.cy_remain -= tile_cy;
-
-                    update_context.tile_x =  update_context.x;
-                    update_context.tile_y += tile_cy;
-                }
-            }
+        if (stream.endroom()) {
+            stream.end += static_cast<SocketTransport&>(this->t).recv_available(
+                reinterpret_cast<char *>(stream.end), stream.endroom());
         }
-        catch (Error & e)
-        {
-            if (e.id != ERR_VNC_NEED_MORE_DATA)
-                throw;
-            else
-            {
-                update_context.data_remain.out_copy_bytes(remaining_data,
-                    remaining_data_length);
-                update_context.data_remain.mark_end();
-            }
+    }
+
+    // size of the next unit of the message being received
+    size_t server_message_needed() const
+    {
+        const Stream & stream = this->server_data;
+
+        switch (this->server_message) {
+        case FRAMEBUFFER_UPDATE:
+            return this->framebuffer_update.needed();
+        case SET_COLOUR_MAP_ENTRIES:
+            // padding(1) first-colour(2) number-of-colours(2), then 6 bytes by colour
+            return ((stream.in_remain() < 5) ? 5 : 5 + 6 * ((stream.p[3] << 8) | stream.p[4]));
+        case SERVER_CUT_TEXT:
+            // padding(3) length(4)
+            return 7;
+        case SERVER_CUT_TEXT_DATA:
+            return this->server_cut_text_remaining;
+        default:
+            // message-type, or some text to drop
+            return 1;
         }
     }
-    //==============================================================================================================
-    void lib_framebuffer_update() throw (Error) {
-    //==============================================================================================================
-        uint8_t data_rec[256];
-        FixedSizeStream stream_rec(data_rec, sizeof(data_rec));
-        stream_rec.end = stream_rec.p;
-        this->t.recv(&stream_rec.end, 3);
-        stream_rec.in_skip_bytes(1);
-        size_t num_recs = stream_rec.in_uint16_be();
-
-        uint8_t Bpp = nbbytes(this->bpp);
-        for (size_t i = 0; i < num_recs; i++) {
-            stream_rec.p = stream_rec.get_data();
-            stream_rec.end = stream_rec.get_data();
-            this->t.recv(&stream_rec.end, 12);
-            const uint16_t x = stream_rec.in_uint16_be();
-            const uint16_t y = stream_rec.in_uint16_be();
-            const uint16_t cx = stream_rec.in_uint16_be();
-            const uint16_t cy = stream_rec.in_uint16_be();
-            const uint32_t encoding = stream_rec.in_uint32_be();
-
-            switch (encoding) {
-            case 0: /* raw */
-            {
-                std::unique_ptr<uint8_t[]> raw(new(std::nothrow) uint8_t[cx * 16 * Bpp]);
-                if (!raw) {
-                    LOG(LOG_ERR, "Memory allocation failed for raw buffer in VNC");
-                    throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
-                }
 
-                update_lock<FrontAPI> lock(this->front);
-                for (uint16_t yy = y ; yy < y + cy ; yy += 16) {
-                    uint8_t * tmp = raw.get();
-                    uint16_t cyy = std::min<uint16_t>(16, cy-(yy-y));
-                    this->t.recv(&tmp, cyy*cx*Bpp);
-                    //LOG(LOG_INFO, "draw vnc: x=%d y=%d cx=%d cy=%d", x, yy, cx, cyy);
-                    this->draw_tile(Rect(x, yy, cx, cyy), raw.get());
-                }
-            }
-            break;
-            case 1: /* copy rect */
+    // decodes the complete units received, the end of the message will come with the next data
+    void process_server_data()
+    {
+        Stream & stream = this->server_data;
+
+        while (stream.in_remain() >= this->server_message_needed()) {
+            switch (this->server_message) {
+            case WAIT_SERVER_MESSAGE:
             {
-                uint8_t data_copy_rect[4];
-                FixedSizeStream stream_copy_rect(data_copy_rect, sizeof(data_copy_rect));
-                stream_copy_rect.end = stream_copy_rect.p;
-                this->t.recv(&stream_copy_rect.end, 4);
-                const int srcx = stream_copy_rect.in_uint16_be();
-                const int srcy = stream_copy_rect.in_uint16_be();
-                //LOG(LOG_INFO, "copy rect: x=%d y=%d cx=%d cy=%d encoding=%d src_x=%d, src_y=%d", x, y, cx, cy, encoding, srcx, srcy);
-                const RDPScrBlt scrblt(Rect(x, y, cx, cy), 0xCC, srcx, srcy);
-                update_lock<FrontAPI> lock(this->front);
-                if (this->gd == this) {
-                    this->front.draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
-                }
-                else {
-                    this->gd->draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
+                const uint8_t type = stream.in_uint8();  /* message-type */
+                switch (type) {
+                    case 0: /* framebuffer update */
+                        this->framebuffer_update.start(this->bpp);
+                        // the next update is requested while this one is received
+                        this->update_screen(Rect(0, 0, this->width, this->height));
+                        this->server_message = FRAMEBUFFER_UPDATE;
+                    break;
+                    case 1: /* palette */
+                        this->server_message = SET_COLOUR_MAP_ENTRIES;
+                    break;
+                    case 3: /* clipboard */ /* ServerCutText */
+                        this->server_message = SERVER_CUT_TEXT;
+                    break;
+                    default:
+                        LOG(LOG_INFO, "unknown in vnc_lib_draw_event %d\n", type);
+                    break;
                 }
             }
             break;
-            case 2: /* RRE */
-            {
-                //LOG(LOG_INFO, "VNC Encoding: RRE, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
-                std::unique_ptr<uint8_t[]> raw(new(std::nothrow) uint8_t[cx * cy * Bpp]);
-                if (!raw) {
-                    LOG(LOG_ERR, "Memory allocation failed for RRE buffer in VNC");
-                    throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
-                }
-
-                uint8_t data_rre[256];
-                FixedSizeStream stream_rre(data_rre, sizeof(data_rre));
-                stream_rre.end = stream_rre.p;
-
-                this->t.recv(&stream_rre.end,
-                      4   /* number-of-subrectangles */
-                    + Bpp /* background-pixel-value */
-                    );
-
-                uint32_t number_of_subrectangles;
-                uint32_t number_of_subrectangles_remain;
-                uint32_t number_of_subrectangles_read;
-
-                number_of_subrectangles_remain =
-                number_of_subrectangles        = stream_rre.in_uint32_be();
-
-                uint8_t * bytes_per_pixel = stream_rre.p;
-                stream_rre.in_skip_bytes(Bpp);
-
-                for (uint8_t * point_cur = raw.get(), * point_end = point_cur + cx * cy * Bpp;
-                     point_cur < point_end; point_cur += Bpp) {
-                    memcpy(point_cur, bytes_per_pixel, Bpp);
+            case FRAMEBUFFER_UPDATE:
+                if (!this->framebuffer_update.decode(stream, *this)) {
+                    return;
                 }
-
-                BStream    subrectangles(65535);
-                uint16_t   subrec_x, subrec_y, subrec_width, subrec_height;
-                uint8_t  * point_line_cur;
-                uint8_t  * point_line_end;
-                uint32_t   i;
-                uint32_t   ling_boundary;
-
-                while (number_of_subrectangles_remain > 0) {
-                    number_of_subrectangles_read = min<uint32_t>(4096, number_of_subrectangles_remain);
-
-                    subrectangles.reset();
-                    this->t.recv(&subrectangles.end, (Bpp + 8) * number_of_subrectangles_read);
-
-                    number_of_subrectangles_remain -= number_of_subrectangles_read;
-
-                    for (i = 0; i < number_of_subrectangles_read; i++) {
-                        bytes_per_pixel = subrectangles.p;
-                        subrectangles.in_skip_bytes(Bpp);
-
-                        subrec_x        = subrectangles.in_uint16_be();
-                        subrec_y        = subrectangles.in_uint16_be();
-                        subrec_width    = subrectangles.in_uint16_be();
-                        subrec_height   = subrectangles.in_uint16_be();
-
-                        ling_boundary = cx * Bpp;
-                        point_line_cur = raw.get() + subrec_y * ling_boundary;
-                        point_line_end = point_line_cur + subrec_height * ling_boundary;
-                        for (; point_line_cur < point_line_end; point_line_cur += ling_boundary) {
-                            for (uint8_t * point_cur = point_line_cur + subrec_x * Bpp,
-                                 * point_end = point_cur + subrec_width * Bpp;
-                                 point_cur < point_end; point_cur += Bpp) {
-                                memcpy(point_cur, bytes_per_pixel, Bpp);
-                            }
-                        }
-                    }
-                }
-
-                update_lock<FrontAPI> lock(this->front);
-                this->draw_tile(Rect(x, y, cx, cy), raw.get());
-            }
+                this->server_message = WAIT_SERVER_MESSAGE;
             break;
-            case 5: /* Hextile */
-                LOG(LOG_INFO, "VNC Encoding: Hextile, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
+            case SET_COLOUR_MAP_ENTRIES:
+                this->lib_palette_update(stream);
+                this->server_message = WAIT_SERVER_MESSAGE;
             break;
-            case 16:    /* ZRLE */
-            {
-                uint8_t data_zrle[256];
-                FixedSizeStream stream_zrle(data_zrle, sizeof(data_zrle));
-                stream_zrle.end = stream_zrle.p;
-
-                //LOG(LOG_INFO, "VNC Encoding: ZRLE, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
-                this->t.recv(&stream_zrle.end, 4);
-
-                uint32_t zlib_compressed_data_length = stream_zrle.in_uint32_be();
-
-                if (this->verbose)
-                {
-                    LOG(LOG_INFO, "VNC Encoding: ZRLE, compressed length = %u",
-                        zlib_compressed_data_length);
-                }
-
-                if (zlib_compressed_data_length > 65536)
-                {
-                    LOG(LOG_ERR,
-                        "VNC Encoding: ZRLE, compressed data buffer too small "
-                            "(65536 < %lu)",
-                        zlib_compressed_data_length);
-                    throw Error(ERR_BUFFER_TOO_SMALL);
-                }
-
-                BStream zlib_compressed_data(65536);
-                this->t.recv(&zlib_compressed_data.end,
-                    zlib_compressed_data_length);
-                REDASSERT(zlib_compressed_data.in_remain() == zlib_compressed_data_length);
-
-                ZRLEUpdateContext zrle_update_context;
-
-                zrle_update_context.Bpp       = Bpp;
-                zrle_update_context.x         = x;
-                zrle_update_context.cx        = cx;
-                zrle_update_context.cx_remain = cx;
-                zrle_update_context.cy_remain = cy;
-                zrle_update_context.tile_x    = x;
-                zrle_update_context.tile_y    = y;
-
-                zstrm.avail_in = zlib_compressed_data_length;
-                zstrm.next_in  = zlib_compressed_data.get_data();
-
-                while (zstrm.avail_in > 0)
-                {
-                    HStream zlib_uncompressed_data_buffer(16384, 49152);
-
-                    zstrm.avail_out = zlib_uncompressed_data_buffer.endroom();
-                    zstrm.next_out  = zlib_uncompressed_data_buffer.get_data();
-
-                    int zlib_result = inflate(&zstrm, Z_NO_FLUSH);
-
-                    if (zlib_result != Z_OK)
-                    {
-                        LOG(LOG_ERR, "vnc zlib decompression failed (%d)", zlib_result);
-                        throw Error(ERR_VNC_ZLIB_INFLATE);
-                    }
-
-                    zlib_uncompressed_data_buffer.out_skip_bytes(zlib_uncompressed_data_buffer.endroom() - zstrm.avail_out);
-                    zlib_uncompressed_data_buffer.mark_end();
-                    zlib_uncompressed_data_buffer.rewind();
-
-                    this->lib_framebuffer_update_zrle(zlib_uncompressed_data_buffer, zrle_update_context);
-                }
-            }
+            default:
+                this->lib_clip_data(stream);
             break;
-            case 0xffffff11: /* (-239) cursor */
-            TODO("see why we get these empty rects ?");
-            if (cx > 0 && cy > 0) {
-                // 7.7.2   Cursor Pseudo-encoding
-                // ------------------------------
+            }
+        }
+    }
 
-                // A client which requests the Cursor pseudo-encoding is
-                // declaring that it is capable of drawing a mouse cursor
-                // locally. This can significantly improve perceived performance
-                // over slow links.
+    virtual void draw_copy_rect(const Rect & rect, uint16_t srcx, uint16_t srcy)
+    {
+        this->tile_shadow.invalidate(rect);
 
-                // The server sets the cursor shape by sending a pseudo-rectangle
-                // with the Cursor pseudo-encoding as part of an update.
+        const RDPScrBlt scrblt(rect, 0xCC, srcx, srcy);
+        if (this->gd == this) {
+            this->front.draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
+        }
+        else {
+            this->gd->draw(scrblt, Rect(0, 0, this->front_width, this->front_height));
+        }
+    }
 
-                // x, y : The pseudo-rectangle's x-position and y-position
-                // indicate the hotspot of the cursor,
+    // 7.7.2   Cursor Pseudo-encoding
+    // ------------------------------
 
-                // cx, cy : width and height indicate the width and height of
-                // the cursor in pixels.
+    // A client which requests the Cursor pseudo-encoding is
+    // declaring that it is capable of drawing a mouse cursor
+    // locally. This can significantly improve perceived performance
+    // over slow links.
 
-                // The data consists of width * height pixel values followed by
-                // a bitmask.
+    // The server sets the cursor shape by sending a pseudo-rectangle
+    // with the Cursor pseudo-encoding as part of an update.
 
-                // PIXEL array : width * height * bytesPerPixel
-                // bitmask     : floor((width + 7) / 8) * height
+    // x, y : The pseudo-rectangle's x-position and y-position
+    // indicate the hotspot of the cursor,
 
-                // The bitmask consists of left-to-right, top-to-bottom
-                // scanlines, where each scanline is padded to a whole number of
-                // bytes. Within each byte the most significant bit represents
-                // the leftmost pixel, with a 1-bit meaning the corresponding
-                // pixel in the cursor is valid.
+    // cx, cy : width and height indicate the width and height of
+    // the cursor in pixels.
 
-                const int sz_pixel_array = cx * cy * Bpp;
-                const int sz_bitmask = nbbytes(cx) * cy;
-                BStream stream_cursor(sz_pixel_array + sz_bitmask);
-                this->t.recv(&stream_cursor.end, sz_pixel_array + sz_bitmask);
+    // The data consists of width * height pixel values followed by
+    // a bitmask.
 
-                const uint8_t *vnc_pointer_data = stream_cursor.in_uint8p(sz_pixel_array);
-                const uint8_t *vnc_pointer_mask = stream_cursor.in_uint8p(sz_bitmask);
+    // PIXEL array : width * height * bytesPerPixel
+    // bitmask     : floor((width + 7) / 8) * height
 
-                Pointer cursor;
-                cursor.x = 3;
-                cursor.y = 3;
-                cursor.bpp = 24;
-                cursor.width = 32;
-                cursor.height = 32;
-                // a VNC pointer of 1x1 size is not visible, so a default minimal pointer (dot pointer) is provided instead
-                if (cx == 1 && cy == 1) {
-                    TODO("Appearence of this 1x1 cursor looks broken, check what we actually get");
-                    memset(cursor.data, 0, sizeof(cursor.data));
-                    cursor.data[2883] = 0xFF;
-                    cursor.data[2884] = 0xFF;
-                    cursor.data[2885] = 0xFF;
-                    memset(cursor.mask, 0xFF, sizeof(cursor.mask));
-                    cursor.mask[116] = 0x1F;
-                    cursor.mask[120] = 0x1F;
-                    cursor.mask[124] = 0x1F;
+    // The bitmask consists of left-to-right, top-to-bottom
+    // scanlines, where each scanline is padded to a whole number of
+    // bytes. Within each byte the most significant bit represents
+    // the leftmost pixel, with a 1-bit meaning the corresponding
+    // pixel in the cursor is valid.
+    virtual void set_vnc_cursor(const Rect & hotspot, const uint8_t * vnc_pointer_data, const uint8_t * vnc_pointer_mask)
+    {
+        const uint16_t cx  = hotspot.cx;
+        const uint16_t cy  = hotspot.cy;
+        const uint8_t  Bpp = nbbytes(this->bpp);
+
+        Pointer cursor;
+        cursor.x = 3;
+        cursor.y = 3;
+        cursor.bpp = 24;
+        cursor.width = 32;
+        cursor.height = 32;
+        // a VNC pointer of 1x1 size is not visible, so a default minimal pointer (dot pointer) is provided instead
+        if (cx == 1 && cy == 1) {
+            TODO("Appearence of this 1x1 cursor looks broken, check what we actually get");
+            memset(cursor.data, 0, sizeof(cursor.data));
+            cursor.data[2883] = 0xFF;
+            cursor.data[2884] = 0xFF;
+            cursor.data[2885] = 0xFF;
+            memset(cursor.mask, 0xFF, sizeof(cursor.mask));
+            cursor.mask[116] = 0x1F;
+            cursor.mask[120] = 0x1F;
+            cursor.mask[124] = 0x1F;
+        }
+        else {
+            // clear target cursor mask
+            for (size_t tmpy = 0; tmpy < 32; tmpy++) {
+                for (size_t mask_x = 0; mask_x < nbbytes(32); mask_x++) {
+                    cursor.mask[tmpy*nbbytes(32) + mask_x] = 0xFF;
                 }
-                else {
-                    // clear target cursor mask
-                    for (size_t tmpy = 0; tmpy < 32; tmpy++) {
-                        for (size_t mask_x = 0; mask_x < nbbytes(32); mask_x++) {
-                            cursor.mask[tmpy*nbbytes(32) + mask_x] = 0xFF;
-                        }
-                    }
-                    TODO("The code below is likely to explain the yellow pointer: we ask for 16 bits for VNC, but we work with cursor as if it were 24 bits. We should use decode primitives and reencode it appropriately. Cursor has the right shape because the mask used is 1 bit per pixel arrays");
-                    // copy vnc pointer and mask to rdp pointer and mask
-
-                    for (int yy = 0; yy < cy; yy++) {
-                        for (int xx = 0 ; xx < cx ; xx++){
-                            if (vnc_pointer_mask[yy * nbbytes(cx) + xx / 8 ] & (0x80 >> (xx&7))){
-                                if ((yy < 32) && (xx < 32)){
-                                    cursor.mask[(31-yy) * nbbytes(32) + (xx / 8)] &= ~(0x80 >> (xx&7));
-                                    int pixel = 0;
-                                    for (int tt = 0 ; tt < Bpp; tt++){
-                                        pixel += vnc_pointer_data[(yy * cx + xx) * Bpp + tt] << (8 * tt);
-                                    }
-                                    TODO("temporary: force black cursor");
-                                    int red   = (pixel >> this->red_shift) & red_max;
-                                    int green = (pixel >> this->green_shift) & green_max;
-                                    int blue  = (pixel >> this->blue_shift) & blue_max;
-                                    cursor.data[((31-yy) * 32 + xx) * 3 + 0] = (red << 3) | (red >> 2);
-                                    cursor.data[((31-yy) * 32 + xx) * 3 + 1] = (green << 2) | (green >> 4);
-                                    cursor.data[((31-yy) * 32 + xx) * 3 + 2] = (blue << 3) | (blue >> 2);
-                                }
+            }
+            TODO("The code below is likely to explain the yellow pointer: we ask for 16 bits for VNC, but we work with cursor as if it were 24 bits. We should use decode primitives and reencode it appropriately. Cursor has the right shape because the mask used is 1 bit per pixel arrays");
+            // copy vnc pointer and mask to rdp pointer and mask
+
+            for (int yy = 0; yy < cy; yy++) {
+                for (int xx = 0 ; xx < cx ; xx++){
+                    if (vnc_pointer_mask[yy * nbbytes(cx) + xx / 8 ] & (0x80 >> (xx&7))){
+                        if ((yy < 32) && (xx < 32)){
+                            cursor.mask[(31-yy) * nbbytes(32) + (xx / 8)] &= ~(0x80 >> (xx&7));
+                            int pixel = 0;
+                            for (int tt = 0 ; tt < Bpp; tt++){
+                                pixel += vnc_pointer_data[(yy * cx + xx) * Bpp + tt] << (8 * tt);
                             }
+                            TODO("temporary: force black cursor");
+                            int red   = (pixel >> this->red_shift) & red_max;
+                            int green = (pixel >> this->green_shift) & green_max;
+                            int blue  = (pixel >> this->blue_shift) & blue_max;
+                            cursor.data[((31-yy) * 32 + xx) * 3 + 0] = (red << 3) | (red >> 2);
+                            cursor.data[((31-yy) * 32 + xx) * 3 + 1] = (green << 2) | (green >> 4);
+                            cursor.data[((31-yy) * 32 + xx) * 3 + 2] = (blue << 3) | (blue >> 2);
                         }
                     }
-                    /* keep these in 32x32, vnc cursor can be alot bigger */
-                    /* (anyway hotspot is usually 0, 0)                   */
-                    //if (x > 31) { x = 31; }
-                    //if (y > 31) { y = 31; }
                 }
-                TODO(" we should manage cursors bigger then 32 x 32  this is not an RDP protocol limitation");
-                this->front.begin_update();
-                this->front.server_set_pointer(cursor);
-                this->front.end_update();
-            }
-            break;
-            default:
-                LOG(LOG_ERR, "unexpected encoding %8x in lib_frame_buffer", encoding);
-                throw Error(ERR_VNC_UNEXPECTED_ENCODING_IN_LIB_FRAME_BUFFER);
             }
+            /* keep these in 32x32, vnc cursor can be alot bigger */
+            /* (anyway hotspot is usually 0, 0)                   */
+            //if (x > 31) { x = 31; }
+            //if (y > 31) { y = 31; }
         }
-
-        this->update_screen(Rect(0, 0, this->width, this->height));
-    } // lib_framebuffer_update
+        TODO(" we should manage cursors bigger then 32 x 32  this is not an RDP protocol limitation");
+        this->front.begin_update();
+        this->front.server_set_pointer(cursor);
+        this->front.end_update();
+    }
 
     //==============================================================================================================
-    void lib_palette_update(void) {
+    // <stream> holds the whole message
+    void lib_palette_update(Stream & stream) {
     //==============================================================================================================
-        BStream stream(32768);
-        this->t.recv(&stream.end, 5);
         stream.in_skip_bytes(1);
         int first_color = stream.in_uint16_be();
         int num_colors = stream.in_uint16_be();
 
-        BStream stream2(8192);
-        this->t.recv(&stream2.end, num_colors * 6);
-
         if (num_colors <= 256) {
             for (int i = 0; i < num_colors; i++) {
-                const int r = stream2.in_uint16_be() >> 8;
-                const int g = stream2.in_uint16_be() >> 8;
-                const int b = stream2.in_uint16_be() >> 8;
+                const int r = stream.in_uint16_be() >> 8;
+                const int g = stream.in_uint16_be() >> 8;
+                const int b = stream.in_uint16_be() >> 8;
                 this->palette.set_color(first_color + i, (r << 16) | (g << 8) | b);
             }
         }
         else {
             LOG(LOG_ERR, "VNC: number of palette colors too large: %d\n", num_colors);
+            stream.in_skip_bytes(num_colors * 6);
         }
 
         this->front.set_mod_palette(this->palette);
@@ -2017,41 +1545,31 @@ private:
     //    status has changed
     //******************************************************************************
     //==============================================================================================================
-    void lib_clip_data(void) {
-        this->to_rdp_clipboard_data.reset();
-        this->t.recv(&this->to_rdp_clipboard_data.end, 7);
-        this->to_rdp_clipboard_data.in_skip_bytes(3);   // padding(3)
-        const uint32_t clipboard_data_length =          // length(4)
-            this->to_rdp_clipboard_data.in_uint32_be();
-        if (this->verbose) {
-            LOG(LOG_INFO, "mod_vnc::lib_clip_data: clipboard_data_length=%u", clipboard_data_length);
-        }
-
-        uint32_t remaining_clipboard_data_length = clipboard_data_length;
-
+    // the text is kept if it fits in the buffer, else dropped as it is received
+    void lib_clip_data(Stream & stream) {
         const bool clipboard_down_is_really_enabled =
             (this->enable_clipboard_down && this->get_channel_by_name(channel_names::cliprdr));
-        if (clipboard_down_is_really_enabled) {
-            this->to_rdp_clipboard_data.reset();
 
-            if (clipboard_data_length < this->to_rdp_clipboard_data.get_capacity()) {
-                this->t.recv(&this->to_rdp_clipboard_data.end, clipboard_data_length);  // Clipboard data.
-                *this->to_rdp_clipboard_data.end++ = '\0';  // Null character.
+        switch (this->server_message) {
+        case SERVER_CUT_TEXT:
+        {
+            stream.in_skip_bytes(3);                        // padding(3)
+            const uint32_t clipboard_data_length =          // length(4)
+                stream.in_uint32_be();
+            if (this->verbose) {
+                LOG(LOG_INFO, "mod_vnc::lib_clip_data: clipboard_data_length=%u", clipboard_data_length);
+            }
 
-                remaining_clipboard_data_length = 0;
+            this->server_cut_text_remaining = clipboard_data_length;
 
-                this->to_rdp_clipboard_data_is_utf8_encoded =
-                    ::is_utf8_string(this->to_rdp_clipboard_data.get_data(), clipboard_data_length);
-                if (this->verbose) {
-                    LOG(LOG_INFO,
-                        "mod_vnc::lib_clip_data: to_rdp_clipboard_data_is_utf8_encoded=%s",
-                        (this->to_rdp_clipboard_data_is_utf8_encoded ? "yes" : "no"));
-                    if (clipboard_data_length <= 64) {
-                        hexdump_c(this->to_rdp_clipboard_data.get_data(), clipboard_data_length);
-                    }
+            this->to_rdp_clipboard_data.reset();
+
+            if (clipboard_down_is_really_enabled) {
+                if (clipboard_data_length < this->to_rdp_clipboard_data.get_capacity()) {
+                    this->server_message = SERVER_CUT_TEXT_DATA;
+                    return;
                 }
-            }
-            else {
+
                 this->to_rdp_clipboard_data.end +=
                         ::snprintf(::char_ptr_cast(this->to_rdp_clipboard_data.end),
                                    this->to_rdp_clipboard_data.get_capacity(),
@@ -2063,20 +1581,50 @@ private:
 
                 this->to_rdp_clipboard_data_is_utf8_encoded = true;
             }
+
+            this->server_message = SERVER_CUT_TEXT_DROP;
         }
+        break;
+        case SERVER_CUT_TEXT_DATA:
+        {
+            const uint32_t clipboard_data_length = this->server_cut_text_remaining;
 
-        while (remaining_clipboard_data_length) {
-            char drop[4096];
+            memcpy(this->to_rdp_clipboard_data.end, stream.in_uint8p(clipboard_data_length),
+                clipboard_data_length);                             // Clipboard data.
+            this->to_rdp_clipboard_data.end += clipboard_data_length;
+            *this->to_rdp_clipboard_data.end++ = '\0';              // Null character.
 
-            char * end = drop;
+            this->server_cut_text_remaining = 0;
 
-            const uint32_t number_of_bytes_to_read =
-                std::min<uint32_t>(remaining_clipboard_data_length, sizeof(drop));
+            this->to_rdp_clipboard_data_is_utf8_encoded =
+                ::is_utf8_string(this->to_rdp_clipboard_data.get_data(), clipboard_data_length);
+            if (this->verbose) {
+                LOG(LOG_INFO,
+                    "mod_vnc::lib_clip_data: to_rdp_clipboard_data_is_utf8_encoded=%s",
+                    (this->to_rdp_clipboard_data_is_utf8_encoded ? "yes" : "no"));
+                if (clipboard_data_length <= 64) {
+                    hexdump_c(this->to_rdp_clipboard_data.get_data(), clipboard_data_length);
+                }
+            }
+        }
+        break;
+        default:
+        {
+            const uint32_t number_of_bytes_to_drop =
+                std::min<uint32_t>(stream.in_remain(), this->server_cut_text_remaining);
 
-            this->t.recv(&end, sizeof(number_of_bytes_to_read));
-            remaining_clipboard_data_length -= number_of_bytes_to_read;
+            stream.in_skip_bytes(number_of_bytes_to_drop);
+            this->server_cut_text_remaining -= number_of_bytes_to_drop;
+        }
+        break;
         }
 
+        if (this->server_cut_text_remaining) {
+            return;
+        }
+
+        this->server_message = WAIT_SERVER_MESSAGE;
+
         if (clipboard_down_is_really_enabled) {
             if (this->verbose) {
                 LOG(LOG_INFO,
@@ -2721,24 +2269,22 @@ public:
     }
 
 private:
-    void draw_tile(const Rect & rect, const uint8_t * raw) const
+    virtual void draw_tile(const Rect & rect, const uint8_t * raw)
     {
-        const uint16_t TILE_CX = 32;
-        const uint16_t TILE_CY = 32;
-
-        for (int y = 0; y < rect.cy ; y += TILE_CY) {
-            uint16_t cy = std::min(TILE_CY, (uint16_t)(rect.cy - y));
+        this->tile_shadow.draw(rect, raw, *this);
+    }
 
-            for (int x = 0; x < rect.cx ; x += TILE_CX) {
-                uint16_t cx = std::min(TILE_CX, (uint16_t)(rect.cx - x));
+    virtual void draw_tile_bitmap(const Rect & rect, const uint8_t * tile_data)
+    {
+        const Bitmap tiled_bmp(tile_data, rect.cx, rect.cy, this->bpp, Rect(0, 0, rect.cx, rect.cy));
+        const RDPMemBlt cmd(0, rect, 0xCC, 0, 0, 0);
+        this->gd->draw(cmd, rect, tiled_bmp);
+    }
 
-                const Rect src_tile(x, y, cx, cy);
-                const Bitmap tiled_bmp(raw, rect.cx, rect.cy, this->bpp, src_tile);
-                const Rect dst_tile(rect.x + x, rect.y + y, cx, cy);
-                const RDPMemBlt cmd2(0, dst_tile, 0xCC, 0, 0, 0);
-                this->gd->draw(cmd2, dst_tile, tiled_bmp);
-            }
-        }
+    virtual void draw_solid_rect(const Rect & rect, uint32_t color)
+    {
+        const RDPOpaqueRect cmd(rect, color);
+        this->gd->draw(cmd, rect);
     }
 };
 
@@ -0,0 +1,1329 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Resumable decoder of the VNC FramebufferUpdate message.
+
+    The decoder is given the bytes received so far. It decodes every complete
+     unit (rectangle header, batch of raw lines, RRE subrectangles, compressed
+     ZRLE data...), gives the finished pixels to its FrameBufferUpdateApi and
+     keeps its position until more bytes are received. A large update from a
+     slow server is so decoded between the other events of the session.
+
+    Tight rectangles are inflated with one of their four zlib streams as the
+     compressed bytes arrive, the copy, palette or gradient filter is applied
+     when the rectangle is complete. JPEG rectangles are decoded with libjpeg
+     and converted to the pixel format of the session.
+*/
+
+#ifndef _REDEMPTION_MOD_VNC_VNC_FRAMEBUFFER_UPDATE_HPP_
+#define _REDEMPTION_MOD_VNC_VNC_FRAMEBUFFER_UPDATE_HPP_
+
+#include "log.hpp"
+#include "error.hpp"
+#include "stream.hpp"
+#include "rect.hpp"
+#include "bitfu.hpp"
+#include "noncopyable.hpp"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <csetjmp>
+#include <jpeglib.h>
+
+#include <memory>
+#include <vector>
+
+namespace aux_ {
+    namespace vnc_jpeg {
+        struct ErrorManager
+        {
+            jpeg_error_mgr pub;
+            jmp_buf        jump;
+        };
+
+        // libjpeg calls exit() by default
+        inline void error_exit(j_common_ptr cinfo)
+        {
+            char message[JMSG_LENGTH_MAX];
+            cinfo->err->format_message(cinfo, message);
+            LOG(LOG_ERR, "VNC Encoding: Tight, JPEG decompression failed (%s)", message);
+            longjmp(reinterpret_cast<ErrorManager *>(cinfo->err)->jump, 1);
+        }
+
+        inline void output_message(j_common_ptr)
+        {
+        }
+
+        // decompresses a JPEG image of cx x cy pixels into <rgb>, 3 bytes by pixel
+        inline bool decompress(const uint8_t * data, size_t length, uint16_t cx, uint16_t cy, uint8_t * rgb)
+        {
+            jpeg_decompress_struct cinfo;
+            ErrorManager           jerr;
+
+            cinfo.err = jpeg_std_error(&jerr.pub);
+            jerr.pub.error_exit     = error_exit;
+            jerr.pub.output_message = output_message;
+            if (setjmp(jerr.jump)) {
+                jpeg_destroy_decompress(&cinfo);
+                return false;
+            }
+
+            jpeg_create_decompress(&cinfo);
+            jpeg_mem_src(&cinfo, const_cast<unsigned char *>(data), length);
+            jpeg_read_header(&cinfo, TRUE);
+            cinfo.out_color_space = JCS_RGB;
+            jpeg_start_decompress(&cinfo);
+
+            if ((cinfo.output_width != cx) || (cinfo.output_height != cy) || (cinfo.output_components != 3)) {
+                LOG(LOG_ERR, "VNC Encoding: Tight, JPEG image of %ux%u pixels for a rectangle of %ux%u",
+                    cinfo.output_width, cinfo.output_height, cx, cy);
+                jpeg_destroy_decompress(&cinfo);
+                return false;
+            }
+
+            while (cinfo.output_scanline < cinfo.output_height) {
+                JSAMPROW row = rgb + cinfo.output_scanline * cx * 3;
+                jpeg_read_scanlines(&cinfo, &row, 1);
+            }
+
+            jpeg_finish_decompress(&cinfo);
+            jpeg_destroy_decompress(&cinfo);
+            return true;
+        }
+    }
+}
+
+struct FrameBufferUpdateApi
+{
+    virtual ~FrameBufferUpdateApi() {}
+
+    // <raw> holds rect.cy lines of rect.cx pixels
+    virtual void draw_tile(const Rect & rect, const uint8_t * raw) = 0;
+
+    virtual void draw_copy_rect(const Rect & rect, uint16_t srcx, uint16_t srcy) = 0;
+
+    // <hotspot> is the position of the hotspot and the size of the cursor,
+    //  <mask> holds one bit by pixel, lines padded to a whole number of bytes
+    virtual void set_vnc_cursor(const Rect & hotspot, const uint8_t * pixels, const uint8_t * mask) = 0;
+};
+
+class FrameBufferUpdateDecoder : noncopyable
+{
+    enum {
+        WAIT_HEADER,            // padding(1) number-of-rectangles(2)
+        WAIT_RECTANGLE_HEADER,  // x(2) y(2) width(2) height(2) encoding-type(4)
+        RAW_LINES,
+        COPY_RECT,
+        RRE_HEADER,
+        RRE_SUBRECTANGLES,
+        ZRLE_LENGTH,
+        ZRLE_DATA,
+        CURSOR,
+        TIGHT_CONTROL,          // compression-control(1)
+        TIGHT_FILL,             // TPIXEL
+        TIGHT_FILTER,           // filter-id(1)
+        TIGHT_PALETTE_SIZE,     // number-of-colours - 1 (1)
+        TIGHT_PALETTE,          // number-of-colours TPIXEL
+        TIGHT_LENGTH,           // compact length of the zlib data or of the JPEG image, 1 to 3 bytes
+        TIGHT_RAW_DATA,         // less than 12 bytes, not compressed
+        TIGHT_ZLIB_DATA,
+        TIGHT_JPEG_DATA,
+        UPDATE_DONE
+    };
+
+    // the batches of raw lines end on the rows of tiles of the screen (ScreenTileShadow)
+    enum {
+        RAW_LINES_BY_BATCH = 32
+    };
+
+    enum {
+        TIGHT_FILTER_COPY,
+        TIGHT_FILTER_PALETTE,
+        TIGHT_FILTER_GRADIENT
+    };
+
+    enum {
+        TIGHT_MIN_TO_COMPRESS = 12
+    };
+
+    int state = UPDATE_DONE;
+
+    uint8_t Bpp = 0;
+
+    // pixel format of the session, Tight pixels and JPEG images are converted to it
+    uint8_t  depth       = 16;
+    uint16_t red_max     = 0x1F;
+    uint16_t green_max   = 0x3F;
+    uint16_t blue_max    = 0x1F;
+    uint8_t  red_shift   = 11;
+    uint8_t  green_shift = 5;
+    uint8_t  blue_shift  = 0;
+
+    // size of a Tight pixel: 3 bytes (red, green, blue) for 24 bits depth in 32 bpp
+    uint8_t tpixel_size = 0;
+
+    uint16_t number_of_rectangles_remain = 0;
+
+    uint16_t x  = 0;
+    uint16_t y  = 0;
+    uint16_t cx = 0;
+    uint16_t cy = 0;
+
+    // lines not decoded yet (raw)
+    uint16_t cy_remain = 0;
+
+    uint32_t number_of_subrectangles_remain = 0;
+
+    // compressed bytes not decoded yet (ZRLE)
+    uint32_t zlib_compressed_data_remain = 0;
+
+    // pixels of the rectangle (RRE)
+    std::unique_ptr<uint8_t[]> rectangle_data;
+    size_t                     rectangle_data_capacity = 0;
+
+    struct ZRLEUpdateContext
+    {
+        uint8_t Bpp;
+
+        uint16_t x;
+        uint16_t cx;
+
+        uint16_t cx_remain;
+        uint16_t cy_remain;
+
+        uint16_t tile_x;
+        uint16_t tile_y;
+
+        BStream data_remain;
+
+        ZRLEUpdateContext() : data_remain(16384) {}
+    } zrle_update_context;
+
+    // one zlib stream for all the ZRLE rectangles of the connection
+    z_stream zstrm;
+
+    // the four zlib streams of Tight, reset on request of the server
+    z_stream tight_zstrm[4];
+
+    uint8_t  tight_stream_id = 0;
+    uint8_t  tight_filter    = TIGHT_FILTER_COPY;
+    bool     tight_jpeg      = false;
+    uint16_t tight_palette_count = 0;
+    uint8_t  tight_palette[256 * 4];    // converted to the pixel format
+
+    uint32_t tight_length       = 0;
+    uint8_t  tight_length_shift = 0;
+
+    // filtered data of the rectangle (Tight), or the RGB pixels of the JPEG image
+    std::unique_ptr<uint8_t[]> tight_data;
+    size_t                     tight_data_capacity = 0;
+    size_t                     tight_data_size     = 0;
+    size_t                     tight_data_received = 0;
+
+    // previous line of the gradient filter, 3 components by pixel
+    std::vector<uint16_t> tight_gradient_line;
+
+    uint32_t verbose;
+
+public:
+    FrameBufferUpdateDecoder(uint32_t verbose)
+    : verbose(verbose)
+    {
+        memset(&this->zstrm, 0, sizeof(this->zstrm));
+        memset(this->tight_zstrm, 0, sizeof(this->tight_zstrm));
+        if (inflateInit(&this->zstrm) != Z_OK)
+        {
+            LOG(LOG_ERR, "vnc zlib initialization failed");
+            throw Error(ERR_VNC_ZLIB_INITIALIZATION);
+        }
+        for (int i = 0; i < 4; i++) {
+            if (inflateInit(&this->tight_zstrm[i]) != Z_OK)
+            {
+                while (i--) {
+                    inflateEnd(&this->tight_zstrm[i]);
+                }
+                inflateEnd(&this->zstrm);
+                LOG(LOG_ERR, "vnc zlib initialization failed");
+                throw Error(ERR_VNC_ZLIB_INITIALIZATION);
+            }
+        }
+    }
+
+    ~FrameBufferUpdateDecoder()
+    {
+        for (z_stream & tight_zstrm : this->tight_zstrm) {
+            inflateEnd(&tight_zstrm);
+        }
+        inflateEnd(&this->zstrm);
+    }
+
+    // true colour format negotiated with the server (RGB 565 by default)
+    void set_pixel_format(uint8_t depth, uint16_t red_max, uint16_t green_max, uint16_t blue_max,
+                          uint8_t red_shift, uint8_t green_shift, uint8_t blue_shift)
+    {
+        this->depth       = depth;
+        this->red_max     = red_max;
+        this->green_max   = green_max;
+        this->blue_max    = blue_max;
+        this->red_shift   = red_shift;
+        this->green_shift = green_shift;
+        this->blue_shift  = blue_shift;
+    }
+
+    // the message-type of the update is read
+    void start(uint8_t bpp)
+    {
+        this->Bpp   = nbbytes(bpp);
+        this->state = WAIT_HEADER;
+
+        this->tpixel_size = (((this->Bpp == 4) && (this->depth == 24) &&
+                              (this->red_max == 0xFF) && (this->green_max == 0xFF) && (this->blue_max == 0xFF))
+                            ? 3 : this->Bpp);
+    }
+
+    bool is_done() const
+    {
+        return (this->state == UPDATE_DONE);
+    }
+
+    // size of the next unit to decode, <stream> must be able to hold it
+    size_t needed() const
+    {
+        switch (this->state)
+        {
+        case WAIT_HEADER:           return 3;
+        case WAIT_RECTANGLE_HEADER: return 12;
+        case RAW_LINES:             return this->raw_lines_in_batch() * this->cx * this->Bpp;
+        case COPY_RECT:             return 4;
+        case RRE_HEADER:            return 4 + this->Bpp;
+        case RRE_SUBRECTANGLES:     return (this->number_of_subrectangles_remain ? this->Bpp + 8 : 0);
+        case ZRLE_LENGTH:           return 4;
+        case ZRLE_DATA:             return 1;
+        case CURSOR:                return this->cx * this->cy * this->Bpp + nbbytes(this->cx) * this->cy;
+        case TIGHT_CONTROL:         return 1;
+        case TIGHT_FILL:            return this->tpixel_size;
+        case TIGHT_FILTER:          return 1;
+        case TIGHT_PALETTE_SIZE:    return 1;
+        case TIGHT_PALETTE:         return this->tight_palette_count * this->tpixel_size;
+        case TIGHT_LENGTH:          return 1;
+        case TIGHT_RAW_DATA:        return this->tight_data_size;
+        case TIGHT_ZLIB_DATA:       return 1;
+        case TIGHT_JPEG_DATA:       return this->tight_length;
+        default:                    return 0;
+        }
+    }
+
+    // decodes the complete units of <stream> (from p to end), returns true at the end of the update
+    bool decode(Stream & stream, FrameBufferUpdateApi & api)
+    {
+        while (this->state != UPDATE_DONE) {
+            if (!this->decode_unit(stream, api)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    void next_rectangle()
+    {
+        this->state = (this->number_of_rectangles_remain ? WAIT_RECTANGLE_HEADER : UPDATE_DONE);
+    }
+
+    static uint8_t * reserve(std::unique_ptr<uint8_t[]> & buffer, size_t & capacity, size_t size)
+    {
+        if (size > capacity) {
+            buffer.reset(new(std::nothrow) uint8_t[size]);
+            if (!buffer) {
+                capacity = 0;
+                LOG(LOG_ERR, "Memory allocation failed for rectangle buffer in VNC");
+                throw Error(ERR_VNC_MEMORY_ALLOCATION_FAILED);
+            }
+            capacity = size;
+        }
+        return buffer.get();
+    }
+
+    uint16_t raw_lines_in_batch() const
+    {
+        const uint16_t yy = this->y + (this->cy - this->cy_remain);
+        return std::min<uint16_t>(RAW_LINES_BY_BATCH - yy % RAW_LINES_BY_BATCH, this->cy_remain);
+    }
+
+    uint8_t * reserve_rectangle_data(size_t size)
+    {
+        return reserve(this->rectangle_data, this->rectangle_data_capacity, size);
+    }
+
+    uint32_t read_pixel(const uint8_t * p) const
+    {
+        uint32_t pixel = 0;
+        for (uint8_t i = 0; i < this->Bpp; i++) {
+            pixel |= p[i] << (8 * i);
+        }
+        return pixel;
+    }
+
+    void write_pixel(uint8_t * p, uint32_t pixel) const
+    {
+        for (uint8_t i = 0; i < this->Bpp; i++) {
+            p[i] = pixel >> (8 * i);
+        }
+    }
+
+    uint32_t rgb_to_pixel(uint8_t red, uint8_t green, uint8_t blue) const
+    {
+        return (((red   * this->red_max   + 127) / 255) << this->red_shift)
+             | (((green * this->green_max + 127) / 255) << this->green_shift)
+             | (((blue  * this->blue_max  + 127) / 255) << this->blue_shift);
+    }
+
+    void tpixel_to_pixel(const uint8_t * tpixel, uint8_t * pixel) const
+    {
+        if (this->tpixel_size == this->Bpp) {
+            memcpy(pixel, tpixel, this->Bpp);
+        }
+        else {
+            this->write_pixel(pixel, this->rgb_to_pixel(tpixel[0], tpixel[1], tpixel[2]));
+        }
+    }
+
+    // size of the filtered data of the Tight rectangle
+    size_t tight_filtered_size() const
+    {
+        if (this->tight_filter == TIGHT_FILTER_PALETTE) {
+            return ((this->tight_palette_count == 2)
+                   ? nbbytes(this->cx) * this->cy
+                   : this->cx * this->cy);
+        }
+        return this->cx * this->cy * this->tpixel_size;
+    }
+
+    // the filter is known, the data follows
+    void start_tight_data()
+    {
+        this->tight_data_size     = this->tight_filtered_size();
+        this->tight_data_received = 0;
+        reserve(this->tight_data, this->tight_data_capacity, this->tight_data_size);
+
+        if (this->tight_data_size < TIGHT_MIN_TO_COMPRESS) {
+            this->state = TIGHT_RAW_DATA;
+        }
+        else {
+            this->tight_jpeg = false;
+            this->start_tight_length();
+        }
+    }
+
+    void start_tight_length()
+    {
+        this->tight_length       = 0;
+        this->tight_length_shift = 0;
+        this->state              = TIGHT_LENGTH;
+    }
+
+    // applies the filter to the Tight data of the rectangle and draws it
+    void draw_tight_rectangle(FrameBufferUpdateApi & api)
+    {
+        if (!this->cx || !this->cy) {
+            return;
+        }
+
+        const uint8_t * src = this->tight_data.get();
+        uint8_t       * dst = this->reserve_rectangle_data(this->cx * this->cy * this->Bpp);
+
+        switch (this->tight_filter) {
+        case TIGHT_FILTER_COPY:
+            if (this->tpixel_size == this->Bpp) {
+                api.draw_tile(Rect(this->x, this->y, this->cx, this->cy), src);
+                return;
+            }
+            for (uint8_t * end = dst + this->cx * this->cy * this->Bpp; dst < end;
+                 dst += this->Bpp, src += this->tpixel_size) {
+                this->tpixel_to_pixel(src, dst);
+            }
+        break;
+
+        case TIGHT_FILTER_PALETTE:
+            if (this->tight_palette_count == 2) {
+                // one bit by pixel, most significant bit first, lines padded to a whole number of bytes
+                for (uint16_t yy = 0; yy < this->cy; yy++) {
+                    for (uint16_t xx = 0; xx < this->cx; xx++, dst += this->Bpp) {
+                        const uint8_t index = (src[xx / 8] >> (7 - xx % 8)) & 1;
+                        memcpy(dst, this->tight_palette + index * this->Bpp, this->Bpp);
+                    }
+                    src += nbbytes(this->cx);
+                }
+            }
+            else {
+                for (uint8_t * end = dst + this->cx * this->cy * this->Bpp; dst < end; dst += this->Bpp, src++) {
+                    if (*src >= this->tight_palette_count) {
+                        LOG(LOG_ERR, "VNC Encoding: Tight, palette index %u out of %u colours",
+                            *src, this->tight_palette_count);
+                        throw Error(ERR_VNC_TIGHT_PROTOCOL);
+                    }
+                    memcpy(dst, this->tight_palette + *src * this->Bpp, this->Bpp);
+                }
+            }
+        break;
+
+        default: /* TIGHT_FILTER_GRADIENT */
+            this->filter_gradient(src, dst);
+        break;
+        }
+
+        api.draw_tile(Rect(this->x, this->y, this->cx, this->cy), this->rectangle_data.get());
+    }
+
+    // each component is the difference with the prediction up + left - up_left,
+    //  clamped to the range of the component
+    void filter_gradient(const uint8_t * src, uint8_t * dst)
+    {
+        const bool     packed   = (this->tpixel_size != this->Bpp);
+        const uint16_t max[3]   = { this->red_max, this->green_max, this->blue_max };
+        const uint8_t  shift[3] = { this->red_shift, this->green_shift, this->blue_shift };
+
+        this->tight_gradient_line.assign(this->cx * 3, 0);
+        uint16_t * const line = this->tight_gradient_line.data();
+
+        for (uint16_t yy = 0; yy < this->cy; yy++) {
+            uint16_t left[3]    = { 0, 0, 0 };
+            uint16_t up_left[3] = { 0, 0, 0 };
+
+            for (uint16_t xx = 0; xx < this->cx; xx++, src += this->tpixel_size, dst += this->Bpp) {
+                uint16_t component[3];
+                uint16_t component_max[3];
+                if (packed) {
+                    for (int c = 0; c < 3; c++) {
+                        component[c]     = src[c];
+                        component_max[c] = 0xFF;
+                    }
+                }
+                else {
+                    const uint32_t pixel = this->read_pixel(src);
+                    for (int c = 0; c < 3; c++) {
+                        component[c]     = (pixel >> shift[c]) & max[c];
+                        component_max[c] = max[c];
+                    }
+                }
+
+                uint16_t * const up = line + xx * 3;
+                for (int c = 0; c < 3; c++) {
+                    const int prediction = std::min<int>(std::max<int>(up[c] + left[c] - up_left[c], 0), component_max[c]);
+                    up_left[c] = up[c];
+                    left[c]    = (component[c] + prediction) & component_max[c];
+                    up[c]      = left[c];
+                }
+
+                this->write_pixel(dst, packed
+                    ? this->rgb_to_pixel(left[0], left[1], left[2])
+                    : (left[0] << shift[0]) | (left[1] << shift[1]) | (left[2] << shift[2]));
+            }
+        }
+    }
+
+    // returns false if the next unit is not complete
+    bool decode_unit(Stream & stream, FrameBufferUpdateApi & api)
+    {
+        if (stream.in_remain() < this->needed()) {
+            return false;
+        }
+
+        switch (this->state)
+        {
+        case WAIT_HEADER:
+            stream.in_skip_bytes(1);
+            this->number_of_rectangles_remain = stream.in_uint16_be();
+            this->next_rectangle();
+            break;
+
+        case WAIT_RECTANGLE_HEADER:
+        {
+            this->number_of_rectangles_remain--;
+
+            this->x  = stream.in_uint16_be();
+            this->y  = stream.in_uint16_be();
+            this->cx = stream.in_uint16_be();
+            this->cy = stream.in_uint16_be();
+            const uint32_t encoding = stream.in_uint32_be();
+
+            switch (encoding) {
+            case 0: /* raw */
+                this->cy_remain = this->cy;
+                this->state     = RAW_LINES;
+                if (!this->cx || !this->cy) {
+                    this->next_rectangle();
+                }
+                break;
+            case 1: /* copy rect */
+                this->state = COPY_RECT;
+                break;
+            case 2: /* RRE */
+                this->state = RRE_HEADER;
+                break;
+            case 5: /* Hextile */
+                LOG(LOG_INFO, "VNC Encoding: Hextile, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u",
+                    this->Bpp, this->x, this->y, this->cx, this->cy);
+                this->next_rectangle();
+                break;
+            case 7: /* Tight */
+                this->state = TIGHT_CONTROL;
+                break;
+            case 16: /* ZRLE */
+                this->state = ZRLE_LENGTH;
+                break;
+            case 0xffffff11: /* (-239) cursor */
+                TODO("see why we get these empty rects ?");
+                this->state = CURSOR;
+                if (!this->cx || !this->cy) {
+                    this->next_rectangle();
+                }
+                break;
+            default:
+                LOG(LOG_ERR, "unexpected encoding %8x in lib_frame_buffer", encoding);
+                throw Error(ERR_VNC_UNEXPECTED_ENCODING_IN_LIB_FRAME_BUFFER);
+            }
+        }
+        break;
+
+        case RAW_LINES:
+        {
+            const uint16_t cyy = this->raw_lines_in_batch();
+            const uint16_t yy  = this->y + (this->cy - this->cy_remain);
+            //LOG(LOG_INFO, "draw vnc: x=%d y=%d cx=%d cy=%d", this->x, yy, this->cx, cyy);
+            api.draw_tile(Rect(this->x, yy, this->cx, cyy), stream.in_uint8p(cyy * this->cx * this->Bpp));
+
+            this->cy_remain -= cyy;
+            if (!this->cy_remain) {
+                this->next_rectangle();
+            }
+        }
+        break;
+
+        case COPY_RECT:
+        {
+            const uint16_t srcx = stream.in_uint16_be();
+            const uint16_t srcy = stream.in_uint16_be();
+            //LOG(LOG_INFO, "copy rect: x=%d y=%d cx=%d cy=%d src_x=%d, src_y=%d", x, y, cx, cy, srcx, srcy);
+            api.draw_copy_rect(Rect(this->x, this->y, this->cx, this->cy), srcx, srcy);
+            this->next_rectangle();
+        }
+        break;
+
+        case RRE_HEADER:
+        {
+            //LOG(LOG_INFO, "VNC Encoding: RRE, Bpp = %u, x=%u, y=%u, cx=%u, cy=%u", Bpp, x, y, cx, cy);
+            this->number_of_subrectangles_remain = stream.in_uint32_be();
+
+            const uint8_t * bytes_per_pixel = stream.in_uint8p(this->Bpp);
+
+            const size_t rectangle_data_size = this->cx * this->cy * this->Bpp;
+            uint8_t * point_cur = this->reserve_rectangle_data(rectangle_data_size);
+            for (uint8_t * point_end = point_cur + rectangle_data_size;
+                 point_cur < point_end; point_cur += this->Bpp) {
+                memcpy(point_cur, bytes_per_pixel, this->Bpp);
+            }
+
+            this->state = RRE_SUBRECTANGLES;
+        }
+        // the subrectangles already received are read at once, the
+        //  rectangle may have none
+        // fall through
+        case RRE_SUBRECTANGLES:
+        {
+            const size_t subrectangle_size = this->Bpp + 8;
+
+            uint32_t number_of_subrectangles_read =
+                std::min<uint32_t>(stream.in_remain() / subrectangle_size, this->number_of_subrectangles_remain);
+
+            this->number_of_subrectangles_remain -= number_of_subrectangles_read;
+
+            const uint32_t ling_boundary = this->cx * this->Bpp;
+
+            for (; number_of_subrectangles_read; number_of_subrectangles_read--) {
+                const uint8_t * bytes_per_pixel = stream.in_uint8p(this->Bpp);
+
+                const uint16_t subrec_x      = stream.in_uint16_be();
+                const uint16_t subrec_y      = stream.in_uint16_be();
+                const uint16_t subrec_width  = stream.in_uint16_be();
+                const uint16_t subrec_height = stream.in_uint16_be();
+
+                if ((subrec_x + subrec_width > this->cx) || (subrec_y + subrec_height > this->cy)) {
+                    LOG(LOG_ERR, "VNC Encoding: RRE, subrectangle out of the rectangle");
+                    throw Error(ERR_VNC);
+                }
+
+                uint8_t * point_line_cur = this->rectangle_data.get() + subrec_y * ling_boundary;
+                uint8_t * point_line_end = point_line_cur + subrec_height * ling_boundary;
+                for (; point_line_cur < point_line_end; point_line_cur += ling_boundary) {
+                    for (uint8_t * point_cur = point_line_cur + subrec_x * this->Bpp,
+                         * point_end = point_cur + subrec_width * this->Bpp;
+                         point_cur < point_end; point_cur += this->Bpp) {
+                        memcpy(point_cur, bytes_per_pixel, this->Bpp);
+                    }
+                }
+            }
+
+            if (!this->number_of_subrectangles_remain) {
+                if (this->cx && this->cy) {
+                    api.draw_tile(Rect(this->x, this->y, this->cx, this->cy), this->rectangle_data.get());
+                }
+                this->next_rectangle();
+            }
+        }
+        break;
+
+        case ZRLE_LENGTH:
+            this->zlib_compressed_data_remain = stream.in_uint32_be();
+
+            if (this->verbose) {
+                LOG(LOG_INFO, "VNC Encoding: ZRLE, compressed length = %u",
+                    this->zlib_compressed_data_remain);
+            }
+
+            this->zrle_update_context.Bpp       = this->Bpp;
+            this->zrle_update_context.x         = this->x;
+            this->zrle_update_context.cx        = this->cx;
+            this->zrle_update_context.cx_remain = this->cx;
+            this->zrle_update_context.cy_remain = this->cy;
+            this->zrle_update_context.tile_x    = this->x;
+            this->zrle_update_context.tile_y    = this->y;
+            this->zrle_update_context.data_remain.reset();
+
+            this->state = ZRLE_DATA;
+            if (!this->zlib_compressed_data_remain) {
+                this->next_rectangle();
+            }
+            break;
+
+        case ZRLE_DATA:
+        {
+            // the compressed data is inflated as it is received
+            const uint32_t zlib_compressed_data_length =
+                std::min<uint32_t>(stream.in_remain(), this->zlib_compressed_data_remain);
+
+            this->zstrm.avail_in = zlib_compressed_data_length;
+            this->zstrm.next_in  = stream.p;
+
+            do
+            {
+                HStream zlib_uncompressed_data_buffer(16384, 49152);
+
+                this->zstrm.avail_out = zlib_uncompressed_data_buffer.endroom();
+                this->zstrm.next_out  = zlib_uncompressed_data_buffer.get_data();
+
+                int zlib_result = inflate(&this->zstrm, Z_NO_FLUSH);
+
+                if (zlib_result == Z_BUF_ERROR)
+                {
+                    // the output of the previous call was full and nothing remains
+                    break;
+                }
+                if (zlib_result != Z_OK)
+                {
+                    LOG(LOG_ERR, "vnc zlib decompression failed (%d)", zlib_result);
+                    throw Error(ERR_VNC_ZLIB_INFLATE);
+                }
+
+                zlib_uncompressed_data_buffer.out_skip_bytes(zlib_uncompressed_data_buffer.endroom() - this->zstrm.avail_out);
+                zlib_uncompressed_data_buffer.mark_end();
+                zlib_uncompressed_data_buffer.rewind();
+
+                this->decode_zrle_tiles(zlib_uncompressed_data_buffer, api);
+            }
+            while (this->zstrm.avail_in > 0 || this->zstrm.avail_out == 0);
+
+            stream.in_skip_bytes(zlib_compressed_data_length);
+            this->zlib_compressed_data_remain -= zlib_compressed_data_length;
+            if (!this->zlib_compressed_data_remain) {
+                this->next_rectangle();
+            }
+        }
+        break;
+
+        case CURSOR:
+        {
+            const uint8_t * vnc_pointer_data = stream.in_uint8p(this->cx * this->cy * this->Bpp);
+            const uint8_t * vnc_pointer_mask = stream.in_uint8p(nbbytes(this->cx) * this->cy);
+            api.set_vnc_cursor(Rect(this->x, this->y, this->cx, this->cy), vnc_pointer_data, vnc_pointer_mask);
+            this->next_rectangle();
+        }
+        break;
+
+        case TIGHT_CONTROL:
+        {
+            const uint8_t compression_control = stream.in_uint8();
+
+            for (int i = 0; i < 4; i++) {
+                if (compression_control & (1 << i)) {
+                    inflateReset(&this->tight_zstrm[i]);
+                }
+            }
+
+            const uint8_t compression_type = compression_control >> 4;
+
+            if (this->verbose) {
+                LOG(LOG_INFO, "VNC Encoding: Tight, compression-control=0x%02X x=%u, y=%u, cx=%u, cy=%u",
+                    compression_control, this->x, this->y, this->cx, this->cy);
+            }
+
+            if (compression_type == 8) {
+                this->state = TIGHT_FILL;
+            }
+            else if (compression_type == 9) {
+                this->tight_jpeg = true;
+                this->start_tight_length();
+            }
+            else if (compression_type > 9) {
+                LOG(LOG_ERR, "VNC Encoding: Tight, unknown compression-control 0x%02X", compression_control);
+                throw Error(ERR_VNC_TIGHT_PROTOCOL);
+            }
+            else {
+                // basic compression
+                this->tight_stream_id = compression_type & 0x3;
+                this->tight_filter    = TIGHT_FILTER_COPY;
+                if (compression_type & 0x4) {
+                    this->state = TIGHT_FILTER;
+                }
+                else {
+                    this->start_tight_data();
+                }
+            }
+        }
+        break;
+
+        case TIGHT_FILL:
+        {
+            const size_t rectangle_data_size = this->cx * this->cy * this->Bpp;
+            uint8_t * point_cur = this->reserve_rectangle_data(std::max<size_t>(rectangle_data_size, this->Bpp));
+            this->tpixel_to_pixel(stream.in_uint8p(this->tpixel_size), point_cur);
+            for (uint8_t * point_end = point_cur + rectangle_data_size, * pixel = point_cur;
+                 (point_cur += this->Bpp) < point_end; ) {
+                memcpy(point_cur, pixel, this->Bpp);
+            }
+
+            if (this->cx && this->cy) {
+                api.draw_tile(Rect(this->x, this->y, this->cx, this->cy), this->rectangle_data.get());
+            }
+            this->next_rectangle();
+        }
+        break;
+
+        case TIGHT_FILTER:
+            this->tight_filter = stream.in_uint8();
+            switch (this->tight_filter) {
+            case TIGHT_FILTER_COPY:
+            case TIGHT_FILTER_GRADIENT:
+                this->start_tight_data();
+                break;
+            case TIGHT_FILTER_PALETTE:
+                this->state = TIGHT_PALETTE_SIZE;
+                break;
+            default:
+                LOG(LOG_ERR, "VNC Encoding: Tight, unknown filter %u", this->tight_filter);
+                throw Error(ERR_VNC_TIGHT_PROTOCOL);
+            }
+        break;
+
+        case TIGHT_PALETTE_SIZE:
+            this->tight_palette_count = stream.in_uint8() + 1;
+            this->state               = TIGHT_PALETTE;
+        break;
+
+        case TIGHT_PALETTE:
+            for (uint16_t i = 0; i < this->tight_palette_count; i++) {
+                this->tpixel_to_pixel(stream.in_uint8p(this->tpixel_size), this->tight_palette + i * this->Bpp);
+            }
+            this->start_tight_data();
+        break;
+
+        case TIGHT_LENGTH:
+        {
+            // 7 bits by byte, the most significant bit tells if a byte follows, the third byte has 8 bits
+            const uint8_t byte = stream.in_uint8();
+            if (this->tight_length_shift < 14) {
+                this->tight_length |= (byte & 0x7F) << this->tight_length_shift;
+                if (byte & 0x80) {
+                    this->tight_length_shift += 7;
+                    break;
+                }
+            }
+            else {
+                this->tight_length |= byte << this->tight_length_shift;
+            }
+
+            if (this->verbose) {
+                LOG(LOG_INFO, "VNC Encoding: Tight, %s length = %u",
+                    (this->tight_jpeg ? "JPEG" : "compressed"), this->tight_length);
+            }
+
+            if (!this->tight_length) {
+                LOG(LOG_ERR, "VNC Encoding: Tight, empty %s data", (this->tight_jpeg ? "JPEG" : "compressed"));
+                throw Error(ERR_VNC_TIGHT_PROTOCOL);
+            }
+
+            if (this->tight_jpeg) {
+                this->state = TIGHT_JPEG_DATA;
+            }
+            else {
+                this->zlib_compressed_data_remain = this->tight_length;
+                this->state                       = TIGHT_ZLIB_DATA;
+            }
+        }
+        break;
+
+        case TIGHT_RAW_DATA:
+            stream.in_copy_bytes(this->tight_data.get(), this->tight_data_size);
+            this->draw_tight_rectangle(api);
+            this->next_rectangle();
+        break;
+
+        case TIGHT_ZLIB_DATA:
+        {
+            // the compressed data is inflated as it is received, straight into the filtered data
+            const uint32_t zlib_compressed_data_length =
+                std::min<uint32_t>(stream.in_remain(), this->zlib_compressed_data_remain);
+
+            z_stream & tight_zstrm = this->tight_zstrm[this->tight_stream_id];
+
+            tight_zstrm.avail_in  = zlib_compressed_data_length;
+            tight_zstrm.next_in   = stream.p;
+            tight_zstrm.avail_out = this->tight_data_size - this->tight_data_received;
+            tight_zstrm.next_out  = this->tight_data.get() + this->tight_data_received;
+
+            const int zlib_result = inflate(&tight_zstrm, Z_SYNC_FLUSH);
+            if ((zlib_result != Z_OK) && (zlib_result != Z_BUF_ERROR))
+            {
+                LOG(LOG_ERR, "vnc zlib decompression failed (%d)", zlib_result);
+                throw Error(ERR_VNC_ZLIB_INFLATE);
+            }
+            if (tight_zstrm.avail_in)
+            {
+                LOG(LOG_ERR, "VNC Encoding: Tight, more compressed data than pixels");
+                throw Error(ERR_VNC_TIGHT_PROTOCOL);
+            }
+
+            this->tight_data_received = this->tight_data_size - tight_zstrm.avail_out;
+
+            stream.in_skip_bytes(zlib_compressed_data_length);
+            this->zlib_compressed_data_remain -= zlib_compressed_data_length;
+            if (!this->zlib_compressed_data_remain) {
+                if (this->tight_data_received != this->tight_data_size) {
+                    LOG(LOG_ERR, "VNC Encoding: Tight, compressed data truncated (%zu < %zu)",
+                        this->tight_data_received, this->tight_data_size);
+                    throw Error(ERR_VNC_TIGHT_PROTOCOL);
+                }
+                this->draw_tight_rectangle(api);
+                this->next_rectangle();
+            }
+        }
+        break;
+
+        case TIGHT_JPEG_DATA:
+        {
+            const uint8_t * jpeg_data = stream.in_uint8p(this->tight_length);
+            if (this->cx && this->cy) {
+                uint8_t * rgb = reserve(this->tight_data, this->tight_data_capacity, this->cx * this->cy * 3);
+                if (!aux_::vnc_jpeg::decompress(jpeg_data, this->tight_length, this->cx, this->cy, rgb)) {
+                    throw Error(ERR_VNC_JPEG_DECOMPRESSION);
+                }
+
+                uint8_t * dst = this->reserve_rectangle_data(this->cx * this->cy * this->Bpp);
+                for (uint8_t * end = dst + this->cx * this->cy * this->Bpp; dst < end; dst += this->Bpp, rgb += 3) {
+                    this->write_pixel(dst, this->rgb_to_pixel(rgb[0], rgb[1], rgb[2]));
+                }
+                api.draw_tile(Rect(this->x, this->y, this->cx, this->cy), this->rectangle_data.get());
+            }
+            this->next_rectangle();
+        }
+        break;
+        }
+
+        return true;
+    }
+
+    void decode_zrle_tiles(HStream & uncompressed_data_buffer, FrameBufferUpdateApi & api)
+    {
+        ZRLEUpdateContext & update_context = this->zrle_update_context;
+
+        if (this->verbose) {
+            LOG(LOG_INFO,
+                "VNC Encoding: ZRLE, uncompressed length=%lu remaining data size=%lu",
+                uncompressed_data_buffer.in_remain(),
+                update_context.data_remain.size());
+        }
+
+        if (update_context.data_remain.size())
+        {
+            uncompressed_data_buffer.copy_to_head(
+                update_context.data_remain.get_data(),
+                update_context.data_remain.size());
+            uncompressed_data_buffer.p = uncompressed_data_buffer.get_data();
+
+            update_context.data_remain.reset();
+        }
+
+        uint8_t    tile_data[16384];    // max size with 16 bpp
+
+        uint8_t  * remaining_data        = nullptr;
+        uint16_t   remaining_data_length = 0;
+
+        try
+        {
+            while (uncompressed_data_buffer.in_remain())
+            {
+                uint16_t tile_cx = std::min<uint16_t>(update_context.cx_remain, 64);
+                uint16_t tile_cy = std::min<uint16_t>(update_context.cy_remain, 64);
+
+                const uint8_t * tile_data_p = tile_data;
+
+                uint16_t tile_data_length = tile_cx * tile_cy * update_context.Bpp;
+                if (tile_data_length > sizeof(tile_data))
+                {
+                    LOG(LOG_ERR,
+                        "VNC Encoding: ZRLE, tile buffer too small (%u < %u)",
+                        sizeof(tile_data), tile_data_length);
+                    throw Error(ERR_BUFFER_TOO_SMALL);
+                }
+
+                remaining_data        = uncompressed_data_buffer.p;
+                remaining_data_length = uncompressed_data_buffer.in_remain();
+
+                uint8_t   subencoding = uncompressed_data_buffer.in_uint8();
+
+                if (this->verbose) {
+                    LOG(LOG_INFO, "VNC Encoding: ZRLE, subencoding = %d",
+                        subencoding);
+                }
+
+                if (!subencoding)
+                {
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Raw pixel data");
+                    }
+
+                    if (uncompressed_data_buffer.in_remain() < tile_data_length)
+                    {
+                        throw Error(ERR_VNC_NEED_MORE_DATA);
+                    }
+
+                    tile_data_p = uncompressed_data_buffer.in_uint8p(tile_data_length);
+                }
+                else if (subencoding == 1)
+                {
+                    if (this->verbose) {
+                        LOG(LOG_INFO,
+                            "VNC Encoding: ZRLE, Solid tile (single color)");
+                    }
+
+                    if (uncompressed_data_buffer.in_remain() < update_context.Bpp)
+                    {
+                        throw Error(ERR_VNC_NEED_MORE_DATA);
+                    }
+
+                    const uint8_t * cpixel_pattern = uncompressed_data_buffer.in_uint8p(update_context.Bpp);
+
+                    uint8_t * tmp_tile_data = tile_data;
+
+                    for (int i = 0; i < tile_cx; i++, tmp_tile_data += update_context.Bpp)
+                        memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
+
+                    uint16_t line_size = tile_cx * update_context.Bpp;
+
+                    for (int i = 1; i < tile_cy; i++, tmp_tile_data += line_size)
+                        memcpy(tmp_tile_data, tile_data, line_size);
+                }
+                else if ((subencoding >= 2) && (subencoding <= 16))
+                {
+                    if (this->verbose) {
+                        LOG(LOG_INFO,
+                            "VNC Encoding: ZRLE, Packed palette types, "
+                                "palette size=%d",
+                            subencoding);
+                    }
+
+                    const uint8_t  * palette;
+                    const uint8_t    palette_count = subencoding;
+                    const uint16_t   palette_size  = palette_count * update_context.Bpp;
+
+                    if (uncompressed_data_buffer.in_remain() < palette_size)
+                    {
+                        throw Error(ERR_VNC_NEED_MORE_DATA);
+                    }
+
+                    palette = uncompressed_data_buffer.in_uint8p(palette_size);
+
+                    uint16_t   packed_pixels_length;
+
+                    if (palette_count == 2)
+                    {
+                        packed_pixels_length = (tile_cx + 7) / 8 * tile_cy;
+                    }
+                    else if ((palette_count == 3) || (palette_count == 4))
+                    {
+                        packed_pixels_length = (tile_cx + 3) / 4 * tile_cy;
+                    }
+                    else// if ((palette_count >= 5) && (palette_count <= 16))
+                    {
+                        packed_pixels_length = (tile_cx + 1) / 2 * tile_cy;
+                    }
+
+                    if (uncompressed_data_buffer.in_remain() < packed_pixels_length)
+                    {
+                        throw Error(ERR_VNC_NEED_MORE_DATA);
+                    }
+
+                    const uint8_t * packed_pixels = uncompressed_data_buffer.in_uint8p(packed_pixels_length);
+
+                    uint8_t * tmp_tile_data = tile_data;
+
+                    uint16_t  tile_data_length_remain = tile_data_length;
+
+                    uint8_t         pixel_remain         = tile_cx;
+                    const uint8_t * packed_pixels_remain = packed_pixels;
+                    uint8_t         current              = 0;
+                    uint8_t         index                = 0;
+
+                    uint8_t palette_index;
+
+                    while (tile_data_length_remain >= update_context.Bpp)
+                    {
+                        pixel_remain--;
+
+                        if (!index)
+                        {
+                            current = *packed_pixels_remain;
+                            packed_pixels_remain++;
+                        }
+
+                        if (palette_count == 2)
+                        {
+                            palette_index = (current & 0x80) >> 7;
+                            current <<= 1;
+                            index++;
+
+                            if (!pixel_remain || (index > 7))
+                            {
+                                index = 0;
+                            }
+                        }
+                        else if ((palette_count == 3) || (palette_count == 4))
+                        {
+                            palette_index = (current & 0xC0) >> 6;
+                            current <<= 2;
+                            index++;
+
+                            if (!pixel_remain || (index > 3))
+                            {
+                                index = 0;
+                            }
+                        }
+                        else// if ((palette_count >= 5) && (palette_count <= 16))
+                        {
+                            palette_index = (current & 0xF0) >> 4;
+                            current <<= 4;
+                            index++;
+
+                            if (!pixel_remain || (index > 1))
+                            {
+                                index = 0;
+                            }
+                        }
+
+                        if (!pixel_remain)
+                        {
+                            pixel_remain = tile_cx;
+                        }
+
+                        const uint8_t * cpixel_pattern = palette + palette_index * update_context.Bpp;
+
+                        memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
+
+                        tmp_tile_data           += update_context.Bpp;
+                        tile_data_length_remain -= update_context.Bpp;
+                    }
+                }
+                else if ((subencoding >= 17) && (subencoding <= 127))
+                {
+                    LOG(LOG_ERR, "VNC Encoding: ZRLE, unused");
+                    throw Error(ERR_VNC_ZRLE_PROTOCOL);
+                }
+                else if (subencoding == 128)
+                {
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Plain RLE");
+                    }
+
+                    uint16_t   tile_data_length_remain = tile_data_length;
+
+                    uint16_t   run_length    = 0;
+                    uint8_t  * tmp_tile_data = tile_data;
+
+                    while (tile_data_length_remain >= update_context.Bpp)
+                    {
+
+                        if (uncompressed_data_buffer.in_remain() < update_context.Bpp)
+                        {
+                            throw Error(ERR_VNC_NEED_MORE_DATA);
+                        }
+
+                        const uint8_t * cpixel_pattern = uncompressed_data_buffer.in_uint8p(update_context.Bpp);
+
+                        run_length = 1;
+
+                        while (true)
+                        {
+                            if (uncompressed_data_buffer.in_remain() < 1)
+                            {
+                                throw Error(ERR_VNC_NEED_MORE_DATA);
+                            }
+
+                            uint8_t byte_value = uncompressed_data_buffer.in_uint8();
+                            run_length += byte_value;
+
+                            if (byte_value != 255)
+                                break;
+                        }
+
+                        // LOG(LOG_INFO, "VNC Encoding: ZRLE, run length=%u", run_length);
+
+                        while ((tile_data_length_remain >= update_context.Bpp) && run_length)
+                        {
+                            memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
+
+                            tmp_tile_data           += update_context.Bpp;
+                            tile_data_length_remain -= update_context.Bpp;
+
+                            run_length--;
+                        }
+                    }
+
+                    // LOG(LOG_INFO, "VNC Encoding: ZRLE, run_length=%u", run_length);
+
+                    REDASSERT(!run_length);
+                    REDASSERT(!tile_data_length_remain);
+                }
+                else if (subencoding == 129)
+                {
+                    LOG(LOG_ERR, "VNC Encoding: ZRLE, unused");
+                    throw Error(ERR_VNC_ZRLE_PROTOCOL);
+                }
+                else
+                {
+                    if (this->verbose) {
+                        LOG(LOG_INFO, "VNC Encoding: ZRLE, Palette RLE");
+                    }
+
+                    const uint8_t  * palette;
+                    const uint8_t    palette_count = subencoding - 128;
+                    const uint16_t   palette_size  = palette_count * update_context.Bpp;
+
+                    if (uncompressed_data_buffer.in_remain() < palette_size)
+                    {
+                        throw Error(ERR_VNC_NEED_MORE_DATA);
+                    }
+
+                    palette = uncompressed_data_buffer.in_uint8p(palette_size);
+
+                    uint16_t   tile_data_length_remain = tile_data_length;
+
+                    uint16_t   run_length    = 0;
+                    uint8_t  * tmp_tile_data = tile_data;
+
+                    while (tile_data_length_remain >= update_context.Bpp)
+                    {
+                        if (uncompressed_data_buffer.in_remain() < 1)
+                        {
+                            throw Error(ERR_VNC_NEED_MORE_DATA);
+                        }
+
+                        uint8_t         palette_index  = uncompressed_data_buffer.in_uint8();
+                        const uint8_t * cpixel_pattern = palette + (palette_index & 0x7F) * update_context.Bpp;
+
+                        run_length = 1;
+
+                        if (palette_index & 0x80)
+                        {
+                            while (true)
+                            {
+                                if (uncompressed_data_buffer.in_remain() < 1)
+                                {
+                                    throw Error(ERR_VNC_NEED_MORE_DATA);
+                                }
+
+                                uint8_t byte_value = uncompressed_data_buffer.in_uint8();
+                                run_length += byte_value;
+
+                                if (byte_value != 255)
+                                    break;
+                            }
+                        }
+
+                        // LOG(LOG_INFO, "VNC Encoding: ZRLE, run length=%u", run_length);
+
+                        while ((tile_data_length_remain >= update_context.Bpp) && run_length)
+                        {
+                            memcpy(tmp_tile_data, cpixel_pattern, update_context.Bpp);
+
+                            tmp_tile_data           += update_context.Bpp;
+                            tile_data_length_remain -= update_context.Bpp;
+
+                            run_length--;
+                        }
+                    }
+
+                    // LOG(LOG_INFO, "VNC Encoding: ZRLE, run_length=%u", run_length);
+
+                    REDASSERT(!run_length);
+                    REDASSERT(!tile_data_length_remain);
+                }
+
+                api.draw_tile(Rect(update_context.tile_x, update_context.tile_y,
+                                   tile_cx, tile_cy),
+                              tile_data_p);
+
+                update_context.cx_remain -= tile_cx;
+                update_context.tile_x    += tile_cx;
+
+                if (!update_context.cx_remain)
+                {
+                    update_context.cx_remain =  update_context.cx;
+                    update_context.cy_remain -= tile_cy;
+
+                    update_context.tile_x =  update_context.x;
+                    update_context.tile_y += tile_cy;
+                }
+            }
+        }
+        catch (Error & e)
+        {
+            if (e.id != ERR_VNC_NEED_MORE_DATA)
+                throw;
+            else
+            {
+                update_context.data_remain.out_copy_bytes(remaining_data,
+                    remaining_data_length);
+                update_context.data_remain.mark_end();
+            }
+        }
+    }
+};
+
+#endif
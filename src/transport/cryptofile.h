@@ -25,7 +25,13 @@ enum crypto_file_state {
 #define AES_BLOCK_SIZE          16
 #define WABCRYPTOFILE_MAGIC     0x4D464357
 #define WABCRYPTOFILE_EOF_MAGIC 0x5743464D
-#define WABCRYPTOFILE_VERSION   0x00000001
+#define WABCRYPTOFILE_VERSION_CBC 0x00000001  /* AES-256-CBC blocks of CRYPTO_BUFFER_SIZE */
+#define WABCRYPTOFILE_VERSION_GCM 0x00000002  /* AES-256-GCM blocks of a size given in the header */
+#define WABCRYPTOFILE_VERSION     WABCRYPTOFILE_VERSION_GCM
+
+/* magic(4) + version(4) + iv(32), followed by block_size(4) from version 2 */
+#define WABCRYPTOFILE_HEADER_SIZE    40
+#define WABCRYPTOFILE_HEADER_SIZE_V2 44
 
 enum {
     DERIVATOR_LENGTH = 8
@@ -41,6 +47,14 @@ enum {
 
 #define CRYPTO_BUFFER_SIZE ((4096 * 4))
 
+/* block sizes of version 2 */
+#define CRYPTO_DEFAULT_BLOCK_SIZE ((64 * 1024))
+#define CRYPTO_MIN_BLOCK_SIZE     ((4 * 1024))
+#define CRYPTO_MAX_BLOCK_SIZE     ((1024 * 1024))
+
+#define CRYPTO_GCM_IV_SIZE  12
+#define CRYPTO_GCM_TAG_SIZE 16
+
 /* 256 bits key size */
 #define CRYPTO_KEY_LENGTH 32
 #define HMAC_KEY_LENGTH   CRYPTO_KEY_LENGTH
@@ -48,6 +62,8 @@ enum {
 struct CryptoContext {
     unsigned char hmac_key[HMAC_KEY_LENGTH];
     unsigned char crypto_key[CRYPTO_KEY_LENGTH];
+    unsigned int  file_version; /* of the written files, 0: WABCRYPTOFILE_VERSION */
+    unsigned int  block_size;   /* of the written files (version 2), 0: CRYPTO_DEFAULT_BLOCK_SIZE */
 };
 
 /* Standard unbase64, store result in buffer. Returns written bytes
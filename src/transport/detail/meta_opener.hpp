@@ -29,6 +29,8 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 namespace detail
 {
@@ -138,6 +140,16 @@ namespace detail
             }
         };
 
+        // Every file of a recording starts with a keyframe (meta, save state,
+        // image and caches chunks), the lines of the meta file are the index
+        // of these keyframes.
+        struct MetaLine
+        {
+            std::string path;
+            unsigned    begin_chunk_time;
+            unsigned    end_chunk_time;
+        };
+
         char path[1024 + (std::numeric_limits<unsigned>::digits10 + 1) * 2 + 4 + 64 * 2 + 2];
         BufMeta buf_meta;
         ReaderLine<ReaderBuf> reader;
@@ -145,6 +157,10 @@ namespace detail
         unsigned end_chunk_time;
         char meta_path[2048];
         uint32_t verbose;
+        std::vector<MetaLine> lines;    // lines already read
+        size_t                line_index;
+        bool                  end_of_meta;
+        unsigned              end_time;         // files beginning after are not read, 0: no limit
 
         static BufMeta & open_and_return(const char * filename, BufMeta & buf)
         {
@@ -163,6 +179,9 @@ namespace detail
         , begin_chunk_time(0)
         , end_chunk_time(0)
         , verbose(params.verbose)
+        , line_index(0)
+        , end_of_meta(false)
+        , end_time(0)
         {
             // headers
             //@{
@@ -227,6 +246,44 @@ namespace detail
             return this->next_line();
         }
 
+        /// Opens the file of the last keyframe before sec (the first file if
+        /// sec is before the recording), the file is read from its beginning.
+        /// \return 0 if success, ERR_TRANSPORT_NO_MORE_DATA if sec is after the recording
+        int seek_to_time(unsigned sec)
+        {
+            while (this->lines.empty() || this->lines.back().begin_chunk_time <= sec) {
+                if (const int e = this->read_meta_line()) {
+                    if (e != ERR_TRANSPORT_NO_MORE_DATA || this->lines.empty()) {
+                        return e;
+                    }
+                    if (sec >= this->lines.back().end_chunk_time) {
+                        return e;
+                    }
+                    break;
+                }
+            }
+
+            auto it = std::upper_bound(this->lines.begin(), this->lines.end(), sec,
+                [](unsigned sec, MetaLine const & line) { return sec < line.begin_chunk_time; });
+            if (it != this->lines.begin()) {
+                --it;
+            }
+
+            if (this->is_open()) {
+                this->close();
+            }
+            this->line_index = it - this->lines.begin();
+            return this->open_next();
+        }
+
+        /// The files beginning at or after sec are not read (0 reads to the end of the recording).
+        void set_end_time(unsigned sec) noexcept
+        { this->end_time = sec; }
+
+        /// number of files opened by next() or seek_to_time() (current file included)
+        size_t get_line_index() const noexcept
+        { return this->line_index; }
+
     private:
         int open_next() {
             if (const int e = this->next_line()) {
@@ -238,11 +295,39 @@ namespace detail
 
         int next_line()
         {
-            ssize_t len = reader.read_line(this->path, sizeof(this->path) - 1, ERR_TRANSPORT_NO_MORE_DATA);
+            if (this->line_index == this->lines.size()) {
+                if (const int e = this->read_meta_line()) {
+                    return e;
+                }
+            }
+
+            if (this->end_time && this->lines[this->line_index].begin_chunk_time >= this->end_time) {
+                return ERR_TRANSPORT_NO_MORE_DATA;
+            }
+
+            MetaLine const & line = this->lines[this->line_index++];
+            strcpy(this->path, line.path.c_str());
+            this->begin_chunk_time = line.begin_chunk_time;
+            this->end_chunk_time   = line.end_chunk_time;
+            return 0;
+        }
+
+        int read_meta_line()
+        {
+            // the reader must not be called again after the last line
+            if (this->end_of_meta) {
+                return ERR_TRANSPORT_NO_MORE_DATA;
+            }
+
+            char path[sizeof(this->path)];
+            ssize_t len = reader.read_line(path, sizeof(path) - 1, ERR_TRANSPORT_NO_MORE_DATA);
             if (len < 0) {
+                if (-len == ERR_TRANSPORT_NO_MORE_DATA) {
+                    this->end_of_meta = true;
+                }
                 return -len;
             }
-            this->path[len] = 0;
+            path[len] = 0;
 
             // Line format "fffff sssss eeeee hhhhh HHHHH"
             //                               ^  ^  ^  ^
@@ -257,8 +342,8 @@ namespace detail
             //     space(1) + hash1(64) + space(1) + hash2(64) >= 135
             typedef std::reverse_iterator<char*> reverse_iterator;
 
-            reverse_iterator last(this->path);
-            reverse_iterator first(this->path + len);
+            reverse_iterator last(path);
+            reverse_iterator first(path + len);
             reverse_iterator e1 = std::find(first, last, ' ');
             reverse_iterator e2 = (e1 == last) ? e1 : std::find(e1 + 1, last, ' ');
             if (e1 - first == 64 && e2 != last) {
@@ -267,30 +352,32 @@ namespace detail
                 e2 = (e1 == last) ? e1 : std::find(e1 + 1, last, ' ');
             }
 
-            this->end_chunk_time = this->parse_sec(e1.base(), first.base());
+            const unsigned end_chunk_time = this->parse_sec(e1.base(), first.base());
             if (e1 != last) {
                 ++e1;
             }
-            this->begin_chunk_time = this->parse_sec(e2.base(), e1.base());
+            const unsigned begin_chunk_time = this->parse_sec(e2.base(), e1.base());
 
             if (e2 != last) {
                 *e2 = 0;
             }
 
-            if (!file_exist(this->path)) {
+            if (!file_exist(path)) {
                 char original_path[1024] = {};
                 char basename[1024] = {};
                 char extension[256] = {};
                 char filename[2048] = {};
 
-                canonical_path( this->path, original_path, sizeof(original_path), basename, sizeof(basename), extension
+                canonical_path( path, original_path, sizeof(original_path), basename, sizeof(basename), extension
                               , sizeof(extension), this->verbose);
                 snprintf(filename, sizeof(filename), "%s%s%s", this->meta_path, basename, extension);
 
                 if (file_exist(filename)) {
-                    strcpy(this->path, filename);
+                    strcpy(path, filename);
                 }
             }
+
+            this->lines.push_back(MetaLine{path, begin_chunk_time, end_chunk_time});
             return 0;
         }
 
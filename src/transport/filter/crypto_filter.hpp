@@ -22,6 +22,7 @@
 #define REDEMPTION_TRANSPORT_FILTER_CRYPTO_FILTER_HPP
 
 #include "log.hpp"
+#include "noncopyable.hpp"
 
 #include "openssl_crypto.hpp"
 #include "openssl_evp.hpp"
@@ -32,12 +33,26 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 
 #include "cryptofile.h"
 
 #define HASH_LEN (MD_HASH_LENGTH << 1)
 
+// Version 1: header(40), then size(4) + AES-256-CBC(snappy(block)) by block of CRYPTO_BUFFER_SIZE,
+//  then WABCRYPTOFILE_EOF_MAGIC(4) + raw_size(4).
+// Version 2: header(44), then size(4) + AES-256-GCM(snappy(block)) + tag(16) by block of block_size
+//  bytes, then WABCRYPTOFILE_EOF_MAGIC(4) + raw_size(4) + tag(16). The key is the trace key, the
+//  nonce of a block is the first 12 bytes of the iv xored with the block number, so the blocks
+//  can neither be modified nor reordered. The tag of the end of file authenticates the header and
+//  raw_size, a truncated file is detected.
+// Both versions are followed by the HMAC of the whole file (hash files and mwrm).
+
 namespace transfil {
     namespace detail {
         inline int init_cypher(EVP_CIPHER_CTX * ctx, unsigned char * trace_key, const unsigned char * iv, bool is_decrypion)
@@ -64,59 +79,209 @@ namespace transfil {
 
             return 0;
         }
+
+        // the nonce is set by block
+        inline int init_gcm_cypher(EVP_CIPHER_CTX * ctx, const unsigned char * trace_key, bool is_decrypion)
+        {
+            const EVP_CIPHER * cipher = ::EVP_aes_256_gcm();
+
+            ::EVP_CIPHER_CTX_init(ctx);
+            if ((is_decrypion
+            ? ::EVP_DecryptInit_ex(ctx, cipher, nullptr, trace_key, nullptr)
+            : ::EVP_EncryptInit_ex(ctx, cipher, nullptr, trace_key, nullptr)) != 1) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not initialize %scrypion context\n",
+                    is_decrypion ? "de":"en", ::getpid());
+                return -1;
+            }
+
+            return 0;
+        }
+
+        inline void gcm_nonce(const unsigned char * iv, uint64_t block_number, unsigned char * nonce)
+        {
+            ::memcpy(nonce, iv, CRYPTO_GCM_IV_SIZE);
+            for (int i = CRYPTO_GCM_IV_SIZE - 8; i < CRYPTO_GCM_IV_SIZE; i++, block_number >>= 8) {
+                nonce[i] ^= block_number & 0xFF;
+            }
+        }
+
+        // Writes the blocks of a file on a thread, one at a time: the next block is
+        // compressed and encrypted while the previous one is written.
+        class block_writer : noncopyable
+        {
+            std::mutex              mutex;
+            std::condition_variable block_pushed;
+            std::condition_variable block_written;
+
+            std::function<ssize_t(const void *, size_t)> sink_write;
+            const void * data    = nullptr;
+            size_t       len     = 0;
+            bool         pending = false;
+            bool         stop    = false;
+            int          result  = 0;   // of the last write
+            int          errnum  = 0;
+
+            std::thread thread;
+
+        public:
+            block_writer() = default;
+
+            ~block_writer()
+            {
+                if (this->thread.joinable()) {
+                    {
+                        std::lock_guard<std::mutex> lock(this->mutex);
+                        this->stop = true;
+                    }
+                    this->block_pushed.notify_one();
+                    this->thread.join();
+                }
+            }
+
+            // Waits until the pending block is written.
+            ///\return 0 if success, otherwise a negatif number and errno is set by the failed write
+            int wait()
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->block_written.wait(lock, [this]() { return !this->pending; });
+                const int result = this->result;
+                if (result) {
+                    this->result = 0;
+                    errno = this->errnum;
+                }
+                return result;
+            }
+
+            // Starts the write of a block once the pending one is written, data must stay
+            //  valid until the next push() or wait().
+            ///\return 0 if success, otherwise the error of the previous write
+            template<class Sink>
+            int push(Sink & snk, const void * data, size_t len)
+            {
+                if (const int err = this->wait()) {
+                    return err;
+                }
+                if (!this->thread.joinable()) {
+                    this->thread = std::thread(&block_writer::run, this);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->sink_write = [&snk](const void * data, size_t len) { return snk.write(data, len); };
+                    this->data       = data;
+                    this->len        = len;
+                    this->pending    = true;
+                }
+                this->block_pushed.notify_one();
+                return 0;
+            }
+
+        private:
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                for (;;) {
+                    this->block_pushed.wait(lock, [this]() { return this->stop || this->pending; });
+                    if (!this->pending) {
+                        break;
+                    }
+
+                    lock.unlock();
+                    const ssize_t res    = this->sink_write(this->data, this->len);
+                    const int     errnum = errno;
+                    lock.lock();
+
+                    if (res < ssize_t(this->len)) {
+                        this->result = (res < 0) ? int(res) : -1;
+                        this->errnum = errnum;
+                    }
+                    this->pending = false;
+                    this->block_written.notify_all();
+                }
+            }
+        };
     }
 
-    class decrypt_filter
+    class decrypt_filter : noncopyable
     {
-        char           buf[CRYPTO_BUFFER_SIZE]; //
+        std::unique_ptr<char[]>          buf;               // the decoded block
+        std::unique_ptr<unsigned char[]> ciphered_buf;
+        std::unique_ptr<unsigned char[]> compressed_buf;
         EVP_CIPHER_CTX ectx;                    // [en|de]cryption context
         uint32_t       pos;                     // current position in buf
         uint32_t       raw_size;                // the unciphered/uncompressed file size
         uint32_t       state;                   // enum crypto_file_state
-        unsigned int   MAX_CIPHERED_SIZE;       // = MAX_COMPRESSED_SIZE + AES_BLOCK_SIZE;
+        unsigned int   MAX_CIPHERED_SIZE;       // = MAX_COMPRESSED_SIZE + AES_BLOCK_SIZE (or CRYPTO_GCM_TAG_SIZE);
+        uint32_t       version;
+        uint32_t       block_size;              // size of the decoded blocks
+        uint64_t       block_number;            // of the next block, for the nonce (version 2)
+        unsigned char  header[WABCRYPTOFILE_HEADER_SIZE_V2];
 
     public:
-        decrypt_filter() = default;
-        //: pos(0)
-        //, raw_size(0)
-        //, state(0)
-        //, MAX_CIPHERED_SIZE(0)
-        //{}
+        decrypt_filter()
+        {
+            ::EVP_CIPHER_CTX_init(&this->ectx);
+        }
+
+        ~decrypt_filter()
+        {
+            ::EVP_CIPHER_CTX_cleanup(&this->ectx);
+        }
 
         template<class Source>
         int open(Source & src, unsigned char * trace_key)
         {
-            ::memset(this->buf, 0, sizeof(this->buf));
-            ::memset(&this->ectx, 0, sizeof(this->ectx));
+            ::EVP_CIPHER_CTX_cleanup(&this->ectx);
 
             this->pos = 0;
             this->raw_size = 0;
             this->state = 0;
-            const size_t MAX_COMPRESSED_SIZE = ::snappy_max_compressed_length(CRYPTO_BUFFER_SIZE);
-            this->MAX_CIPHERED_SIZE = MAX_COMPRESSED_SIZE + AES_BLOCK_SIZE;
-
-            unsigned char tmp_buf[40];
+            this->block_number = 0;
 
-            if (const ssize_t err = this->raw_read(src, tmp_buf, 40)) {
+            if (const ssize_t err = this->raw_read(src, this->header, WABCRYPTOFILE_HEADER_SIZE)) {
                 return err;
             }
 
             // Check magic
+            const unsigned char * tmp_buf = this->header;
             const uint32_t magic = tmp_buf[0] + (tmp_buf[1] << 8) + (tmp_buf[2] << 16) + (tmp_buf[3] << 24);
             if (magic != WABCRYPTOFILE_MAGIC) {
                 LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Wrong file type %04x != %04x\n",
                     ::getpid(), magic, WABCRYPTOFILE_MAGIC);
                 return -1;
             }
-            const int version = tmp_buf[4] + (tmp_buf[5] << 8) + (tmp_buf[6] << 16) + (tmp_buf[7] << 24);
-            if (version > WABCRYPTOFILE_VERSION) {
+            this->version = tmp_buf[4] + (tmp_buf[5] << 8) + (tmp_buf[6] << 16) + (tmp_buf[7] << 24);
+            if (this->version > WABCRYPTOFILE_VERSION) {
                 LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Unsupported version %04x > %04x\n",
-                    ::getpid(), version, WABCRYPTOFILE_VERSION);
+                    ::getpid(), this->version, WABCRYPTOFILE_VERSION);
                 return -1;
             }
 
-            unsigned char * const iv = tmp_buf + 8;
-            return detail::init_cypher(&this->ectx, trace_key, iv, true);
+            unsigned char * const iv = this->header + 8;
+
+            if (this->version < WABCRYPTOFILE_VERSION_GCM) {
+                this->block_size = CRYPTO_BUFFER_SIZE;
+                this->MAX_CIPHERED_SIZE = ::snappy_max_compressed_length(this->block_size) + AES_BLOCK_SIZE;
+                if (const int err = this->alloc_buffers()) {
+                    return err;
+                }
+                return detail::init_cypher(&this->ectx, trace_key, iv, true);
+            }
+
+            if (const ssize_t err = this->raw_read(src, this->header + WABCRYPTOFILE_HEADER_SIZE,
+                                                   WABCRYPTOFILE_HEADER_SIZE_V2 - WABCRYPTOFILE_HEADER_SIZE)) {
+                return err;
+            }
+            tmp_buf = this->header + WABCRYPTOFILE_HEADER_SIZE;
+            this->block_size = tmp_buf[0] + (tmp_buf[1] << 8) + (tmp_buf[2] << 16) + (tmp_buf[3] << 24);
+            if (this->block_size < CRYPTO_MIN_BLOCK_SIZE || this->block_size > CRYPTO_MAX_BLOCK_SIZE) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Unsupported block size %u\n", ::getpid(), this->block_size);
+                return -1;
+            }
+            this->MAX_CIPHERED_SIZE = ::snappy_max_compressed_length(this->block_size) + CRYPTO_GCM_TAG_SIZE;
+            if (const int err = this->alloc_buffers()) {
+                return err;
+            }
+            return detail::init_gcm_cypher(&this->ectx, trace_key, true);
         }
 
         template<class Source>
@@ -133,70 +298,10 @@ namespace transfil {
                 // Check how much we have decoded
                 if (!this->raw_size) {
                     // Buffer is empty. Read a chunk from file
-                    /*
-                     i f (-1 == ::do_chunk_read*(this)) {
-                         return -1;
-                }
-                */
-                    // TODO: avoid reading size directly into an integer, performance enhancement is minimal
-                    // and it's not portable because of endianness issue => read in a buffer and decode by hand
-                    unsigned char tmp_buf[4] = {};
-                    if (const int err = this->raw_read(src, tmp_buf, 4)) {
+                    if (const int err = this->read_chunk(src)) {
                         return err;
                     }
 
-                    uint32_t ciphered_buf_size = tmp_buf[0] + (tmp_buf[1] << 8) + (tmp_buf[2] << 16) + (tmp_buf[3] << 24);
-
-                    if (ciphered_buf_size == WABCRYPTOFILE_EOF_MAGIC) { // end of file
-                        this->state |= CF_EOF;
-                        this->pos = 0;
-                        this->raw_size = 0;
-                    }
-                    else {
-                        if (ciphered_buf_size > this->MAX_CIPHERED_SIZE) {
-                            LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Integrity error, erroneous chunk size!\n", ::getpid());
-                            return -1;
-                        }
-                        else {
-                            uint32_t compressed_buf_size = ciphered_buf_size + AES_BLOCK_SIZE;
-                            //char ciphered_buf[ciphered_buf_size];
-                            unsigned char ciphered_buf[65536];
-                            //char compressed_buf[compressed_buf_size];
-                            unsigned char compressed_buf[65536];
-
-                            if (const ssize_t err = this->raw_read(src, ciphered_buf, ciphered_buf_size)) {
-                                return err;
-                            }
-
-                            if (this->xaes_decrypt(ciphered_buf, ciphered_buf_size, compressed_buf, &compressed_buf_size)) {
-                                return -1;
-                            }
-
-                            size_t chunk_size = CRYPTO_BUFFER_SIZE;
-                            const snappy_status status = snappy_uncompress(reinterpret_cast<char *>(compressed_buf),
-                                                                           compressed_buf_size, this->buf, &chunk_size);
-
-                            switch (status)
-                            {
-                                case SNAPPY_OK:
-                                    break;
-                                case SNAPPY_INVALID_INPUT:
-                                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with status code INVALID_INPUT!\n", getpid());
-                                    return -1;
-                                case SNAPPY_BUFFER_TOO_SMALL:
-                                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with status code BUFFER_TOO_SMALL!\n", getpid());
-                                    return -1;
-                                default:
-                                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with unknown status code (%d)!\n", getpid(), status);
-                                    return -1;
-                            }
-
-                            this->pos = 0;
-                            // When reading, raw_size represent the current chunk size
-                            this->raw_size = chunk_size;
-                        }
-                    }
-
                     // TODO: check that
                     if (!this->raw_size) { // end of file reached
                         break;
@@ -207,7 +312,7 @@ namespace transfil {
                 // Check how much we can copy
                 unsigned int copiable_size = MIN(remaining_size, requested_size);
                 // Copy buffer to caller
-                ::memcpy(static_cast<char*>(data) + (len - requested_size), this->buf + this->pos, copiable_size);
+                ::memcpy(static_cast<char*>(data) + (len - requested_size), this->buf.get() + this->pos, copiable_size);
                 this->pos      += copiable_size;
                 requested_size -= copiable_size;
                 // Check if we reach the end
@@ -219,6 +324,111 @@ namespace transfil {
         }
 
     private:
+        int alloc_buffers()
+        {
+            this->buf.reset(new (std::nothrow) char[this->block_size]);
+            this->ciphered_buf.reset(new (std::nothrow) unsigned char[this->MAX_CIPHERED_SIZE]);
+            this->compressed_buf.reset(new (std::nothrow) unsigned char[this->MAX_CIPHERED_SIZE + AES_BLOCK_SIZE]);
+            if (!this->buf || !this->ciphered_buf || !this->compressed_buf) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: malloc!\n", ::getpid());
+                return -1;
+            }
+            return 0;
+        }
+
+        ///\return 0 if success, otherwise a negatif number
+        template<class Source>
+        int read_chunk(Source & src)
+        {
+            // TODO: avoid reading size directly into an integer, performance enhancement is minimal
+            // and it's not portable because of endianness issue => read in a buffer and decode by hand
+            unsigned char tmp_buf[4] = {};
+            if (const int err = this->raw_read(src, tmp_buf, 4)) {
+                return err;
+            }
+
+            uint32_t ciphered_buf_size = tmp_buf[0] + (tmp_buf[1] << 8) + (tmp_buf[2] << 16) + (tmp_buf[3] << 24);
+
+            if (ciphered_buf_size == WABCRYPTOFILE_EOF_MAGIC) { // end of file
+                this->state |= CF_EOF;
+                this->pos = 0;
+                this->raw_size = 0;
+                return (this->version < WABCRYPTOFILE_VERSION_GCM) ? 0 : this->check_eof(src);
+            }
+
+            if (ciphered_buf_size > this->MAX_CIPHERED_SIZE) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Integrity error, erroneous chunk size!\n", ::getpid());
+                return -1;
+            }
+
+            unsigned char * const ciphered_buf = this->ciphered_buf.get();
+            unsigned char * const compressed_buf = this->compressed_buf.get();
+
+            if (const ssize_t err = this->raw_read(src, ciphered_buf, ciphered_buf_size)) {
+                return err;
+            }
+
+            uint32_t compressed_buf_size;
+            if (this->version < WABCRYPTOFILE_VERSION_GCM) {
+                compressed_buf_size = ciphered_buf_size + AES_BLOCK_SIZE;
+                if (this->xaes_decrypt(ciphered_buf, ciphered_buf_size, compressed_buf, &compressed_buf_size)) {
+                    return -1;
+                }
+            }
+            else {
+                if (ciphered_buf_size < CRYPTO_GCM_TAG_SIZE) {
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Integrity error, erroneous chunk size!\n", ::getpid());
+                    return -1;
+                }
+                compressed_buf_size = ciphered_buf_size - CRYPTO_GCM_TAG_SIZE;
+                if (this->xgcm_decrypt(nullptr, 0, ciphered_buf, compressed_buf_size, compressed_buf,
+                                       ciphered_buf + compressed_buf_size)) {
+                    return -1;
+                }
+            }
+
+            size_t chunk_size = this->block_size;
+            const snappy_status status = snappy_uncompress(reinterpret_cast<char *>(compressed_buf),
+                                                           compressed_buf_size, this->buf.get(), &chunk_size);
+
+            switch (status)
+            {
+                case SNAPPY_OK:
+                    break;
+                case SNAPPY_INVALID_INPUT:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with status code INVALID_INPUT!\n", getpid());
+                    return -1;
+                case SNAPPY_BUFFER_TOO_SMALL:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with status code BUFFER_TOO_SMALL!\n", getpid());
+                    return -1;
+                default:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy decompression failed with unknown status code (%d)!\n", getpid(), status);
+                    return -1;
+            }
+
+            this->pos = 0;
+            // When reading, raw_size represent the current chunk size
+            this->raw_size = chunk_size;
+            return 0;
+        }
+
+        // raw_size(4) + tag(16) after WABCRYPTOFILE_EOF_MAGIC, the tag authenticates the header and the end of file
+        template<class Source>
+        int check_eof(Source & src)
+        {
+            unsigned char eof_buf[WABCRYPTOFILE_HEADER_SIZE_V2 + 8 + CRYPTO_GCM_TAG_SIZE];
+            unsigned char * const eof = eof_buf + WABCRYPTOFILE_HEADER_SIZE_V2;
+            ::memcpy(eof_buf, this->header, WABCRYPTOFILE_HEADER_SIZE_V2);
+            eof[0] = WABCRYPTOFILE_EOF_MAGIC & 0xFF;
+            eof[1] = (WABCRYPTOFILE_EOF_MAGIC >> 8) & 0xFF;
+            eof[2] = (WABCRYPTOFILE_EOF_MAGIC >> 16) & 0xFF;
+            eof[3] = (WABCRYPTOFILE_EOF_MAGIC >> 24) & 0xFF;
+            if (const ssize_t err = this->raw_read(src, eof + 4, 4 + CRYPTO_GCM_TAG_SIZE)) {
+                return err;
+            }
+            return this->xgcm_decrypt(eof_buf, WABCRYPTOFILE_HEADER_SIZE_V2 + 8, nullptr, 0, nullptr, eof + 8);
+        }
+
         ///\return 0 if success, otherwise a negatif number
         template<class Source>
         ssize_t raw_read(Source & src, void * data, size_t len)
@@ -248,38 +458,121 @@ namespace transfil {
             *dst_sz = safe_size + remaining_size;
             return 0;
         }
-    };
 
+        /* Decrypt src_buf into dst_buf (src_sz bytes) and check the tag of the block with aad
+         * Return 0 on success, negative value on error
+         */
+        int xgcm_decrypt(const unsigned char * aad, uint32_t aad_sz, const unsigned char * src_buf, uint32_t src_sz,
+                         unsigned char * dst_buf, const unsigned char * tag)
+        {
+            unsigned char nonce[CRYPTO_GCM_IV_SIZE];
+            detail::gcm_nonce(this->header + 8, this->block_number++, nonce);
 
-    class encrypt_filter
+            int safe_size = 0;
+            unsigned char final_buf[AES_BLOCK_SIZE];
+            int remaining_size = 0;
+
+            if (EVP_DecryptInit_ex(&this->ectx, nullptr, nullptr, nullptr, nonce) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not prepare decryption context!\n", getpid());
+                return -1;
+            }
+            if (aad_sz && EVP_DecryptUpdate(&this->ectx, nullptr, &safe_size, aad, aad_sz) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not decrypt data!\n", getpid());
+                return -1;
+            }
+            if (src_sz && EVP_DecryptUpdate(&this->ectx, dst_buf, &safe_size, src_buf, src_sz) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not decrypt data!\n", getpid());
+                return -1;
+            }
+            if (EVP_CIPHER_CTX_ctrl(&this->ectx, EVP_CTRL_GCM_SET_TAG, CRYPTO_GCM_TAG_SIZE,
+                                    const_cast<unsigned char *>(tag)) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not set the tag!\n", getpid());
+                return -1;
+            }
+            if (EVP_DecryptFinal_ex(&this->ectx, final_buf, &remaining_size) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Integrity error, authentication of the chunk failed!\n", getpid());
+                return -1;
+            }
+            return 0;
+        }
+    };
+
+    class encrypt_filter : noncopyable
     {
-        char           buf[CRYPTO_BUFFER_SIZE]; //
+        std::unique_ptr<char[]>          buf;                   // the block being filled
+        std::unique_ptr<unsigned char[]> compressed_buf;
+        std::unique_ptr<unsigned char[]> ciphered_bufs[2];      // the block being encrypted and the block being written
+        unsigned       ciphered_index;          // of the block being encrypted
+        uint32_t       buffers_block_size;      // block size of the allocated buffers
         EVP_CIPHER_CTX ectx;                    // [en|de]cryption context
         EVP_MD_CTX     hctx;                    // hash context
         EVP_MD_CTX     hctx4k;                  // hash context
         uint32_t       pos;                     // current position in buf
         uint32_t       raw_size;                // the unciphered/uncompressed file size
         uint32_t       file_size;               // the current file size
+        uint32_t       version;
+        uint32_t       block_size;
+        uint64_t       block_number;            // of the next block, for the nonce (version 2)
+        unsigned char  header[WABCRYPTOFILE_HEADER_SIZE_V2];
+        uint32_t       header_size;
+
+        // last member, the pending write is finished before the buffers are released
+        detail::block_writer writer;
 
     public:
-        encrypt_filter() = default;
-        //: pos(0)
-        //, raw_size(0)
-        //, file_size(0)
-        //{}
+        encrypt_filter()
+        : buffers_block_size(0)
+        {
+            ::EVP_CIPHER_CTX_init(&this->ectx);
+            ::EVP_MD_CTX_init(&this->hctx);
+            ::EVP_MD_CTX_init(&this->hctx4k);
+        }
+
+        ~encrypt_filter()
+        {
+            ::EVP_CIPHER_CTX_cleanup(&this->ectx);
+            ::EVP_MD_CTX_cleanup(&this->hctx);
+            ::EVP_MD_CTX_cleanup(&this->hctx4k);
+        }
 
         template<class Sink>
         int open(Sink & snk, unsigned char * trace_key, CryptoContext * cctx, const unsigned char * iv)
         {
-            ::memset(this->buf, 0, sizeof(this->buf));
-            ::memset(&this->ectx, 0, sizeof(this->ectx));
-            ::memset(&this->hctx, 0, sizeof(this->hctx));
-            ::memset(&this->hctx4k, 0, sizeof(this->hctx4k));
+            ::EVP_CIPHER_CTX_cleanup(&this->ectx);
+            ::EVP_MD_CTX_cleanup(&this->hctx);
+            ::EVP_MD_CTX_cleanup(&this->hctx4k);
             this->pos = 0;
             this->raw_size = 0;
             this->file_size = 0;
+            this->block_number = 0;
+
+            this->version = cctx->file_version ? cctx->file_version : WABCRYPTOFILE_VERSION;
+            if (this->version > WABCRYPTOFILE_VERSION) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Unsupported version %04x > %04x\n",
+                    ::getpid(), this->version, WABCRYPTOFILE_VERSION);
+                return -1;
+            }
 
-            if (const int err = detail::init_cypher(&this->ectx, trace_key, iv, false)) {
+            if (this->version < WABCRYPTOFILE_VERSION_GCM) {
+                this->block_size = CRYPTO_BUFFER_SIZE;
+                this->header_size = WABCRYPTOFILE_HEADER_SIZE;
+                if (const int err = detail::init_cypher(&this->ectx, trace_key, iv, false)) {
+                    return err;
+                }
+            }
+            else {
+                this->block_size = cctx->block_size ? cctx->block_size : CRYPTO_DEFAULT_BLOCK_SIZE;
+                if (this->block_size < CRYPTO_MIN_BLOCK_SIZE || this->block_size > CRYPTO_MAX_BLOCK_SIZE) {
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Unsupported block size %u\n", ::getpid(), this->block_size);
+                    return -1;
+                }
+                this->header_size = WABCRYPTOFILE_HEADER_SIZE_V2;
+                if (const int err = detail::init_gcm_cypher(&this->ectx, trace_key, false)) {
+                    return err;
+                }
+            }
+
+            if (const int err = this->alloc_buffers()) {
                 return err;
             }
 
@@ -301,6 +594,7 @@ namespace transfil {
                 return -1;
             }
 
+
             // HMAC: key^ipad
             const int     blocksize = ::EVP_MD_block_size(md);
             unsigned char * key_buf = new(std::nothrow) unsigned char[blocksize];
@@ -336,26 +630,30 @@ namespace transfil {
             }
 
             // update context with previously written data
-            char tmp_buf[40];
+            unsigned char * tmp_buf = this->header;
             tmp_buf[0] = WABCRYPTOFILE_MAGIC & 0xFF;
             tmp_buf[1] = (WABCRYPTOFILE_MAGIC >> 8) & 0xFF;
             tmp_buf[2] = (WABCRYPTOFILE_MAGIC >> 16) & 0xFF;
             tmp_buf[3] = (WABCRYPTOFILE_MAGIC >> 24) & 0xFF;
-            tmp_buf[4] = WABCRYPTOFILE_VERSION & 0xFF;
-            tmp_buf[5] = (WABCRYPTOFILE_VERSION >> 8) & 0xFF;
-            tmp_buf[6] = (WABCRYPTOFILE_VERSION >> 16) & 0xFF;
-            tmp_buf[7] = (WABCRYPTOFILE_VERSION >> 24) & 0xFF;
+            tmp_buf[4] = this->version & 0xFF;
+            tmp_buf[5] = (this->version >> 8) & 0xFF;
+            tmp_buf[6] = (this->version >> 16) & 0xFF;
+            tmp_buf[7] = (this->version >> 24) & 0xFF;
             ::memcpy(tmp_buf + 8, iv, 32);
+            tmp_buf[40] = this->block_size & 0xFF;
+            tmp_buf[41] = (this->block_size >> 8) & 0xFF;
+            tmp_buf[42] = (this->block_size >> 16) & 0xFF;
+            tmp_buf[43] = (this->block_size >> 24) & 0xFF;
 
             // TODO: if I suceeded writing a broken file, wouldn't it be better to remove it ?
-            if (const ssize_t write_ret = this->raw_write(snk, tmp_buf, 40)){
+            if (const ssize_t write_ret = this->raw_write(snk, tmp_buf, this->header_size)){
                 LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: write error! error=%s\n", ::getpid(), ::strerror(errno));
                 return write_ret;
             }
             // update file_size
-            this->file_size += 40;
+            this->file_size += this->header_size;
 
-            return this->xmd_update(tmp_buf, 40);
+            return this->xmd_update(tmp_buf, this->header_size);
         }
 
         template<class Sink>
@@ -364,13 +662,13 @@ namespace transfil {
             unsigned int remaining_size = len;
             while (remaining_size > 0) {
                 // Check how much we can append into buffer
-                unsigned int available_size = MIN(CRYPTO_BUFFER_SIZE - this->pos, remaining_size);
+                unsigned int available_size = MIN(this->block_size - this->pos, remaining_size);
                 // Append and update pos pointer
-                ::memcpy(this->buf + this->pos, static_cast<const char*>(data) + (len - remaining_size), available_size);
+                ::memcpy(this->buf.get() + this->pos, static_cast<const char*>(data) + (len - remaining_size), available_size);
                 this->pos += available_size;
                 // If buffer is full, flush it to disk
-                if (this->pos == CRYPTO_BUFFER_SIZE) {
-                    if (this->flush(snk)) {
+                if (this->pos == this->block_size) {
+                    if (this->flush_block(snk, true)) {
                         return -1;
                     }
                 }
@@ -387,63 +685,7 @@ namespace transfil {
         template<class Sink>
         int flush(Sink & snk)
         {
-            // No data to flush
-            if (!this->pos) {
-                return 0;
-            }
-
-            // Compress
-            // TODO: check this
-            char compressed_buf[65536];
-            //char compressed_buf[compressed_buf_sz];
-            size_t compressed_buf_sz = ::snappy_max_compressed_length(this->pos);
-            snappy_status status = snappy_compress(this->buf, this->pos, compressed_buf, &compressed_buf_sz);
-
-            switch (status)
-            {
-                case SNAPPY_OK:
-                    break;
-                case SNAPPY_INVALID_INPUT:
-                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with status code INVALID_INPUT!\n", getpid());
-                    return -1;
-                case SNAPPY_BUFFER_TOO_SMALL:
-                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with status code BUFFER_TOO_SMALL!\n", getpid());
-                    return -1;
-                default:
-                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with unknown status code (%d)!\n", getpid(), status);
-                    return -1;
-            }
-
-            // Encrypt
-            unsigned char ciphered_buf[4 + 65536];
-            //char ciphered_buf[ciphered_buf_sz];
-            uint32_t ciphered_buf_sz = compressed_buf_sz + AES_BLOCK_SIZE;
-            {
-                const unsigned char * src_buf = reinterpret_cast<unsigned char*>(compressed_buf);
-                if (this->xaes_encrypt(src_buf, compressed_buf_sz, ciphered_buf + 4, &ciphered_buf_sz)) {
-                    return -1;
-                }
-            }
-
-            ciphered_buf[0] = ciphered_buf_sz & 0xFF;
-            ciphered_buf[1] = (ciphered_buf_sz >> 8) & 0xFF;
-            ciphered_buf[2] = (ciphered_buf_sz >> 16) & 0xFF;
-            ciphered_buf[3] = (ciphered_buf_sz >> 24) & 0xFF;
-
-            ciphered_buf_sz += 4;
-
-            if (const ssize_t err = this->raw_write(snk, ciphered_buf, ciphered_buf_sz)) {
-                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Write error : %s\n", ::getpid(), ::strerror(errno));
-                return err;
-            }
-            if (-1 == this->xmd_update(&ciphered_buf, ciphered_buf_sz)) {
-                return -1;
-            }
-            this->file_size += ciphered_buf_sz;
-
-            // Reset buffer
-            this->pos = 0;
-            return 0;
+            return this->flush_block(snk, false);
         }
 
         template<class Sink>
@@ -452,7 +694,7 @@ namespace transfil {
             int result = this->flush(snk);
 
             const uint32_t eof_magic = WABCRYPTOFILE_EOF_MAGIC;
-            unsigned char tmp_buf[8] = {
+            unsigned char tmp_buf[8 + CRYPTO_GCM_TAG_SIZE] = {
                 eof_magic & 0xFF,
                 (eof_magic >> 8) & 0xFF,
                 (eof_magic >> 16) & 0xFF,
@@ -462,15 +704,28 @@ namespace transfil {
                 uint8_t((this->raw_size >> 16) & 0xFF),
                 uint8_t((this->raw_size >> 24) & 0xFF),
             };
+            uint32_t eof_size = 8;
+
+            if (this->version >= WABCRYPTOFILE_VERSION_GCM) {
+                // the tag authenticates the header and the end of file
+                unsigned char aad[WABCRYPTOFILE_HEADER_SIZE_V2 + 8];
+                ::memcpy(aad, this->header, WABCRYPTOFILE_HEADER_SIZE_V2);
+                ::memcpy(aad + WABCRYPTOFILE_HEADER_SIZE_V2, tmp_buf, 8);
+                uint32_t tag_size = 0;
+                if (this->xgcm_encrypt(aad, sizeof(aad), nullptr, 0, tmp_buf + 8, &tag_size)) {
+                    result = -1;
+                }
+                eof_size += CRYPTO_GCM_TAG_SIZE;
+            }
 
-            int write_ret1 = this->raw_write(snk, tmp_buf, 8);
+            int write_ret1 = this->raw_write(snk, tmp_buf, eof_size);
             if (write_ret1){
                 // TOOD: actual error code could help
                 LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Write error : %s\n", ::getpid(), ::strerror(errno));
             }
-            this->file_size += 8;
+            this->file_size += eof_size;
 
-            this->xmd_update(tmp_buf, 8);
+            this->xmd_update(tmp_buf, eof_size);
 
             if (hash) {
                 unsigned char tmp_hash[HASH_LEN];
@@ -557,7 +812,103 @@ namespace transfil {
             return result;
         }
 
+
     private:
+        int alloc_buffers()
+        {
+            if (this->buffers_block_size == this->block_size) {
+                return 0;
+            }
+            this->buffers_block_size = 0;
+            // size(4) + ciphered data + AES_BLOCK_SIZE (padding) or CRYPTO_GCM_TAG_SIZE
+            const size_t ciphered_buf_size = 4 + ::snappy_max_compressed_length(this->block_size) + AES_BLOCK_SIZE;
+            this->buf.reset(new (std::nothrow) char[this->block_size]);
+            this->compressed_buf.reset(new (std::nothrow) unsigned char[::snappy_max_compressed_length(this->block_size)]);
+            this->ciphered_bufs[0].reset(new (std::nothrow) unsigned char[ciphered_buf_size]);
+            this->ciphered_bufs[1].reset(new (std::nothrow) unsigned char[ciphered_buf_size]);
+            this->ciphered_index = 0;
+            if (!this->buf || !this->compressed_buf || !this->ciphered_bufs[0] || !this->ciphered_bufs[1]) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: malloc!\n", ::getpid());
+                return -1;
+            }
+            this->buffers_block_size = this->block_size;
+            return 0;
+        }
+
+        /* Compress and encrypt the block, the write is done by the writer thread if pipelined
+         *  (the file is written when the next block is flushed), otherwise before returning.
+         * Return 0 on success, negatif on error
+         */
+        template<class Sink>
+        int flush_block(Sink & snk, bool pipelined)
+        {
+            // No data to flush
+            if (!this->pos) {
+                return pipelined ? 0 : this->writer.wait();
+            }
+
+            // Compress
+            char * compressed_buf = reinterpret_cast<char*>(this->compressed_buf.get());
+            size_t compressed_buf_sz = ::snappy_max_compressed_length(this->pos);
+            snappy_status status = snappy_compress(this->buf.get(), this->pos, compressed_buf, &compressed_buf_sz);
+
+            switch (status)
+            {
+                case SNAPPY_OK:
+                    break;
+                case SNAPPY_INVALID_INPUT:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with status code INVALID_INPUT!\n", getpid());
+                    return -1;
+                case SNAPPY_BUFFER_TOO_SMALL:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with status code BUFFER_TOO_SMALL!\n", getpid());
+                    return -1;
+                default:
+                    LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Snappy compression failed with unknown status code (%d)!\n", getpid(), status);
+                    return -1;
+            }
+
+            // Encrypt, the other buffer may be being written
+            unsigned char * ciphered_buf = this->ciphered_bufs[this->ciphered_index].get();
+            uint32_t ciphered_buf_sz = compressed_buf_sz + AES_BLOCK_SIZE;
+            {
+                const unsigned char * src_buf = reinterpret_cast<unsigned char*>(compressed_buf);
+                if (this->version < WABCRYPTOFILE_VERSION_GCM
+                  ? this->xaes_encrypt(src_buf, compressed_buf_sz, ciphered_buf + 4, &ciphered_buf_sz)
+                  : this->xgcm_encrypt(nullptr, 0, src_buf, compressed_buf_sz, ciphered_buf + 4, &ciphered_buf_sz)) {
+                    return -1;
+                }
+            }
+
+            ciphered_buf[0] = ciphered_buf_sz & 0xFF;
+            ciphered_buf[1] = (ciphered_buf_sz >> 8) & 0xFF;
+            ciphered_buf[2] = (ciphered_buf_sz >> 16) & 0xFF;
+            ciphered_buf[3] = (ciphered_buf_sz >> 24) & 0xFF;
+
+            ciphered_buf_sz += 4;
+
+            // the hash follows the order of the file
+            if (-1 == this->xmd_update(ciphered_buf, ciphered_buf_sz)) {
+                return -1;
+            }
+            this->file_size += ciphered_buf_sz;
+
+            // Reset buffer
+            this->pos = 0;
+
+            int err;
+            if (pipelined) {
+                err = this->writer.push(snk, ciphered_buf, ciphered_buf_sz);
+                this->ciphered_index ^= 1;
+            }
+            else if (!(err = this->writer.wait())) {
+                err = this->raw_write(snk, ciphered_buf, ciphered_buf_sz);
+            }
+            if (err) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Write error : %s\n", ::getpid(), ::strerror(errno));
+            }
+            return err;
+        }
+
         ///\return 0 if success, otherwise a negatif number
         template<class Sink>
         ssize_t raw_write(Sink & snk, void * data, size_t len)
@@ -591,6 +942,45 @@ namespace transfil {
             return 0;
         }
 
+        /* Encrypt src_buf into dst_buf followed by the tag of the block with aad. Update dst_sz with
+         *  encrypted output size
+         * Return 0 on success, negative value on error
+         */
+        int xgcm_encrypt(const unsigned char * aad, uint32_t aad_sz, const unsigned char * src_buf, uint32_t src_sz,
+                         unsigned char * dst_buf, uint32_t * dst_sz)
+        {
+            unsigned char nonce[CRYPTO_GCM_IV_SIZE];
+            detail::gcm_nonce(this->header + 8, this->block_number++, nonce);
+
+            int safe_size = 0;
+            int remaining_size = 0;
+
+            if (EVP_EncryptInit_ex(&this->ectx, nullptr, nullptr, nullptr, nonce) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not prepare encryption context!\n", getpid());
+                return -1;
+            }
+            if (aad_sz && EVP_EncryptUpdate(&this->ectx, nullptr, &safe_size, aad, aad_sz) != 1) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could encrypt data!\n", getpid());
+                return -1;
+            }
+            safe_size = 0;
+            if (src_sz && EVP_EncryptUpdate(&this->ectx, dst_buf, &safe_size, src_buf, src_sz) != 1) {
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could encrypt data!\n", getpid());
+                return -1;
+            }
+            if (EVP_EncryptFinal_ex(&this->ectx, dst_buf + safe_size, &remaining_size) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not finish encryption!\n", getpid());
+                return -1;
+            }
+            safe_size += remaining_size;
+            if (EVP_CIPHER_CTX_ctrl(&this->ectx, EVP_CTRL_GCM_GET_TAG, CRYPTO_GCM_TAG_SIZE, dst_buf + safe_size) != 1){
+                LOG(LOG_ERR, "[CRYPTO_ERROR][%d]: Could not get the tag!\n", getpid());
+                return -1;
+            }
+            *dst_sz = safe_size + CRYPTO_GCM_TAG_SIZE;
+            return 0;
+        }
+
         /* Update hash context with new data.
          * Returns 0 on success, -1 on error
          */
@@ -54,6 +54,26 @@ struct InMetaSequenceTransport
 
     const char * path() const noexcept
     { return this->buffer().current_path(); }
+
+    // Goes to the keyframe (file of the recording) before sec, throws
+    // ERR_TRANSPORT_NO_MORE_DATA if sec is after the end of the recording.
+    virtual void seek_to_time(time_t sec) override
+    {
+        const ssize_t res = this->buffer().seek_to_time(sec);
+        if (res) {
+            if (res < 0) {
+                this->status = false;
+                throw Error(ERR_TRANSPORT_READ_FAILED, -res);
+            }
+            throw Error(res == ERR_TRANSPORT_NO_MORE_DATA ? ERR_TRANSPORT_NO_MORE_DATA : ERR_TRANSPORT_READ_FAILED);
+        }
+        this->status = true;
+        this->seqno  = this->buffer().get_line_index();
+    }
+
+    // The files beginning at or after sec are not read.
+    void set_end_time(time_t sec) noexcept
+    { this->buffer().set_end_time(sec); }
 };
 
 #endif
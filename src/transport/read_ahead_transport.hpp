@@ -0,0 +1,255 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Input transport of a recording read ahead by a worker thread.
+*/
+
+#ifndef _REDEMPTION_TRANSPORT_READ_AHEAD_TRANSPORT_HPP_
+#define _REDEMPTION_TRANSPORT_READ_AHEAD_TRANSPORT_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "transport.hpp"
+
+// The worker thread reads the recording (InMetaSequenceTransport or
+// CryptoInMetaSequenceTransport: file reads and decryption) by blocks of
+// BLOCK_SIZE bytes, at most MAX_BLOCKS blocks ahead of the reader.
+//
+// The chunk times are those of the file where the block being read started,
+// they may be the ones of the previous file for the end of a block spanning
+// two files (the ones of the first file for the first block). The Error which
+// stopped the worker (end of the recording, file which can not be opened...)
+// is thrown by recv() after the last bytes read.
+class ReadAheadTransportBase : public Transport
+{
+public:
+    enum {
+        BLOCK_SIZE = 65536,
+        MAX_BLOCKS = 8
+    };
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t   size             = 0;
+        unsigned begin_chunk_time = 0;
+        unsigned end_chunk_time   = 0;
+        int      error_id         = NO_ERROR;
+        int      error_errnum     = 0;
+    };
+
+    std::mutex              mutex;
+    std::condition_variable block_read;
+    std::condition_variable block_consumed;
+
+    std::deque<Block> blocks;
+    bool              stop = false;
+
+    // the block being consumed
+    Block  current;
+    size_t current_pos = 0;
+
+    std::thread worker;
+
+public:
+    virtual ~ReadAheadTransportBase()
+    {
+        this->stop_worker();
+    }
+
+    unsigned begin_chunk_time() const noexcept
+    { return this->current.begin_chunk_time; }
+
+    unsigned end_chunk_time() const noexcept
+    { return this->current.end_chunk_time; }
+
+    // The blocks read ahead are dropped, the worker restarts at the keyframe before sec.
+    virtual void seek_to_time(time_t sec) override
+    {
+        this->stop_worker();
+
+        try {
+            this->source_seek_to_time(sec);
+        }
+        catch (...) {
+            // the blocks read ahead are kept, the reading goes on from where it was
+            this->start();
+            throw;
+        }
+
+        this->blocks.clear();
+        this->current     = Block();
+        this->current_pos = 0;
+        this->status      = true;
+        this->start();
+    }
+
+protected:
+    // called by the worker thread only
+    virtual void source_recv(char ** pbuffer, size_t len) = 0;
+    virtual unsigned source_begin_chunk_time() const = 0;
+    virtual unsigned source_end_chunk_time() const = 0;
+
+    // called while the worker is stopped
+    virtual void source_seek_to_time(time_t sec) = 0;
+
+    // the source must be built before the worker is started and the worker
+    // stopped before the source is destroyed
+    void start()
+    {
+        this->stop   = false;
+        this->worker = std::thread(&ReadAheadTransportBase::run, this);
+    }
+
+    void stop_worker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stop = true;
+        }
+        this->block_consumed.notify_one();
+        if (this->worker.joinable()) {
+            this->worker.join();
+        }
+    }
+
+private:
+    void run()
+    {
+        for (;;) {
+            Block block;
+            block.begin_chunk_time = this->source_begin_chunk_time();
+            block.end_chunk_time   = this->source_end_chunk_time();
+
+            try {
+                block.data.reset(new char[BLOCK_SIZE]);
+                char * end = block.data.get();
+                try {
+                    this->source_recv(&end, BLOCK_SIZE);
+                }
+                catch (Error const & e) {
+                    block.error_id     = e.id;
+                    block.error_errnum = e.errnum;
+                }
+                block.size = end - block.data.get();
+            }
+            catch (std::bad_alloc const &) {
+                block.error_id = ERR_TRANSPORT_READ_FAILED;
+            }
+
+            // no file was opened before the first block
+            if (!block.begin_chunk_time) {
+                block.begin_chunk_time = this->source_begin_chunk_time();
+                block.end_chunk_time   = this->source_end_chunk_time();
+            }
+
+            const bool last_block = (block.error_id != NO_ERROR);
+
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->block_consumed.wait(lock, [this]() {
+                    return this->stop || this->blocks.size() < MAX_BLOCKS;
+                });
+                // kept even when stopped, the source is after this block
+                this->blocks.push_back(std::move(block));
+                if (this->stop) {
+                    return;
+                }
+            }
+            this->block_read.notify_one();
+
+            if (last_block) {
+                return;
+            }
+        }
+    }
+
+    virtual void do_recv(char ** pbuffer, size_t len) override
+    {
+        while (len) {
+            if (this->current_pos == this->current.size) {
+                if (this->current.error_id != NO_ERROR) {
+                    this->status = false;
+                    throw Error(this->current.error_id, this->current.error_errnum);
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->block_read.wait(lock, [this]() { return !this->blocks.empty(); });
+                    this->current = std::move(this->blocks.front());
+                    this->blocks.pop_front();
+                }
+                this->block_consumed.notify_one();
+                this->current_pos = 0;
+                continue;
+            }
+
+            const size_t size = std::min(len, this->current.size - this->current_pos);
+            memcpy(*pbuffer, this->current.data.get() + this->current_pos, size);
+            *pbuffer                    += size;
+            len                         -= size;
+            this->current_pos           += size;
+            this->last_quantum_received += size;
+        }
+    }
+};
+
+template<class InTrans>
+class ReadAheadTransport : public ReadAheadTransportBase
+{
+    InTrans source;
+
+public:
+    template<class... Args>
+    ReadAheadTransport(Args && ... args)
+    : source(std::forward<Args>(args)...)
+    {
+        this->start();
+    }
+
+    virtual ~ReadAheadTransport()
+    {
+        this->stop_worker();
+    }
+
+private:
+    virtual void source_recv(char ** pbuffer, size_t len) override
+    { this->source.recv(pbuffer, len); }
+
+    virtual unsigned source_begin_chunk_time() const override
+    { return this->source.begin_chunk_time(); }
+
+    virtual unsigned source_end_chunk_time() const override
+    { return this->source.end_chunk_time(); }
+
+    virtual void source_seek_to_time(time_t sec) override
+    { this->source.seek_to_time(sec); }
+};
+
+#endif
@@ -32,9 +32,12 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 #ifndef INVALID_SOCKET
 #define INVALID_SOCKET -1
@@ -121,6 +124,20 @@ public:
 
     SSL * io;
 
+    // vectored sends are gathered here before SSL_write
+    std::vector<char> tls_send_buffer;
+
+private:
+    // the next PDU gathered by gather_pdu(), served first by recv()
+    std::unique_ptr<char[]> pdu_buffer;
+    size_t                  pdu_begin = 0;
+    size_t                  pdu_end   = 0;
+
+    // TPKT length is 16 bits, fast-path length 15 bits
+    static const size_t PDU_BUFFER_SIZE = 65536;
+
+public:
+
     SocketTransport( const char * name, int sck, const char *ip_address, int port
                    , uint32_t verbose, std::string * error_message = nullptr)
     : tls(false)
@@ -167,14 +184,9 @@ public:
         return this->public_key_length;
     }
 
-    virtual void enable_server_tls(const char * certificate_password) throw (Error)
+    // Creates a server TLS context with proxy certificate, private key and DH parameters.
+    static SSL_CTX * new_server_tls_context(const char * certificate_password)
     {
-        if (this->tls) {
-            TODO("this should be an error, no need to commute two times to TLS");
-            return;
-        }
-        LOG(LOG_INFO, "SocketTransport::enable_server_tls() start");
-
         // SSL_CTX_new - create a new SSL_CTX object as framework for TLS/SSL enabled functions
         // ------------------------------------------------------------------------------------
 
@@ -203,7 +215,6 @@ public:
         BIO * bio_err = BIO_new_fp(stderr, BIO_NOCLOSE);
 
         SSL_CTX* ctx = SSL_CTX_new(SSLv23_server_method());
-        this->allocated_ctx = ctx;
 
         /*
          * This is necessary, because the Microsoft TLS implementation is not perfect.
@@ -377,50 +388,85 @@ public:
 
         // --------Start of session specific init code ---------------------------------
 
+        // On error, the context is released and nullptr returned, the caller
+        //  decides whether the process can go on.
+        auto failure = [&](const char * message) -> SSL_CTX * {
+            LOG(LOG_ERR, "SocketTransport::new_server_tls_context: %s", message);
+            ERR_print_errors(bio_err);
+            BIO_free(bio_err);
+            SSL_CTX_free(ctx);
+            return nullptr;
+        };
+
         /* Load our keys and certificates*/
         if(!(SSL_CTX_use_certificate_chain_file(ctx, CFG_PATH "/rdpproxy.crt")))
         {
-            BIO_printf(bio_err, "Can't read certificate file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+            return failure("Can't read certificate file " CFG_PATH "/rdpproxy.crt");
         }
 
         SSL_CTX_set_default_passwd_cb(ctx, password_cb0);
         SSL_CTX_set_default_passwd_cb_userdata(ctx, const_cast<void*>(static_cast<const void*>(certificate_password)));
         if(!(SSL_CTX_use_PrivateKey_file(ctx, CFG_PATH "/rdpproxy.key", SSL_FILETYPE_PEM)))
         {
-            BIO_printf(bio_err,"Can't read key file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+            return failure("Can't read key file " CFG_PATH "/rdpproxy.key");
         }
 
         DH *ret = nullptr;
         BIO *bio;
 
         if ((bio=BIO_new_file(CFG_PATH "/" DH_PEM,"r")) == nullptr){
-            BIO_printf(bio_err,"Couldn't open DH file\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+            return failure("Couldn't open DH file " CFG_PATH "/" DH_PEM);
         }
 
         ret = PEM_read_bio_DHparams(bio, nullptr, nullptr, nullptr);
         BIO_free(bio);
-        if(SSL_CTX_set_tmp_dh(ctx, ret)<0)
+        if(!ret || (SSL_CTX_set_tmp_dh(ctx, ret) <= 0))
         {
-            BIO_printf(bio_err,"Couldn't set DH parameters\n");
-            ERR_print_errors(bio_err);
-            exit(0);
+            DH_free(ret);
+            return failure("Couldn't set DH parameters from " CFG_PATH "/" DH_PEM);
         }
         DH_free(ret);
-        // SSL_new() creates a new SSL structure which is needed to hold the data for a TLS/SSL
-        // connection. The new structure inherits the settings of the underlying context ctx:
-        // - connection method (SSLv2/v3/TLSv1),
-        // - options,
-        // - verification settings,
-        // - timeout settings.
 
-        // return value: nullptr: The creation of a new SSL structure failed. Check the error stack
-        // to find out the reason.
+        // Session resumption: clients reconnecting (auto-reconnect, server redirection)
+        // skip the full handshake. The session cache is local to the process, tickets
+        // are encrypted with keys held by the context and thus remain valid in every
+        // session forked after the context was created.
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        static const unsigned char session_id_context[] = "rdpproxy";
+        SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+
+        BIO_free(bio_err);
+        return ctx;
+    }
+
+    // Server TLS context shared by all server transports of the process. Call it
+    // before forking sessions so they inherit it instead of loading certificate,
+    // key and DH parameters again. nullptr when they cannot be loaded.
+    static SSL_CTX * server_tls_context(const char * certificate_password)
+    {
+        static SSL_CTX * ctx = nullptr;
+        if (!ctx) {
+            ctx = new_server_tls_context(certificate_password);
+        }
+        return ctx;
+    }
+
+    virtual void enable_server_tls(const char * certificate_password) throw (Error)
+    {
+        if (this->tls) {
+            TODO("this should be an error, no need to commute two times to TLS");
+            return;
+        }
+        LOG(LOG_INFO, "SocketTransport::enable_server_tls() start");
+
+        BIO * bio_err = BIO_new_fp(stderr, BIO_NOCLOSE);
+
+        SSL_CTX * ctx = server_tls_context(certificate_password);
+        if (!ctx) {
+            BIO_free(bio_err);
+            throw Error(ERR_TRANSPORT_TLS_CONNECT_FAILED);
+        }
+
         TODO("add error management");
         BIO * sbio = BIO_new_socket(this->sck, BIO_NOCLOSE);
         SSL * ssl = SSL_new(ctx);
@@ -1144,13 +1190,102 @@ public:
         return rv;
     }
 
-    virtual void do_recv(char ** pbuffer, size_t len)
+    // receives what the socket holds now, at most <len> bytes, without waiting for more
+    //  (with TLS, a record is read whole). Returns 0 if nothing is available.
+    size_t recv_available(char * buffer, size_t len)
+    {
+        ssize_t res;
+        if (this->tls) {
+            // the data buffered by OpenSSL are not seen by select()
+            if (!::SSL_pending(this->io) && !this->can_recv()) {
+                return 0;
+            }
+            res = ::SSL_read(this->io, buffer, len);
+            if (res <= 0) {
+                const unsigned long error = SSL_get_error(this->io, res);
+                if ((error == SSL_ERROR_WANT_READ) || (error == SSL_ERROR_WANT_WRITE)) {
+                    return 0;
+                }
+                throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
+            }
+        }
+        else {
+            res = ::recv(this->sck, buffer, len, MSG_DONTWAIT);
+            if (res < 0) {
+                if (try_again(errno)) {
+                    return 0;
+                }
+                throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
+            }
+            if (res == 0) {
+                // socket closed
+                throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
+            }
+        }
+
+        if (this->verbose & 0x100){
+            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, res);
+            hexdump_c(buffer, res);
+            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, res);
+        }
+
+        this->last_quantum_received += res;
+        return res;
+    }
+
+    // Reads what the socket holds of the next TPKT or fast-path PDU without
+    //  blocking, the next call goes on with the same PDU. Returns true once
+    //  the whole PDU is buffered, recv() then serves it before reading the
+    //  socket again. Data not framed as a TPKT or fast-path PDU are left to
+    //  recv() and true is returned.
+    bool gather_pdu()
+    {
+        if (!this->pdu_buffer) {
+            this->pdu_buffer.reset(new char[PDU_BUFFER_SIZE]);
+        }
+        for (;;) {
+            const size_t available = this->pdu_end - this->pdu_begin;
+            const size_t needed = pdu_length(
+                reinterpret_cast<const uint8_t *>(this->pdu_buffer.get() + this->pdu_begin), available);
+            if (!needed || (available >= needed)) {
+                return true;
+            }
+            if (this->pdu_begin + needed > PDU_BUFFER_SIZE) {
+                memmove(this->pdu_buffer.get(), this->pdu_buffer.get() + this->pdu_begin, available);
+                this->pdu_begin = 0;
+                this->pdu_end   = available;
+            }
+            const size_t res = this->recv_available(this->pdu_buffer.get() + this->pdu_end, needed - available);
+            if (!res) {
+                return false;
+            }
+            this->pdu_end += res;
+        }
+    }
+
+    virtual void do_recv(char ** pbuffer, size_t len) override
     {
         if (this->verbose & 0x100){
             LOG(LOG_INFO, "Socket %s (%u) receiving %u bytes", this->name, this->sck, len);
         }
         char * start = *pbuffer;
 
+        // the bytes gathered by gather_pdu() are already accounted
+        const size_t gathered = std::min(len, this->pdu_end - this->pdu_begin);
+        if (gathered) {
+            memcpy(*pbuffer, this->pdu_buffer.get() + this->pdu_begin, gathered);
+            *pbuffer += gathered;
+            this->pdu_begin += gathered;
+            if (this->pdu_begin == this->pdu_end) {
+                this->pdu_begin = 0;
+                this->pdu_end   = 0;
+            }
+            if (gathered == len) {
+                return;
+            }
+        }
+        len -= gathered;
+
         ssize_t res = this->tls ? this->privrecv_tls(*pbuffer, len) : this->privrecv(*pbuffer, len);
         if (res < 0){
             throw Error(ERR_TRANSPORT_NO_MORE_DATA, 0);
@@ -1162,16 +1297,16 @@ public:
         }
 
         if (this->verbose & 0x100){
-            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, len);
-            hexdump_c(start, len);
-            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, len);
+            LOG(LOG_INFO, "Recv done on %s (%u) %u bytes", this->name, this->sck, gathered + len);
+            hexdump_c(start, gathered + len);
+            LOG(LOG_INFO, "Dump done on %s (%u) %u bytes", this->name, this->sck, gathered + len);
         }
 
         TODO("move that to base class : accounting_recv(len)");
         this->last_quantum_received += len;
     }
 
-    virtual void do_send(const char * const buffer, size_t len)
+    virtual void do_send(const char * const buffer, size_t len) override
     {
         if (len == 0) { return; }
 
@@ -1196,6 +1331,45 @@ public:
         this->last_quantum_sent += len;
     }
 
+    // one writev() in clear, one SSL_write() (so one TLS record up to 16 KiB) with TLS
+    virtual void do_sendv(const iovec * iov, size_t iovcnt) override
+    {
+        size_t len = 0;
+        for (size_t i = 0; i < iovcnt; ++i) {
+            if (this->verbose & 0x100){
+                LOG(LOG_INFO, "Sending on %s (%u) %u bytes", this->name, this->sck, iov[i].iov_len);
+                hexdump_c(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+                LOG(LOG_INFO, "Sent dumped on %s (%u) %u bytes", this->name, this->sck, iov[i].iov_len);
+            }
+            len += iov[i].iov_len;
+        }
+        if (len == 0) { return; }
+
+        ssize_t res;
+        if (this->tls) {
+            this->tls_send_buffer.clear();
+            for (size_t i = 0; i < iovcnt; ++i) {
+                const char * data = static_cast<const char *>(iov[i].iov_base);
+                this->tls_send_buffer.insert(this->tls_send_buffer.end(), data, data + iov[i].iov_len);
+            }
+            res = this->privsend_tls(this->tls_send_buffer.data(), len);
+        }
+        else {
+            res = this->privsendv(iov, iovcnt, len);
+        }
+        if (res < 0) {
+            LOG(LOG_WARNING,
+                "SocketTransport::Send failed on %s (%d) errno=%u [%s]",
+                this->name, this->sck, errno, strerror(errno));
+            throw Error(ERR_TRANSPORT_WRITE_FAILED);
+        }
+        if (res < (ssize_t)len) {
+            throw Error(ERR_TRANSPORT_NO_MORE_DATA);
+        }
+
+        this->last_quantum_sent += len;
+    }
+
     virtual void seek(int64_t offset, int whence) throw (Error) {
         throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE);
     }
@@ -1206,6 +1380,45 @@ public:
     }
 
 private:
+    // Sleeps until the socket is readable (POLLIN) or writable (POLLOUT),
+    //  errors and hang up also wake up, the next recv/send reports them.
+    void wait_ready(short events) const
+    {
+        pollfd pfd;
+        pfd.fd      = this->sck;
+        pfd.events  = events;
+        pfd.revents = 0;
+        while ((::poll(&pfd, 1, -1) < 0) && (errno == EINTR)) {
+        }
+    }
+
+    // Bytes of the PDU starting at <data> needed to know its length, then its
+    //  length. 0 when it is not a TPKT or fast-path PDU.
+    static size_t pdu_length(const uint8_t * data, size_t available)
+    {
+        if (available < 2) {
+            return 2;
+        }
+        // TPKT: version 3, reserved, length on 16 bits big endian
+        if (data[0] == 3) {
+            if (available < 4) {
+                return 4;
+            }
+            return std::max<size_t>((data[2] << 8) | data[3], 4);
+        }
+        // fast-path: action 0 in the 2 low bits, length on 1 or 2 bytes
+        if ((data[0] & 3) == 0) {
+            if (data[1] & 0x80) {
+                if (available < 3) {
+                    return 3;
+                }
+                return std::max<size_t>(((data[1] & 0x7F) << 8) | data[2], 3);
+            }
+            return std::max<size_t>(data[1], 2);
+        }
+        return 0;
+    }
+
     ssize_t privrecv(char * data, size_t len)
     {
         size_t remaining_len = len;
@@ -1215,11 +1428,7 @@ private:
             switch (res) {
                 case -1: /* error, maybe EAGAIN */
                     if (try_again(errno)) {
-                        fd_set fds;
-                        struct timeval time = { 0, 100000 };
-                        FD_ZERO(&fds);
-                        FD_SET(this->sck, &fds);
-                        ::select(this->sck + 1, &fds, nullptr, nullptr, &time);
+                        this->wait_ready(POLLIN);
                         continue;
                     }
                     if (len != remaining_len){
@@ -1248,11 +1457,7 @@ private:
             switch (sent){
             case -1:
                 if (try_again(errno)) {
-                    fd_set wfds;
-                    struct timeval time = { 0, 10000 };
-                    FD_ZERO(&wfds);
-                    FD_SET(this->sck, &wfds);
-                    select(this->sck + 1, nullptr, &wfds, nullptr, &time);
+                    this->wait_ready(POLLOUT);
                     continue;
                 }
                 return -1;
@@ -1265,6 +1470,46 @@ private:
         return len;
     }
 
+    ssize_t privsendv(const iovec * iov, size_t iovcnt, size_t len)
+    {
+        // the entries are moved forward after a partial write, so they are copied, 16 at a time
+        iovec parts[16];
+        size_t total = 0;
+        while (iovcnt) {
+            const size_t count = std::min<size_t>(iovcnt, sizeof(parts) / sizeof(parts[0]));
+            std::copy(iov, iov + count, parts);
+            iovec * first = parts;
+            iovec * last  = parts + count;
+            while (first != last) {
+                ssize_t sent = ::writev(this->sck, first, last - first);
+                switch (sent){
+                case -1:
+                    if (try_again(errno)) {
+                        this->wait_ready(POLLOUT);
+                        continue;
+                    }
+                    return -1;
+                case 0:
+                    return -1;
+                default:
+                    total += sent;
+                    // skip what was written, the first buffer may be partially sent
+                    for (; first != last && size_t(sent) >= first->iov_len; ++first) {
+                        sent -= first->iov_len;
+                    }
+                    if (first != last) {
+                        first->iov_base = static_cast<char *>(first->iov_base) + sent;
+                        first->iov_len -= sent;
+                    }
+                }
+            }
+            iov += count;
+            iovcnt -= count;
+        }
+        REDASSERT(total == len);
+        return len;
+    }
+
     ssize_t privrecv_tls(char * data, size_t len)
     {
         char * pbuffer = data;
@@ -1279,11 +1524,17 @@ private:
                     break;
 
                 case SSL_ERROR_WANT_READ:
-                    LOG(LOG_INFO, "recv_tls WANT READ");
+                    if (this->verbose & 0x100) {
+                        LOG(LOG_INFO, "recv_tls WANT READ");
+                    }
+                    this->wait_ready(POLLIN);
                     continue;
 
                 case SSL_ERROR_WANT_WRITE:
-                    LOG(LOG_INFO, "recv_tls WANT WRITE");
+                    if (this->verbose & 0x100) {
+                        LOG(LOG_INFO, "recv_tls WANT WRITE");
+                    }
+                    this->wait_ready(POLLOUT);
                     continue;
 
                 case SSL_ERROR_WANT_CONNECT:
@@ -1342,11 +1593,17 @@ private:
                     break;
 
                 case SSL_ERROR_WANT_READ:
-                    LOG(LOG_INFO, "send_tls WANT READ");
+                    if (this->verbose & 0x100) {
+                        LOG(LOG_INFO, "send_tls WANT READ");
+                    }
+                    this->wait_ready(POLLIN);
                     continue;
 
                 case SSL_ERROR_WANT_WRITE:
-                    LOG(LOG_INFO, "send_tls WANT WRITE");
+                    if (this->verbose & 0x100) {
+                        LOG(LOG_INFO, "send_tls WANT WRITE");
+                    }
+                    this->wait_ready(POLLOUT);
                     continue;
 
                 default:
@@ -24,6 +24,7 @@
 #define REDEMPTION_TRANSPORT_TRANSPORT_HPP
 
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <stdint.h>
 #include <cstddef>
 
@@ -146,6 +147,12 @@ public:
         this->do_send(reinterpret_cast<const char * const>(buffer), len);
     }
 
+    // the buffers are sent as one block of data, with one system call where the transport can
+    void send(const iovec * iov, size_t iovcnt)
+    {
+        this->do_sendv(iov, iovcnt);
+    }
+
     virtual void flush()
     {}
 
@@ -163,6 +170,14 @@ private:
         throw Error(ERR_TRANSPORT_INPUT_ONLY_USED_FOR_RECV);
     }
 
+    virtual void do_sendv(const iovec * iov, size_t iovcnt) {
+        for (const iovec * e = iov + iovcnt; iov != e; ++iov) {
+            if (iov->iov_len) {
+                this->do_send(static_cast<const char *>(iov->iov_base), iov->iov_len);
+            }
+        }
+    }
+
 public:
 
     TODO("All these functions should be changed after Stream refactoring to remove dependency between transport and Stream")
@@ -188,6 +203,15 @@ public:
         this->send(stream.get_data(), stream.size());
     }
 
+    void send(Stream const & header, Stream const & payload)
+    {
+        const iovec iov[] = {
+            { header.get_data(), header.size() },
+            { payload.get_data(), payload.size() },
+        };
+        this->send(iov, 2);
+    }
+
     void send(Stream const & stream)
     {
         this->send(stream.get_data(), stream.size());
@@ -222,6 +246,13 @@ public:
         return true;
     }
 
+    virtual void seek_to_time(time_t sec)
+    REDOC("Transports made of time stamped units (files of a recording) can restart"
+          "reading from the beginning of the unit containing sec.")
+    {
+        throw Error(ERR_TRANSPORT_SEEK_NOT_AVAILABLE);
+    }
+
     virtual void request_full_cleaning()
     {}
 
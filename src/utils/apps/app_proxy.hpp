@@ -386,7 +386,7 @@ int app_proxy(
     ParametersHldr parametersHldr;
 
     LOG(LOG_INFO, "ReDemPtion " VERSION " starting");
-    redemption_main_loop(ini, euid, egid, parametersHldr);
+    const int status = redemption_main_loop(ini, euid, egid, parametersHldr);
 
     /* delete the .pid file if it exists */
     /* don't care about errors. */
@@ -394,7 +394,7 @@ int app_proxy(
     /* hence some errors are expected */
     unlink(PID_PATH "/redemption/" LOCKFILE);
 
-    return 0;
+    return status;
 }
 
 #endif
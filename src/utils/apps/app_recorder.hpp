@@ -22,6 +22,8 @@
 #define REDEMPTION_UTILS_APPS_APP_RECORDER_HPP
 
 #include <signal.h>
+#include <dirent.h>
+#include <sys/wait.h>
 
 #include "FileToChunk.hpp"
 #include "ChunkToFile.hpp"
@@ -33,6 +35,8 @@
 #include "crypto_in_meta_sequence_transport.hpp"
 #include "program_options.hpp"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -43,7 +47,7 @@ int recompress_or_record( std::string const & input_filename, std::string & outp
                         , bool auto_output_file, uint32_t begin_cap, uint32_t end_cap
                         , uint32_t order_count, uint32_t clear, unsigned zoom
                         , bool show_file_metadata, bool show_statistics
-                        , bool force_record, uint32_t verbose
+                        , bool force_record, unsigned jobs, uint32_t verbose
                         , ExtraArguments&&... extra_argument);
 
 template<typename InWrmTrans>
@@ -64,6 +68,23 @@ static int do_record( Transport & in_wrm_trans, const timeval begin_record, cons
 static int do_recompress( CryptoContext & cctx, Transport & in_wrm_trans, const timeval begin_record
                         , std::string const & output_filename, Inifile & ini, uint32_t verbose);
 
+// a wrm file of the movie
+struct RecordSegment {
+    time_t   begin;
+    time_t   end;
+    uint64_t size;
+};
+
+template<typename InWrmTrans>
+std::vector<RecordSegment> get_record_segments(InWrmTrans & in_wrm_trans, unsigned file_count);
+
+static std::vector<size_t> split_record_segments(std::vector<RecordSegment> const & segments, unsigned jobs);
+
+template<class RecordPart>
+static int do_parallel_record( std::vector<RecordSegment> const & segments, std::vector<size_t> const & parts
+                             , bool from_movie_start, std::string const & output_filename, Inifile & ini
+                             , uint32_t clear, uint32_t verbose, RecordPart record_part);
+
 
 static void show_statistics(FileToGraphic::Statistics const & statistics);
 
@@ -126,6 +147,7 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
     uint32_t    wrm_break_interval = 86400;
     uint32_t    order_count        = 0;
     unsigned    zoom               = 100;
+    unsigned    jobs               = 1;
     bool        show_file_metadata = false;
     bool        show_statistics    = false;
     bool        auto_output_file   = false;
@@ -158,6 +180,8 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
         {"clear", &clear, "clear old capture files with same prefix (default on)"},
         {"verbose", &verbose, "more logs"},
         {"zoom", &zoom, "scaling factor for png capture (default 100%)"},
+        {'j', "jobs", &jobs, "number of processes transcoding the wrm files of the movie in parallel (default 1),"
+                             " ignored with encrypted output (the keys derive from the file names), --meta, --statistics or --count"},
         {'m', "meta", "show file metadata"},
         {'s', "statistics", "show statistics"},
 
@@ -339,7 +363,7 @@ int app_recorder( int argc, char ** argv, const char * copyright_notice
       , begin_cap, end_cap, order_count, clear, zoom
       , show_file_metadata, show_statistics
       , has_extra_capture(ini)
-      , verbose
+      , jobs, verbose
       , std::forward<ExtraArguments>(extra_argument)...);
 }
 
@@ -373,7 +397,7 @@ int recompress_or_record( std::string const & input_filename, std::string & outp
                         , bool auto_output_file, uint32_t begin_cap, uint32_t end_cap
                         , uint32_t order_count, uint32_t clear, unsigned zoom
                         , bool show_file_metadata, bool show_statistics
-                        , bool force_record, uint32_t verbose
+                        , bool force_record, unsigned jobs, uint32_t verbose
                         , ExtraArguments&&... extra_argument)
 {
 /*
@@ -435,6 +459,11 @@ int recompress_or_record( std::string const & input_filename, std::string & outp
     timeval  begin_record = { 0, 0 };
     timeval  end_record   = { 0, 0 };
     unsigned file_count   = 0;
+
+    // wrm files of the movie and first file of each process with --jobs
+    std::vector<RecordSegment> segments;
+    std::vector<size_t>        parts;
+
     try {
         if (infile_is_encrypted == false) {
             InMetaSequenceTransport in_wrm_trans_tmp(infile_prefix, infile_extension.c_str());
@@ -444,6 +473,23 @@ int recompress_or_record( std::string const & input_filename, std::string & outp
             CryptoInMetaSequenceTransport in_wrm_trans_tmp(&cctx, infile_prefix, infile_extension.c_str());
             file_count = get_file_count(in_wrm_trans_tmp, begin_cap, end_cap, begin_record, end_record);
         }
+
+        if (jobs > 1) {
+            if (!output_filename.length() || show_file_metadata || show_statistics || order_count
+             || ini.globals.enable_file_encryption.get()) {
+                // the keys of encrypted files are derived from their names, they can not be renamed
+                std::cerr << "Option --jobs ignored with --meta, --statistics, --count or encrypted output\n";
+            }
+            else if (infile_is_encrypted == false) {
+                InMetaSequenceTransport in_wrm_trans_tmp(infile_prefix, infile_extension.c_str());
+                segments = get_record_segments(in_wrm_trans_tmp, file_count);
+            }
+            else {
+                CryptoInMetaSequenceTransport in_wrm_trans_tmp(&cctx, infile_prefix, infile_extension.c_str());
+                segments = get_record_segments(in_wrm_trans_tmp, file_count);
+            }
+            parts = split_record_segments(segments, jobs);
+        }
     }
     catch (const Error & e) {
         if (e.id == static_cast<unsigned>(ERR_TRANSPORT_NO_MORE_DATA)) {
@@ -461,16 +507,42 @@ int recompress_or_record( std::string const & input_filename, std::string & outp
         timeval begin_capture = {0, 0};
         timeval end_capture = {0, 0};
 
+        // each process opens its own input transport, seeks to the keyframe of its first file
+        // and stops before the first file of the next process (end is 0 for the last one)
+        auto record_part = [&](time_t begin, time_t end, std::string const & part_output_filename) {
+            const timeval begin_capture = { begin, 0 };
+            // a file ends in the second its next file begins
+            const timeval end_capture   = { end ? end + 1 : 0, 0 };
+            if (infile_is_encrypted == false) {
+                InMetaSequenceTransport in_wrm_trans(infile_prefix, infile_extension.c_str());
+                in_wrm_trans.set_end_time(end);
+                return do_record<CaptureMaker>(
+                    in_wrm_trans, begin_record, end_record, begin_capture, end_capture
+                  , part_output_filename, ini, 1, 0, clear, zoom, false, false, verbose, extra_argument...);
+            }
+            CryptoInMetaSequenceTransport in_wrm_trans(&cctx, infile_prefix, infile_extension.c_str());
+            in_wrm_trans.set_end_time(end);
+            return do_record<CaptureMaker>(
+                in_wrm_trans, begin_record, end_record, begin_capture, end_capture
+              , part_output_filename, ini, 1, 0, clear, zoom, false, false, verbose, extra_argument...);
+        };
+
         int result = -1;
         try {
-            result = (
+            const bool record =
                 force_record
              || ini.video.capture_png
              || ini.video.wrm_color_depth_selection_strategy != USE_ORIGINAL_COLOR_DEPTH
              || show_file_metadata
              || show_statistics
              || file_count > 1
-             || order_count)
+             || order_count;
+            result = (record && parts.size() > 1)
+                ? ((verbose ? void(std::cout << "[C]"<< std::endl) : void())
+                  , do_parallel_record( segments, parts, file_count <= 1, output_filename, ini, clear, verbose
+                                      , record_part)
+                )
+                : record
                 ? ((verbose ? void(std::cout << "[A]"<< std::endl) : void())
                   , do_record<CaptureMaker>(
                       trans, begin_record, end_record, begin_capture, end_capture
@@ -584,6 +656,426 @@ void remove_file( InWrmTrans & in_wrm_trans, const char * hash_path, const char
     }
 }
 
+template<typename InWrmTrans>
+std::vector<RecordSegment> get_record_segments(InWrmTrans & in_wrm_trans, unsigned file_count) {
+    std::vector<RecordSegment> segments;
+    try {
+        do {
+            in_wrm_trans.next();
+            if (in_wrm_trans.get_seqno() >= file_count) {
+                const int size = filesize(in_wrm_trans.path());
+                segments.push_back({ in_wrm_trans.begin_chunk_time(), in_wrm_trans.end_chunk_time()
+                                   , static_cast<uint64_t>(std::max(size, 1))});
+            }
+        }
+        while (true);
+    }
+    catch (const Error & e) {
+        if (e.id != static_cast<unsigned>(ERR_TRANSPORT_NO_MORE_DATA)) {
+            throw;
+        }
+    };
+    return segments;
+}
+
+REDOC("Every wrm file starts with a keyframe (full image and caches), the files are shared between"
+      " at most jobs processes, each one decoding about the same amount of data."
+      " Returns the index of the first file of each process.")
+inline
+static std::vector<size_t> split_record_segments(std::vector<RecordSegment> const & segments, unsigned jobs) {
+    std::vector<size_t> parts;
+    if (segments.empty()) {
+        return parts;
+    }
+
+    uint64_t total_size = 0;
+    for (RecordSegment const & segment : segments) {
+        total_size += segment.size;
+    }
+
+    parts.push_back(0);
+    uint64_t size = segments.front().size;
+    for (size_t i = 1; i < segments.size() && parts.size() < jobs; i++) {
+        // the next part starts with the first file whose middle is after the share of the previous parts
+        if ((size * 2 + segments[i].size) * jobs >= total_size * 2 * parts.size()) {
+            parts.push_back(i);
+        }
+        size += segments[i].size;
+    }
+    return parts;
+}
+
+// Header (3 lines) and files ("path begin end" lines) of a mwrm file, false if it can not be read.
+inline
+static bool read_meta_file( std::string const & meta_filename, std::string & header
+                          , std::vector<std::pair<std::string, std::string>> & files) {
+    std::ifstream meta(meta_filename.c_str());
+    if (!meta) {
+        return false;
+    }
+
+    std::string line;
+    for (int i = 0; i < 3 && std::getline(meta, line); i++) {
+        header += line;
+        header += '\n';
+    }
+    while (std::getline(meta, line)) {
+        const size_t end_pos = line.rfind(' ');
+        const size_t pos = (end_pos == std::string::npos || end_pos == 0) ? end_pos : line.rfind(' ', end_pos - 1);
+        if (pos == std::string::npos || pos == 0) {
+            continue;
+        }
+        files.emplace_back(line.substr(0, pos), line.substr(pos));
+    }
+    return true;
+}
+
+// Numbers of the "<basename>-NNNNNN<extension>" files of path, in order.
+inline
+static std::vector<unsigned> get_sequence_numbers(const char * path, const char * basename, const char * extension) {
+    std::vector<unsigned> numbers;
+
+    DIR * d = opendir(path);
+    if (!d) {
+        return numbers;
+    }
+
+    const size_t basename_len  = strlen(basename);
+    const size_t extension_len = strlen(extension);
+    while (dirent * entry = readdir(d)) {
+        const char * name = entry->d_name;
+        unsigned n   = 0;
+        int      len = 0;
+        if (strlen(name) == basename_len + 7 + extension_len
+         && !strncmp(name, basename, basename_len) && name[basename_len] == '-'
+         && sscanf(name + basename_len + 1, "%6u%n", &n, &len) == 1 && len == 6
+         && !strcmp(name + basename_len + 7, extension)) {
+            numbers.push_back(n);
+        }
+    }
+    closedir(d);
+
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// Renames the png and wrm files written by the processes of do_parallel_record in order
+// and writes the mwrm file of the whole movie.
+inline
+static void stitch_record_parts( const char * path, const char * basename
+                               , std::vector<std::string> const & part_basenames, size_t first_sought_part
+                               , unsigned png_limit, uint32_t verbose) {
+    FilenameGenerator png_filegen(FilenameGenerator::PATH_FILE_COUNT_EXTENSION, path, basename, ".png", 0);
+    FilenameGenerator wrm_filegen(FilenameGenerator::PATH_FILE_COUNT_EXTENSION, path, basename, ".wrm", 0);
+
+    std::vector<std::pair<unsigned, std::string>> pngs;
+    unsigned png_count = 0;
+
+    std::string meta_header;
+    std::string meta_lines;
+    bool        has_meta  = false;
+    unsigned    wrm_count = 0;
+
+    for (size_t i = 0; i < part_basenames.size(); i++) {
+        std::string const & part_basename = part_basenames[i];
+        FilenameGenerator part_png_filegen( FilenameGenerator::PATH_FILE_COUNT_EXTENSION, path
+                                          , part_basename.c_str(), ".png", 0);
+        const std::vector<unsigned> numbers = get_sequence_numbers(path, part_basename.c_str(), ".png");
+        for (unsigned n : numbers) {
+            pngs.emplace_back(png_count + n, png_filegen.get(png_count + n));
+            if (::rename(part_png_filegen.get(n), pngs.back().second.c_str()) < 0) {
+                LOG(LOG_ERR, "Failed to rename \"%s\": %s", part_png_filegen.get(n), strerror(errno));
+            }
+        }
+        // images removed because of png_limit are numbered anyway
+        if (!numbers.empty()) {
+            png_count += numbers.back() + 1;
+        }
+
+        const std::string part_meta_filename = std::string(path) + part_basename + ".mwrm";
+        std::string header;
+        std::vector<std::pair<std::string, std::string>> files;
+        if (!read_meta_file(part_meta_filename, header, files)) {
+            continue;
+        }
+        if (!has_meta) {
+            meta_header = header;
+            has_meta    = true;
+        }
+        if (i >= first_sought_part && files.size() > 1) {
+            // the capture of a process that seeks starts with a blank screen, this file is
+            // ended by the breakpoint made with the image of the keyframe
+            ::unlink(files.front().first.c_str());
+            files.erase(files.begin());
+        }
+        for (auto & file : files) {
+            const char * wrm_filename = wrm_filegen.get(wrm_count++);
+            if (::rename(file.first.c_str(), wrm_filename) < 0) {
+                LOG(LOG_ERR, "Failed to rename \"%s\": %s", file.first.c_str(), strerror(errno));
+            }
+            meta_lines += wrm_filename;
+            meta_lines += file.second;
+            meta_lines += '\n';
+        }
+        ::unlink(part_meta_filename.c_str());
+    }
+
+    if (png_limit) {
+        for (auto & png : pngs) {
+            if (png.first + png_limit < png_count) {
+                ::unlink(png.second.c_str());
+            }
+        }
+    }
+
+    if (has_meta) {
+        const std::string meta_filename = std::string(path) + basename + ".mwrm";
+        ::unlink(meta_filename.c_str());
+        const int fd = ::open(meta_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR);
+        if (fd == -1) {
+            throw Error(ERR_TRANSPORT_OPEN_FAILED, errno);
+        }
+        meta_header += meta_lines;
+        const ssize_t res = ::write(fd, meta_header.data(), meta_header.size());
+        const int err = errno;
+        ::close(fd);
+        if (res != static_cast<ssize_t>(meta_header.size())) {
+            throw Error(ERR_TRANSPORT_WRITE_FAILED, err);
+        }
+    }
+
+    if (verbose) {
+        std::cout << "Stitched " << part_basenames.size() << " parts: " << png_count << " png, "
+                  << wrm_count << " wrm" << std::endl;
+    }
+}
+
+// Files written by a process of do_parallel_record.
+inline
+static void remove_record_part(const char * path, std::string const & part_basename) {
+    clear_files_flv_meta_png(path, part_basename.c_str(), 0);
+
+    const std::string part_meta_filename = std::string(path) + part_basename + ".mwrm";
+    std::string header;
+    std::vector<std::pair<std::string, std::string>> files;
+    if (read_meta_file(part_meta_filename, header, files)) {
+        for (auto & file : files) {
+            ::unlink(file.first.c_str());
+        }
+        ::unlink(part_meta_filename.c_str());
+    }
+}
+
+// Percentage written in a .pgs file by UpdateProgressData, -1 with the error code and message
+// when the process failed.
+inline
+static int read_progress(const char * progress_filename, int & code, std::string & message) {
+    std::ifstream pgs(progress_filename);
+    int percentage = 0;
+    if (!(pgs >> percentage) || percentage >= 0) {
+        return std::max(percentage, 0);
+    }
+
+    // "-1 message (code)"
+    pgs.get();
+    std::getline(pgs, message);
+    const size_t pos = message.rfind(" (");
+    if (pos != std::string::npos) {
+        code = atoi(message.c_str() + pos + 2);
+        message.resize(pos);
+    }
+    return -1;
+}
+
+REDOC("Transcodes the movie with one process for each part given by split_record_segments:"
+      " a process seeks to the keyframe of its first file and stops at the beginning of the next part,"
+      " its files are written with a \"-partN\" suffix, then renamed in order. The progress of the"
+      " processes is summed in the .pgs file of the output.")
+template<class RecordPart>
+static int do_parallel_record( std::vector<RecordSegment> const & segments, std::vector<size_t> const & parts
+                             , bool from_movie_start, std::string const & output_filename, Inifile & ini
+                             , uint32_t clear, uint32_t verbose, RecordPart record_part) {
+    char outfile_path     [1024] = {};
+    char outfile_basename [1024] = {};
+    char outfile_extension[1024] = {};
+
+    canonical_path( output_filename.c_str()
+                  , outfile_path
+                  , sizeof(outfile_path)
+                  , outfile_basename
+                  , sizeof(outfile_basename)
+                  , outfile_extension
+                  , sizeof(outfile_extension)
+                  , verbose
+                  );
+
+    if (clear == 1) {
+        clear_files_flv_meta_png(outfile_path, outfile_basename);
+    }
+
+    char progress_filename[4096];
+    snprintf( progress_filename, sizeof(progress_filename), "%s%s.pgs"
+            , outfile_path, outfile_basename);
+
+    UpdateProgressData update_progress_data(progress_filename, segments.front().begin, segments.back().end, 0, 0);
+    if (!update_progress_data.is_valid()) {
+        return -1;
+    }
+
+    struct Part {
+        std::string basename;
+        std::string progress_filename;
+        time_t      begin;
+        time_t      end;
+        uint64_t    size;   // of the wrm files
+        pid_t       pid;    // -1: not started, 0: done
+        bool        done;
+    };
+    std::vector<Part> processes;
+    std::vector<std::string> part_basenames;
+    for (size_t i = 0; i < parts.size(); i++) {
+        char part_basename[2048];
+        snprintf(part_basename, sizeof(part_basename), "%s-part%u", outfile_basename, static_cast<unsigned>(i));
+        part_basenames.push_back(part_basename);
+
+        Part part;
+        part.basename          = part_basename;
+        part.progress_filename = std::string(outfile_path) + part_basename + ".pgs";
+        part.begin             = segments[parts[i]].begin;
+        part.end               = (i + 1 < parts.size()) ? segments[parts[i + 1]].begin : segments.back().end;
+        part.size              = 0;
+        for (size_t k = parts[i]; k < ((i + 1 < parts.size()) ? parts[i + 1] : segments.size()); k++) {
+            part.size += segments[k].size;
+        }
+        part.pid               = -1;
+        part.done              = false;
+        processes.push_back(part);
+    }
+
+    bool failed = false;
+
+    std::cout.flush();
+    for (size_t i = 0; i < processes.size() && !failed; i++) {
+        Part & part = processes[i];
+        part.pid = fork();
+        if (part.pid == 0) {
+            int result = -1;
+            try {
+                // the last process plays to the end of the movie
+                result = record_part( part.begin, (i + 1 < processes.size()) ? part.end : 0
+                                    , std::string(outfile_path) + part.basename + outfile_extension);
+            }
+            catch (Error const & e) {
+                const bool msg_with_error_id = false;
+                UpdateProgressData(part.progress_filename.c_str(), 0, 0, 0, 0)
+                    .raise_error(e.id, e.errmsg(msg_with_error_id));
+            }
+            catch (...) {
+                UpdateProgressData(part.progress_filename.c_str(), 0, 0, 0, 0).raise_error(65536, "Unknown error");
+            }
+            std::cout.flush();
+            // the parent files and progress are not closed by this process
+            _exit(result ? 1 : 0);
+        }
+        if (part.pid < 0) {
+            LOG(LOG_ERR, "Failed to start transcoding process: %s", strerror(errno));
+            failed = true;
+        }
+    }
+
+    uint64_t total_size = 0;
+    for (Part & part : processes) {
+        total_size += part.size;
+    }
+
+    for (bool running = true, stop_sent = false; running; ) {
+        if ((failed || program_requested_to_shutdown) && !stop_sent) {
+            for (Part & part : processes) {
+                if (part.pid > 0) {
+                    kill(part.pid, SIGTERM);
+                }
+            }
+            stop_sent = true;
+        }
+
+        running = false;
+        // the progress of the processes is weighted by the size of their files
+        double transcoded = 0;
+        for (Part & part : processes) {
+            if (part.pid > 0) {
+                int status = 0;
+                if (waitpid(part.pid, &status, WNOHANG) == part.pid) {
+                    part.pid  = 0;
+                    part.done = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                    failed |= !part.done;
+                }
+                else {
+                    running = true;
+                }
+            }
+
+            if (part.done) {
+                transcoded += part.size;
+            }
+            else if (part.pid > 0) {
+                int code = 0;
+                std::string message;
+                const int percentage = read_progress(part.progress_filename.c_str(), code, message);
+                transcoded += part.size * std::max(percentage, 0) / 100.;
+            }
+        }
+
+        if (!failed) {
+            const time_t begin = segments.front().begin;
+            update_progress_data(begin + static_cast<time_t>((segments.back().end - begin) * transcoded / total_size));
+        }
+        if (running) {
+            usleep(100000);
+        }
+    }
+
+    int return_code = 0;
+
+    if (failed || program_requested_to_shutdown) {
+        int code = 65536;
+        std::string message = "Transcoding process failed";
+        for (Part & part : processes) {
+            if (read_progress(part.progress_filename.c_str(), code, message) < 0) {
+                break;
+            }
+        }
+        if (program_requested_to_shutdown) {
+            update_progress_data.raise_error(65537, "Program requested to shutdown");
+        }
+        else {
+            update_progress_data.raise_error(code, message.c_str());
+        }
+
+        for (Part & part : processes) {
+            remove_record_part(outfile_path, part.basename);
+        }
+        return_code = -1;
+    }
+    else {
+        try {
+            // the first process seeks unless it starts with the movie
+            stitch_record_parts( outfile_path, outfile_basename, part_basenames, from_movie_start ? 1 : 0
+                               , ini.video.png_limit, verbose);
+        }
+        catch (Error const & e) {
+            const bool msg_with_error_id = false;
+            update_progress_data.raise_error(e.id, e.errmsg(msg_with_error_id));
+            return_code = -1;
+        }
+    }
+
+    for (Part & part : processes) {
+        ::unlink(part.progress_filename.c_str());
+    }
+
+    return return_code;
+}   // do_parallel_record
+
 inline
 static int do_recompress( CryptoContext & cctx, Transport & in_wrm_trans, const timeval begin_record
                         , std::string const & output_filename, Inifile & ini, uint32_t verbose) {
@@ -41,6 +41,7 @@
 #include <cerrno>
 #include <cassert>
 #include <cstddef>
+#include <algorithm>
 #include <utility>
 #include <type_traits> // aligned_storage
 
@@ -50,6 +51,7 @@
 #include "colors.hpp"
 #include "stream.hpp"
 #include "ssl_calls.hpp"
+#include "fingerprint.hpp"
 #include "rect.hpp"
 #include "fdbuf.hpp"
 #include "bitmap_data_allocator.hpp"
@@ -72,6 +74,8 @@ class Bitmap
         size_t size_compressed_;
         mutable uint8_t sha1_[20];
         mutable bool sha1_is_init_;
+        mutable Fingerprint fingerprint_;
+        mutable bool fingerprint_is_init_;
 
         DataBitmapBase(uint8_t bpp, uint16_t cx, uint16_t cy, uint8_t * ptr) noexcept
         : cx_(align4(cx))
@@ -84,6 +88,7 @@ class Bitmap
         , data_compressed_(nullptr)
         , size_compressed_(0)
         , sha1_is_init_(false)
+        , fingerprint_is_init_(false)
         {}
 
         DataBitmapBase(uint16_t cx, uint16_t cy, uint8_t * ptr) noexcept
@@ -97,6 +102,7 @@ class Bitmap
         , data_compressed_(nullptr)
         , size_compressed_(0)
         , sha1_is_init_(false)
+        , fingerprint_is_init_(false)
         {}
     };
 
@@ -167,6 +173,28 @@ class Bitmap
             memcpy(sig, this->sha1_, sizeof(this->sha1_));
         }
 
+        const Fingerprint & fingerprint() const noexcept {
+            if (!this->fingerprint_is_init_) {
+                this->fingerprint_is_init_ = true;
+                uint64_t seed = (uint64_t(this->bpp_) << 32) | (uint32_t(this->cx_) << 16) | this->cy_;
+                if (this->bpp_ == 8) {
+                    seed = ::compute_fingerprint(this->data_palette(), sizeof(BGRPalette), seed).h[0];
+                }
+                this->fingerprint_ = ::compute_fingerprint(this->get(), this->bmp_size_, seed);
+            }
+            return this->fingerprint_;
+        }
+
+        // the signatures already computed for the same pixels
+        void copy_signatures(const DataBitmap & other) noexcept {
+            if (other.sha1_is_init_) {
+                memcpy(this->sha1_, other.sha1_, sizeof(this->sha1_));
+                this->sha1_is_init_ = true;
+            }
+            this->fingerprint_ = other.fingerprint_;
+            this->fingerprint_is_init_ = other.fingerprint_is_init_;
+        }
+
         uint8_t * get() const noexcept {
             return this->ptr_;
         }
@@ -337,7 +365,7 @@ public:
             const uint16_t cy = this->cy();
             for (uint16_t i = 0; i < cy ; i++){
                 memcpy(dest, src, data_width);
-                memset(dest + line_size, 0, line_size - data_width);
+                memset(dest + data_width, 0, line_size - data_width);
                 src += data_width;
                 dest += line_size;
             }
@@ -681,6 +709,22 @@ public:
         return res;
     }
 
+    // Deep copy, unlike the copy constructor the data (and its reference counter) is not shared.
+    Bitmap clone() const {
+        Bitmap bmp;
+        if (this->data_bitmap) {
+            bmp.data_bitmap = (this->cx() == align4(this->cx()))
+                            ? DataBitmap::construct(this->bpp(), this->cx(), this->cy())
+                            : DataBitmap::construct_png(this->cx(), this->cy());
+            if (this->bpp() == 8) {
+                bmp.data_bitmap->palette() = this->palette();
+            }
+            memcpy(bmp.data_bitmap->get(), this->data(), this->bmp_size());
+            bmp.data_bitmap->copy_signatures(*this->data_bitmap);
+        }
+        return bmp;
+    }
+
     const uint8_t* data() const noexcept {
         return this->data_bitmap->get();
     }
@@ -843,7 +887,40 @@ private:
 
     void decompress(const uint8_t* input, uint16_t src_cx, uint16_t src_cy, size_t size) const
     {
-        const uint8_t Bpp = nbbytes(this->bpp());
+        switch (nbbytes(this->bpp())) {
+            case 1:  return this->decompress_rle<1>(input, src_cx, src_cy, size);
+            case 2:  return this->decompress_rle<2>(input, src_cx, src_cy, size);
+            case 3:  return this->decompress_rle<3>(input, src_cx, src_cy, size);
+            default: return this->decompress_rle<4>(input, src_cx, src_cy, size);
+        }
+    }
+
+    template<uint8_t Bpp>
+    static void out_pixels(uint8_t * out, unsigned count, unsigned pixel)
+    {
+        if (Bpp == 1) {
+            memset(out, pixel, count);
+        }
+        else {
+            for (uint8_t * end = out + count * Bpp; out < end; out += Bpp) {
+                out_bytes_le(out, Bpp, pixel);
+            }
+        }
+    }
+
+    template<uint8_t Bpp>
+    static void out_xor_pixels(uint8_t * out, const uint8_t * above, unsigned count, unsigned mix)
+    {
+        for (uint8_t * end = out + count * Bpp; out < end; out += Bpp, above += Bpp) {
+            out_bytes_le(out, Bpp, get_pixel<Bpp>(above) ^ mix);
+        }
+    }
+
+    // Pixels are written by runs clipped to the end of the current scanline,
+    // so FILL, MIX, COLOR and COPY become block copies, fills or xors
+    template<uint8_t Bpp>
+    void decompress_rle(const uint8_t* input, uint16_t src_cx, uint16_t src_cy, size_t size) const
+    {
         const uint16_t dst_cx = this->cx();
         uint8_t* pmin = this->data_bitmap->get();
         uint8_t* pmax = pmin + this->bmp_size();
@@ -981,21 +1058,21 @@ private:
             break;
             case BICOLOR:
                 bicolor = 0;
-                color1 = this->get_pixel(Bpp, input);
+                color1 = get_pixel<Bpp>(input);
                 input += Bpp;
-                color2 = this->get_pixel(Bpp, input);
+                color2 = get_pixel<Bpp>(input);
                 input += Bpp;
                 break;
             case COLOR:
-                color2 = this->get_pixel(Bpp, input);
+                color2 = get_pixel<Bpp>(input);
                 input += Bpp;
                 break;
             case MIX_SET:
-                mix = this->get_pixel(Bpp, input);
+                mix = get_pixel<Bpp>(input);
                 input += Bpp;
             break;
             case FOM_SET:
-                mix = this->get_pixel(Bpp, input);
+                mix = get_pixel<Bpp>(input);
                 input += Bpp;
                 mask = 1;
                 fom_mask = input[0]; input++;
@@ -1008,7 +1085,7 @@ private:
             if ((opcode == FILL)
             && (opcode == lastopcode)
             && (out != pmin + line_size)){
-                yprev = (out - line_size < pmin) ? 0 : this->get_pixel(Bpp, out - line_size);
+                yprev = (out - line_size < pmin) ? 0 : get_pixel<Bpp>(out - line_size);
                 out_bytes_le(out, Bpp, yprev ^ mix);
                 count--;
                 out += Bpp;
@@ -1028,64 +1105,77 @@ private:
                     LOG(LOG_WARNING, "Decompressed bitmap too large. Dying.");
                     throw Error(ERR_BITMAP_DECOMPRESSED_DATA_TOO_LARGE);
                 }
-                yprev = (out - line_size < pmin) ? 0 : this->get_pixel(Bpp, out - line_size);
+                const unsigned n = std::min<unsigned>(count, dst_cx - out_x_count);
+                const uint8_t * above = out - line_size;
+                const bool first_line = (above < pmin);
 
                 switch (opcode) {
                 case FILL:
-                    out_bytes_le(out, Bpp, yprev);
+                    if (first_line) {
+                        memset(out, 0, n * Bpp);
+                    }
+                    else {
+                        memcpy(out, above, n * Bpp);
+                    }
                     break;
                 case MIX_SET:
                 case MIX:
-                    out_bytes_le(out, Bpp, yprev ^ mix);
+                    if (first_line) {
+                        out_pixels<Bpp>(out, n, mix);
+                    }
+                    else {
+                        out_xor_pixels<Bpp>(out, above, n, mix);
+                    }
                     break;
                 case FOM_SET:
                 case FOM:
-                    if (mask == 0x100){
-                        mask = 1;
-                        fom_mask = input[0]; input++;
-                    }
                 case SPECIAL_FGBG_1:
                 case SPECIAL_FGBG_2:
-                    if (mask & fom_mask){
-                        out_bytes_le(out, Bpp, yprev ^ mix);
-                    }
-                    else {
-                        out_bytes_le(out, Bpp, yprev);
+                    for (unsigned i = 0; i < n; i++) {
+                        if (mask == 0x100 && (opcode == FOM || opcode == FOM_SET)){
+                            mask = 1;
+                            fom_mask = input[0]; input++;
+                        }
+                        yprev = first_line ? 0 : get_pixel<Bpp>(above + i * Bpp);
+                        if (mask & fom_mask){
+                            out_bytes_le(out + i * Bpp, Bpp, yprev ^ mix);
+                        }
+                        else {
+                            out_bytes_le(out + i * Bpp, Bpp, yprev);
+                        }
+                        mask <<= 1;
                     }
-                    mask <<= 1;
                     break;
                 case COLOR:
-                    out_bytes_le(out, Bpp, color2);
+                    out_pixels<Bpp>(out, n, color2);
                     break;
                 case COPY:
-                    out_bytes_le(out, Bpp, this->get_pixel(Bpp, input));
-                    input += Bpp;
+                    memcpy(out, input, n * Bpp);
+                    input += n * Bpp;
                     break;
                 case BICOLOR:
-                    if (bicolor) {
-                        out_bytes_le(out, Bpp, color2);
-                        bicolor = 0;
-                    }
-                    else {
-                        out_bytes_le(out, Bpp, color1);
-                        bicolor = 1;
+                    for (unsigned i = 0; i < n; i++) {
+                        out_bytes_le(out + i * Bpp, Bpp, bicolor ? color2 : color1);
+                        bicolor ^= 1;
                     }
                 break;
                 case WHITE:
-                    out_bytes_le(out, Bpp, 0xFFFFFFFF);
+                    out_pixels<Bpp>(out, n, 0xFFFFFFFF);
                 break;
                 case BLACK:
-                    out_bytes_le(out, Bpp, 0);
+                    out_pixels<Bpp>(out, n, 0);
                 break;
                 default:
                     assert(false);
                     break;
                 }
-                count--;
-                out += Bpp;
-                out_x_count += 1;
+                count -= n;
+                out += n * Bpp;
+                out_x_count += n;
                 if (out_x_count == dst_cx){
-                    memset(out, 0, (dst_cx - src_cx) * Bpp);
+                    if (out < pmax) {
+                        memset(out, 0, (dst_cx - src_cx) * Bpp);
+                    }
                     out_x_count = 0;
                 }
             }
@@ -1287,23 +1377,12 @@ public:
 
         for (uint8_t * ypos_begin = color_plane + cx, * ypos_end = color_plane + cx * src_cy;
              ypos_begin < ypos_end; ypos_begin += cx) {
-            for (uint8_t * xpos_begin = ypos_begin, * xpos_end = xpos_begin + src_cx; xpos_begin < xpos_end; xpos_begin++) {
-                uint8_t delta = *xpos_begin;
-
-                //LOG(LOG_INFO, "delta=%d", delta);
-
-                if ((delta % 2) == 0) {
-                    delta >>= 1;
-                    //LOG(LOG_INFO, "delta(o)=%02x", delta);
-                }
-                else {
-                    delta = 255 - ((delta - 1) >> 1);
-                    //LOG(LOG_INFO, "delta(e)=%02x", delta);
-                }
-
-                *xpos_begin = static_cast<uint8_t>(*(xpos_begin - cx) + delta);
-
-                //LOG(LOG_INFO, "delta(1)=%d", (*xpos_begin));
+            const uint8_t * above = ypos_begin - cx;
+            for (uint16_t x = 0; x < src_cx; x++) {
+                // deltas are stored as (delta << 1) for positive values
+                // and ((-delta - 1) << 1) + 1 for negative ones
+                const uint8_t delta = ypos_begin[x];
+                ypos_begin[x] = static_cast<uint8_t>(above[x] + ((delta >> 1) ^ -(delta & 1)));
             }
         }
     }
@@ -1323,6 +1402,20 @@ private:
         }
     }
 
+    template<uint8_t Bpp>
+    static void merge_color_planes(uint8_t * pixel, const uint8_t * r, const uint8_t * g, const uint8_t * b,
+         size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            pixel[i * Bpp + 0] = b[i];
+            pixel[i * Bpp + 1] = g[i];
+            pixel[i * Bpp + 2] = r[i];
+            if (Bpp == 4) {
+                pixel[i * Bpp + 3] = 0xFF;
+            }
+        }
+    }
+
     void decompress60(uint16_t src_cx, uint16_t src_cy, const uint8_t * data, size_t data_size) const
     {
         //LOG(LOG_INFO, "bmp decompress60: cx=%u cy=%u data_size=%u", src_cx, src_cy, data_size);
@@ -1385,19 +1478,11 @@ private:
         //LOG(LOG_INFO, "data_size=%u", data_size);
         REDASSERT(!data_size);
 
-        uint8_t * r     = red_plane;
-        uint8_t * g     = green_plane;
-        uint8_t * b     = blue_plane;
-        uint8_t * pixel = this->data_bitmap->get();
-        uint8_t   bpp   = nbbytes(this->bpp());
-
-        for (uint16_t y = 0; y < cy; y++) {
-            for (uint16_t x = 0; x < cx; x++) {
-                uint32_t color = (0xFF << 24) | ((*r++) << 16) | ((*g++) << 8) | (*b++);
-
-                ::out_bytes_le(pixel, bpp, color);
-                pixel += bpp;
-            }
+        if (this->bpp() == 24) {
+            merge_color_planes<3>(this->data_bitmap->get(), red_plane, green_plane, blue_plane, color_plane_size);
+        }
+        else {
+            merge_color_planes<4>(this->data_bitmap->get(), red_plane, green_plane, blue_plane, color_plane_size);
         }
 
         //LOG(LOG_INFO, "bmp decompress60: done");
@@ -1415,61 +1500,113 @@ public:
         FLAG_BICOLOR = 9
     };
 
-    unsigned get_pixel(const uint8_t Bpp, const uint8_t * const p) const
+    // Run scanners used by the RLE encoder, instantiated for each pixel size.
+    // Runs of identical pixels are found by comparing the bitmap with itself
+    // shifted by one pixel (color), two pixels (bicolor) or one scanline (fill)
+    // a machine word at a time.
+
+    static size_t common_prefix_size(const uint8_t * a, const uint8_t * b, size_t n)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+            uint64_t wa;
+            uint64_t wb;
+            memcpy(&wa, a + i, sizeof(wa));
+            memcpy(&wb, b + i, sizeof(wb));
+            if (wa != wb) {
+                break;
+            }
+        }
+        while (i < n && a[i] == b[i]) {
+            ++i;
+        }
+        return i;
+    }
+
+    static size_t zero_prefix_size(const uint8_t * a, size_t n)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+            uint64_t wa;
+            memcpy(&wa, a + i, sizeof(wa));
+            if (wa) {
+                break;
+            }
+        }
+        while (i < n && !a[i]) {
+            ++i;
+        }
+        return i;
+    }
+
+    template<uint8_t Bpp>
+    static unsigned get_pixel(const uint8_t * const p)
     {
         return in_uint32_from_nb_bytes_le(Bpp, p);
     }
 
-    unsigned get_pixel_above(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * const p) const
+    template<uint8_t Bpp>
+    unsigned get_pixel_above(const uint8_t * pmin, const uint8_t * const p) const
     {
         return ((p-this->line_size()) < pmin)
         ? 0
-        : this->get_pixel(Bpp, p - this->line_size());
+        : get_pixel<Bpp>(p - this->line_size());
     }
 
-    unsigned get_color_count(const uint8_t Bpp, const uint8_t * pmax, const uint8_t * p, unsigned color) const
+    template<uint8_t Bpp>
+    unsigned get_color_count(const uint8_t * pmax, const uint8_t * p, unsigned color) const
     {
-        unsigned acc = 0;
-        while (p < pmax && this->get_pixel(Bpp, p) == color){
-            acc++;
-            p = p + Bpp;
+        if (p >= pmax || get_pixel<Bpp>(p) != color) {
+            return 0;
         }
-        return acc;
+        // pixels starting before pmax
+        const size_t n = (pmax - p + Bpp - 1) / Bpp;
+        return 1 + common_prefix_size(p + Bpp, p, (n - 1) * Bpp) / Bpp;
     }
 
-    unsigned get_bicolor_count(const uint8_t Bpp, const uint8_t * pmax, const uint8_t * p, unsigned color1, unsigned color2) const
+    template<uint8_t Bpp>
+    unsigned get_bicolor_count(const uint8_t * pmax, const uint8_t * p, unsigned color1, unsigned color2) const
     {
-        unsigned acc = 0;
-        while ((p < pmax)
-            && (color1 == this->get_pixel(Bpp, p))
+        if (!((p < pmax)
+            && (color1 == get_pixel<Bpp>(p))
             && (p + Bpp < pmax)
-            && (color2 == this->get_pixel(Bpp, p + Bpp))) {
-                acc = acc + 2;
-                p = p + 2 * Bpp;
+            && (color2 == get_pixel<Bpp>(p + Bpp)))) {
+            return 0;
         }
-        return acc;
+        const size_t n = (pmax - p + Bpp - 1) / Bpp;
+        // pixels after the first pair repeating the pixel two steps before
+        const size_t repeat = common_prefix_size(p + 2 * Bpp, p, (n - 2) * Bpp) / Bpp;
+        return (repeat + 2) / 2 * 2;
     }
 
-    unsigned get_fill_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p) const
+    template<uint8_t Bpp>
+    unsigned get_fill_count(const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p) const
     {
-        unsigned acc = 0;
-        while  (p + Bpp <= pmax) {
-            unsigned pixel = this->get_pixel(Bpp, p);
-            unsigned ypixel = this->get_pixel_above(Bpp, pmin, p);
-            if (ypixel != pixel){
-                break;
-            }
-            p += Bpp;
-            acc += 1;
-        }
-        return acc;
+        if (p + Bpp > pmax) {
+            return 0;
+        }
+        size_t n = (pmax - p) / Bpp;
+        size_t acc = 0;
+        const uint8_t * second_line = pmin + this->line_size();
+        if (p < second_line) {
+            // no scanline above, pixels are compared with black
+            const size_t n0 = std::min<size_t>(n, (second_line - p + Bpp - 1) / Bpp);
+            acc = zero_prefix_size(p, n0 * Bpp) / Bpp;
+            if (acc < n0) {
+                return acc;
+            }
+            p += n0 * Bpp;
+            n -= n0;
+        }
+        return acc + common_prefix_size(p, p - this->line_size(), n * Bpp) / Bpp;
     }
 
-    unsigned get_mix_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground) const
+    template<uint8_t Bpp>
+    unsigned get_mix_count(const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground) const
     {
         unsigned acc = 0;
         while (p + Bpp <= pmax){
-            if (this->get_pixel_above(Bpp, pmin, p) ^ foreground ^ this->get_pixel(Bpp, p)){
+            if (this->get_pixel_above<Bpp>(pmin, p) ^ foreground ^ get_pixel<Bpp>(p)){
                 break;
             }
             p += Bpp;
@@ -1478,14 +1615,15 @@ public:
         return acc;
     }
 
-    unsigned get_fom_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground, bool fill) const
+    template<uint8_t Bpp>
+    unsigned get_fom_count(const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground, bool fill) const
     {
         unsigned acc = 0;
         while (true){
             unsigned count = 0;
             while  (p + Bpp <= pmax) {
-                unsigned pixel = this->get_pixel(Bpp, p);
-                unsigned ypixel = this->get_pixel_above(Bpp, pmin, p);
+                unsigned pixel = get_pixel<Bpp>(p);
+                unsigned ypixel = this->get_pixel_above<Bpp>(pmin, p);
                 if (ypixel ^ pixel ^ (fill?0:foreground)){
                     break;
                 }
@@ -1504,7 +1642,8 @@ public:
         return acc;
     }
 
-    void get_fom_masks(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * p, uint8_t * mask, const unsigned count) const
+    template<uint8_t Bpp>
+    void get_fom_masks(const uint8_t * pmin, const uint8_t * p, uint8_t * mask, const unsigned count) const
     {
         unsigned i = 0;
         for (i = 0; i < count; i += 8)
@@ -1513,20 +1652,21 @@ public:
         }
         for (i = 0 ; i < count; i++, p += Bpp)
         {
-            if (get_pixel(Bpp, p) != get_pixel_above(Bpp, pmin, p)){
+            if (get_pixel<Bpp>(p) != this->get_pixel_above<Bpp>(pmin, p)){
                 mask[i>>3] |= static_cast<uint8_t>(0x01 << (i & 7));
             }
         }
     }
 
-    unsigned get_fom_count_set(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned & foreground, unsigned & flags) const
+    template<uint8_t Bpp>
+    unsigned get_fom_count_set(const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned & foreground, unsigned & flags) const
     {
         // flags : 1 = fill, 2 = MIX, 3 = (1+2) = FOM
         flags = FLAG_FILL;
-        unsigned fill_count = this->get_fill_count(Bpp, pmin, pmax, p);
+        unsigned fill_count = this->get_fill_count<Bpp>(pmin, pmax, p);
         if (fill_count) {
             if (fill_count < 8) {
-                unsigned fom_count = this->get_fom_count(Bpp, pmin, pmax, p + fill_count * Bpp, foreground, false);
+                unsigned fom_count = this->get_fom_count<Bpp>(pmin, pmax, p + fill_count * Bpp, foreground, false);
                 if (fom_count){
                     flags = FLAG_FOM;
                     fill_count += fom_count;
@@ -1541,11 +1681,11 @@ public:
         if  (p + Bpp <= pmax) {
             flags = FLAG_MIX;
             // if there is a pixel we are always able to mix (at worse we will set foreground ourself)
-            foreground = this->get_pixel_above(Bpp, pmin, p) ^ this->get_pixel(Bpp, p);
-            unsigned mix_count = 1 + this->get_mix_count(Bpp, pmin, pmax, p + Bpp, foreground);
+            foreground = this->get_pixel_above<Bpp>(pmin, p) ^ get_pixel<Bpp>(p);
+            unsigned mix_count = 1 + this->get_mix_count<Bpp>(pmin, pmax, p + Bpp, foreground);
             if (mix_count < 8) {
                 unsigned fom_count = 0;
-                fom_count = this->get_fom_count(Bpp, pmin, pmax, p + mix_count * Bpp, foreground, true);
+                fom_count = this->get_fom_count<Bpp>(pmin, pmax, p + mix_count * Bpp, foreground, true);
                 if (fom_count){
                     flags = FLAG_FOM;
                     mix_count += fom_count;
@@ -1557,6 +1697,88 @@ public:
         return 0;
     }
 
+    unsigned get_pixel(const uint8_t Bpp, const uint8_t * const p) const
+    {
+        return in_uint32_from_nb_bytes_le(Bpp, p);
+    }
+
+    unsigned get_pixel_above(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * const p) const
+    {
+        return ((p-this->line_size()) < pmin)
+        ? 0
+        : this->get_pixel(Bpp, p - this->line_size());
+    }
+
+    unsigned get_color_count(const uint8_t Bpp, const uint8_t * pmax, const uint8_t * p, unsigned color) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_color_count<1>(pmax, p, color);
+            case 2:  return this->get_color_count<2>(pmax, p, color);
+            case 3:  return this->get_color_count<3>(pmax, p, color);
+            default: return this->get_color_count<4>(pmax, p, color);
+        }
+    }
+
+    unsigned get_bicolor_count(const uint8_t Bpp, const uint8_t * pmax, const uint8_t * p, unsigned color1, unsigned color2) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_bicolor_count<1>(pmax, p, color1, color2);
+            case 2:  return this->get_bicolor_count<2>(pmax, p, color1, color2);
+            case 3:  return this->get_bicolor_count<3>(pmax, p, color1, color2);
+            default: return this->get_bicolor_count<4>(pmax, p, color1, color2);
+        }
+    }
+
+    unsigned get_fill_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_fill_count<1>(pmin, pmax, p);
+            case 2:  return this->get_fill_count<2>(pmin, pmax, p);
+            case 3:  return this->get_fill_count<3>(pmin, pmax, p);
+            default: return this->get_fill_count<4>(pmin, pmax, p);
+        }
+    }
+
+    unsigned get_mix_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_mix_count<1>(pmin, pmax, p, foreground);
+            case 2:  return this->get_mix_count<2>(pmin, pmax, p, foreground);
+            case 3:  return this->get_mix_count<3>(pmin, pmax, p, foreground);
+            default: return this->get_mix_count<4>(pmin, pmax, p, foreground);
+        }
+    }
+
+    unsigned get_fom_count(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned foreground, bool fill) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_fom_count<1>(pmin, pmax, p, foreground, fill);
+            case 2:  return this->get_fom_count<2>(pmin, pmax, p, foreground, fill);
+            case 3:  return this->get_fom_count<3>(pmin, pmax, p, foreground, fill);
+            default: return this->get_fom_count<4>(pmin, pmax, p, foreground, fill);
+        }
+    }
+
+    void get_fom_masks(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * p, uint8_t * mask, const unsigned count) const
+    {
+        switch (Bpp) {
+            case 1:  this->get_fom_masks<1>(pmin, p, mask, count); return;
+            case 2:  this->get_fom_masks<2>(pmin, p, mask, count); return;
+            case 3:  this->get_fom_masks<3>(pmin, p, mask, count); return;
+            default: this->get_fom_masks<4>(pmin, p, mask, count); return;
+        }
+    }
+
+    unsigned get_fom_count_set(const uint8_t Bpp, const uint8_t * pmin, const uint8_t * pmax, const uint8_t * p, unsigned & foreground, unsigned & flags) const
+    {
+        switch (Bpp) {
+            case 1:  return this->get_fom_count_set<1>(pmin, pmax, p, foreground, flags);
+            case 2:  return this->get_fom_count_set<2>(pmin, pmax, p, foreground, flags);
+            case 3:  return this->get_fom_count_set<3>(pmin, pmax, p, foreground, flags);
+            default: return this->get_fom_count_set<4>(pmin, pmax, p, foreground, flags);
+        }
+    }
+
     TODO(" simplify and enhance compression using 1 pixel orders BLACK or WHITE.")
     void compress(uint8_t session_color_depth, Stream & outbuffer) const
     {
@@ -1569,390 +1791,403 @@ public:
             return this->compress60(outbuffer);
         }
 
-        struct RLE_OutStream {
-            Stream & stream;
-            RLE_OutStream(Stream & outbuffer)
-            : stream(outbuffer)
-            {}
+        switch (nbbytes(this->bpp())) {
+            case 1:  return this->compress_rle<1>(outbuffer);
+            case 2:  return this->compress_rle<2>(outbuffer);
+            case 3:  return this->compress_rle<3>(outbuffer);
+            default: return this->compress_rle<4>(outbuffer);
+        }
+    }
 
-            // =========================================================================
-            // Helper methods for RDP RLE bitmap compression support
-            // =========================================================================
-            void out_count(const int in_count, const int mask){
-                if (in_count < 32) {
-                    this->stream.out_uint8(static_cast<uint8_t>((mask << 5) | in_count));
-                }
-                else if (in_count < 256 + 32){
-                    this->stream.out_uint8(static_cast<uint8_t>(mask << 5));
-                    this->stream.out_uint8(static_cast<uint8_t>(in_count - 32));
-                }
-                else {
-                    this->stream.out_uint8(static_cast<uint8_t>(0xf0 | mask));
-                    this->stream.out_uint16_le(in_count);
-                }
-            }
+private:
+    struct RLE_OutStream {
+        Stream & stream;
+        RLE_OutStream(Stream & outbuffer)
+        : stream(outbuffer)
+        {}
 
-            // Background Run Orders
-            // ~~~~~~~~~~~~~~~~~~~~~
-
-            // A Background Run Order encodes a run of pixels where each pixel in the
-            // run matches the uncompressed pixel on the previous scanline. If there is
-            // no previous scanline then each pixel in the run MUST be black.
-
-            // When encountering back-to-back background runs, the decompressor MUST
-            // write a one-pixel foreground run to the destination buffer before
-            // processing the second background run if both runs occur on the first
-            // scanline or after the first scanline (if the first run is on the first
-            // scanline, and the second run is on the second scanline, then a one-pixel
-            // foreground run MUST NOT be written to the destination buffer). This
-            // one-pixel foreground run is counted in the length of the run.
-
-            // The run length encodes the number of pixels in the run. There is no data
-            // associated with Background Run Orders.
-
-            // +-----------------------+-----------------------------------------------+
-            // | 0x0 REGULAR_BG_RUN    | The compression order encodes a regular-form  |
-            // |                       | background run. The run length is stored in   |
-            // |                       | the five low-order bits of  the order header  |
-            // |                       | byte. If this value is zero, then the run     |
-            // |                       | length is encoded in the byte following the   |
-            // |                       | order header and MUST be incremented by 32 to |
-            // |                       | give the final value.                         |
-            // +-----------------------+-----------------------------------------------+
-            // | 0xF0 MEGA_MEGA_BG_RUN | The compression order encodes a MEGA_MEGA     |
-            // |                       | background run. The run length is stored in   |
-            // |                       | the two bytes following the order header      |
-            // |                       | (in little-endian format).                    |
-            // +-----------------------+-----------------------------------------------+
-
-            void out_fill_count(const int in_count)
-            {
-                this->out_count(in_count, 0x00);
-            }
-
-            // Foreground Run Orders
-            // ~~~~~~~~~~~~~~~~~~~~~
-
-            // A Foreground Run Order encodes a run of pixels where each pixel in the
-            // run matches the uncompressed pixel on the previous scanline XOR’ed with
-            // the current foreground color. If there is no previous scanline, then
-            // each pixel in the run MUST be set to the current foreground color (the
-            // initial foreground color is white).
-
-            // The run length encodes the number of pixels in the run.
-            // If the order is a "set" variant, then in addition to encoding a run of
-            // pixels, the order also encodes a new foreground color (in little-endian
-            // format) in the bytes following the optional run length. The current
-            // foreground color MUST be updated with the new value before writing
-            // the run to the destination buffer.
-
-            // +---------------------------+-------------------------------------------+
-            // | 0x1 REGULAR_FG_RUN        | The compression order encodes a           |
-            // |                           | regular-form foreground run. The run      |
-            // |                           | length is stored in the five low-order    |
-            // |                           | bits of the order header byte. If this    |
-            // |                           | value is zero, then the run length is     |
-            // |                           | encoded in the byte following the order   |
-            // |                           | header and MUST be incremented by 32 to   |
-            // |                           | give the final value.                     |
-            // +---------------------------+-------------------------------------------+
-            // | 0xF1 MEGA_MEGA_FG_RUN     | The compression order encodes a MEGA_MEGA |
-            // |                           | foreground run. The run length is stored  |
-            // |                           | in the two bytes following the order      |
-            // |                           | header (in little-endian format).         |
-            // +---------------------------+-------------------------------------------+
-            // | 0xC LITE_SET_FG_FG_RUN    | The compression order encodes a "set"     |
-            // |                           | variant lite-form foreground run. The run |
-            // |                           | length is stored in the four low-order    |
-            // |                           | bits of the order header byte. If this    |
-            // |                           | value is zero, then the run length is     |
-            // |                           | encoded in the byte following the order   |
-            // |                           | header and MUST be incremented by 16 to   |
-            // |                           | give the final value.                     |
-            // +---------------------------+-------------------------------------------+
-            // | 0xF6 MEGA_MEGA_SET_FG_RUN | The compression order encodes a "set"     |
-            // |                           | variant MEGA_MEGA foreground run. The run |
-            // |                           | length is stored in the two bytes         |
-            // |                           | following the order header (in            |
-            // |                           | little-endian format).                    |
-            // +---------------------------+-------------------------------------------+
-
-            void out_mix_count(const int in_count)
-            {
-                this->out_count(in_count, 0x01);
+        // =========================================================================
+        // Helper methods for RDP RLE bitmap compression support
+        // =========================================================================
+        void out_count(const int in_count, const int mask){
+            if (in_count < 32) {
+                this->stream.out_uint8(static_cast<uint8_t>((mask << 5) | in_count));
+            }
+            else if (in_count < 256 + 32){
+                this->stream.out_uint8(static_cast<uint8_t>(mask << 5));
+                this->stream.out_uint8(static_cast<uint8_t>(in_count - 32));
             }
+            else {
+                this->stream.out_uint8(static_cast<uint8_t>(0xf0 | mask));
+                this->stream.out_uint16_le(in_count);
+            }
+        }
+
+        // Background Run Orders
+        // ~~~~~~~~~~~~~~~~~~~~~
+
+        // A Background Run Order encodes a run of pixels where each pixel in the
+        // run matches the uncompressed pixel on the previous scanline. If there is
+        // no previous scanline then each pixel in the run MUST be black.
+
+        // When encountering back-to-back background runs, the decompressor MUST
+        // write a one-pixel foreground run to the destination buffer before
+        // processing the second background run if both runs occur on the first
+        // scanline or after the first scanline (if the first run is on the first
+        // scanline, and the second run is on the second scanline, then a one-pixel
+        // foreground run MUST NOT be written to the destination buffer). This
+        // one-pixel foreground run is counted in the length of the run.
+
+        // The run length encodes the number of pixels in the run. There is no data
+        // associated with Background Run Orders.
+
+        // +-----------------------+-----------------------------------------------+
+        // | 0x0 REGULAR_BG_RUN    | The compression order encodes a regular-form  |
+        // |                       | background run. The run length is stored in   |
+        // |                       | the five low-order bits of  the order header  |
+        // |                       | byte. If this value is zero, then the run     |
+        // |                       | length is encoded in the byte following the   |
+        // |                       | order header and MUST be incremented by 32 to |
+        // |                       | give the final value.                         |
+        // +-----------------------+-----------------------------------------------+
+        // | 0xF0 MEGA_MEGA_BG_RUN | The compression order encodes a MEGA_MEGA     |
+        // |                       | background run. The run length is stored in   |
+        // |                       | the two bytes following the order header      |
+        // |                       | (in little-endian format).                    |
+        // +-----------------------+-----------------------------------------------+
+
+        void out_fill_count(const int in_count)
+        {
+            this->out_count(in_count, 0x00);
+        }
+
+        // Foreground Run Orders
+        // ~~~~~~~~~~~~~~~~~~~~~
+
+        // A Foreground Run Order encodes a run of pixels where each pixel in the
+        // run matches the uncompressed pixel on the previous scanline XOR’ed with
+        // the current foreground color. If there is no previous scanline, then
+        // each pixel in the run MUST be set to the current foreground color (the
+        // initial foreground color is white).
+
+        // The run length encodes the number of pixels in the run.
+        // If the order is a "set" variant, then in addition to encoding a run of
+        // pixels, the order also encodes a new foreground color (in little-endian
+        // format) in the bytes following the optional run length. The current
+        // foreground color MUST be updated with the new value before writing
+        // the run to the destination buffer.
+
+        // +---------------------------+-------------------------------------------+
+        // | 0x1 REGULAR_FG_RUN        | The compression order encodes a           |
+        // |                           | regular-form foreground run. The run      |
+        // |                           | length is stored in the five low-order    |
+        // |                           | bits of the order header byte. If this    |
+        // |                           | value is zero, then the run length is     |
+        // |                           | encoded in the byte following the order   |
+        // |                           | header and MUST be incremented by 32 to   |
+        // |                           | give the final value.                     |
+        // +---------------------------+-------------------------------------------+
+        // | 0xF1 MEGA_MEGA_FG_RUN     | The compression order encodes a MEGA_MEGA |
+        // |                           | foreground run. The run length is stored  |
+        // |                           | in the two bytes following the order      |
+        // |                           | header (in little-endian format).         |
+        // +---------------------------+-------------------------------------------+
+        // | 0xC LITE_SET_FG_FG_RUN    | The compression order encodes a "set"     |
+        // |                           | variant lite-form foreground run. The run |
+        // |                           | length is stored in the four low-order    |
+        // |                           | bits of the order header byte. If this    |
+        // |                           | value is zero, then the run length is     |
+        // |                           | encoded in the byte following the order   |
+        // |                           | header and MUST be incremented by 16 to   |
+        // |                           | give the final value.                     |
+        // +---------------------------+-------------------------------------------+
+        // | 0xF6 MEGA_MEGA_SET_FG_RUN | The compression order encodes a "set"     |
+        // |                           | variant MEGA_MEGA foreground run. The run |
+        // |                           | length is stored in the two bytes         |
+        // |                           | following the order header (in            |
+        // |                           | little-endian format).                    |
+        // +---------------------------+-------------------------------------------+
+
+        void out_mix_count(const int in_count)
+        {
+            this->out_count(in_count, 0x01);
+        }
 
-            void out_mix_count_set(const int in_count, const uint8_t Bpp, unsigned new_foreground)
-            {
-                const uint8_t mask = 0x06;
-                if (in_count < 16) {
-                    this->stream.out_uint8(static_cast<uint8_t>(0xc0 | in_count));
-                }
-                else if (in_count < 256 + 16){
-                    this->stream.out_uint8(0xc0);
-                    this->stream.out_uint8(static_cast<uint8_t>(in_count - 16));
-                }
-                else {
-                    this->stream.out_uint8(0xf0 | mask);
-                    this->stream.out_uint16_le(in_count);
-                }
-                this->stream.out_bytes_le(Bpp, new_foreground);
-            }
-
-            // Foreground / Background Image Orders
-            // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-
-            // A Foreground/Background Image Order encodes a binary image where each
-            // pixel in the image that is not on the first scanline fulfils exactly one
-            // of the following two properties:
-
-            // (a) The pixel matches the uncompressed pixel on the previous scanline
-            // XOR'ed with the current foreground color.
-
-            // (b) The pixel matches the uncompressed pixel on the previous scanline.
-
-            // If the pixel is on the first scanline then it fulfils exactly one of the
-            // following two properties:
-
-            // (c) The pixel is the current foreground color.
-
-            // (d) The pixel is black.
-
-            // The binary image is encoded as a sequence of byte-sized bitmasks which
-            // follow the optional run length (the last bitmask in the sequence can be
-            // smaller than one byte in size). If the order is a "set" variant then the
-            // bitmasks MUST follow the bytes which specify the new foreground color.
-            // Each bit in the encoded bitmask sequence represents one pixel in the
-            // image. A bit that has a value of 1 represents a pixel that fulfils
-            // either property (a) or (c), while a bit that has a value of 0 represents
-            // a pixel that fulfils either property (b) or (d). The individual bitmasks
-            // MUST each be processed from the low-order bit to the high-order bit.
-
-            // The run length encodes the number of pixels in the run.
-
-            // If the order is a "set" variant, then in addition to encoding a binary
-            // image, the order also encodes a new foreground color (in little-endian
-            // format) in the bytes following the optional run length. The current
-            // foreground color MUST be updated with the new value before writing
-            // the run to the destination buffer.
-
-            // +--------------------------------+--------------------------------------+
-            // | 0x2 REGULAR_FGBG_IMAGE         | The compression order encodes a      |
-            // |                                | regular-form foreground/background   |
-            // |                                | image. The run length is encoded in  |
-            // |                                | the five low-order bits of the order |
-            // |                                | header byte and MUST be multiplied   |
-            // |                                | by 8 to give the final value. If     |
-            // |                                | this value is zero, then the run     |
-            // |                                | length is encoded in the byte        |
-            // |                                | following the order header and MUST  |
-            // |                                | be incremented by 1 to give the      |
-            // |                                | final value.                         |
-            // +--------------------------------+--------------------------------------+
-            // | 0xF2 MEGA_MEGA_FGBG_IMAGE      | The compression order encodes a      |
-            // |                                | MEGA_MEGA foreground/background      |
-            // |                                | image. The run length is stored in   |
-            // |                                | the two bytes following the order    |
-            // |                                | header (in little-endian format).    |
-            // +--------------------------------+--------------------------------------+
-            // | 0xD LITE_SET_FG_FGBG_IMAGE     | The compression order encodes a      |
-            // |                                | "set" variant lite-form              |
-            // |                                | foreground/background image. The run |
-            // |                                | length is encoded in the four        |
-            // |                                | low-order bits of the order header   |
-            // |                                | byte and MUST be multiplied by 8 to  |
-            // |                                | give the final value. If this value  |
-            // |                                | is zero, then the run length is      |
-            // |                                | encoded in the byte following the    |
-            // |                                | order header and MUST be incremented |
-            // |                                | by 1 to give the final value.        |
-            // +--------------------------------+--------------------------------------+
-            // | 0xF7 MEGA_MEGA_SET_FGBG_IMAGE  | The compression order encodes a      |
-            // |                                | "set" variant MEGA_MEGA              |
-            // |                                | foreground/background image. The run |
-            // |                                | length is stored in the two bytes    |
-            // |                                | following the order header (in       |
-            // |                                | little-endian format).               |
-            // +-----------------------------------------------------------------------+
-
-            void out_fom_count(const int in_count)
-            {
-                if (in_count < 256){
-                    if (in_count & 7){
-                        this->stream.out_uint8(0x40);
-                        this->stream.out_uint8(static_cast<uint8_t>(in_count - 1));
-                    }
-                    else{
-                        this->stream.out_uint8(static_cast<uint8_t>(0x40 | (in_count >> 3)));
-                    }
+        void out_mix_count_set(const int in_count, const uint8_t Bpp, unsigned new_foreground)
+        {
+            const uint8_t mask = 0x06;
+            if (in_count < 16) {
+                this->stream.out_uint8(static_cast<uint8_t>(0xc0 | in_count));
+            }
+            else if (in_count < 256 + 16){
+                this->stream.out_uint8(0xc0);
+                this->stream.out_uint8(static_cast<uint8_t>(in_count - 16));
+            }
+            else {
+                this->stream.out_uint8(0xf0 | mask);
+                this->stream.out_uint16_le(in_count);
+            }
+            this->stream.out_bytes_le(Bpp, new_foreground);
+        }
+
+        // Foreground / Background Image Orders
+        // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+        // A Foreground/Background Image Order encodes a binary image where each
+        // pixel in the image that is not on the first scanline fulfils exactly one
+        // of the following two properties:
+
+        // (a) The pixel matches the uncompressed pixel on the previous scanline
+        // XOR'ed with the current foreground color.
+
+        // (b) The pixel matches the uncompressed pixel on the previous scanline.
+
+        // If the pixel is on the first scanline then it fulfils exactly one of the
+        // following two properties:
+
+        // (c) The pixel is the current foreground color.
+
+        // (d) The pixel is black.
+
+        // The binary image is encoded as a sequence of byte-sized bitmasks which
+        // follow the optional run length (the last bitmask in the sequence can be
+        // smaller than one byte in size). If the order is a "set" variant then the
+        // bitmasks MUST follow the bytes which specify the new foreground color.
+        // Each bit in the encoded bitmask sequence represents one pixel in the
+        // image. A bit that has a value of 1 represents a pixel that fulfils
+        // either property (a) or (c), while a bit that has a value of 0 represents
+        // a pixel that fulfils either property (b) or (d). The individual bitmasks
+        // MUST each be processed from the low-order bit to the high-order bit.
+
+        // The run length encodes the number of pixels in the run.
+
+        // If the order is a "set" variant, then in addition to encoding a binary
+        // image, the order also encodes a new foreground color (in little-endian
+        // format) in the bytes following the optional run length. The current
+        // foreground color MUST be updated with the new value before writing
+        // the run to the destination buffer.
+
+        // +--------------------------------+--------------------------------------+
+        // | 0x2 REGULAR_FGBG_IMAGE         | The compression order encodes a      |
+        // |                                | regular-form foreground/background   |
+        // |                                | image. The run length is encoded in  |
+        // |                                | the five low-order bits of the order |
+        // |                                | header byte and MUST be multiplied   |
+        // |                                | by 8 to give the final value. If     |
+        // |                                | this value is zero, then the run     |
+        // |                                | length is encoded in the byte        |
+        // |                                | following the order header and MUST  |
+        // |                                | be incremented by 1 to give the      |
+        // |                                | final value.                         |
+        // +--------------------------------+--------------------------------------+
+        // | 0xF2 MEGA_MEGA_FGBG_IMAGE      | The compression order encodes a      |
+        // |                                | MEGA_MEGA foreground/background      |
+        // |                                | image. The run length is stored in   |
+        // |                                | the two bytes following the order    |
+        // |                                | header (in little-endian format).    |
+        // +--------------------------------+--------------------------------------+
+        // | 0xD LITE_SET_FG_FGBG_IMAGE     | The compression order encodes a      |
+        // |                                | "set" variant lite-form              |
+        // |                                | foreground/background image. The run |
+        // |                                | length is encoded in the four        |
+        // |                                | low-order bits of the order header   |
+        // |                                | byte and MUST be multiplied by 8 to  |
+        // |                                | give the final value. If this value  |
+        // |                                | is zero, then the run length is      |
+        // |                                | encoded in the byte following the    |
+        // |                                | order header and MUST be incremented |
+        // |                                | by 1 to give the final value.        |
+        // +--------------------------------+--------------------------------------+
+        // | 0xF7 MEGA_MEGA_SET_FGBG_IMAGE  | The compression order encodes a      |
+        // |                                | "set" variant MEGA_MEGA              |
+        // |                                | foreground/background image. The run |
+        // |                                | length is stored in the two bytes    |
+        // |                                | following the order header (in       |
+        // |                                | little-endian format).               |
+        // +-----------------------------------------------------------------------+
+
+        void out_fom_count(const int in_count)
+        {
+            if (in_count < 256){
+                if (in_count & 7){
+                    this->stream.out_uint8(0x40);
+                    this->stream.out_uint8(static_cast<uint8_t>(in_count - 1));
                 }
                 else{
-                    this->stream.out_uint8(0xf2);
-                    this->stream.out_uint16_le(in_count);
+                    this->stream.out_uint8(static_cast<uint8_t>(0x40 | (in_count >> 3)));
                 }
             }
-
-            void out_fom_sequence(const int count, const uint8_t * masks) {
-                this->out_fom_count(count);
-                this->stream.out_copy_bytes(masks, nbbytes_large(count));
+            else{
+                this->stream.out_uint8(0xf2);
+                this->stream.out_uint16_le(in_count);
             }
+        }
 
-            void out_fom_count_set(const int in_count)
-            {
-                if (in_count < 256){
-                    if (in_count & 0x87){
-                        this->stream.out_uint8(0xD0);
-                        this->stream.out_uint8(static_cast<uint8_t>(in_count - 1));
-                    }
-                    else{
-                        this->stream.out_uint8(static_cast<uint8_t>(0xD0 | (in_count >> 3)));
-                    }
+        void out_fom_sequence(const int count, const uint8_t * masks) {
+            this->out_fom_count(count);
+            this->stream.out_copy_bytes(masks, nbbytes_large(count));
+        }
+
+        void out_fom_count_set(const int in_count)
+        {
+            if (in_count < 256){
+                if (in_count & 0x87){
+                    this->stream.out_uint8(0xD0);
+                    this->stream.out_uint8(static_cast<uint8_t>(in_count - 1));
                 }
                 else{
-                    this->stream.out_uint8(0xf7);
-                    this->stream.out_uint16_le(in_count);
+                    this->stream.out_uint8(static_cast<uint8_t>(0xD0 | (in_count >> 3)));
                 }
             }
-
-            void out_fom_sequence_set(const uint8_t Bpp, const int count,
-                                      const unsigned foreground, const uint8_t * masks) {
-                this->out_fom_count_set(count);
-                this->stream.out_bytes_le(Bpp, foreground);
-                this->stream.out_copy_bytes(masks, nbbytes_large(count));
+            else{
+                this->stream.out_uint8(0xf7);
+                this->stream.out_uint16_le(in_count);
             }
+        }
 
-            // Color Run Orders
-            // ~~~~~~~~~~~~~~~~
+        void out_fom_sequence_set(const uint8_t Bpp, const int count,
+                                  const unsigned foreground, const uint8_t * masks) {
+            this->out_fom_count_set(count);
+            this->stream.out_bytes_le(Bpp, foreground);
+            this->stream.out_copy_bytes(masks, nbbytes_large(count));
+        }
 
-            // A Color Run Order encodes a run of pixels where each pixel is the same
-            // color. The color is encoded (in little-endian format) in the bytes
-            // following the optional run length.
+        // Color Run Orders
+        // ~~~~~~~~~~~~~~~~
 
-            // The run length encodes the number of pixels in the run.
+        // A Color Run Order encodes a run of pixels where each pixel is the same
+        // color. The color is encoded (in little-endian format) in the bytes
+        // following the optional run length.
 
-            // +--------------------------+--------------------------------------------+
-            // | 0x3 REGULAR_COLOR_RUN    | The compression order encodes a            |
-            // |                          | regular-form color run. The run length is  |
-            // |                          | stored in the five low-order bits of the   |
-            // |                          | order header byte. If this value is zero,  |
-            // |                          | then the run length is encoded in the byte |
-            // |                          | following the order header and MUST be     |
-            // |                          | incremented by 32 to give the final value. |
-            // +--------------------------+--------------------------------------------+
-            // | 0xF3 MEGA_MEGA_COLOR_RUN | The compression order encodes a MEGA_MEGA  |
-            // |                          | color run. The run length is stored in the |
-            // |                          | two bytes following the order header (in   |
-            // |                          | little-endian format).                     |
-            // +--------------------------+--------------------------------------------+
+        // The run length encodes the number of pixels in the run.
 
-            void out_color_sequence(const uint8_t Bpp, const int count, const uint32_t color)
-            {
-                this->out_color_count(count);
-                this->stream.out_bytes_le(Bpp, color);
-            }
+        // +--------------------------+--------------------------------------------+
+        // | 0x3 REGULAR_COLOR_RUN    | The compression order encodes a            |
+        // |                          | regular-form color run. The run length is  |
+        // |                          | stored in the five low-order bits of the   |
+        // |                          | order header byte. If this value is zero,  |
+        // |                          | then the run length is encoded in the byte |
+        // |                          | following the order header and MUST be     |
+        // |                          | incremented by 32 to give the final value. |
+        // +--------------------------+--------------------------------------------+
+        // | 0xF3 MEGA_MEGA_COLOR_RUN | The compression order encodes a MEGA_MEGA  |
+        // |                          | color run. The run length is stored in the |
+        // |                          | two bytes following the order header (in   |
+        // |                          | little-endian format).                     |
+        // +--------------------------+--------------------------------------------+
 
-            void out_color_count(const int in_count)
-            {
-                this->out_count(in_count, 0x03);
-            }
-
-            // Color Image Orders
-            // ~~~~~~~~~~~~~~~~~~
-
-            // A Color Image Order encodes a run of uncompressed pixels.
-
-            // The run length encodes the number of pixels in the run. So, to compute
-            // the actual number of bytes which follow the optional run length, the run
-            // length MUST be multiplied by the color depth (in bits-per-pixel) of the
-            // bitmap data.
-
-            // +-----------------------------+-----------------------------------------+
-            // | 0x4 REGULAR_COLOR_IMAGE     | The compression order encodes a         |
-            // |                             | regular-form color image. The run       |
-            // |                             | length is stored in the five low-order  |
-            // |                             | bits of the order header byte. If this  |
-            // |                             | value is zero, then the run length is   |
-            // |                             | encoded in the byte following the order |
-            // |                             | header and MUST be incremented by 32 to |
-            // |                             | give the final value.                   |
-            // +-----------------------------+-----------------------------------------+
-            // | 0xF4 MEGA_MEGA_COLOR_IMAGE  | The compression order encodes a         |
-            // |                             | MEGA_MEGA color image. The run length   |
-            // |                             | is stored in the two bytes following    |
-            // |                             | the order header (in little-endian      |
-            // |                             | format).                                |
-            // +-----------------------------+-----------------------------------------+
-
-            void out_copy_sequence(const uint8_t Bpp, const int count, const uint8_t * data)
-            {
-                this->out_copy_count(count);
-                this->stream.out_copy_bytes(data, count * Bpp);
-            }
+        void out_color_sequence(const uint8_t Bpp, const int count, const uint32_t color)
+        {
+            this->out_color_count(count);
+            this->stream.out_bytes_le(Bpp, color);
+        }
 
-            void out_copy_count(const int in_count)
-            {
-                this->out_count(in_count, 0x04);
-            }
-
-            // Dithered Run Orders
-            // ~~~~~~~~~~~~~~~~~~~
-
-            // A Dithered Run Order encodes a run of pixels which is composed of two
-            // alternating colors. The two colors are encoded (in little-endian format)
-            // in the bytes following the optional run length.
-
-            // The run length encodes the number of pixel-pairs in the run (not pixels).
-
-            // +-----------------------------+-----------------------------------------+
-            // | 0xE LITE_DITHERED_RUN       | The compression order encodes a         |
-            // |                             | lite-form dithered run. The run length  |
-            // |                             | is stored in the four low-order bits of |
-            // |                             | the order header byte. If this value is |
-            // |                             | zero, then the run length is encoded in |
-            // |                             | the byte following the order header and |
-            // |                             | MUST be incremented by 16 to give the   |
-            // |                             | final value.                            |
-            // +-----------------------------+-----------------------------------------+
-            // | 0xF8 MEGA_MEGA_DITHERED_RUN | The compression order encodes a         |
-            // |                             | MEGA_MEGA dithered run. The run length  |
-            // |                             | is stored in the two bytes following    |
-            // |                             | the order header (in little-endian      |
-            // |                             | format).                                |
-            // +-----------------------------+-----------------------------------------+
-
-            void out_bicolor_sequence(const uint8_t Bpp, const int count,
-                                      const unsigned color1, const unsigned color2)
-            {
-                this->out_bicolor_count(count);
-                this->stream.out_bytes_le(Bpp, color1);
-                this->stream.out_bytes_le(Bpp, color2);
-            }
+        void out_color_count(const int in_count)
+        {
+            this->out_count(in_count, 0x03);
+        }
+
+        // Color Image Orders
+        // ~~~~~~~~~~~~~~~~~~
+
+        // A Color Image Order encodes a run of uncompressed pixels.
+
+        // The run length encodes the number of pixels in the run. So, to compute
+        // the actual number of bytes which follow the optional run length, the run
+        // length MUST be multiplied by the color depth (in bits-per-pixel) of the
+        // bitmap data.
+
+        // +-----------------------------+-----------------------------------------+
+        // | 0x4 REGULAR_COLOR_IMAGE     | The compression order encodes a         |
+        // |                             | regular-form color image. The run       |
+        // |                             | length is stored in the five low-order  |
+        // |                             | bits of the order header byte. If this  |
+        // |                             | value is zero, then the run length is   |
+        // |                             | encoded in the byte following the order |
+        // |                             | header and MUST be incremented by 32 to |
+        // |                             | give the final value.                   |
+        // +-----------------------------+-----------------------------------------+
+        // | 0xF4 MEGA_MEGA_COLOR_IMAGE  | The compression order encodes a         |
+        // |                             | MEGA_MEGA color image. The run length   |
+        // |                             | is stored in the two bytes following    |
+        // |                             | the order header (in little-endian      |
+        // |                             | format).                                |
+        // +-----------------------------+-----------------------------------------+
+
+        void out_copy_sequence(const uint8_t Bpp, const int count, const uint8_t * data)
+        {
+            this->out_copy_count(count);
+            this->stream.out_copy_bytes(data, count * Bpp);
+        }
 
-            void out_bicolor_count(const int in_count)
-            {
-                const uint8_t mask = 0x08;
-                if (in_count / 2 < 16){
-                    this->stream.out_uint8(static_cast<uint8_t>(0xe0 | (in_count / 2)));
-                }
-                else if (in_count / 2 < 256 + 16){
-                    this->stream.out_uint8(static_cast<uint8_t>(0xe0));
-                    this->stream.out_uint8(static_cast<uint8_t>(in_count / 2 - 16));
-                }
-                else{
-                    this->stream.out_uint8(0xf0 | mask);
-                    this->stream.out_uint16_le(in_count / 2);
-                }
+        void out_copy_count(const int in_count)
+        {
+            this->out_count(in_count, 0x04);
+        }
+
+        // Dithered Run Orders
+        // ~~~~~~~~~~~~~~~~~~~
+
+        // A Dithered Run Order encodes a run of pixels which is composed of two
+        // alternating colors. The two colors are encoded (in little-endian format)
+        // in the bytes following the optional run length.
+
+        // The run length encodes the number of pixel-pairs in the run (not pixels).
+
+        // +-----------------------------+-----------------------------------------+
+        // | 0xE LITE_DITHERED_RUN       | The compression order encodes a         |
+        // |                             | lite-form dithered run. The run length  |
+        // |                             | is stored in the four low-order bits of |
+        // |                             | the order header byte. If this value is |
+        // |                             | zero, then the run length is encoded in |
+        // |                             | the byte following the order header and |
+        // |                             | MUST be incremented by 16 to give the   |
+        // |                             | final value.                            |
+        // +-----------------------------+-----------------------------------------+
+        // | 0xF8 MEGA_MEGA_DITHERED_RUN | The compression order encodes a         |
+        // |                             | MEGA_MEGA dithered run. The run length  |
+        // |                             | is stored in the two bytes following    |
+        // |                             | the order header (in little-endian      |
+        // |                             | format).                                |
+        // +-----------------------------+-----------------------------------------+
+
+        void out_bicolor_sequence(const uint8_t Bpp, const int count,
+                                  const unsigned color1, const unsigned color2)
+        {
+            this->out_bicolor_count(count);
+            this->stream.out_bytes_le(Bpp, color1);
+            this->stream.out_bytes_le(Bpp, color2);
+        }
+
+        void out_bicolor_count(const int in_count)
+        {
+            const uint8_t mask = 0x08;
+            if (in_count / 2 < 16){
+                this->stream.out_uint8(static_cast<uint8_t>(0xe0 | (in_count / 2)));
+            }
+            else if (in_count / 2 < 256 + 16){
+                this->stream.out_uint8(static_cast<uint8_t>(0xe0));
+                this->stream.out_uint8(static_cast<uint8_t>(in_count / 2 - 16));
             }
-        } out(outbuffer);
+            else{
+                this->stream.out_uint8(0xf0 | mask);
+                this->stream.out_uint16_le(in_count / 2);
+            }
+        }
+    };
+
+    template<uint8_t Bpp>
+    void compress_rle(Stream & outbuffer) const
+    {
+        RLE_OutStream out(outbuffer);
 
         uint8_t * tmp_data_compressed = out.stream.p;
 
-        const uint8_t Bpp = nbbytes(this->bpp());
         const uint8_t * pmin = this->data_bitmap->get();
         const uint8_t * p = pmin;
 
         // white with the right length : either 0xFF or 0xFFFF or 0xFFFFFF
-        unsigned foreground = ~(-1 << (Bpp*8));
+        unsigned foreground = 0xFFFFFFFFu >> (32 - Bpp * 8);
         unsigned new_foreground = foreground;
         unsigned flags = 0;
         uint8_t masks[512];
@@ -1982,7 +2217,7 @@ public:
             }
             while (p < pmax)
             {
-                uint32_t fom_count = this->get_fom_count_set(Bpp, pmin, pmax, p, new_foreground, flags);
+                uint32_t fom_count = this->get_fom_count_set<Bpp>(pmin, pmax, p, new_foreground, flags);
                 if (nbbytes_large(fom_count) > sizeof(masks)) {
                     fom_count = sizeof(masks) * 8;
                 }
@@ -1990,14 +2225,14 @@ public:
                 uint32_t bicolor_count = 0;
 
                 if (p + Bpp < pmax){
-                    color = this->get_pixel(Bpp, p);
-                    color2 = this->get_pixel(Bpp, p + Bpp);
+                    color = get_pixel<Bpp>(p);
+                    color2 = get_pixel<Bpp>(p + Bpp);
 
                     if (color == color2){
-                        color_count = this->get_color_count(Bpp, pmax, p, color);
+                        color_count = this->get_color_count<Bpp>(pmax, p, color);
                     }
                     else {
-                        bicolor_count = this->get_bicolor_count(Bpp, pmax, p, color, color2);
+                        bicolor_count = this->get_bicolor_count<Bpp>(pmax, p, color, color2);
                     }
                 }
 
@@ -2013,7 +2248,7 @@ public:
                 && fom_cost < copy_fom_cost) {
                     switch (flags){
                         case FLAG_FOM:
-                            this->get_fom_masks(Bpp, pmin, p, masks, fom_count);
+                            this->get_fom_masks<Bpp>(pmin, p, masks, fom_count);
                             if (new_foreground != foreground){
                                 flags = FLAG_FOM_SET;
                             }
@@ -2102,6 +2337,7 @@ public:
         this->data_bitmap->copy_compressed_buffer(tmp_data_compressed, out.stream.p - tmp_data_compressed);
     }
 
+public:
     static void get_run(const uint8_t * data, uint16_t data_size, uint8_t last_raw, uint32_t & run_length,
         uint32_t & raw_bytes)
     {
@@ -2352,11 +2588,86 @@ public:
         this->data_bitmap->copy_sha1(sig);
     }
 
+    // key of the bitmap caches, see fingerprint.hpp
+    const Fingerprint & compute_fingerprint() const
+    {
+        return this->data_bitmap->fingerprint();
+    }
+
     static size_t compute_bmp_size(uint8_t bpp, uint16_t cx, uint16_t cy)
     {
         return DataBitmap::compute_bmp_size(bpp, cx, cy);
     }
 
+private:
+    template<uint8_t InBpp, uint8_t OutBpp>
+    static uint32_t convert_pixel(uint32_t pixel, const BGRPalette & palette)
+    {
+        pixel = color_decode(pixel, InBpp, palette);
+        if (OutBpp == 16 || OutBpp == 15 || OutBpp == 8){
+            pixel = RGBtoBGR(pixel);
+        }
+        return color_encode(pixel, OutBpp);
+    }
+
+    // Color depth conversion kernel for a (InBpp, OutBpp) pair. Pixel sizes are
+    // constants, the compiler unrolls byte accesses and vectorizes the loop.
+    template<uint8_t InBpp, uint8_t OutBpp>
+    static void convert_pixels(uint8_t * dest, const uint8_t * src, size_t count, const BGRPalette & palette)
+    {
+        const uint8_t in_nbbytes = (InBpp + 7) / 8;
+        const uint8_t out_nbbytes = (OutBpp + 7) / 8;
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t pixel = convert_pixel<InBpp, OutBpp>(
+                in_uint32_from_nb_bytes_le(in_nbbytes, src + i * in_nbbytes), palette);
+            out_bytes_le(dest + i * out_nbbytes, out_nbbytes, pixel);
+        }
+    }
+
+    // Palette based source: the 256 colors are converted once.
+    template<uint8_t OutBpp>
+    static void convert_palette_pixels(uint8_t * dest, const uint8_t * src, size_t count, const BGRPalette & palette)
+    {
+        uint32_t table[256];
+        for (unsigned c = 0; c < 256; ++c) {
+            table[c] = convert_pixel<8, OutBpp>(c, palette);
+        }
+        const uint8_t out_nbbytes = (OutBpp + 7) / 8;
+        for (size_t i = 0; i < count; ++i) {
+            out_bytes_le(dest + i * out_nbbytes, out_nbbytes, table[src[i]]);
+        }
+    }
+
+    typedef void (*convert_pixels_fn)(uint8_t * dest, const uint8_t * src, size_t count, const BGRPalette & palette);
+
+    static convert_pixels_fn get_convert_pixels(uint8_t in_bpp, uint8_t out_bpp)
+    {
+        static const convert_pixels_fn converters[5][5] = {
+            { nullptr, convert_palette_pixels<15>, convert_palette_pixels<16>,
+              convert_palette_pixels<24>, convert_palette_pixels<32> },
+            { convert_pixels<15, 8>, nullptr, convert_pixels<15, 16>, convert_pixels<15, 24>, convert_pixels<15, 32> },
+            { convert_pixels<16, 8>, convert_pixels<16, 15>, nullptr, convert_pixels<16, 24>, convert_pixels<16, 32> },
+            { convert_pixels<24, 8>, convert_pixels<24, 15>, convert_pixels<24, 16>, nullptr, convert_pixels<24, 32> },
+            { convert_pixels<32, 8>, convert_pixels<32, 15>, convert_pixels<32, 16>, convert_pixels<32, 24>, nullptr },
+        };
+        struct bpp_index {
+            static int get(uint8_t bpp) {
+                switch (bpp) {
+                    case 8:  return 0;
+                    case 15: return 1;
+                    case 16: return 2;
+                    case 24: return 3;
+                    case 32: return 4;
+                    default: return -1;
+                }
+            }
+        };
+        const int in = bpp_index::get(in_bpp);
+        const int out = bpp_index::get(out_bpp);
+        return (in < 0 || out < 0) ? nullptr : converters[in][out];
+    }
+
+public:
     Bitmap(uint8_t out_bpp, const Bitmap& bmp)
     {
         //LOG(LOG_INFO, "Creating bitmap (%p) (copy constructor) cx=%u cy=%u size=%u bpp=%u", this, cx, cy, bmp_size, bpp);
@@ -2366,31 +2677,29 @@ public:
 
             uint8_t * dest = this->data_bitmap->get();
             const uint8_t * src = bmp.data_bitmap->get();
-            const uint8_t src_nbbytes = nbbytes(bmp.bpp());
-            const uint8_t Bpp = nbbytes(out_bpp);
 
-            for (size_t y = 0; y < bmp.cy() ; y++) {
-                for (size_t x = 0; x < bmp.cx() ; x++) {
-                    uint32_t pixel = in_uint32_from_nb_bytes_le(src_nbbytes, src);
+            if (convert_pixels_fn convert = get_convert_pixels(bmp.bpp(), out_bpp)) {
+                convert(dest, src, size_t(bmp.cx()) * bmp.cy(), bmp.palette());
+            }
+            else {
+                const uint8_t src_nbbytes = nbbytes(bmp.bpp());
+                const uint8_t Bpp = nbbytes(out_bpp);
 
-                    pixel = color_decode(pixel, bmp.bpp(), bmp.palette());
-                    if (out_bpp == 16 || out_bpp == 15 || out_bpp == 8){
-                        pixel = RGBtoBGR(pixel);
-                    }
-                    pixel = color_encode(pixel, out_bpp);
+                for (size_t y = 0; y < bmp.cy() ; y++) {
+                    for (size_t x = 0; x < bmp.cx() ; x++) {
+                        uint32_t pixel = in_uint32_from_nb_bytes_le(src_nbbytes, src);
 
-                    out_bytes_le(dest, Bpp, pixel);
-                    src += src_nbbytes;
-                    dest += Bpp;
+                        pixel = color_decode(pixel, bmp.bpp(), bmp.palette());
+                        if (out_bpp == 16 || out_bpp == 15 || out_bpp == 8){
+                            pixel = RGBtoBGR(pixel);
+                        }
+                        pixel = color_encode(pixel, out_bpp);
+
+                        out_bytes_le(dest, Bpp, pixel);
+                        src += src_nbbytes;
+                        dest += Bpp;
+                    }
                 }
-                //TODO("padding code should not be necessary as source bmp width is already aligned");
-                //if (this->line_size < bmp.cx() * Bpp){
-                //    uint16_t padding = this->line_size - bmp.cx() * Bpp;
-                //    memset(dest, 0, padding);
-                //    dest += padding;
-                //}
-                //TODO("padding code should not be necessary for source either as source bmp width is already aligned");
-                //src += bmp.line_size - bmp.cx * src_nbbytes;
             }
 
             if (out_bpp == 8){
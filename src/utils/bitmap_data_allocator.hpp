@@ -31,6 +31,7 @@
 #define _REDEMPTION_UTILS_BITMAP_DATA_ALLOCATOR_HPP__
 
 #include <new>
+#include <mutex>
 
 using std::size_t;
 
@@ -83,6 +84,8 @@ namespace aux_ {
 
         Memory mems[5];
         void * data = nullptr;
+        // bitmaps are also allocated and released by the capture worker thread
+        std::mutex mutex;
 
     public:
         BmpMemAlloc() = default;
@@ -92,6 +95,7 @@ namespace aux_ {
         }
 
         void * alloc(size_t n) {
+            std::lock_guard<std::mutex> lock(this->mutex);
             //std::cout << "n: " << n << std::endl;
             for (Memory & mem : this->mems) {
                 if (n <= mem.size_element()) {
@@ -106,6 +110,7 @@ namespace aux_ {
         }
 
         void dealloc(void * p) {
+            std::lock_guard<std::mutex> lock(this->mutex);
             for (Memory & mem : this->mems) {
                 if (mem.contains(p)) {
                     mem.push(p);
@@ -130,6 +135,7 @@ namespace aux_ {
         };
 
         void reserve(MemoryDef const & m1, MemoryDef const & m2, MemoryDef const & m3, MemoryDef const & m4, MemoryDef const & m5) {
+            std::lock_guard<std::mutex> lock(this->mutex);
             if (!this->data) {
                 const size_t mem_size = m1.cel * m1.sz + m2.cel * m2.sz + m3.cel * m3.sz + m4.cel * m4.sz + m5.cel * m5.sz;
                 const size_t ntotal = (m1.cel + m2.cel + m3.cel + m4.cel + m5.cel);
@@ -30,8 +30,14 @@
 #include "rect.hpp"
 #include "ellipse.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using std::size_t;
 
+// The raster operations work on a byte of each color component. With SSE2, they also work
+// on 16 bytes at once (4 pixels of a 32 bpp drawable).
 namespace Ops {
     using u8 = uint8_t;
 
@@ -41,6 +47,13 @@ namespace Ops {
        {
            return source;
        }
+
+#ifdef __SSE2__
+       __m128i operator()(__m128i /*target*/, __m128i source) const noexcept
+       {
+           return source;
+       }
+#endif
     };
 
     struct InvertSrc
@@ -49,6 +62,13 @@ namespace Ops {
        {
            return ~source;
        }
+
+#ifdef __SSE2__
+       __m128i operator()(__m128i /*target*/, __m128i source) const noexcept
+       {
+           return _mm_xor_si128(source, _mm_set1_epi32(-1));
+       }
+#endif
     };
 
     struct InvertTarget
@@ -57,6 +77,13 @@ namespace Ops {
        {
            return ~target;
        }
+
+#ifdef __SSE2__
+       __m128i operator()(__m128i target, __m128i /*source*/) const noexcept
+       {
+           return _mm_xor_si128(target, _mm_set1_epi32(-1));
+       }
+#endif
     };
 
 
@@ -66,6 +93,13 @@ namespace Ops {
         {
             return ((target ^ pattern) & source) ^ pattern;
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source, __m128i pattern) const noexcept
+        {
+            return _mm_xor_si128(_mm_and_si128(_mm_xor_si128(target, pattern), source), pattern);
+        }
+#endif
     };
 
 // 2.2.2.2.1.1.1.6 Binary Raster Operation (ROP2_OPERATION)
@@ -82,6 +116,13 @@ namespace Ops {
        {
            return 0x00;
        }
+
+#ifdef __SSE2__
+       __m128i operator()(__m128i /*target*/, __m128i /*source*/) const noexcept
+       {
+           return _mm_setzero_si128();
+       }
+#endif
     };
 
     struct Op2_0x02 // R2_NOTMERGEPEN DPon
@@ -90,6 +131,13 @@ namespace Ops {
         {
             return ~(target | source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_xor_si128(_mm_or_si128(target, source), _mm_set1_epi32(-1));
+        }
+#endif
     };
 
     struct Op2_0x03 // R2_MASKNOTPEN DPna
@@ -98,6 +146,13 @@ namespace Ops {
         {
             return (target & ~source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_andnot_si128(source, target);
+        }
+#endif
     };
 
     typedef InvertSrc Op2_0x04; // R2_NOTCOPYPEN Pn
@@ -108,6 +163,13 @@ namespace Ops {
         {
             return (source & ~target);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_andnot_si128(target, source);
+        }
+#endif
     };
 
     typedef InvertTarget Op2_0x06; // R2_NOT Dn
@@ -118,6 +180,13 @@ namespace Ops {
         {
             return (target ^ source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_xor_si128(target, source);
+        }
+#endif
     };
 
     struct Op2_0x08 // R2_NOTMASKPEN DPan
@@ -126,6 +195,13 @@ namespace Ops {
         {
             return ~(target & source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_xor_si128(_mm_and_si128(target, source), _mm_set1_epi32(-1));
+        }
+#endif
     };
 
     struct Op2_0x09 // R2_MASKPEN DPa
@@ -134,6 +210,13 @@ namespace Ops {
         {
             return (target & source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_and_si128(target, source);
+        }
+#endif
     };
 
     struct Op2_0x0A // R2_NOTXORPEN DPxn
@@ -142,6 +225,13 @@ namespace Ops {
         {
             return ~(target ^ source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_xor_si128(_mm_xor_si128(target, source), _mm_set1_epi32(-1));
+        }
+#endif
     };
 
     // struct Op2_0x0B // R2_NOP D
@@ -158,6 +248,13 @@ namespace Ops {
         {
             return (target | ~source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_or_si128(target, _mm_xor_si128(source, _mm_set1_epi32(-1)));
+        }
+#endif
     };
 
     typedef CopySrc Op2_0x0D; // R2_COPYPEN P
@@ -168,6 +265,13 @@ namespace Ops {
         {
             return (source | ~target);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_or_si128(source, _mm_xor_si128(target, _mm_set1_epi32(-1)));
+        }
+#endif
     };
 
     struct Op2_0x0F // R2_MERGEPEN PDo
@@ -176,6 +280,13 @@ namespace Ops {
         {
             return (target | source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_or_si128(target, source);
+        }
+#endif
     };
 
     struct Op2_0x10 // R2_WHITE 1
@@ -184,6 +295,13 @@ namespace Ops {
        {
            return 0xFF;
        }
+
+#ifdef __SSE2__
+       __m128i operator()(__m128i /*target*/, __m128i /*source*/) const noexcept
+       {
+           return _mm_set1_epi32(-1);
+       }
+#endif
     };
 
 
@@ -205,6 +323,13 @@ namespace Ops {
         {
             return ~(target | ~source);
         }
+
+#ifdef __SSE2__
+        __m128i operator()(__m128i target, __m128i source) const noexcept
+        {
+            return _mm_andnot_si128(target, source);
+        }
+#endif
     };
 
     typedef Op2_0x03 Op_0x22;
@@ -228,6 +353,7 @@ struct DrawableTraitColor24
 {
     // 24 bpp
     static const size_t Bpp = 3;
+    static const size_t row_alignment = 1;
 
     class color_t {
         uint8_t r;
@@ -280,6 +406,34 @@ struct DrawableTraitColor24
         return dest;
     }
 
+    static uint8_t * fill(uint8_t * dest, size_t n, color_t color)
+    {
+        for (uint8_t * e = dest + n * Bpp; dest != e; ) {
+            dest = assign(dest, color);
+        }
+        return dest;
+    }
+
+    template<class BinaryOp>
+    static uint8_t * fill(uint8_t * dest, size_t n, color_t color, BinaryOp op)
+    {
+        for (uint8_t * e = dest + n * Bpp; dest != e; ) {
+            dest = assign(dest, color, op);
+        }
+        return dest;
+    }
+
+    // n pixels of src (src_Bpp bytes per pixel) converted with to_color
+    template<class ToColor, class BinaryOp, class... Col>
+    static uint8_t * convert(uint8_t * dest, const uint8_t * src, size_t n, size_t src_Bpp,
+                             ToColor to_color, BinaryOp op, Col... c)
+    {
+        for (uint8_t * e = dest + n * Bpp; dest != e; src += src_Bpp) {
+            dest = assign(dest, to_color(src), c..., op);
+        }
+        return dest;
+    }
+
     static constexpr color_t u32_to_color(uint32_t color) noexcept
     {
         return {uint8_t(color), uint8_t(color >> 8), uint8_t(color >> 16)};
@@ -347,6 +501,168 @@ struct DrawableTraitColor24
     };
 };
 
+// 32 bpp: the components of DrawableTraitColor24 followed by an unused byte, the rows are
+// aligned on a cache line. A pixel is an uint32_t, so that fills, copies and raster
+// operations run on 4 pixels at once with SSE2.
+struct DrawableTraitColor32
+: DrawableTraitColor24
+{
+    static const size_t Bpp = 4;
+    static const size_t row_alignment = 64;
+
+    static constexpr uint32_t to_pixel(color_t color) noexcept
+    {
+        return color.red() | (color.green() << 8) | (color.blue() << 16);
+    }
+
+    static uint8_t * assign(uint8_t * dest, color_t color)
+    {
+        *dest++ = color.red();
+        *dest++ = color.green();
+        *dest++ = color.blue();
+        *dest++ = 0;
+        return dest;
+    }
+
+    template<class BinaryOp>
+    static uint8_t * assign(uint8_t * dest, color_t color, BinaryOp op)
+    {
+        return DrawableTraitColor24::assign(dest, color, op) + 1;
+    }
+
+    template<class BinaryOp>
+    static uint8_t * assign(uint8_t * dest, color_t color, color_t color2, BinaryOp op)
+    {
+        return DrawableTraitColor24::assign(dest, color, color2, op) + 1;
+    }
+
+    static uint8_t * fill(uint8_t * dest, size_t n, color_t color)
+    {
+#ifdef __SSE2__
+        const __m128i pixels = _mm_set1_epi32(to_pixel(color));
+        for (; n >= 4; n -= 4, dest += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), pixels);
+        }
+#endif
+        for (; n; --n) {
+            dest = assign(dest, color);
+        }
+        return dest;
+    }
+
+    template<class BinaryOp>
+    static uint8_t * fill(uint8_t * dest, size_t n, color_t color, BinaryOp op)
+    {
+#ifdef __SSE2__
+        const __m128i pixels = _mm_set1_epi32(to_pixel(color));
+        for (; n >= 4; n -= 4, dest += 16) {
+            __m128i * p = reinterpret_cast<__m128i *>(dest);
+            _mm_storeu_si128(p, op(_mm_loadu_si128(p), pixels));
+        }
+#endif
+        for (; n; --n) {
+            dest = assign(dest, color, op);
+        }
+        return dest;
+    }
+
+    template<class ToColor, class BinaryOp, class... Col>
+    static uint8_t * convert(uint8_t * dest, const uint8_t * src, size_t n, size_t src_Bpp,
+                             ToColor to_color, BinaryOp op, Col... c)
+    {
+        for (uint8_t * e = dest + n * Bpp; dest != e; src += src_Bpp) {
+            dest = assign(dest, to_color(src), c..., op);
+        }
+        return dest;
+    }
+
+    static uint8_t * convert(uint8_t * dest, const uint8_t * src, size_t n, size_t /*src_Bpp*/,
+                             toColor24, Ops::CopySrc)
+    {
+#ifdef __SSE2__
+        // 4 pixels of 3 bytes moved to the 4 lanes with byte shifts, 16 bytes are read
+        for (; n >= 6; n -= 4, dest += 16, src += 12) {
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            const __m128i pixels = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(c, _mm_setr_epi32(0xffffff, 0, 0, 0)),
+                             _mm_and_si128(_mm_slli_si128(c, 1), _mm_setr_epi32(0, 0xffffff, 0, 0))),
+                _mm_or_si128(_mm_and_si128(_mm_slli_si128(c, 2), _mm_setr_epi32(0, 0, 0xffffff, 0)),
+                             _mm_and_si128(_mm_slli_si128(c, 3), _mm_setr_epi32(0, 0, 0, 0xffffff))));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), pixels);
+        }
+#endif
+        for (uint8_t * e = dest + n * Bpp; dest != e; dest += Bpp, src += 3) {
+            const uint32_t pixel = src[0] | (src[1] << 8) | (src[2] << 16);
+            memcpy(dest, &pixel, sizeof(pixel));
+        }
+        return dest;
+    }
+
+    static uint8_t * convert(uint8_t * dest, const uint8_t * src, size_t n, size_t src_Bpp,
+                             toColor16 to_color, Ops::CopySrc op)
+    {
+#ifdef __SSE2__
+        // same computation as toColor16 on 8 pixels
+        for (; n >= 8; n -= 8, dest += 32, src += 16) {
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            const __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(c, 8), _mm_set1_epi16(0xf8)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 13), _mm_set1_epi16(0x7)));
+            const __m128i g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(c, 3), _mm_set1_epi16(0xfc)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 9), _mm_set1_epi16(0x3)));
+            const __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(c, 3), _mm_set1_epi16(0xf8)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 2), _mm_set1_epi16(0x7)));
+            store_8_pixels(dest, b, g, r);
+        }
+#endif
+        return convert<toColor16, Ops::CopySrc>(dest, src, n, src_Bpp, to_color, op);
+    }
+
+    static uint8_t * convert(uint8_t * dest, const uint8_t * src, size_t n, size_t src_Bpp,
+                             toColor15 to_color, Ops::CopySrc op)
+    {
+#ifdef __SSE2__
+        // same computation as toColor15 on 8 pixels
+        for (; n >= 8; n -= 8, dest += 32, src += 16) {
+            const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            const __m128i r = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(c, 7), _mm_set1_epi16(0xf8)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 12), _mm_set1_epi16(0x7)));
+            const __m128i g = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(c, 2), _mm_set1_epi16(0xf8)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 7), _mm_set1_epi16(0x7)));
+            const __m128i b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(c, 3), _mm_set1_epi16(0xf8)),
+                                           _mm_and_si128(_mm_srli_epi16(c, 2), _mm_set1_epi16(0x7)));
+            store_8_pixels(dest, b, g, r);
+        }
+#endif
+        return convert<toColor15, Ops::CopySrc>(dest, src, n, src_Bpp, to_color, op);
+    }
+
+    // 24 bpp rows of the png and wrm images
+    static void to_color24_row(uint8_t * dest, const uint8_t * src, size_t n)
+    {
+        for (const uint8_t * e = src + n * Bpp; src != e; src += Bpp, dest += 3) {
+            dest[0] = src[0];
+            dest[1] = src[1];
+            dest[2] = src[2];
+        }
+    }
+
+    static void from_color24_row(uint8_t * dest, const uint8_t * src, size_t n)
+    {
+        convert(dest, src, n, 3, toColor24{}, Ops::CopySrc{});
+    }
+
+private:
+#ifdef __SSE2__
+    // 16 bits lanes of the components, toColor15 and toColor16 put blue in the first byte
+    static void store_8_pixels(uint8_t * dest, __m128i b, __m128i g, __m128i r)
+    {
+        const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), _mm_unpacklo_epi16(bg, r));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 16), _mm_unpackhi_epi16(bg, r));
+    }
+#endif
+};
+
 template<DepthColor BppIn>
 struct DrawableTrait;
 
@@ -355,6 +671,11 @@ struct DrawableTrait<DepthColor::color24>
 : DrawableTraitColor24
 {};
 
+template<>
+struct DrawableTrait<DepthColor::color32>
+: DrawableTraitColor32
+{};
+
 
 template<DepthColor BppIn>
 class DrawableImpl
@@ -362,7 +683,6 @@ class DrawableImpl
     static_assert(BppIn != DepthColor::color8, "8 bit isn't supported");
     static_assert(BppIn != DepthColor::color15, "15 bit isn't supported");
     static_assert(BppIn != DepthColor::color16, "16 bit isn't supported");
-    static_assert(BppIn != DepthColor::color32, "32 bit isn't supported");
 
     using u8 = uint8_t;
     using u16 = uint16_t;
@@ -384,16 +704,17 @@ public:
     DrawableImpl(unsigned width, unsigned height)
     : width_(width)
     , height_(height)
-    , rowsize_(width * Bpp)
+    , rowsize_((width * Bpp + traits::row_alignment - 1) / traits::row_alignment * traits::row_alignment)
     , data_([this]{
         if (!(this->rowsize_ * this->height_)) {
             throw Error(ERR_RECORDER_EMPTY_IMAGE);
         }
-        uint8_t * data = new (std::nothrow) uint8_t[this->rowsize_ * this->height_] {};
-        if (nullptr == data) {
+        void * data = nullptr;
+        if (posix_memalign(&data, 64, this->rowsize_ * this->height_)) {
             throw Error(ERR_RECORDER_FRAME_ALLOCATION_FAILED);
         }
-        return data;
+        memset(data, 0, this->rowsize_ * this->height_);
+        return static_cast<uint8_t *>(data);
     }())
     {}
 
@@ -402,7 +723,7 @@ public:
 
     ~DrawableImpl()
     {
-        delete[] this->data_;
+        free(this->data_);
     }
 
     const uint8_t * data() const noexcept {
@@ -410,7 +731,7 @@ public:
     }
 
     const uint8_t * data(int x, int y) const noexcept {
-        return this->data_ + (y * this->width_ + x) * Bpp;
+        return this->first_pixel(x, y);
     }
 
     uint16_t width() const noexcept {
@@ -446,7 +767,7 @@ public:
     }
 
     uint8_t * first_pixel(int x, int y) const noexcept {
-        return this->data_ + (y * this->width_ + x) * Bpp;
+        return this->data_ + y * ptrdiff_t(this->rowsize_) + x * ptrdiff_t(Bpp);
     }
 
     uint8_t * first_pixel(const Rect & rect) const noexcept {
@@ -461,18 +782,11 @@ public:
         return this->first_pixel() + y * this->rowsize();
     }
 
-private:
-    template<class>
-    struct AssignOp;
-    struct Assign;
-    struct Invert;
-
-public:
     void opaque_rect(const Rect & rect, const color_t color)
     {
         P const base = this->first_pixel(rect);
 
-        apply_for_line(base, rect.cx, Assign{color});
+        traits::fill(base, rect.cx, color);
 
         P target = base;
         const size_t line_size = this->rowsize();
@@ -524,17 +838,9 @@ private:
         P dest, cP src, u16 cx, u16 cy, size_t bmp_Bpp, size_t bmp_line_size, Op op, ToColor to_color, Col... c)
     {
         const size_t line_size = this->rowsize();
-        const size_t destn = cx * Bpp;
-        const size_t srcn = cx * bmp_Bpp;
-        const size_t inc_line = line_size - destn;
-        const size_t inc_bmp_line = bmp_line_size + srcn;
-
-        for (cP ep = dest + line_size * cy; dest < ep; dest += inc_line, src -= inc_bmp_line) {
-            const cP dest_e = dest + destn;
-            while (dest != dest_e) {
-                dest = traits::assign(dest, to_color(src), c..., op);
-                src += bmp_Bpp;
-            }
+
+        for (cP ep = dest + line_size * cy; dest < ep; dest += line_size, src -= bmp_line_size) {
+            traits::convert(dest, src, cx, bmp_Bpp, to_color, op, c...);
         }
     }
 
@@ -672,7 +978,7 @@ private:
             l = this->width() - x;
         }
         P p = this->first_pixel(x, y);
-        this->apply_for_line(p, l, AssignOp<Op2>{color});
+        traits::fill(p, l, color, Op2());
     }
 
 public:
@@ -848,57 +1154,46 @@ public:
     }
 
     template<class Op>
-    void horizontal_line(uint16_t startx, uint16_t y, uint16_t endx, color_t color, Op)
+    void horizontal_line(uint16_t startx, uint16_t y, uint16_t endx, color_t color, Op op)
     {
-        this->apply_for_line(this->first_pixel(startx, y), endx - startx + 1, AssignOp<Op>{color});
+        traits::fill(this->first_pixel(startx, y), endx - startx + 1, color, op);
     }
 
     template <typename Op>
-    void patblt_op(const Rect & rect, color_t color, Op)
+    void patblt_op(const Rect & rect, color_t color, Op op)
     {
-        this->apply_for_rect(rect, AssignOp<Op>{color});
+        this->fill_rect(rect, color, op);
     }
 
     void patblt_op(const Rect & rect, color_t color, Ops::InvertSrc)
     {
-        this->apply_for_rect(rect, Assign{~color});
+        this->fill_rect(rect, ~color);
     }
 
     void patblt_op(const Rect & rect, color_t color, Ops::CopySrc)
     {
-        this->apply_for_rect(rect, Assign{color});
+        this->fill_rect(rect, color);
     }
 
     void invert_color(const Rect & rect)
     {
-        this->apply_for_rect(rect, Invert{});
+        this->fill_rect(rect, color_t(0, 0, 0), Ops::InvertTarget());
     }
 
 private:
-    struct Assign {
-        color_t color;
-
-        P operator()(P dest) const
-        { return traits::assign(dest, color); }
-    };
-
-    template<class Op>
-    struct AssignOp {
-        color_t color;
-
-        P operator()(P dest) const
-        { return traits::assign(dest, color, Op()); }
-    };
-
-    struct Invert {
-        P operator()(P dest) const
-        { *dest ^= 0xff; return ++dest; }
-    };
-
     template<class Op>
     void copy(uint8_t * dest, const uint8_t * src, size_t n, Op op)
     {
         const uint8_t * e = dest + n;
+#ifdef __SSE2__
+        // a block reads source bytes that the bytewise loop would have already overwritten
+        if (dest <= src || dest >= src + 16) {
+            for (; dest + 16 <= e; dest += 16, src += 16) {
+                __m128i * p = reinterpret_cast<__m128i *>(dest);
+                _mm_storeu_si128(p, op(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src))));
+            }
+        }
+#endif
         for (; dest != e; ++dest, ++src) {
             *dest = op(*dest, *src);
         }
@@ -913,33 +1208,20 @@ private:
     void copy(uint8_t * dest, const uint8_t * src, size_t n, Op op, color_t c)
     {
         const uint8_t * e = dest + n;
-        while (dest != e) {
-            *dest = op(*dest, *src, c.red());   ++dest; ++src;
-            *dest = op(*dest, *src, c.green()); ++dest; ++src;
-            *dest = op(*dest, *src, c.blue());  ++dest; ++src;
-        }
-    }
-
-    template<class F>
-    P apply_for_line(P p, size_t n, F f)
-    {
-        for (cP pe = p + n * Bpp; p != pe; ) {
-            p = f(p);
+        for (; dest != e; dest += Bpp, src += Bpp) {
+            dest[0] = op(dest[0], src[0], c.red());
+            dest[1] = op(dest[1], src[1], c.green());
+            dest[2] = op(dest[2], src[2], c.blue());
         }
-        return p;
     }
 
-    template<class F>
-    void apply_for_rect(const Rect & rect, F f)
+    template<class... Op>
+    void fill_rect(const Rect & rect, color_t color, Op... op)
     {
         P p = this->first_pixel(rect);
         const size_t line_size = this->rowsize();
-        const size_t cx = rect.cx * Bpp;
-        const size_t inc_line = static_cast<size_t>(line_size - cx);
-        for (cP pe = p + rect.cy * line_size; p != pe; p += inc_line) {
-            for (cP pe2 = p + cx; p != pe2; ) {
-                p = f(p);
-            }
+        for (cP pe = p + rect.cy * line_size; p != pe; p += line_size) {
+            traits::fill(p, rect.cx, color, op...);
         }
     }
 };
@@ -1026,12 +1308,16 @@ struct DrawablePointer {
     }
 };  // struct DrawablePointer
 
+// The pixels are stored in 24 bpp (default) or in 32 bpp with aligned rows, which makes
+// the drawing faster. The rows given to set_row(), the pointer, the timestamp and the
+// png images are always 24 bpp.
 class Drawable
-: DrawableImpl<DepthColor::color24>
 {
-    using DrawableImplPrivate = DrawableImpl<DepthColor::color24>;
-    DrawableImplPrivate & impl() noexcept { return *this; }
-    const DrawableImplPrivate & impl() const noexcept { return *this; }
+    using DrawableImpl24 = DrawableImpl<DepthColor::color24>;
+    using DrawableImpl32 = DrawableImpl<DepthColor::color32>;
+
+    std::unique_ptr<DrawableImpl24> impl24;
+    std::unique_ptr<DrawableImpl32> impl32;
 
     enum {
         char_width  = 7,
@@ -1048,12 +1334,12 @@ class Drawable
         size_str_timestamp = ts_max_length + 1
     };
 
-    uint8_t timestamp_save[ts_width * ts_height * Bpp];
-    uint8_t timestamp_data[ts_width * ts_height * Bpp];
+    uint8_t timestamp_save[ts_width * ts_height * DrawableImpl32::Bpp];
+    uint8_t timestamp_data[ts_width * ts_height * 3];
     char previous_timestamp[size_str_timestamp];
     uint8_t previous_timestamp_length;
 
-    uint8_t  save_mouse[3072];   // 32 lines * 32 columns * 3 bytes per pixel = 3072 octets
+    uint8_t  save_mouse[4096];   // 32 lines * 32 columns * 4 bytes per pixel = 4096 octets
     uint16_t save_mouse_x;
     uint16_t save_mouse_y;
 
@@ -1061,6 +1347,11 @@ public:
     Rect tracked_area;
     bool tracked_area_changed;
 
+    // Bounding box of the pixels changed by the drawing primitives (mouse cursor moves
+    // and pointer changes included) since the last reset_dirty_area(). Timestamp and
+    // mouse cursor traced for a snapshot are not accounted.
+    Rect dirty_area;
+
     bool logical_frame_ended;
 
 private:
@@ -1078,16 +1369,15 @@ private:
 public:
     DrawablePointer default_pointer;
 
-    using Color = DrawableImplPrivate::color_t;
-
-    static const std::size_t Bpp = DrawableImplPrivate::Bpp;
-
+    using Color = DrawableTraitColor24::color_t;
 
-    Drawable(int width, int height)
-    : DrawableImplPrivate(width, height)
+    Drawable(int width, int height, DepthColor depth = DepthColor::color24)
+    : impl24((depth == DepthColor::color32) ? nullptr : new DrawableImpl24(width, height))
+    , impl32((depth == DepthColor::color32) ? new DrawableImpl32(width, height) : nullptr)
     , previous_timestamp_length(0)
     , tracked_area(0, 0, 0, 0)
     , tracked_area_changed(false)
+    , dirty_area(0, 0, width, height)
     , logical_frame_ended(true)
     , mouse_cursor_pos_x(width / 2)
     , mouse_cursor_pos_y(height / 2)
@@ -1100,55 +1390,90 @@ public:
     }
 
     const uint8_t * data() const noexcept {
-        return this->impl().data();
+        return this->first_pixel();
     }
 
     Color u32_to_color(uint32_t color) const {
-        return DrawableImplPrivate::traits::u32_to_color(color);
+        return DrawableTraitColor24::u32_to_color(color);
     }
 
     Color u32bgr_to_color(uint32_t color) const {
-        return DrawableImplPrivate::traits::u32bgr_to_color(color);
+        return DrawableTraitColor24::u32bgr_to_color(color);
     }
 
     const uint8_t * data(int x, int y) const noexcept {
-        return this->impl().data(x, y);
+        return this->impl32 ? this->impl32->data(x, y) : this->impl24->data(x, y);
     }
 
     uint16_t width() const noexcept {
-        return this->impl().width();
+        return this->impl32 ? this->impl32->width() : this->impl24->width();
     }
 
     uint16_t height() const noexcept {
-        return this->impl().height();
+        return this->impl32 ? this->impl32->height() : this->impl24->height();
     }
 
     unsigned size() const noexcept {
-        return this->impl().size();
+        return this->impl32 ? this->impl32->size() : this->impl24->size();
     }
 
     size_t rowsize() const noexcept {
-        return this->impl().rowsize();
+        return this->impl32 ? this->impl32->rowsize() : this->impl24->rowsize();
     }
 
     size_t pix_len() const noexcept {
-        return this->impl().pix_len();
+        return this->impl32 ? this->impl32->pix_len() : this->impl24->pix_len();
     }
 
-    static constexpr uint8_t nbbytes_color() noexcept {
-        return DrawableImplPrivate::nbbytes_color();
+    uint8_t nbbytes_color() const noexcept {
+        return this->impl32 ? DrawableImpl32::nbbytes_color() : DrawableImpl24::nbbytes_color();
     }
 
-    static constexpr uint8_t bpp() noexcept {
-        return DrawableImplPrivate::bpp();
+    uint8_t bpp() const noexcept {
+        return this->impl32 ? DrawableImpl32::bpp() : DrawableImpl24::bpp();
+    }
+
+    // row of width() 24 bpp pixels
+    void get_row24(size_t rownum, uint8_t * dest) const {
+        if (this->impl32) {
+            DrawableImpl32::traits::to_color24_row(dest, this->impl32->row_data(rownum), this->width());
+        }
+        else {
+            memcpy(dest, this->impl24->row_data(rownum), this->rowsize());
+        }
     }
 
     void set_mouse_cursor_pos(int x, int y) {
-        this->mouse_cursor_pos_x = x;
-        this->mouse_cursor_pos_y = y;
+        if (x != this->mouse_cursor_pos_x || y != this->mouse_cursor_pos_y) {
+            this->update_changed_pointer_area();
+            this->mouse_cursor_pos_x = x;
+            this->mouse_cursor_pos_y = y;
+            this->update_changed_pointer_area();
+        }
+    }
+
+    void reset_dirty_area() {
+        this->dirty_area = Rect();
     }
 
 private:
+    void update_changed_area(const Rect & rect) {
+        if (this->tracked_area.has_intersection(rect)) {
+            this->tracked_area_changed = true;
+        }
+        this->dirty_area = this->dirty_area.enlarge_to(rect.intersect(this->width(), this->height()));
+    }
+
+    void update_changed_pointer_area() {
+        if (!this->dont_show_mouse_cursor && this->current_pointer) {
+            this->dirty_area = this->dirty_area.enlarge_to(Rect(
+                this->mouse_cursor_pos_x - this->current_pointer->hotspot_x,
+                this->mouse_cursor_pos_y - this->current_pointer->hotspot_y,
+                32, 32
+            ).intersect(this->width(), this->height()));
+        }
+    }
+
     int _posch_12x7(char ch) const {
         return char_width * char_height *
         (isdigit(ch)  ? ch-'0'
@@ -1691,15 +2016,15 @@ private:
                 const char * poldch = digits + _posch_12x7(oldch);
 
                 unsigned br_pix = 0;
-                unsigned br_pixindex = i * (char_width * Bpp);
+                unsigned br_pixindex = i * (char_width * 3);
 
-                for (size_t y = 0 ; y < char_height ; ++y, br_pix += char_width, br_pixindex += width*Bpp) {
+                for (size_t y = 0 ; y < char_height ; ++y, br_pix += char_width, br_pixindex += width*3) {
                     for (size_t x = 0 ; x <  char_width ; ++x) {
                         unsigned pix = br_pix + x;
                         if (pnewch[pix] != poldch[pix]) {
                             uint8_t pixcolorcomponent = (pnewch[pix] == 'X') ? 0xFF : 0;
-                            unsigned pixindex = br_pixindex + x*Bpp;
-                            memset(&rgbpixbuf[pixindex], pixcolorcomponent, Bpp);
+                            unsigned pixindex = br_pixindex + x*3;
+                            memset(&rgbpixbuf[pixindex], pixcolorcomponent, 3);
                         }
                     }
                 }
@@ -1711,7 +2036,7 @@ public:
     /*
      * The name doesn't say it : mem_blt COPIES a decoded bitmap from
      * a cache (data) and insert a subpart (srcx, srcy) to the local
-     * image cache (this->impl().first_pixel()) a the given position (rect).
+     * image cache (this->first_pixel()) a the given position (rect).
      */
     void mem_blt(const Rect & rect, const Bitmap & bmp, const uint16_t srcx, const uint16_t srcy) {
         this->mem_blt_op<Ops::CopySrc>(rect, bmp, srcx, srcy);
@@ -1740,11 +2065,14 @@ private:
         }
         const Rect trect(rect.x, rect.y, mincx, mincy);
 
-        if (this->tracked_area.has_intersection(trect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(trect);
 
-        this->impl().mem_blt(trect, bmp, srcx, srcy, Op(), c...);
+        if (this->impl32) {
+            this->impl32->mem_blt(trect, bmp, srcx, srcy, Op(), c...);
+        }
+        else {
+            this->impl24->mem_blt(trect, bmp, srcx, srcy, Op(), c...);
+        }
     }
 
 public:
@@ -1825,22 +2153,28 @@ public:
     {
         const Rect trect = rect.intersect(this->width(), this->height());
 
-        if (this->tracked_area.has_intersection(trect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(trect);
 
-        this->impl().component_rect(trect, 0);
+        if (this->impl32) {
+            this->impl32->component_rect(trect, 0);
+        }
+        else {
+            this->impl24->component_rect(trect, 0);
+        }
     }
 
     void white_color(const Rect & rect)
     {
         const Rect trect = rect.intersect(this->width(), this->height());
 
-        if (this->tracked_area.has_intersection(rect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(rect);
 
-        this->impl().component_rect(trect, 0xFF);
+        if (this->impl32) {
+            this->impl32->component_rect(trect, 0xFF);
+        }
+        else {
+            this->impl24->component_rect(trect, 0xFF);
+        }
     }
 
 private:
@@ -1848,11 +2182,14 @@ private:
     {
         const Rect trect = rect.intersect(this->width(), this->height());
 
-        if (this->tracked_area.has_intersection(trect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(trect);
 
-        this->impl().invert_color(trect);
+        if (this->impl32) {
+            this->impl32->invert_color(trect);
+        }
+        else {
+            this->impl24->invert_color(trect);
+        }
     }
 
 // 2.2.2.2.1.1.1.6 Binary Raster Operation (ROP2_OPERATION)
@@ -1865,90 +2202,109 @@ private:
 
 public:
     void ellipse(const Ellipse & el, const uint8_t rop, const uint8_t fill, const Color color) {
-        if (this->tracked_area.has_intersection(el.get_rect())) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(el.get_rect());
         switch (rop) {
         case 0x01: // R2_BLACK
-            this->impl().draw_ellipse<Ops::Op2_0x01>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x01>(el, fill, color);
             break;
         case 0x02: // R2_NOTMERGEPEN
-            this->impl().draw_ellipse<Ops::Op2_0x02>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x02>(el, fill, color);
             break;
         case 0x03: // R2_MASKNOTPEN
-            this->impl().draw_ellipse<Ops::Op2_0x03>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x03>(el, fill, color);
             break;
         case 0x04: // R2_NOTCOPYPEN
-            this->impl().draw_ellipse<Ops::Op2_0x04>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x04>(el, fill, color);
             break;
         case 0x05: // R2_MASKPENNOT
-            this->impl().draw_ellipse<Ops::Op2_0x05>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x05>(el, fill, color);
             break;
         case 0x06:  // R2_NOT
-            this->impl().draw_ellipse<Ops::Op2_0x06>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x06>(el, fill, color);
             break;
         case 0x07:  // R2_XORPEN
-            this->impl().draw_ellipse<Ops::Op2_0x07>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x07>(el, fill, color);
             break;
         case 0x08:  // R2_NOTMASKPEN
-            this->impl().draw_ellipse<Ops::Op2_0x08>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x08>(el, fill, color);
             break;
         case 0x09:  // R2_MASKPEN
-            this->impl().draw_ellipse<Ops::Op2_0x09>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x09>(el, fill, color);
             break;
         case 0x0A:  // R2_NOTXORPEN
-            this->impl().draw_ellipse<Ops::Op2_0x0A>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0A>(el, fill, color);
             break;
         case 0x0B:  // R2_NOP
             break;
         case 0x0C:  // R2_MERGENOTPEN
-            this->impl().draw_ellipse<Ops::Op2_0x0C>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0C>(el, fill, color);
             break;
         case 0x0D:  // R2_COPYPEN
-            this->impl().draw_ellipse<Ops::Op2_0x0D>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0D>(el, fill, color);
             break;
         case 0x0E:  // R2_MERGEPENNOT
-            this->impl().draw_ellipse<Ops::Op2_0x0E>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0E>(el, fill, color);
             break;
         case 0x0F:  // R2_MERGEPEN
-            this->impl().draw_ellipse<Ops::Op2_0x0F>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0F>(el, fill, color);
             break;
         case 0x10: // R2_WHITE
-            this->impl().draw_ellipse<Ops::Op2_0x10>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x10>(el, fill, color);
             break;
         default:
-            this->impl().draw_ellipse<Ops::Op2_0x0D>(el, fill, color);
+            this->draw_ellipse<Ops::Op2_0x0D>(el, fill, color);
             break;
         }
     }
 
+private:
+    template<typename Op2>
+    void draw_ellipse(const Ellipse & el, const uint8_t fill, const Color color) {
+        if (this->impl32) {
+            this->impl32->draw_ellipse<Op2>(el, fill, color);
+        }
+        else {
+            this->impl24->draw_ellipse<Op2>(el, fill, color);
+        }
+    }
+
+public:
     // low level opaquerect,
     // mostly avoid clipping because we already took care of it
     // also we already swapped color if we are using BGR instead of RGB
     void opaquerect(const Rect & rect, const Color color)
     {
-        if (this->tracked_area.has_intersection(rect)) {
-            this->tracked_area_changed = true;
+        this->update_changed_area(rect);
+        if (this->impl32) {
+            this->impl32->opaque_rect(rect, color);
+        }
+        else {
+            this->impl24->opaque_rect(rect, color);
         }
-        this->impl().opaque_rect(rect, color);
     }
 
     void draw_pixel(int16_t x, int16_t y, const Color color)
     {
-        if (this->tracked_area.has_intersection(x, y)) {
-            this->tracked_area_changed = true;
+        this->update_changed_area(Rect(x, y, 1, 1));
+        if (this->impl32) {
+            this->impl32->draw_pixel(x, y, color);
+        }
+        else {
+            this->impl24->draw_pixel(x, y, color);
         }
-        this->impl().draw_pixel(x, y, color);
     }
 
 private:
     template <typename Op>
     void patblt_op(const Rect & rect, const Color color)
     {
-        if (this->tracked_area.has_intersection(rect)) {
-            this->tracked_area_changed = true;
+        this->update_changed_area(rect);
+        if (this->impl32) {
+            this->impl32->patblt_op(rect, color, Op());
+        }
+        else {
+            this->impl24->patblt_op(rect, color, Op());
         }
-        this->impl().patblt_op(rect, color, Op());
     }
 
 public:
@@ -2072,11 +2428,14 @@ private:
     void patblt_op_ex(const Rect & rect, const uint8_t * brush_data, int8_t org_x, int8_t org_y,
         const Color back_color, const Color fore_color)
     {
-        if (this->tracked_area.has_intersection(rect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(rect);
 
-        this->impl().patblt_op_ex<Op>(rect, brush_data, org_x, org_y, back_color, fore_color);
+        if (this->impl32) {
+            this->impl32->patblt_op_ex<Op>(rect, brush_data, org_x, org_y, back_color, fore_color);
+        }
+        else {
+            this->impl24->patblt_op_ex<Op>(rect, brush_data, org_x, org_y, back_color, fore_color);
+        }
     }
 
 public:
@@ -2133,11 +2492,14 @@ public:
     template <typename Op>
     void scr_blt_op(uint16_t srcx, uint16_t srcy, const Rect & drect)
     {
-        if (this->tracked_area.has_intersection(drect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(drect);
 
-        this->impl().scr_blt_op<Op>(drect, srcx, srcy);
+        if (this->impl32) {
+            this->impl32->scr_blt_op<Op>(drect, srcx, srcy);
+        }
+        else {
+            this->impl24->scr_blt_op<Op>(drect, srcx, srcy);
+        }
     }
 
 public:
@@ -2264,61 +2626,98 @@ public:
         }
     }
 
+private:
+    template<class Op>
+    void draw_line(int x, int y, int endx, int endy, Color color, Op op)
+    {
+        if (this->impl32) {
+            this->impl32->line(x, y, endx, endy, color, op);
+        }
+        else {
+            this->impl24->line(x, y, endx, endy, color, op);
+        }
+    }
+
+    template<class Op>
+    void draw_vertical_line(uint16_t x, uint16_t y, uint16_t endy, Color color, Op op)
+    {
+        if (this->impl32) {
+            this->impl32->vertical_line(x, y, endy, color, op);
+        }
+        else {
+            this->impl24->vertical_line(x, y, endy, color, op);
+        }
+    }
+
+    template<class Op>
+    void draw_horizontal_line(uint16_t x, uint16_t y, uint16_t endx, Color color, Op op)
+    {
+        if (this->impl32) {
+            this->impl32->horizontal_line(x, y, endx, color, op);
+        }
+        else {
+            this->impl24->horizontal_line(x, y, endx, color, op);
+        }
+    }
+
+public:
     // nor horizontal nor vertical, use Bresenham
     void line(int mix_mode, int x, int y, int endx, int endy, uint8_t rop, Color color)
     {
         const Rect line_rect = Rect(x, y, 1, 1).enlarge_to(endx, endy);
-        if (this->tracked_area.has_intersection(line_rect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(line_rect);
 
         if (rop == 0x06) {
-            this->impl().line(x, y, endx, endy, color, Ops::InvertTarget());
+            this->draw_line(x, y, endx, endy, color, Ops::InvertTarget());
         }
         else {
-            this->impl().line(x, y, endx, endy, color, Ops::CopySrc());
+            this->draw_line(x, y, endx, endy, color, Ops::CopySrc());
         }
     }
 
     void vertical_line(uint8_t mix_mode, uint16_t x, uint16_t y, uint16_t endy, uint8_t rop, Color color)
     {
         const Rect line_rect = Rect(x, y, 1, 1).enlarge_to(x+1, endy);
-        if (this->tracked_area.has_intersection(line_rect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(line_rect);
 
         if (rop == 0x06) {
-            this->impl().vertical_line(x, y, endy, color, Ops::InvertTarget());
+            this->draw_vertical_line(x, y, endy, color, Ops::InvertTarget());
         }
         else {
-            this->impl().vertical_line(x, y, endy, color, Ops::CopySrc());
+            this->draw_vertical_line(x, y, endy, color, Ops::CopySrc());
         }
     }
 
     void horizontal_line(uint8_t mix_mode, uint16_t x, uint16_t y, uint16_t endx, uint8_t rop, Color color)
     {
         const Rect line_rect = Rect(x, y, 1, 1).enlarge_to(endx, y+1);
-        if (this->tracked_area.has_intersection(line_rect)) {
-            this->tracked_area_changed = true;
-        }
+        this->update_changed_area(line_rect);
 
         if (rop == 0x06) {
-            this->impl().horizontal_line(x, y, endx, color, Ops::InvertTarget());
+            this->draw_horizontal_line(x, y, endx, color, Ops::InvertTarget());
         }
         else {
-            this->impl().horizontal_line(x, y, endx, color, Ops::CopySrc());
+            this->draw_horizontal_line(x, y, endx, color, Ops::CopySrc());
         }
     }
 
     void use_pointer(int hotspot_x, int hotspot_y, const uint8_t * pointer_data, const uint8_t * pointer_mask) {
+        this->update_changed_pointer_area();
         this->dynamic_pointer.initialize(hotspot_x, hotspot_y, pointer_data, pointer_mask);
 
         this->current_pointer = &this->dynamic_pointer;
+        this->update_changed_pointer_area();
     }
 
     void set_row(size_t rownum, const uint8_t * data)
     {
-        memcpy(this->impl().row_data(rownum), data, this->rowsize());
+        this->update_changed_area(Rect(0, rownum, this->width(), 1));
+        if (this->impl32) {
+            DrawableImpl32::traits::from_color24_row(this->impl32->row_data(rownum), data, this->width());
+        }
+        else {
+            memcpy(this->impl24->row_data(rownum), data, this->rowsize());
+        }
     }
 
     void trace_mouse() {
@@ -2331,10 +2730,11 @@ public:
 
         const int x = this->mouse_cursor_pos_x - this->current_pointer->hotspot_x;
         const int y = this->mouse_cursor_pos_y - this->current_pointer->hotspot_y;
+        const size_t Bpp = this->nbbytes_color();
         this->priv_trace_mouse(
-            [](uint8_t * psave, uint8_t * pixel_start, const uint8_t * data, size_t n) {
-                memcpy(psave, pixel_start, n);
-                memcpy(pixel_start, data, n);
+            [this, Bpp](uint8_t * psave, uint8_t * pixel_start, const uint8_t * data, size_t n) {
+                memcpy(psave, pixel_start, n * Bpp);
+                this->copy_color24_pixels(pixel_start, data, n);
             },
             x, y
         );
@@ -2347,42 +2747,70 @@ public:
 
         const int x = this->save_mouse_x - this->current_pointer->hotspot_x;
         const int y = this->save_mouse_y - this->current_pointer->hotspot_y;
+        const size_t Bpp = this->nbbytes_color();
         this->priv_trace_mouse(
-            [](uint8_t * psave, uint8_t * pixel_start, const uint8_t * /*data*/, size_t n) {
-                ::memcpy(pixel_start, psave, n);
+            [Bpp](uint8_t * psave, uint8_t * pixel_start, const uint8_t * /*data*/, size_t n) {
+                ::memcpy(pixel_start, psave, n * Bpp);
             },
             x, y
         );
     }
 
 private:
+    // the tracer gets a number of pixels, data is the 24 bpp pointer.
+    // The pointer is clipped on the pixels of the screen seen as one line, a line of the
+    // pointer out of the right border continues at the beginning of the next row.
     template<class Tracer>
     void priv_trace_mouse(Tracer tracer, int x, int y)
     {
         uint8_t * psave = this->save_mouse;
-        const uint8_t * data_end = this->impl().last_pixel();
+        const int pix_count = this->width() * this->height();
 
         for (DrawablePointer::ContiguousPixels const & contiguous_pixels : this->current_pointer->contiguous_pixels_view()) {
-            uint8_t  * pixel_start = this->impl().first_pixel(contiguous_pixels.x + x, contiguous_pixels.y + y);
-            unsigned   lg          = contiguous_pixels.data_size;
-            if (pixel_start + lg <= this->impl().first_pixel()) {
+            int pos = (contiguous_pixels.y + y) * this->width() + contiguous_pixels.x + x;
+            int lg = contiguous_pixels.data_size / 3;
+            if (pos + lg <= 0) {
                 continue;
             }
 
             int offset = 0;
-            if (pixel_start < this->impl().first_pixel()) {
-                offset = this->data() - pixel_start;
+            if (pos < 0) {
+                offset = -pos;
                 lg -= offset;
-                pixel_start = this->impl().first_pixel();
+                pos = 0;
             }
-            if (pixel_start >= data_end) {
+            if (pos >= pix_count) {
                 break;
             }
-            if (pixel_start + lg >= data_end) {
-                lg = data_end - pixel_start;
+            lg = std::min(lg, pix_count - pos);
+
+            // rows are not contiguous in 32 bpp
+            while (lg > 0) {
+                const int px = pos % this->width();
+                const int n = std::min(lg, this->width() - px);
+                tracer(psave, this->first_pixel(px, pos / this->width()), contiguous_pixels.data + offset * 3, n);
+                psave += n * this->nbbytes_color();
+                pos += n;
+                offset += n;
+                lg -= n;
             }
-            tracer(psave, pixel_start, contiguous_pixels.data + offset, lg);
-            psave += lg;
+        }
+    }
+
+    uint8_t * first_pixel() const noexcept {
+        return this->impl32 ? this->impl32->first_pixel() : this->impl24->first_pixel();
+    }
+
+    uint8_t * first_pixel(int x, int y) const noexcept {
+        return this->impl32 ? this->impl32->first_pixel(x, y) : this->impl24->first_pixel(x, y);
+    }
+
+    void copy_color24_pixels(uint8_t * dest, const uint8_t * src, size_t n) const {
+        if (this->impl32) {
+            DrawableImpl32::traits::from_color24_row(dest, src, n);
+        }
+        else {
+            memcpy(dest, src, n * 3);
         }
     }
 
@@ -2410,7 +2838,10 @@ public:
 private:
     size_t priv_offset_timestamp(uint8_t timestamp_len) const
     {
-        return this->rowsize() * (this->height() / 2) + ((this->width() - timestamp_len*char_width)*Bpp) / 2;
+        const int x = this->width() - timestamp_len*char_width;
+        // in 24 bpp, the offset of an odd x is not on a pixel boundary
+        return this->rowsize() * (this->height() / 2)
+             + (this->impl32 ? (x / 2) * DrawableImpl32::Bpp : (x * DrawableImpl24::Bpp) / 2);
     }
 
     void priv_trace_timestamp(tm & now, bool has_clear)
@@ -2428,22 +2859,34 @@ private:
         this->previous_timestamp_length = timestamp_length;
 
         uint8_t * tsave = this->timestamp_save;
-        uint8_t * buf = this->impl().first_pixel() + (has_clear ? this->priv_offset_timestamp(timestamp_length) : 0);
-        const size_t n = timestamp_length * char_width * Bpp;
-        const size_t cp_n = std::min<size_t>(n, this->width());
+        uint8_t * buf = this->first_pixel() + (has_clear ? this->priv_offset_timestamp(timestamp_length) : 0);
+        const size_t n = timestamp_length * char_width * this->nbbytes_color();
+        const size_t cp_n = this->priv_timestamp_copy_length(timestamp_length);
         const size_t ny = std::min<size_t>(ts_height, this->height());
         for (size_t y = 0; y < ny ; ++y, buf += this->rowsize(), tsave += n) {
             memcpy(tsave, buf, cp_n);
-            memcpy(buf, this->timestamp_data + y*ts_width*Bpp, cp_n);
+            if (this->impl32) {
+                this->copy_color24_pixels(buf, this->timestamp_data + y*ts_width*3, cp_n / DrawableImpl32::Bpp);
+            }
+            else {
+                memcpy(buf, this->timestamp_data + y*ts_width*3, cp_n);
+            }
         }
     }
 
+    // bytes of a line of the timestamp, limited to width() bytes of the 24 bpp timestamp
+    size_t priv_timestamp_copy_length(uint8_t timestamp_len) const
+    {
+        const size_t n = std::min<size_t>(timestamp_len * char_width * 3, this->width());
+        return this->impl32 ? n / 3 * DrawableImpl32::Bpp : n;
+    }
+
     void priv_clear_timestamp(size_t offset)
     {
         const uint8_t * tsave = this->timestamp_save;
-        uint8_t * buf = this->impl().first_pixel() + offset;
-        const size_t n = this->previous_timestamp_length * char_width * Bpp;
-        const size_t cp_n = std::min<size_t>(n, this->width());
+        uint8_t * buf = this->first_pixel() + offset;
+        const size_t n = this->previous_timestamp_length * char_width * this->nbbytes_color();
+        const size_t cp_n = this->priv_timestamp_copy_length(this->previous_timestamp_length);
         const size_t ny = std::min<size_t>(ts_height, this->height());
         for (size_t y = 0; y < ny; ++y, buf += this->rowsize(), tsave += n) {
             memcpy(buf, tsave, cp_n);
@@ -0,0 +1,135 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Readiness of a fixed set of descriptors through epoll.
+
+   Each descriptor has a slot chosen by the owner. A descriptor is
+   registered (EPOLLIN, level triggered) when it first appears in its slot
+   and stays registered while the slot keeps the same descriptor and
+   generation, so waiting does not rebuild anything. The kernel drops a
+   closed descriptor by itself: the owner changes the generation of the slot
+   when a new socket may have been given the number of a closed one.
+*/
+
+#ifndef _REDEMPTION_UTILS_EPOLL_REACTOR_HPP_
+#define _REDEMPTION_UTILS_EPOLL_REACTOR_HPP_
+
+#include <sys/epoll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "log.hpp"
+#include "error.hpp"
+#include "noncopyable.hpp"
+
+class EpollReactor : noncopyable
+{
+    struct Slot {
+        int      fd         = -1;
+        uint64_t generation = 0;
+        bool     ready      = false;
+    };
+
+    int                      epfd;
+    std::vector<Slot>        slots;
+    std::vector<epoll_event> events;
+
+public:
+    explicit EpollReactor(unsigned nb_slots)
+    : epfd(::epoll_create1(EPOLL_CLOEXEC))
+    , slots(nb_slots)
+    , events(nb_slots)
+    {
+        if (this->epfd < 0) {
+            LOG(LOG_ERR, "EpollReactor: epoll_create1 failed with error %d : %s", errno, strerror(errno));
+            throw Error(ERR_SOCKET_ERROR, errno);
+        }
+    }
+
+    ~EpollReactor()
+    {
+        ::close(this->epfd);
+    }
+
+    // Watches <fd> in <slot>, -1 stops watching.
+    void watch(unsigned slot, int fd, uint64_t generation = 0)
+    {
+        Slot & s = this->slots[slot];
+        if ((s.fd == fd) && (s.generation == generation)) {
+            return;
+        }
+
+        if ((s.fd > -1) && !this->is_watched_elsewhere(slot, s.fd)) {
+            // fails when the descriptor is already closed, it was dropped then
+            ::epoll_ctl(this->epfd, EPOLL_CTL_DEL, s.fd, nullptr);
+        }
+        s.fd         = fd;
+        s.generation = generation;
+        s.ready      = false;
+
+        if (fd > -1) {
+            epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events   = EPOLLIN;
+            event.data.u32 = slot;
+            if ((::epoll_ctl(this->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+             && ((errno != EEXIST) || (::epoll_ctl(this->epfd, EPOLL_CTL_MOD, fd, &event) < 0))) {
+                LOG(LOG_ERR, "EpollReactor: cannot watch %d, error %d : %s", fd, errno, strerror(errno));
+                throw Error(ERR_SOCKET_ERROR, errno);
+            }
+        }
+    }
+
+    int fd(unsigned slot) const
+    { return this->slots[slot].fd; }
+
+    // Waits at most <timeout_ms> (-1 without limit) for a watched descriptor,
+    //  returns the number of slots ready, or -1 (errno is set).
+    int wait(int timeout_ms)
+    {
+        for (Slot & s : this->slots) {
+            s.ready = false;
+        }
+        const int n = ::epoll_wait(this->epfd, this->events.data(), this->events.size(), timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            // errors and hang up are reported as ready, the next read fails
+            this->slots[this->events[i].data.u32].ready = true;
+        }
+        return n;
+    }
+
+    bool is_ready(unsigned slot) const
+    { return this->slots[slot].ready; }
+
+private:
+    bool is_watched_elsewhere(unsigned slot, int fd) const
+    {
+        for (unsigned i = 0; i < this->slots.size(); ++i) {
+            if ((i != slot) && (this->slots[i].fd == fd)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   128-bit fingerprint of a memory block, used as key of the bitmap caches.
+
+   It is not a cryptographic hash: the content must be compared when two
+   fingerprints are equal. The block is read by stripes of 32 bytes mixed in
+   four independent 64-bit lanes (the xxHash64 round), the lanes are folded
+   in two 64-bit halves at the end. It is an order of magnitude faster than
+   SHA-1, which is kept where the signature goes on the wire or to disk
+   (persistent bitmap caches).
+*/
+
+#ifndef _REDEMPTION_UTILS_FINGERPRINT_HPP_
+#define _REDEMPTION_UTILS_FINGERPRINT_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+struct Fingerprint
+{
+    uint64_t h[2];
+
+    bool operator==(const Fingerprint & other) const noexcept {
+        return this->h[0] == other.h[0] && this->h[1] == other.h[1];
+    }
+
+    bool operator!=(const Fingerprint & other) const noexcept {
+        return !(*this == other);
+    }
+};
+
+namespace aux_ {
+    namespace fingerprint {
+        static const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+        static const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+        static const uint64_t P3 = 0x165667B19E3779F9ULL;
+        static const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+        static const uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+        inline uint64_t rotl(uint64_t x, int r) noexcept {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        inline uint64_t read64(const uint8_t * p) noexcept {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t round(uint64_t acc, uint64_t input) noexcept {
+            acc += input * P2;
+            acc  = rotl(acc, 31);
+            return acc * P1;
+        }
+
+        inline uint64_t avalanche(uint64_t h) noexcept {
+            h ^= h >> 33;
+            h *= P2;
+            h ^= h >> 29;
+            h *= P3;
+            h ^= h >> 32;
+            return h;
+        }
+    }
+}
+
+// <seed> chains the fingerprints of several blocks.
+inline Fingerprint compute_fingerprint(const void * data, size_t len, uint64_t seed = 0) noexcept
+{
+    using namespace aux_::fingerprint;
+
+    const uint8_t * p = static_cast<const uint8_t *>(data);
+    const uint8_t * const end = p + len;
+
+    uint64_t v1 = seed + P1 + P2;
+    uint64_t v2 = seed + P2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - P1;
+
+    for (; end - p >= 32; p += 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+    }
+
+    // the 0 to 31 last bytes
+    uint64_t * const lanes[] = { &v1, &v2, &v3, &v4 };
+    unsigned lane = 0;
+    for (; end - p >= 8; p += 8) {
+        *lanes[lane] = round(*lanes[lane], read64(p));
+        ++lane;
+    }
+    if (p != end) {
+        uint64_t last = 0;
+        memcpy(&last, p, end - p);
+        *lanes[lane] = round(*lanes[lane], last ^ P5);
+    }
+
+    Fingerprint fp;
+    fp.h[0] = avalanche((rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18)) ^ (len * P5));
+    fp.h[1] = avalanche((rotl(v1, 18) ^ rotl(v2, 12) ^ rotl(v3, 7) ^ rotl(v4, 1)) + len * P4 + P3);
+    return fp;
+}
+
+#endif
@@ -23,9 +23,17 @@
 
 #include <stdint.h>
 #include <png.h>
+#include <zlib.h>
 
 #include "transport.hpp"
 
+// zlib level and row filters (PNG_FILTER_* mask) of the encoder, libpng defaults
+// (Z_DEFAULT_COMPRESSION and adaptive filtering) unless set.
+struct PngEncoding {
+    int compression_level = Z_DEFAULT_COMPRESSION;
+    int filters           = PNG_ALL_FILTERS;
+};
+
 namespace detail {
 
     struct NoExceptTransport {
@@ -53,10 +61,14 @@ namespace detail {
     static void dump_png24_impl(
         png_struct * ppng, png_info * pinfo,
         const uint8_t * data, const size_t width, const size_t height, const size_t rowsize,
-        const bool bgr, IsOk is_ok
+        const bool bgr, IsOk is_ok, const PngEncoding & encoding = PngEncoding(),
+        const size_t pixel_size = 3
     ) {
         assert(align4(rowsize) == rowsize);
 
+        png_set_compression_level(ppng, encoding.compression_level);
+        png_set_filter(ppng, PNG_FILTER_TYPE_BASE, encoding.filters);
+
         png_set_IHDR(ppng, pinfo, width, height, 8,
                     PNG_COLOR_TYPE_RGB,
                     PNG_INTERLACE_NONE,
@@ -67,7 +79,24 @@ namespace detail {
         // send image buffer to file, one pixel row at once
         const uint8_t * row = data;
 
-        if (bgr) {
+        if (pixel_size != 3) {
+            // 32 bpp rows, the fourth byte is not written
+            uint8_t rgbtmp[8192*3];
+            const size_t r = bgr ? 2 : 0;
+            const size_t b = bgr ? 0 : 2;
+            for (size_t k = 0 ; k < height && is_ok(); ++k) {
+                const uint8_t * s = row;
+                uint8_t * t = rgbtmp;
+                for (uint8_t * e = t + width * 3; t < e; s += pixel_size, t += 3) {
+                    t[0] = s[r];
+                    t[1] = s[1];
+                    t[2] = s[b];
+                }
+                png_write_row(ppng, rgbtmp);
+                row += rowsize;
+            }
+        }
+        else if (bgr) {
             uint8_t bgrtmp[8192*4];
             for (size_t k = 0 ; k < height && is_ok(); ++k) {
                 const uint8_t * s = row;
@@ -107,7 +136,9 @@ static inline void transport_dump_png24(Transport & trans, const uint8_t * data,
                             const size_t width,
                             const size_t height,
                             const size_t rowsize,
-                            const bool bgr)
+                            const bool bgr,
+                            const PngEncoding & encoding = PngEncoding(),
+                            const size_t pixel_size = 3)
 {
     detail::NoExceptTransport no_except_transport = { &trans, 0 };
 
@@ -118,7 +149,8 @@ static inline void transport_dump_png24(Transport & trans, const uint8_t * data,
 
     detail::dump_png24_impl(
         ppng, pinfo, data, width, height, rowsize, bgr,
-        [&]() noexcept {return !no_except_transport.error_id;}
+        [&]() noexcept {return !no_except_transport.error_id;},
+        encoding, pixel_size
     );
 
     if (!no_except_transport.error_id) {
@@ -120,6 +120,21 @@ struct Rect {
         }
     }
 
+    // compute a new rect containing old rect and given rect
+    Rect enlarge_to(const Rect & other) const {
+        if (other.isempty()){
+            return *this;
+        }
+        if (this->isempty()){
+            return other;
+        }
+        const int x0 = std::min<int>(this->x, other.x);
+        const int y0 = std::min<int>(this->y, other.y);
+        const int x1 = std::max<int>(this->right(), other.right());
+        const int y1 = std::max<int>(this->bottom(), other.bottom());
+        return Rect(x0, y0, x1 - x0, y1 - y0);
+    }
+
     Rect offset(int dx, int dy) const {
         return Rect(this->x + dx, this->y + dy, this->cx, this->cy);
     }
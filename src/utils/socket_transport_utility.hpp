@@ -22,6 +22,7 @@
 #define REDEMPTION_UTILS_SOCKET_TRANSPORT_UTILITY_HPP
 
 #include "socket_transport.hpp"
+#include "epoll_reactor.hpp"
 #include "wait_obj.hpp"
 
 inline
@@ -104,4 +105,49 @@ bool is_set(wait_obj & w, int fd, fd_set & rfds)
     return false;
 }
 
+// Same as above, with the descriptors watched in the slots of an EpollReactor.
+
+inline
+void add_to_reactor(wait_obj & w, int fd, EpollReactor & reactor, unsigned slot, uint64_t generation, timeval & timeout)
+{
+    reactor.watch(slot, fd, generation);
+    if (((fd <= -1) || w.object_and_time) && w.set_state) {
+        struct timeval now;
+        now = tvtime();
+        timeval remain = how_long_to_wait(w.trigger_time, now);
+        if (lessthantimeval(remain, timeout)) {
+            timeout = remain;
+        }
+    }
+}
+
+inline
+void add_to_reactor(wait_obj & w, SocketTransport * t, EpollReactor & reactor, unsigned slot, uint64_t generation, timeval & timeout)
+{
+    add_to_reactor(w, (t && (t->sck > INVALID_SOCKET)) ? t->sck : -1, reactor, slot, generation, timeout);
+}
+
+inline
+bool is_set(wait_obj & w, EpollReactor & reactor, unsigned slot)
+{
+    w.waked_up_by_time = false;
+
+    if (reactor.fd(slot) > -1) {
+        bool res = reactor.is_ready(slot);
+
+        if (res || !w.object_and_time) {
+            return res;
+        }
+    }
+
+    if (w.set_state) {
+        if (tvtime() >= w.trigger_time) {
+            w.waked_up_by_time = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 #endif
@@ -33,6 +33,7 @@
 #include "error.hpp"
 #include "bitfu.hpp"
 #include "utf.hpp"
+#include "stream_buffer_allocator.hpp"
 
 // using a template for default size of stream would make sense instead of always using the large buffer below
 enum {
@@ -1448,11 +1449,12 @@ public:
 
 // BStream is for "buffering stream", as this stream allocate a work buffer.
 class BStream : public Stream {
-    uint8_t autobuffer[AUTOSIZE];
+    // real size of <this->data>, a size class of the stream buffer allocator
+    size_t buffer_size;
 
 public:
     BStream(size_t size = AUTOSIZE)
-        : autobuffer()
+        : buffer_size(0)
     {
         this->p = nullptr;
         this->end = nullptr;
@@ -1462,32 +1464,38 @@ public:
     }
 
     virtual ~BStream() {
-        // <this->data> is allocated dynamically.
-        if (this->capacity > AUTOSIZE) {
-            delete [] this->data;
-        }
+        aux_::stream_buffer_allocator().dealloc(this->data, this->buffer_size);
     }
 
-    // a default buffer of 65536 bytes is allocated automatically, we will only allocate dynamic memory if we need more.
+private:
+    BStream(BStream const &) /* = delete*/;
+    BStream& operator=(BStream const &) /* = delete*/;
+
+public:
+    // the buffer is taken from the free list of its size class, a smaller capacity keeps
+    //  the current buffer. As the former 64 KiB automatic buffer, buffers up to AUTOSIZE
+    //  start filled with zeroes.
     virtual void init(size_t v) {
         if (v != this->capacity) {
-            // <this->data> is allocated dynamically.
-            if (this->capacity > AUTOSIZE){
-                delete [] this->data;
-            }
-
-            this->capacity = v;
-            if (v > AUTOSIZE){
-                this->data = new(std::nothrow) uint8_t[v];
-                if (!this->data) {
-                    this->capacity = 0;
+            if (!this->data || v > this->buffer_size) {
+                aux_::stream_buffer_allocator().dealloc(this->data, this->buffer_size);
+                this->data = nullptr;
+                this->buffer_size = 0;
+                this->capacity = 0;
+
+                size_t size = v;
+                uint8_t * buffer = aux_::stream_buffer_allocator().alloc(size);
+                if (!buffer) {
                     LOG(LOG_ERR, "failed to allocate buffer : size asked = %d\n", static_cast<int>(v));
                     throw Error(ERR_STREAM_MEMORY_ALLOCATION_ERROR);
                 }
+                if (v <= AUTOSIZE) {
+                    memset(buffer, 0, v);
+                }
+                this->data = buffer;
+                this->buffer_size = size;
             }
-            else {
-                this->data = &(this->autobuffer[0]);
-            }
+            this->capacity = v;
         }
         this->p = this->data;
         this->end = this->data;
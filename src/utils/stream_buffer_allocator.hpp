@@ -0,0 +1,143 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Size class free lists for the buffers of BStream and HStream.
+
+   Most PDUs are built in a temporary stream, the released buffers are kept
+   in a free list of their size class (powers of two from 256 bytes to
+   128 KiB) and given back to the next stream of the same class. Larger
+   buffers are allocated and released directly. As the proxy runs one
+   process by session, the free lists and the counters belong to a session.
+*/
+
+#ifndef _REDEMPTION_UTILS_STREAM_BUFFER_ALLOCATOR_HPP_
+#define _REDEMPTION_UTILS_STREAM_BUFFER_ALLOCATOR_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <new>
+#include <mutex>
+
+namespace aux_ {
+    class StreamBufferAlloc {
+        enum {
+            MIN_SHIFT      = 8,     // 256 bytes
+            MAX_SHIFT      = 17,    // 128 KiB, a 64 KiB PDU and its headers
+            CLASS_COUNT    = MAX_SHIFT - MIN_SHIFT + 1,
+            MAX_FREE_COUNT = 8      // released buffers kept by class
+        };
+
+        struct FreeList {
+            uint8_t * buffers[MAX_FREE_COUNT];
+            unsigned  count = 0;
+        };
+
+        FreeList free_lists[CLASS_COUNT];
+        // streams are also built by the capture worker thread and the drive I/O threads
+        std::mutex mutex;
+
+    public:
+        struct Counters {
+            uint64_t allocations = 0;       // buffers given to streams
+            uint64_t reused = 0;            // ... taken from a free list
+            uint64_t heap_allocations = 0;  // ... allocated with operator new
+            uint64_t heap_releases = 0;     // buffers given back with operator delete
+            uint64_t free_bytes = 0;        // size of the buffers waiting in the free lists
+        };
+
+    private:
+        Counters counters;
+
+        static unsigned size_class(size_t size) {
+            unsigned shift = MIN_SHIFT;
+            while ((size_t(1) << shift) < size) {
+                ++shift;
+            }
+            return shift - MIN_SHIFT;
+        }
+
+    public:
+        enum {
+            MAX_POOLED_SIZE = size_t(1) << MAX_SHIFT
+        };
+
+        StreamBufferAlloc() = default;
+
+        ~StreamBufferAlloc() {
+            for (FreeList & free_list : this->free_lists) {
+                while (free_list.count) {
+                    ::operator delete(free_list.buffers[--free_list.count]);
+                }
+            }
+        }
+
+        StreamBufferAlloc(StreamBufferAlloc const &) = delete;
+        StreamBufferAlloc & operator=(StreamBufferAlloc const &) = delete;
+
+        // <size> is updated with the real size of the buffer, to give back to dealloc()
+        // returns nullptr if the memory is exhausted
+        uint8_t * alloc(size_t & size) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            ++this->counters.allocations;
+            if (size <= MAX_POOLED_SIZE) {
+                const unsigned i = size_class(size);
+                size = size_t(1) << (i + MIN_SHIFT);
+                FreeList & free_list = this->free_lists[i];
+                if (free_list.count) {
+                    ++this->counters.reused;
+                    this->counters.free_bytes -= size;
+                    return free_list.buffers[--free_list.count];
+                }
+            }
+            ++this->counters.heap_allocations;
+            return static_cast<uint8_t*>(::operator new(size, std::nothrow));
+        }
+
+        void dealloc(uint8_t * p, size_t size) {
+            if (!p) {
+                return ;
+            }
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (size <= MAX_POOLED_SIZE) {
+                FreeList & free_list = this->free_lists[size_class(size)];
+                if (free_list.count < MAX_FREE_COUNT) {
+                    free_list.buffers[free_list.count++] = p;
+                    this->counters.free_bytes += size;
+                    return ;
+                }
+            }
+            ++this->counters.heap_releases;
+            ::operator delete(p);
+        }
+
+        Counters get_counters() {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            return this->counters;
+        }
+    };
+
+    // built on first use, so before any static stream and destroyed after it
+    inline StreamBufferAlloc & stream_buffer_allocator() {
+        static StreamBufferAlloc allocator;
+        return allocator;
+    }
+}
+
+#endif
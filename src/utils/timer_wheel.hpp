@@ -0,0 +1,192 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Hashed timer wheel with a resolution of one second.
+
+   A timer is linked in the slot of its deadline modulo the number of
+   slots, arming, moving or cancelling it is done in constant time. The
+   wheel turns with advance(), which fires the timers due on the slots
+   passed over. A timer beyond one turn of the wheel stays in its slot and is
+   skipped until its turn comes, so next_expiry() never looks further than
+   one turn ahead.
+*/
+
+#ifndef _REDEMPTION_UTILS_TIMER_WHEEL_HPP_
+#define _REDEMPTION_UTILS_TIMER_WHEEL_HPP_
+
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "noncopyable.hpp"
+
+class TimerWheel : noncopyable
+{
+public:
+    enum {
+        NB_SLOTS = 64
+    };
+
+private:
+    static const unsigned NONE = ~0u;
+
+    struct Timer {
+        time_t   deadline = 0;
+        bool     armed    = false;
+        bool     expired  = false;
+        unsigned slot     = 0;
+        unsigned prev     = NONE;
+        unsigned next     = NONE;
+    };
+
+    std::vector<Timer> timers;
+    unsigned           slots[NB_SLOTS];
+
+    // all the seconds before <current> are expired
+    time_t current;
+
+public:
+    // the timers are identified by 0 to <nb_timers> - 1
+    TimerWheel(unsigned nb_timers, time_t now)
+    : timers(nb_timers)
+    , current(now)
+    {
+        for (unsigned & slot : this->slots) {
+            slot = NONE;
+        }
+    }
+
+    bool is_armed(unsigned id) const
+    { return this->timers[id].armed; }
+
+    time_t deadline(unsigned id) const
+    { return this->timers[id].deadline; }
+
+    // A deadline already passed expires at the next advance().
+    void arm(unsigned id, time_t deadline)
+    {
+        Timer & timer = this->timers[id];
+        if (timer.armed) {
+            if (timer.deadline == deadline) {
+                return;
+            }
+            this->unlink(id);
+        }
+        timer.deadline = deadline;
+        timer.armed    = true;
+        timer.slot     = ((deadline < this->current) ? this->current : deadline) % NB_SLOTS;
+
+        unsigned & head = this->slots[timer.slot];
+        timer.prev = NONE;
+        timer.next = head;
+        if (head != NONE) {
+            this->timers[head].prev = id;
+        }
+        head = id;
+    }
+
+    void cancel(unsigned id)
+    {
+        if (this->timers[id].armed) {
+            this->unlink(id);
+        }
+    }
+
+    // arms the timer at <deadline>, or cancels it when <deadline> is 0
+    void rearm(unsigned id, time_t deadline)
+    {
+        if (deadline) {
+            this->arm(id, deadline);
+        }
+        else {
+            this->cancel(id);
+        }
+    }
+
+    // Second of the first timer due within one turn of the wheel, the end of
+    //  the turn when the timers are further, 0 when no timer is armed.
+    time_t next_expiry() const
+    {
+        bool any = false;
+        for (time_t tick = this->current; tick < this->current + NB_SLOTS; ++tick) {
+            for (unsigned id = this->slots[tick % NB_SLOTS]; id != NONE; id = this->timers[id].next) {
+                if (this->timers[id].deadline <= tick) {
+                    return tick;
+                }
+                any = true;
+            }
+        }
+        return any ? this->current + NB_SLOTS : 0;
+    }
+
+    // Fires the timers due at <now>, they are disarmed before
+    //  <on_expiry>(id) is called, which may arm them again.
+    template<class F>
+    void advance(time_t now, F on_expiry)
+    {
+        if (now < this->current) {
+            return;
+        }
+        bool any = false;
+        const time_t end = std::min<time_t>(now + 1, this->current + NB_SLOTS);
+        for (time_t tick = this->current; tick < end; ++tick) {
+            unsigned id = this->slots[tick % NB_SLOTS];
+            while (id != NONE) {
+                const unsigned next = this->timers[id].next;
+                if (this->timers[id].deadline <= now) {
+                    this->unlink(id);
+                    this->timers[id].expired = true;
+                    any = true;
+                }
+                id = next;
+            }
+        }
+        this->current = now + 1;
+
+        if (any) {
+            for (unsigned id = 0; id < this->timers.size(); ++id) {
+                if (this->timers[id].expired) {
+                    this->timers[id].expired = false;
+                    on_expiry(id);
+                }
+            }
+        }
+    }
+
+private:
+    void unlink(unsigned id)
+    {
+        Timer & timer = this->timers[id];
+        if (timer.prev != NONE) {
+            this->timers[timer.prev].next = timer.next;
+        }
+        else {
+            this->slots[timer.slot] = timer.next;
+        }
+        if (timer.next != NONE) {
+            this->timers[timer.next].prev = timer.prev;
+        }
+        timer.armed = false;
+        timer.prev  = NONE;
+        timer.next  = NONE;
+    }
+};
+
+#endif
@@ -480,3 +480,27 @@ BOOST_AUTO_TEST_CASE(TestAuthentifierInactivity)
     sesman.check(mm, 10255, signal);
     BOOST_CHECK_EQUAL(mm.last_module, true); // disconnected on inactivity
 }
+
+BOOST_AUTO_TEST_CASE(TestAuthentifierNextCheckTime)
+{
+    Inifile ini;
+
+    KeepAlive keepalive(30, 0);
+    keepalive.start(10000);
+    // renew keepalive
+    BOOST_CHECK_EQUAL(10031, keepalive.next_check_time());
+    BOOST_CHECK_EQUAL(false, keepalive.check(10030, ini));
+    BOOST_CHECK_EQUAL(false, ini.context_is_asked(AUTHID_KEEPALIVE));
+    BOOST_CHECK_EQUAL(false, keepalive.check(10031, ini));
+    BOOST_CHECK_EQUAL(true, ini.context_is_asked(AUTHID_KEEPALIVE));
+    // waiting for answer
+    BOOST_CHECK_EQUAL(10061, keepalive.next_check_time());
+    BOOST_CHECK_EQUAL(false, keepalive.check(10060, ini));
+    BOOST_CHECK_EQUAL(true, keepalive.check(10061, ini));
+
+    ActivityAlwaysFalse activity_checker;
+    Inactivity inactivity(activity_checker, 240, 10000, 0);
+    BOOST_CHECK_EQUAL(10241, inactivity.next_check_time());
+    BOOST_CHECK_EQUAL(false, inactivity.check(10240));
+    BOOST_CHECK_EQUAL(true, inactivity.check(10241));
+}
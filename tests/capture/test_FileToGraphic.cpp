@@ -32,6 +32,7 @@
 
 #include "out_filename_sequence_transport.hpp"
 #include "in_file_transport.hpp"
+#include "in_meta_sequence_transport.hpp"
 #include "nativecapture.hpp"
 #include "FileToGraphic.hpp"
 #include "image_capture.hpp"
@@ -231,3 +232,59 @@ BOOST_AUTO_TEST_CASE(TestSample0WRM)
 //    sq_outfilename_unlink(&(out_wrm_trans.seq), 2);
 //}
 
+
+BOOST_AUTO_TEST_CASE(TestSeekToKeyframe)
+{
+    InMetaSequenceTransport in_wrm_trans("./tests/fixtures/sample", ".mwrm");
+    timeval begin_capture;
+    begin_capture.tv_sec = 0; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+    FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+
+    RDPDrawable drawable(player.screen_rect.cx, player.screen_rect.cy, 24);
+    player.add_consumer(&drawable, &drawable);
+
+    BOOST_CHECK_EQUAL((unsigned)1352304810, (unsigned)player.record_now.tv_sec);
+
+    // sample1.wrm starts with a keyframe
+    timeval t;
+    t.tv_sec = 1352304900; t.tv_usec = 0;
+    player.seek_to_keyframe(t);
+    BOOST_CHECK_EQUAL(2, in_wrm_trans.get_seqno());
+    BOOST_CHECK_LE((unsigned)1352304870, (unsigned)player.record_now.tv_sec);
+    BOOST_CHECK_GT((unsigned)1352304900, (unsigned)player.record_now.tv_sec);
+
+    const uint32_t total_orders_count = player.total_orders_count;
+    bool requested_to_stop = false;
+    player.play(requested_to_stop);
+    BOOST_CHECK_EQUAL((unsigned)1352304938, (unsigned)player.record_now.tv_sec);
+
+    // and backward
+    t.tv_sec = 1352304810;
+    player.seek_to_keyframe(t);
+    BOOST_CHECK_EQUAL(1, in_wrm_trans.get_seqno());
+    BOOST_CHECK_EQUAL((unsigned)1352304810, (unsigned)player.record_now.tv_sec);
+    BOOST_CHECK_LT(total_orders_count, player.total_orders_count);
+}
+
+BOOST_AUTO_TEST_CASE(TestBeginCaptureSeek)
+{
+    InMetaSequenceTransport in_wrm_trans("./tests/fixtures/sample", ".mwrm");
+    timeval begin_capture;
+    begin_capture.tv_sec = 1352304935; begin_capture.tv_usec = 0;
+    timeval end_capture;
+    end_capture.tv_sec = 0; end_capture.tv_usec = 0;
+    FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+
+    RDPDrawable drawable(player.screen_rect.cx, player.screen_rect.cy, 24);
+    player.add_consumer(&drawable, &drawable);
+
+    // files before the one of begin_capture are not read
+    bool requested_to_stop = false;
+    player.play(requested_to_stop);
+    BOOST_CHECK_EQUAL(3, in_wrm_trans.get_seqno());
+    BOOST_CHECK_EQUAL((unsigned)1352304938, (unsigned)player.record_now.tv_sec);
+    BOOST_CHECK_GT(in_wrm_trans.get_total_received(), 0);
+    BOOST_CHECK_LT(in_wrm_trans.get_total_received(), 1471394 + 444578 + 290245);
+}
@@ -180,6 +180,75 @@ BOOST_AUTO_TEST_CASE(TestSplittedCapture)
     }
 }
 
+BOOST_AUTO_TEST_CASE(TestSplittedCaptureQueue)
+{
+    Inifile ini;
+    ini.video.rt_display.set(1);
+    {
+        // Same records as TestSplittedCapture, written by the capture worker thread
+        timeval now;
+        now.tv_usec = 0;
+        now.tv_sec = 1000;
+
+        Rect scr(0, 0, 800, 600);
+
+        ini.video.frame_interval = 100; // one timestamp every second
+        ini.video.break_interval = 3;   // one WRM file every 5 seconds
+
+        ini.video.png_limit = 0;
+
+        ini.video.capture_wrm = true;
+        ini.video.capture_png = false;
+        ini.video.capture_queue_size = 64;
+        ini.globals.enable_file_encryption.set(false);
+
+        Capture capture(
+            now, scr.cx, scr.cy, 24, 24, "./", "./", "/tmp/", "capture_queue", false, false, nullptr, ini
+        );
+
+        bool ignore_frame_in_timeval = false;
+        bool requested_to_stop       = false;
+
+        const uint32_t colors[] = { GREEN, BLUE, WHITE, RED, BLACK, PINK, WABGREEN };
+        for (int i = 0; i < 7; i++) {
+            capture.draw(RDPOpaqueRect(i ? Rect(i, i * 50, 700, 30) : scr, colors[i]), scr);
+            now.tv_sec++;
+            capture.snapshot(now, 0, 0, ignore_frame_in_timeval, requested_to_stop);
+        }
+
+        // The destruction of capture object waits for the worker and finalizes the metafile content
+    }
+
+    {
+        FilenameGenerator wrm_seq(
+            FilenameGenerator::PATH_FILE_COUNT_EXTENSION
+        , "./" , "capture_queue", ".wrm", ini.video.capture_groupid
+        );
+
+        const char * filename;
+
+        filename = wrm_seq.get(0);
+        BOOST_CHECK_EQUAL(1646, ::filesize(filename));
+        ::unlink(filename);
+        filename = wrm_seq.get(1);
+        BOOST_CHECK_EQUAL(3508, ::filesize(filename));
+        ::unlink(filename);
+        filename = wrm_seq.get(2);
+        BOOST_CHECK_EQUAL(3484, ::filesize(filename));
+        ::unlink(filename);
+        filename = wrm_seq.get(3);
+        BOOST_CHECK_EQUAL(false, file_exist(filename));
+    }
+
+    {
+        FilenameGenerator mwrm_seq(
+            FilenameGenerator::PATH_FILE_EXTENSION
+          , "./", "capture_queue", ".mwrm", 0
+        );
+        ::unlink(mwrm_seq.get(0));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TestBppToOtherBppCapture)
 {
     Inifile ini;
@@ -0,0 +1,152 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of the capture worker thread queue
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestCaptureQueue
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "capture_queue.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(TestCaptureQueueOrder)
+{
+    std::vector<int> done;
+    {
+        CaptureQueue queue(1024, nullptr);
+        for (int i = 0; i < 100; i++) {
+            queue.push(100, [&done, i]() { done.push_back(i); });
+        }
+        queue.wait();
+        BOOST_CHECK_EQUAL(100, done.size());
+
+        queue.push(0, [&done]() { done.push_back(100); });
+        // the destructor runs the remaining jobs
+    }
+    BOOST_REQUIRE_EQUAL(101, done.size());
+    for (int i = 0; i < 101; i++) {
+        BOOST_CHECK_EQUAL(i, done[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureQueueBackPressure)
+{
+    std::atomic<bool> release(false);
+    std::atomic<int>  running(0);
+    CaptureQueue queue(1000, nullptr);
+
+    // blocks the worker
+    queue.push(600, [&]() {
+        running++;
+        while (!release) {
+            std::this_thread::yield();
+        }
+    });
+
+    // a job larger than the queue is accepted when the queue is empty, not here
+    std::thread session([&]() {
+        queue.push(600, [&]() { running++; });
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(1, running);
+
+    release = true;
+    session.join();
+    queue.wait();
+    BOOST_CHECK_EQUAL(2, running);
+
+    queue.push(5000, [&]() { running++; });
+    queue.wait();
+    BOOST_CHECK_EQUAL(3, running);
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureQueueError)
+{
+    int done = 0;
+    CaptureQueue queue(1024, nullptr);
+    queue.push(0, [&done]() { done++; });
+
+    try {
+        queue.push(0, []() { throw Error(ERR_TRANSPORT_WRITE_FAILED, 28); });
+        queue.push(0, [&done]() { done++; });
+        queue.wait();
+        BOOST_CHECK(false);
+    }
+    catch (Error const & e) {
+        BOOST_CHECK_EQUAL(ERR_TRANSPORT_WRITE_FAILED, e.id);
+        BOOST_CHECK_EQUAL(28, e.errnum);
+    }
+    // the jobs after the error are dropped
+    BOOST_CHECK_EQUAL(1, done);
+
+    // the capture is stopped
+    BOOST_CHECK_THROW(queue.push(0, [&done]() { done++; }), Error);
+    BOOST_CHECK_EQUAL(1, done);
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureQueueUnknownError)
+{
+    CaptureQueue queue(1024, nullptr);
+
+    // any exception of a job stops the capture instead of ending the thread
+    queue.push(0, []() { throw std::runtime_error("job failed"); });
+    try {
+        queue.wait();
+        BOOST_CHECK(false);
+    }
+    catch (Error const & e) {
+        BOOST_CHECK_EQUAL(ERR_RECORDER_JOB_FAILED, e.id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestCaptureQueueReport)
+{
+    struct Authentifier : auth_api {
+        std::string reports;
+
+        virtual void set_auth_channel_target(const char * target) override {}
+
+        virtual void report(const char * reason, const char * message) override {
+            this->reports += reason;
+            this->reports += ':';
+            this->reports += message;
+            this->reports += '\n';
+        }
+    } authentifier;
+
+    CaptureQueue queue(1024, &authentifier);
+    auth_api * transport_authentifier = &queue;
+    queue.push(0, [transport_authentifier]() {
+        transport_authentifier->report("FILESYSTEM_FULL", "100|/var/wab/recorded");
+    });
+    // forwarded by the session thread
+    queue.wait();
+    BOOST_CHECK_EQUAL("FILESYSTEM_FULL:100|/var/wab/recorded\n", authentifier.reports);
+}
@@ -145,3 +145,59 @@ BOOST_AUTO_TEST_CASE(TestFrameMarker)
     ::unlink(trans.seqgen()->get(1));
 }
 
+
+BOOST_AUTO_TEST_CASE(TestUnchangedScreen)
+{
+    Rect screen_rect(0, 0, 800, 600);
+    const int groupid = 0;
+    OutFilenameSequenceTransport trans(FilenameGenerator::PATH_FILE_PID_COUNT_EXTENSION, "./", "test_unchanged", ".png", groupid);
+
+    timeval now;
+    now.tv_sec = 1350998222;
+    now.tv_usec = 0;
+
+    Inifile ini;
+    ini.video.rt_display.set(1);
+    ini.video.png_limit = 3;
+    ini.video.png_interval = 10;
+    ini.video.png_compression_level = 1;
+    ini.video.png_filter = 1;
+    RDPDrawable drawable(800, 600, 24);
+    StaticCapture consumer(now, trans, trans.seqgen(), 800, 600, false, ini, drawable.impl());
+
+    bool ignore_frame_in_timeval = false;
+    bool requested_to_stop       = false;
+
+    drawable.draw(RDPOpaqueRect(screen_rect, RED), screen_rect);
+    // -> PNG
+    consumer.snapshot(now, 10, 10, ignore_frame_in_timeval, requested_to_stop);
+    now.tv_sec++;
+    consumer.snapshot(now, 10, 10, ignore_frame_in_timeval, requested_to_stop);
+    now.tv_sec++;
+    BOOST_CHECK_EQUAL(1, trans.get_seqno());
+
+    // mouse moved -> PNG
+    drawable.set_mouse_cursor_pos(20, 20);
+    consumer.snapshot(now, 20, 20, ignore_frame_in_timeval, requested_to_stop);
+    now.tv_sec++;
+    consumer.snapshot(now, 20, 20, ignore_frame_in_timeval, requested_to_stop);
+    now.tv_sec++;
+    BOOST_CHECK_EQUAL(2, trans.get_seqno());
+
+    // -> PNG
+    drawable.draw(RDPOpaqueRect(Rect(100, 100, 200, 200), BLUE), screen_rect);
+    consumer.snapshot(now, 20, 20, ignore_frame_in_timeval, requested_to_stop);
+    now.tv_sec++;
+    BOOST_CHECK_EQUAL(3, trans.get_seqno());
+
+    // the paused image is replaced by the next snapshot
+    consumer.pause_snapshot(now);
+    now.tv_sec++;
+    consumer.snapshot(now, 20, 20, ignore_frame_in_timeval, requested_to_stop);
+    BOOST_CHECK_EQUAL(5, trans.get_seqno());
+
+    for (unsigned i = 2; i < 5; i++) {
+        BOOST_CHECK(::filesize(trans.seqgen()->get(i)) > 0);
+        ::unlink(trans.seqgen()->get(i));
+    }
+}
@@ -0,0 +1,227 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test of the read and write requests engine of the proxy managed drives
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRdpdrDriveIOEngine
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "RDP/channels/rdpdr_drive_io_engine.hpp"
+#include "test_transport.hpp"
+
+#include <poll.h>
+
+#include <map>
+#include <vector>
+
+// Rebuilds the PDUs from the chunks.
+class TestToServerSender : public ToServerSender {
+    std::vector<uint8_t> pdu;
+
+public:
+    std::vector<std::vector<uint8_t>> pdus;
+    unsigned chunk_count = 0;
+
+    virtual void operator() (size_t total_length, uint32_t flags, const uint8_t * chunk_data,
+                             size_t chunk_data_length) override {
+        BOOST_CHECK(chunk_data_length <= CHANNELS::CHANNEL_CHUNK_LENGTH);
+        BOOST_CHECK_EQUAL(bool(flags & CHANNELS::CHANNEL_FLAG_FIRST), this->pdu.empty());
+        this->pdu.insert(this->pdu.end(), chunk_data, chunk_data + chunk_data_length);
+        this->chunk_count++;
+        if (flags & CHANNELS::CHANNEL_FLAG_LAST) {
+            BOOST_CHECK_EQUAL(total_length, this->pdu.size());
+            this->pdus.push_back(std::move(this->pdu));
+            this->pdu.clear();
+        }
+    }
+};
+
+struct Completion {
+    uint32_t DeviceId;
+    uint32_t IoStatus;
+    uint32_t Length;
+    std::vector<uint8_t> data;
+};
+
+static void wait_completions(RdpdrDriveIOEngine & engine, TestToServerSender & sender,
+                             std::map<uint32_t, Completion> & completions) {
+    while (engine.has_pending_io()) {
+        pollfd pfd = { engine.get_completion_fd(), POLLIN, 0 };
+        BOOST_REQUIRE_EQUAL(1, ::poll(&pfd, 1, 10000));
+        engine.send_completions(sender, 0);
+    }
+
+    for (std::vector<uint8_t> & pdu : sender.pdus) {
+        StaticStream stream(pdu.data(), pdu.size());
+        BOOST_CHECK_EQUAL(0x4472, stream.in_uint16_le());  // RDPDR_CTYP_CORE
+        BOOST_CHECK_EQUAL(0x4943, stream.in_uint16_le());  // PAKID_CORE_DEVICE_IOCOMPLETION
+        Completion completion;
+        completion.DeviceId = stream.in_uint32_le();
+        const uint32_t CompletionId = stream.in_uint32_le();
+        completion.IoStatus = stream.in_uint32_le();
+        completion.Length   = stream.in_uint32_le();
+        completion.data.assign(stream.p, stream.end);
+        BOOST_CHECK(!completions.count(CompletionId));
+        completions[CompletionId] = std::move(completion);
+    }
+    sender.pdus.clear();
+}
+
+BOOST_AUTO_TEST_CASE(TestRdpdrDriveIOEngine)
+{
+    char filename[] = "/tmp/test_rdpdr_drive_io_engineXXXXXX";
+    const int fd = ::mkstemp(filename);
+    BOOST_REQUIRE(fd > -1);
+
+    std::vector<uint8_t> content(300000);
+    for (size_t i = 0; i < content.size(); i++) {
+        content[i] = i * 7 + (i >> 10);
+    }
+
+    RdpdrDriveIOEngine engine(3);
+    TestToServerSender sender;
+    std::map<uint32_t, Completion> completions;
+
+    BOOST_CHECK(!engine.has_pending_io());
+    BOOST_CHECK_EQUAL(-1, engine.get_completion_fd());
+
+    // several writes of 64 KiB at the same time, in reverse order
+    const uint32_t block_size = 65536;
+    uint32_t completion_id = 0;
+    for (size_t offset = content.size() - content.size() % block_size + block_size;
+         offset > 0; offset -= block_size) {
+        const size_t begin = offset - block_size;
+        const size_t end   = std::min(offset, content.size());
+        engine.write(fd, 32767, completion_id++, begin,
+            std::vector<uint8_t>(content.begin() + begin, content.begin() + end));
+    }
+    BOOST_CHECK(engine.has_pending_io());
+    wait_completions(engine, sender, completions);
+
+    BOOST_REQUIRE_EQUAL(5, completions.size());
+    for (auto & c : completions) {
+        BOOST_CHECK_EQUAL(32767, c.second.DeviceId);
+        BOOST_CHECK_EQUAL(0, c.second.IoStatus);
+        // Length(4) + Padding(1)
+        BOOST_CHECK_EQUAL((c.first == 0) ? content.size() % block_size : block_size, c.second.Length);
+        BOOST_CHECK_EQUAL(1, c.second.data.size());
+    }
+    engine.wait_file(fd);
+    BOOST_CHECK_EQUAL(content.size(), ::lseek(fd, 0, SEEK_END));
+
+    // sequential reads, the last one is truncated by the end of the file
+    completions.clear();
+    sender.chunk_count = 0;
+    for (uint32_t offset = 0; offset < content.size(); offset += block_size) {
+        engine.read(fd, 32767, offset / block_size, block_size, offset);
+    }
+    // after the end of the file
+    engine.read(fd, 32767, 100, block_size, 1000000);
+    wait_completions(engine, sender, completions);
+
+    BOOST_REQUIRE_EQUAL(6, completions.size());
+    for (uint32_t i = 0; i < 5; i++) {
+        const size_t begin = i * block_size;
+        const size_t end   = std::min<size_t>(begin + block_size, content.size());
+        Completion & c = completions[i];
+        BOOST_CHECK_EQUAL(0, c.IoStatus);
+        BOOST_CHECK_EQUAL(end - begin, c.Length);
+        BOOST_REQUIRE_EQUAL(end - begin, c.data.size());
+        BOOST_CHECK(std::equal(c.data.begin(), c.data.end(), content.begin() + begin));
+    }
+    BOOST_CHECK_EQUAL(0, completions[100].IoStatus);
+    BOOST_CHECK_EQUAL(0, completions[100].Length);
+    BOOST_CHECK_EQUAL(0, completions[100].data.size());
+    // 4 * 41 chunks of 65536 + 20 bytes, 24 chunks of 37856 + 20 bytes, 1 chunk of 20 bytes
+    BOOST_CHECK_EQUAL(189, sender.chunk_count);
+
+    // a huge Length of the server is cut at the end of the file
+    completions.clear();
+    engine.read(fd, 32767, 101, 0xFFFFFFFF, 1000);
+    wait_completions(engine, sender, completions);
+    BOOST_REQUIRE_EQUAL(1, completions.size());
+    BOOST_CHECK_EQUAL(0, completions[101].IoStatus);
+    BOOST_CHECK_EQUAL(content.size() - 1000, completions[101].Length);
+    BOOST_REQUIRE_EQUAL(content.size() - 1000, completions[101].data.size());
+    BOOST_CHECK(std::equal(completions[101].data.begin(), completions[101].data.end(),
+                           content.begin() + 1000));
+
+    engine.close_file(fd);
+    ::close(fd);
+
+    // error on a closed file
+    completions.clear();
+    engine.read(fd, 32767, 200, 10, 0);
+    wait_completions(engine, sender, completions);
+    BOOST_REQUIRE_EQUAL(1, completions.size());
+    BOOST_CHECK_EQUAL(0xC0000001, completions[200].IoStatus);   // STATUS_UNSUCCESSFUL
+    BOOST_CHECK_EQUAL(0, completions[200].Length);
+
+    ::unlink(filename);
+}
+
+class TransportToServerSender : public ToServerSender {
+    Transport & transport;
+
+public:
+    TransportToServerSender(Transport & transport) : transport(transport) {}
+
+    virtual void operator() (size_t total_length, uint32_t flags,
+        const uint8_t * chunk_data, size_t chunk_data_length) override {
+        BStream stream(128);
+        stream.out_uint32_le(total_length);
+        stream.out_uint32_le(flags);
+        stream.mark_end();
+
+        this->transport.send(stream);
+        this->transport.send(chunk_data, chunk_data_length);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TestRdpdrDriveIOEngineRead)
+{
+    uint32_t verbose = 1;
+
+    int fd = ::open("tests/fixtures/rfc959.txt", O_RDONLY);
+    BOOST_REQUIRE(fd > -1);
+
+    #include "fixtures/test_rdpdr_drive_read_task.hpp"
+    CheckTransport check_transport(outdata, sizeof(outdata), verbose);
+    TransportToServerSender to_server_sender(check_transport);
+
+    const uint32_t DeviceId = 0;
+    const uint32_t CompletionId = 8;
+
+    RdpdrDriveIOEngine engine;
+    engine.read(fd, DeviceId, CompletionId, 2 * 1024, 1024 * 32);
+    while (engine.has_pending_io()) {
+        pollfd pfd = { engine.get_completion_fd(), POLLIN, 0 };
+        BOOST_REQUIRE_EQUAL(1, ::poll(&pfd, 1, 10000));
+        engine.send_completions(to_server_sender, verbose);
+    }
+
+    engine.close_file(fd);
+    ::close(fd);
+}
@@ -0,0 +1,180 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test of the requests of the server on the proxy managed drives
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestRdpdrFileSystemDriveManager
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#define DRIVE_REDIRECTION_PATH "/tmp"
+
+#include "make_unique.hpp"
+#include "RDP/channels/rdpdr_file_system_drive_manager.hpp"
+
+#include <string>
+#include <vector>
+
+class TestToServerSender : public ToServerSender {
+public:
+    std::vector<std::vector<uint8_t>> pdus;
+
+    virtual void operator() (size_t total_length, uint32_t flags, const uint8_t * chunk_data,
+                             size_t chunk_data_length) override {
+        BOOST_CHECK_EQUAL(CHANNELS::CHANNEL_FLAG_FIRST | CHANNELS::CHANNEL_FLAG_LAST, flags);
+        BOOST_CHECK_EQUAL(total_length, chunk_data_length);
+        this->pdus.emplace_back(chunk_data, chunk_data + chunk_data_length);
+    }
+};
+
+// Sends the response of the request, if any, and returns its IoStatus.
+static uint32_t run_response(std::unique_ptr<AsynchronousTask> & task, TestToServerSender & sender,
+                             uint32_t & FileId) {
+    BOOST_REQUIRE(task);
+    wait_obj event;
+    BOOST_CHECK(!task->run(event));
+    task.reset();
+
+    BOOST_REQUIRE_EQUAL(1, sender.pdus.size());
+    StaticStream stream(sender.pdus[0].data(), sender.pdus[0].size());
+    stream.in_skip_bytes(4);    // SharedHeader(4)
+    stream.in_skip_bytes(8);    // DeviceId(4) + CompletionId(4)
+    const uint32_t IoStatus = stream.in_uint32_le();
+    FileId = stream.in_uint32_le();
+    sender.pdus.clear();
+    return IoStatus;
+}
+
+static void make_request(Stream & stream, uint32_t FileId, uint32_t CompletionId,
+                         uint32_t MajorFunction) {
+    stream.out_uint16_le(0x4472);       // RDPDR_CTYP_CORE
+    stream.out_uint16_le(0x4952);       // PAKID_CORE_DEVICE_IOREQUEST
+    stream.out_uint32_le(32767);        // DeviceId
+    stream.out_uint32_le(FileId);
+    stream.out_uint32_le(CompletionId);
+    stream.out_uint32_le(MajorFunction);
+    stream.out_uint32_le(0);            // MinorFunction
+}
+
+BOOST_AUTO_TEST_CASE(TestRdpdrFileSystemDriveManagerHugeWrite)
+{
+    char dirname[] = "/tmp/test_rdpdr_file_system_drive_managerXXXXXX";
+    BOOST_REQUIRE(::mkdtemp(dirname));
+    const std::string filename = std::string(dirname) + "/file.bin";
+    {
+        const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+        BOOST_REQUIRE(fd > -1);
+        BOOST_CHECK_EQUAL(6, ::write(fd, "abcdef", 6));
+        ::close(fd);
+    }
+
+    TestToServerSender sender;
+    std::unique_ptr<AsynchronousTask> task;
+    uint32_t FileId = 0;
+
+    {
+        FileSystemDriveManager manager;
+        BOOST_REQUIRE(manager.EnableDrive(dirname + 5, 0));
+
+        rdpdr::DeviceIORequest device_io_request;
+
+        {
+            BStream stream(1024);
+            make_request(stream, 0, 1, rdpdr::IRP_MJ_CREATE);
+            stream.out_uint32_le(smb2::FILE_READ_DATA | smb2::FILE_WRITE_DATA);  // DesiredAccess
+            stream.out_uint64_le(0);                // AllocationSize
+            stream.out_uint32_le(0);                // FileAttributes
+            stream.out_uint32_le(0);                // SharedAccess
+            stream.out_uint32_le(smb2::FILE_OPEN);  // CreateDisposition
+            stream.out_uint32_le(0);                // CreateOptions
+            const char path[] = "/\0f\0i\0l\0e\0.\0b\0i\0n\0\0";
+            stream.out_uint32_le(sizeof(path));     // PathLength
+            stream.out_copy_bytes(path, sizeof(path));
+            stream.mark_end();
+            stream.p = stream.get_data() + 4;
+
+            device_io_request.receive(stream);
+            manager.ProcessDeviceIORequest(device_io_request, true, stream, sender, task, 0);
+            BOOST_CHECK_EQUAL(0, run_response(task, sender, FileId));    // STATUS_SUCCESS
+        }
+
+        // the data of a write larger than MAX_IO_LENGTH is not kept
+        const uint32_t Length = RdpdrDriveIOEngine::MAX_IO_LENGTH + 1;
+        {
+            BStream stream(CHANNELS::CHANNEL_CHUNK_LENGTH);
+            make_request(stream, FileId, 2, rdpdr::IRP_MJ_WRITE);
+            stream.out_uint32_le(Length);
+            stream.out_uint64_le(0);                // Offset
+            stream.out_clear_bytes(20);             // Padding(20)
+            stream.out_clear_bytes(stream.tailroom());
+            stream.mark_end();
+            stream.p = stream.get_data() + 4;
+
+            device_io_request.receive(stream);
+            // Length(4) + Offset(8) + Padding(20)
+            uint32_t received = stream.in_remain() - 32;
+            manager.ProcessDeviceIORequest(device_io_request, true, stream, sender, task, 0);
+
+            BStream chunk(CHANNELS::CHANNEL_CHUNK_LENGTH);
+            chunk.out_clear_bytes(chunk.tailroom());
+            chunk.mark_end();
+            while (received < Length) {
+                BOOST_REQUIRE(!task);
+                chunk.p = chunk.get_data();
+                chunk.end = chunk.p + std::min<uint32_t>(Length - received, CHANNELS::CHANNEL_CHUNK_LENGTH);
+                received += chunk.in_remain();
+                manager.ProcessDeviceIORequest(device_io_request, false, chunk, sender, task, 0);
+            }
+        }
+        uint32_t WriteLength = 0;
+        BOOST_CHECK_EQUAL(0xC000000D, run_response(task, sender, WriteLength));  // STATUS_INVALID_PARAMETER
+        BOOST_CHECK_EQUAL(0, WriteLength);
+        BOOST_CHECK(!manager.HasPendingIO());
+
+        // next write is done
+        {
+            BStream stream(1024);
+            make_request(stream, FileId, 3, rdpdr::IRP_MJ_WRITE);
+            stream.out_uint32_le(3);                // Length
+            stream.out_uint64_le(6);                // Offset
+            stream.out_clear_bytes(20);             // Padding(20)
+            stream.out_copy_bytes("ghi", 3);
+            stream.mark_end();
+            stream.p = stream.get_data() + 4;
+
+            device_io_request.receive(stream);
+            manager.ProcessDeviceIORequest(device_io_request, true, stream, sender, task, 0);
+            BOOST_CHECK(!task);
+            BOOST_CHECK(manager.HasPendingIO());
+        }
+    }
+
+    // the write completion was not sent, the file is closed with the manager
+    struct stat sb;
+    BOOST_REQUIRE_EQUAL(0, ::stat(filename.c_str(), &sb));
+    BOOST_CHECK_EQUAL(9, sb.st_size);
+
+    ::unlink(filename.c_str());
+    ::rmdir(dirname);
+}
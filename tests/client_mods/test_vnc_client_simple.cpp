@@ -127,6 +127,10 @@ BOOST_AUTO_TEST_CASE(TestDecodePacket)
 // set_mod_bpp(bpp=16)
 // ========================================
 
+// Socket VNC Target (3) sending 10 bytes
+ /* 0000 */ "\x03\x01\x00\x00\x00\x00\x04\x00\x03\x00"                         // ..........
+// Dump done VNC Target (3) sending 10 bytes
+// Send done on VNC Target (3)
 // Socket VNC Target (3) sending 10 bytes
  /* 0000 */ "\x03\x01\x00\x00\x00\x00\x04\x00\x03\x00"                         // ..........
 // Dump done VNC Target (3) sending 10 bytes
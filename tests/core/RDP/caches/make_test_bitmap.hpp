@@ -0,0 +1,38 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2015
+ *   Author(s): Christophe Grosjean
+ */
+
+#ifndef REDEMPTION_TESTS_CORE_RDP_CACHES_MAKE_TEST_BITMAP_HPP
+#define REDEMPTION_TESTS_CORE_RDP_CACHES_MAKE_TEST_BITMAP_HPP
+
+#include "bitmap.hpp"
+
+// 16x16 24 bpp bitmap filled with the color <n>, distinct bitmaps for distinct <n>
+inline Bitmap make_test_bitmap(uint32_t n)
+{
+    uint8_t data[16 * 16 * 3];
+    for (size_t i = 0; i < sizeof(data); i += 3) {
+        data[i]     = n;
+        data[i + 1] = n >> 8;
+        data[i + 2] = n >> 16;
+    }
+    return Bitmap(24, 24, nullptr, 16, 16, data, sizeof(data));
+}
+
+#endif
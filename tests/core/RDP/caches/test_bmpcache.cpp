@@ -0,0 +1,131 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2015
+ *   Author(s): Christophe Grosjean
+ */
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBmpCache
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/caches/bmpcache.hpp"
+#include "make_test_bitmap.hpp"
+
+#include <vector>
+
+namespace {
+    uint32_t result(uint8_t status, uint8_t cache_id, uint16_t cache_index) {
+        return (status << 24) | (cache_id << 16) | cache_index;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheLeastRecentlyUsed)
+{
+    BmpCache bmp_cache(BmpCache::Front, 24, 1, false, BmpCache::CacheOption(4, 768, false));
+
+    Bitmap bmp[6] = {
+        make_test_bitmap(0), make_test_bitmap(1), make_test_bitmap(2), make_test_bitmap(3), make_test_bitmap(4), make_test_bitmap(5)
+    };
+
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp[0]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp[1]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp[2]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 3), bmp_cache.cache_bitmap(bmp[3]));
+
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp[0]));
+
+    // 1 is the least recently used
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp[4]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp[1]));
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 3), bmp_cache.cache_bitmap(bmp[3]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp[5]));
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp[4]));
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp[1]));
+
+    bmp_cache.reset();
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp[1]));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp[4]));
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheWaitingList)
+{
+    BmpCache bmp_cache(BmpCache::Front, 24, 1, true, BmpCache::CacheOption(4, 768, true));
+
+    Bitmap bmp0 = make_test_bitmap(0);
+    Bitmap bmp1 = make_test_bitmap(1);
+    Bitmap bmp2 = make_test_bitmap(2);
+
+    // first use goes to waiting list, second one to persistent cache
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, BmpCache::IN_WAIT_LIST, 0), bmp_cache.cache_bitmap(bmp0));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, BmpCache::IN_WAIT_LIST, 1), bmp_cache.cache_bitmap(bmp1));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp1));
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp1));
+
+    // waiting list entry released by bmp1 is reused first
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, BmpCache::IN_WAIT_LIST, 1), bmp_cache.cache_bitmap(bmp2));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp0));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp2));
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 1), bmp_cache.cache_bitmap(bmp0));
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCachePutGet)
+{
+    BmpCache bmp_cache(BmpCache::Recorder, 24, 1, false, BmpCache::CacheOption(4, 768, false));
+
+    Bitmap bmp0 = make_test_bitmap(0);
+    Bitmap bmp1 = make_test_bitmap(1);
+
+    bmp_cache.put(0, 2, bmp0, 0, 0);
+    BOOST_CHECK(bmp_cache.get(0, 2).is_valid());
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp0));
+
+    // overwritten entry is no longer found
+    bmp_cache.put(0, 2, bmp1, 0, 0);
+    BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, 2), bmp_cache.cache_bitmap(bmp1));
+    BOOST_CHECK_EQUAL(result(BmpCache::ADDED_TO_CACHE, 0, 0), bmp_cache.cache_bitmap(bmp0));
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheWorkingSetLargerThanCache)
+{
+    // working set twice as large as the cache, accessed with a skewed distribution
+    const uint16_t entries = 600;
+    BmpCache bmp_cache(BmpCache::Front, 24, 1, false, BmpCache::CacheOption(entries, 768, false));
+
+    std::vector<Bitmap> bitmaps;
+    for (uint32_t i = 0; i < entries * 2u; ++i) {
+        bitmaps.push_back(make_test_bitmap(i));
+    }
+
+    uint32_t rnd = 12345;
+    unsigned found = 0;
+    for (unsigned i = 0; i < 5000; ++i) {
+        rnd = rnd * 1103515245 + 12345;
+        const uint32_t r = (rnd >> 8) % bitmaps.size();
+        const Bitmap & bmp = bitmaps[(rnd & 0x80) ? r / 2 : r];
+        const uint32_t res = bmp_cache.cache_bitmap(bmp);
+        BOOST_CHECK_EQUAL(0, (res >> 16) & 0xff);
+        BOOST_CHECK((res & 0xffff) < entries);
+
+        // the bitmap cached last is found at the same place
+        BOOST_CHECK_EQUAL(result(BmpCache::FOUND_IN_CACHE, 0, res & 0xffff), bmp_cache.cache_bitmap(bmp));
+        found += ((res >> 24) == BmpCache::FOUND_IN_CACHE);
+    }
+    BOOST_CHECK(found > 0);
+}
@@ -0,0 +1,259 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Unit test of the persistent bitmap store shared by the sessions
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBmpCacheStore
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "RDP/caches/bmpcachepersister.hpp"
+#include "RDP/caches/bmpcachestore.hpp"
+#include "RDP/PersistentKeyListPDU.hpp"
+#include "test_transport.hpp"
+#include "make_test_bitmap.hpp"
+
+#include <memory>
+
+static BmpCache * make_bmp_cache(uint8_t bpp, uint32_t verbose)
+{
+    return new BmpCache( BmpCache::Recorder, bpp, 3, false
+                       , BmpCache::CacheOption(120,  nbbytes(bpp) * 16 * 16, false)
+                       , BmpCache::CacheOption(120,  nbbytes(bpp) * 32 * 32, false)
+                       , BmpCache::CacheOption(2553, nbbytes(bpp) * 64 * 64, true)
+                       , BmpCache::CacheOption()
+                       , BmpCache::CacheOption()
+                       , verbose
+                       );
+}
+
+// Appends the bitmaps make_test_bitmap(first) to make_test_bitmap(last - 1).
+static unsigned append_bitmaps(BmpCacheStore & store, uint32_t first, uint32_t last)
+{
+    BmpCache bmp_cache(BmpCache::Recorder, 24, 1, false, BmpCache::CacheOption(16, 16 * 16 * 3, true));
+    for (uint32_t n = first; n < last; n++) {
+        const Bitmap bmp = make_test_bitmap(n);
+        bmp_cache.cache_bitmap(bmp);
+    }
+    return store.append(bmp_cache);
+}
+
+static bool contains_bitmap(const BmpCacheStore & store, uint32_t n)
+{
+    uint8_t sha1[20];
+    make_test_bitmap(n).compute_sha1(sha1);
+    uint8_t sig[8];
+    memcpy(sig, sha1, sizeof(sig));
+    return store.contains(sig);
+}
+
+static size_t file_size(const char * filename)
+{
+    struct stat st;
+    BOOST_REQUIRE_EQUAL(0, ::stat(filename, &st));
+    return st.st_size;
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheStore)
+{
+    uint8_t  bpp     = 8;
+    uint32_t verbose = 1;
+
+    const char * filename = "/tmp/test_bmpcachestore.pbst";
+    ::unlink(filename);
+
+    std::unique_ptr<BmpCache> bmp_cache(make_bmp_cache(bpp, verbose));
+    {
+        #include "fixtures/persistent_disk_bitmap_cache.hpp"
+        GeneratorTransport t(outdata, sizeof(outdata));
+        BmpCachePersister::load_all_from_disk(*bmp_cache, t, "fixtures/persistent_disk_bitmap_cache.hpp", verbose);
+    }
+
+    {
+        BmpCacheStore store(filename, verbose);
+        BOOST_CHECK_EQUAL(0, store.size());
+
+        // a second session opens the same store
+        BmpCacheStore other_store(filename, verbose);
+
+        BOOST_CHECK_EQUAL(3, store.append(*bmp_cache));
+        BOOST_CHECK_EQUAL(3, store.size());
+
+        // already in the store
+        BOOST_CHECK_EQUAL(0, other_store.append(*bmp_cache));
+        BOOST_CHECK_EQUAL(3, other_store.size());
+
+        const uint8_t sig[8] = { 0x6E, 0x89, 0xE8, 0x03, 0xC8, 0x7F, 0x26, 0x5C };
+        BmpCacheStore::Record record;
+        BOOST_REQUIRE(other_store.find(sig, record));
+        const Bitmap & bmp = bmp_cache->get_cache(2)[1].bmp;
+        BOOST_CHECK_EQUAL(8, record.original_bpp);
+        BOOST_CHECK_EQUAL(bmp.cx(), record.cx);
+        BOOST_CHECK_EQUAL(bmp.cy(), record.cy);
+        BOOST_CHECK_EQUAL(bmp.bmp_size(), record.bmp_size);
+        BOOST_CHECK(!memcmp(bmp.data(), record.data, record.bmp_size));
+
+        const uint8_t unknown_sig[8] = { 0xAB, 0xAB, 0xAB, 0xAB, 0xCD, 0xCD, 0xCD, 0xCD };
+        BOOST_CHECK(!other_store.find(unknown_sig, record));
+    }
+
+    // a torn record at the end of the file is ignored
+    {
+        int fd = ::open(filename, O_WRONLY | O_APPEND);
+        BOOST_REQUIRE(fd != -1);
+        const uint8_t torn[] = { 1, 2, 3, 4, 5, 6, 7, 8, 24, 64, 0, 64, 0, 0xFF };
+        BOOST_CHECK_EQUAL(sizeof(torn), ::write(fd, torn, sizeof(torn)));
+        ::close(fd);
+    }
+
+    {
+        BmpCacheStore store(filename, verbose);
+        BOOST_CHECK_EQUAL(3, store.size());
+
+        // the bitmaps of the key list are decoded from the store
+        std::unique_ptr<BmpCache> new_bmp_cache(make_bmp_cache(bpp, verbose));
+        BmpCachePersister bmp_cache_persister(*new_bmp_cache, store, verbose);
+
+        RDP::BitmapCachePersistentListEntry persistent_list[] = {
+            { 0x99E1C40C, 0x17C187AF },
+            { 0x03E8896E, 0x5C267FC8 },
+            { 0xABABABAB, 0xCDCDCDCD },
+            { 0x63D8DC64, 0x0A888EF6 }
+        };
+        uint8_t  cache_id          = 2;
+        uint16_t number_of_entries = sizeof(persistent_list) / sizeof(persistent_list[0]);
+        uint16_t first_entry_index = 0;
+        bmp_cache_persister.process_key_list(cache_id, persistent_list, number_of_entries, first_entry_index);
+
+        BmpCache::cache_ const & cache = new_bmp_cache->get_cache(cache_id);
+        BOOST_CHECK((cache[0].sig.sig_32[0] == 0x99E1C40C) && (cache[0].sig.sig_32[1] == 0x17C187AF));
+        BOOST_CHECK((cache[1].sig.sig_32[0] == 0x03E8896E) && (cache[1].sig.sig_32[1] == 0x5C267FC8));
+        BOOST_CHECK(!cache[2]);
+        BOOST_CHECK((cache[3].sig.sig_32[0] == 0x63D8DC64) && (cache[3].sig.sig_32[1] == 0x0A888EF6));
+        BOOST_CHECK(!cache[4]);
+
+        BOOST_CHECK_EQUAL(cache[1].bmp.bmp_size(), bmp_cache->get_cache(cache_id)[1].bmp.bmp_size());
+        BOOST_CHECK(!memcmp( cache[1].bmp.data(), bmp_cache->get_cache(cache_id)[1].bmp.data()
+                           , cache[1].bmp.bmp_size()));
+
+        // nothing new to append, the torn record is left to the next writer
+        BOOST_CHECK_EQUAL(0, store.append(*new_bmp_cache));
+    }
+
+    ::unlink(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheStoreKeyList)
+{
+    uint8_t  bpp     = 8;
+    uint32_t verbose = 1;
+
+    const char * filename = "/tmp/test_bmpcachestore_key_list.pbst";
+    ::unlink(filename);
+
+    std::unique_ptr<BmpCache> bmp_cache(make_bmp_cache(bpp, verbose));
+    {
+        #include "fixtures/persistent_disk_bitmap_cache.hpp"
+        GeneratorTransport t(outdata, sizeof(outdata));
+        BmpCachePersister::load_all_from_disk(*bmp_cache, t, "fixtures/persistent_disk_bitmap_cache.hpp", verbose);
+    }
+
+    BmpCacheStore store(filename, verbose);
+
+    // the file only gets the signatures, in cache order
+    MemoryTransport t;
+    BmpCachePersister::save_all_to_disk(*bmp_cache, store, t, verbose);
+    BOOST_CHECK_EQUAL(3, store.size());
+    // magic(4) + version(1) + 3 * bitmap_count(2) + 3 * sig(8)
+    BOOST_CHECK_EQUAL(35, t.out_stream.get_offset());
+
+    std::unique_ptr<BmpCache> new_bmp_cache(make_bmp_cache(bpp, verbose));
+    BmpCachePersister::load_all_from_disk(*new_bmp_cache, store, t, "memory", verbose);
+
+    uint8_t cache_id = 2;
+    BmpCache::cache_ const & cache = new_bmp_cache->get_cache(cache_id);
+    BOOST_CHECK((cache[0].sig.sig_32[0] == 0x99E1C40C) && (cache[0].sig.sig_32[1] == 0x17C187AF));
+    BOOST_CHECK((cache[1].sig.sig_32[0] == 0x03E8896E) && (cache[1].sig.sig_32[1] == 0x5C267FC8));
+    BOOST_CHECK((cache[2].sig.sig_32[0] == 0x63D8DC64) && (cache[2].sig.sig_32[1] == 0x0A888EF6));
+    BOOST_CHECK(!cache[3]);
+    BOOST_CHECK(!memcmp( cache[2].bmp.data(), bmp_cache->get_cache(cache_id)[2].bmp.data()
+                       , cache[2].bmp.bmp_size()));
+
+    // a signature list can not be read without its store
+    MemoryTransport t2;
+    BmpCachePersister::save_all_to_disk(*bmp_cache, store, t2, verbose);
+    std::unique_ptr<BmpCache> bmp_cache_without_store(make_bmp_cache(bpp, verbose));
+    BOOST_CHECK_THROW( BmpCachePersister::load_all_from_disk(*bmp_cache_without_store, t2, "memory", verbose)
+                     , Error);
+
+    ::unlink(filename);
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCacheStoreCompaction)
+{
+    const char * filename = "/tmp/test_bmpcachestore_compaction.pbst";
+    ::unlink(filename);
+
+    // sig(8) + original_bpp(1) + cx(2) + cy(2) + bmp_size(2) + data(768)
+    const size_t record_size   = 15 + 16 * 16 * 3;
+    const size_t max_file_size = 8 + 10 * record_size;
+
+    BmpCacheStore store(filename, 0, max_file_size);
+
+    BOOST_CHECK_EQUAL(6, append_bitmaps(store, 0, 6));
+    BOOST_CHECK_EQUAL(4, append_bitmaps(store, 4, 10));
+    BOOST_CHECK_EQUAL(max_file_size, file_size(filename));
+
+    BmpCacheStore other_store(filename, 0, max_file_size);
+    BOOST_CHECK_EQUAL(10, other_store.size());
+
+    // full: the most recent records fitting in half of the maximum size are
+    //  kept with the new ones
+    BOOST_CHECK_EQUAL(2, append_bitmaps(store, 10, 12));
+    BOOST_CHECK_EQUAL(8 + 4 * record_size, file_size(filename));
+    BOOST_CHECK_EQUAL(4, store.size());
+    for (uint32_t n = 0; n < 8; n++) {
+        BOOST_CHECK(!contains_bitmap(store, n));
+    }
+    for (uint32_t n = 8; n < 12; n++) {
+        BOOST_CHECK(contains_bitmap(store, n));
+    }
+
+    // a session still reads the file it mapped...
+    BOOST_CHECK(contains_bitmap(other_store, 0));
+    BOOST_CHECK(!contains_bitmap(other_store, 10));
+
+    // ... and appends to the new one
+    BOOST_CHECK_EQUAL(2, append_bitmaps(other_store, 0, 2));
+    BOOST_CHECK_EQUAL(8 + 6 * record_size, file_size(filename));
+    BOOST_CHECK_EQUAL(6, other_store.size());
+    BOOST_CHECK(contains_bitmap(other_store, 10));
+
+    BmpCacheStore new_store(filename, 0, max_file_size);
+    BOOST_CHECK_EQUAL(6, new_store.size());
+    BOOST_CHECK(contains_bitmap(new_store, 0));
+    BOOST_CHECK(contains_bitmap(new_store, 11));
+
+    ::unlink(filename);
+}
@@ -21,12 +21,38 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestGlyphCache
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 
+#include "RDP/caches/glyphcache.hpp"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+BOOST_AUTO_TEST_CASE(TestGlyphSpans)
 {
+    // 10 pixels wide, 2 bytes by row
+    FontChar fc(0, -3, 10, 3, 11);
+    const uint8_t data[] = {
+        0xF0, 0x40,     // XXXX.....X
+        0x00, 0x00,     // ..........
+        0x81, 0xC0,     // X......XXX
+    };
+    memcpy(fc.data.get(), data, sizeof(data));
+
+    GlyphCache gly_cache;
+    int cacheidx = -1;
+    BOOST_CHECK_EQUAL(GlyphCache::GLYPH_ADDED_TO_CACHE, gly_cache.add_glyph(fc, 2, cacheidx));
+    BOOST_CHECK_EQUAL(0, cacheidx);
+
+    std::vector<GlyphSpan> const & spans = gly_cache.glyphs[2][0].spans;
+    BOOST_REQUIRE_EQUAL(4, spans.size());
+    BOOST_CHECK_EQUAL(0, spans[0].x); BOOST_CHECK_EQUAL(0, spans[0].y); BOOST_CHECK_EQUAL(4, spans[0].cx);
+    BOOST_CHECK_EQUAL(9, spans[1].x); BOOST_CHECK_EQUAL(0, spans[1].y); BOOST_CHECK_EQUAL(1, spans[1].cx);
+    BOOST_CHECK_EQUAL(0, spans[2].x); BOOST_CHECK_EQUAL(2, spans[2].y); BOOST_CHECK_EQUAL(1, spans[2].cx);
+    BOOST_CHECK_EQUAL(7, spans[3].x); BOOST_CHECK_EQUAL(2, spans[3].y); BOOST_CHECK_EQUAL(3, spans[3].cx);
+
+    // the spans follow the glyph
+    FontChar empty(0, 0, 3, 1, 3);
+    gly_cache.set_glyph(std::move(empty), 2, 0);
+    BOOST_CHECK_EQUAL(0, gly_cache.glyphs[2][0].spans.size());
 }
@@ -81,6 +81,21 @@ inline void process_glyphcache(GlyphCache & gly_cache, Stream & stream) {
     }
 }
 
+// cache 7: 6 glyphs
+static uint8_t glyph_cache_data[] = {
+/* 0000 */ 0x07, 0x06, 0x00, 0x00, 0x00, 0x00, 0xf8, 0xff, 0x07, 0x00, 0x08, 0x00, 0xf8, 0xcc, 0xc6, 0xc6,  // ................
+/* 0010 */ 0xc6, 0xc6, 0xcc, 0xf8, 0x01, 0x00, 0x00, 0x00, 0xf7, 0xff, 0x06, 0x00, 0x09, 0x00, 0x18, 0x30,  // ...............0
+/* 0020 */ 0x00, 0x78, 0xcc, 0xfc, 0xc0, 0xc0, 0x7c, 0x02, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0xfa, 0xff,  // .x....|.........
+/* 0030 */ 0x0a, 0x00, 0x06, 0x00, 0xfb, 0x80, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0,  // ................
+/* 0040 */ 0x03, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x06, 0x00, 0x06, 0x00, 0x78, 0x0c, 0x7c, 0xcc, 0xcc, 0x7c,  // ..........x.|..|
+/* 0050 */ 0x18, 0x00, 0x04, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x04, 0x00, 0x06, 0x00, 0xd0, 0xf0, 0xc0, 0xc0,  // ................
+/* 0060 */ 0xc0, 0xc0, 0x18, 0x00, 0x05, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x06, 0x00, 0x06, 0x00, 0x78, 0xcc,  // ..............x.
+/* 0070 */ 0xfc, 0xc0, 0xc0, 0x7c, 0x18, 0x00, 0x09, 0x1b, 0xeb, 0x03, 0x38, 0x07, 0x03, 0x01, 0xd4, 0xd0,  // ...|......8.....
+/* 0080 */ 0xc8, 0x16, 0x00, 0xea, 0x02, 0x4d, 0x00, 0xf7, 0x02, 0x16, 0x00, 0xf5, 0x02, 0x13, 0x00, 0x00,  // .....M..........
+/* 0090 */ 0x01, 0x08, 0x02, 0x07, 0x03, 0x0b, 0x04, 0x07, 0x04, 0x05, 0x05, 0x05, 0x04, 0x07, 0xff, 0x00,  // ................
+/* 00a0 */ 0x10,                                               // .
+};
+
 BOOST_AUTO_TEST_CASE(TestDrawGlyphIndex)
 {
     uint16_t width = 1024;
@@ -93,19 +108,6 @@ BOOST_AUTO_TEST_CASE(TestDrawGlyphIndex)
     GlyphCache gly_cache;
 
     {
-        uint8_t glyph_cache_data[] = {
-/* 0000 */ 0x07, 0x06, 0x00, 0x00, 0x00, 0x00, 0xf8, 0xff, 0x07, 0x00, 0x08, 0x00, 0xf8, 0xcc, 0xc6, 0xc6,  // ................
-/* 0010 */ 0xc6, 0xc6, 0xcc, 0xf8, 0x01, 0x00, 0x00, 0x00, 0xf7, 0xff, 0x06, 0x00, 0x09, 0x00, 0x18, 0x30,  // ...............0
-/* 0020 */ 0x00, 0x78, 0xcc, 0xfc, 0xc0, 0xc0, 0x7c, 0x02, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0xfa, 0xff,  // .x....|.........
-/* 0030 */ 0x0a, 0x00, 0x06, 0x00, 0xfb, 0x80, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0, 0xcc, 0xc0,  // ................
-/* 0040 */ 0x03, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x06, 0x00, 0x06, 0x00, 0x78, 0x0c, 0x7c, 0xcc, 0xcc, 0x7c,  // ..........x.|..|
-/* 0050 */ 0x18, 0x00, 0x04, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x04, 0x00, 0x06, 0x00, 0xd0, 0xf0, 0xc0, 0xc0,  // ................
-/* 0060 */ 0xc0, 0xc0, 0x18, 0x00, 0x05, 0x00, 0x00, 0x00, 0xfa, 0xff, 0x06, 0x00, 0x06, 0x00, 0x78, 0xcc,  // ..............x.
-/* 0070 */ 0xfc, 0xc0, 0xc0, 0x7c, 0x18, 0x00, 0x09, 0x1b, 0xeb, 0x03, 0x38, 0x07, 0x03, 0x01, 0xd4, 0xd0,  // ...|......8.....
-/* 0080 */ 0xc8, 0x16, 0x00, 0xea, 0x02, 0x4d, 0x00, 0xf7, 0x02, 0x16, 0x00, 0xf5, 0x02, 0x13, 0x00, 0x00,  // .....M..........
-/* 0090 */ 0x01, 0x08, 0x02, 0x07, 0x03, 0x0b, 0x04, 0x07, 0x04, 0x05, 0x05, 0x05, 0x04, 0x07, 0xff, 0x00,  // ................
-/* 00a0 */ 0x10,                                               // .
-        };
         StaticStream stream(glyph_cache_data, sizeof(glyph_cache_data));
         process_glyphcache(gly_cache, stream);
 
@@ -165,3 +167,57 @@ BOOST_AUTO_TEST_CASE(TestDrawGlyphIndex)
     // uncomment to see result in png file
     //dump_png("test_glyph_000_", gd.impl());
 }
+
+BOOST_AUTO_TEST_CASE(TestDrawGlyphIndexFragment)
+{
+    uint16_t width = 1024;
+    uint16_t height = 768;
+    Rect screen_rect(0, 0, width, height);
+    RDPDrawable gd(width, height, 24);
+
+    GlyphCache gly_cache;
+    StaticStream stream(glyph_cache_data, sizeof(glyph_cache_data));
+    process_glyphcache(gly_cache, stream);
+
+    Rect rect_bk(22, 746, 56, 14);
+    Rect rect_op(0, 0, 1, 1);
+
+    // the glyphs are drawn and kept in the fragment 0 (ADD)
+    gd.draw(RDPGlyphIndex(7, 3, 0, 1, 0x000000, 0xc8d0d4, rect_bk, rect_op, RDPBrush(), 22, 757, 19,
+                          byte_ptr_cast("\x00\x00\x01\x08\x02\x07\x03\x0b\x04\x07"
+                                        "\x04\x05\x05\x05\x04\x07\xff\x00\x10")),
+            screen_rect, &gly_cache);
+
+    // then drawn again from the fragment (USE)
+    gd.draw(RDPOpaqueRect(screen_rect, BLACK), screen_rect);
+    gd.draw(RDPGlyphIndex(7, 3, 0, 1, 0x000000, 0xc8d0d4, rect_bk, rect_op, RDPBrush(), 22, 757, 3,
+                          byte_ptr_cast("\xfe\x00\x00")),
+            screen_rect, &gly_cache);
+
+    char message[1024];
+    if (!check_sig(gd, message,
+                   "\xd8\xf7\x6e\xf5\xd1\xe6\x4a\x05\x56\x0a"
+                   "\x21\x42\xa4\x27\x73\x5a\xce\x67\xf6\xb3"
+                   )){
+        BOOST_CHECK_MESSAGE(false, message);
+    }
+
+    // the glyphs are clipped
+    const std::vector<uint8_t> unclipped(gd.data(), gd.data() + gd.rowsize() * height);
+    gd.draw(RDPOpaqueRect(screen_rect, BLACK), screen_rect);
+    const Rect clip(30, 750, 20, 5);
+    gd.draw(RDPGlyphIndex(7, 3, 0, 1, 0x000000, 0xc8d0d4, rect_bk, rect_op, RDPBrush(), 22, 757, 3,
+                          byte_ptr_cast("\xfe\x00\x00")),
+            clip, &gly_cache);
+    for (int y = 0; y < height; y++) {
+        const uint8_t * row = gd.data() + y * gd.rowsize();
+        const uint8_t * unclipped_row = unclipped.data() + y * gd.rowsize();
+        for (int x = 0; x < width; x++) {
+            const uint8_t black[3] = {};
+            if (memcmp(row + x * 3, clip.contains_pt(x, y) ? unclipped_row + x * 3 : black, 3)) {
+                BOOST_CHECK_MESSAGE(false, "bad pixel at " << x << "," << y);
+                return;
+            }
+        }
+    }
+}
@@ -198,3 +198,109 @@ BOOST_AUTO_TEST_CASE(TestHashTableManager)
         hash_tab_mgr.update_indirect(data + i, offset);
     BOOST_CHECK_EQUAL(false, hash_tab_mgr.undo_last_changes());
 }
+
+BOOST_AUTO_TEST_CASE(TestHashChainManager)
+{
+    typedef uint16_t                                        offset_type;
+    typedef rdp_mppc_enc_hash_chain_manager<offset_type, 4> hash_chain_manager;
+
+    hash_chain_manager hash_chain_mgr(3, 0);
+    hash_chain_mgr.reset();
+
+    //                 0         1
+    //                 0123456789012345
+    uint8_t data[] = "abcdeXabcdYabcde";
+
+    offset_type match_offset = 0;
+    for (offset_type offset = 0; offset < 6; offset++) {
+        BOOST_CHECK_EQUAL(0, hash_chain_mgr.find_match(data, offset, 3, match_offset));
+    }
+    hash_chain_mgr.clear_undo_history();
+
+    BOOST_CHECK_EQUAL(4, hash_chain_mgr.find_match(data, 6, 5, match_offset));
+    BOOST_CHECK_EQUAL(0, match_offset);
+    BOOST_CHECK_EQUAL(0, hash_chain_mgr.find_match(data, 10, 3, match_offset));
+
+    // the longest of the candidates is kept, not the last one inserted
+    BOOST_CHECK_EQUAL(5, hash_chain_mgr.find_match(data, 11, 5, match_offset));
+    BOOST_CHECK_EQUAL(0, match_offset);
+
+    // the offsets added since clear_undo_history() are removed, otherwise
+    //  the head of the chain (offset 11) would be after offset 6
+    BOOST_CHECK_EQUAL(true, hash_chain_mgr.undo_last_changes());
+    BOOST_CHECK_EQUAL(4, hash_chain_mgr.find_match(data, 6, 5, match_offset));
+    BOOST_CHECK_EQUAL(0, match_offset);
+
+    BOOST_CHECK_EQUAL(4, hash_chain_manager::match_length(data, data + 6, 5));
+    BOOST_CHECK_EQUAL(5, hash_chain_manager::match_length(data, data + 11, 5));
+    BOOST_CHECK_EQUAL(16, hash_chain_manager::match_length(data, data, 16));
+}
+
+BOOST_AUTO_TEST_CASE(TestHashChainManagerUndoUnsignedOffset)
+{
+    typedef uint16_t                                        offset_type;
+    typedef rdp_mppc_enc_hash_chain_manager<offset_type, 4> hash_chain_manager;
+
+    hash_chain_manager hash_chain_mgr(3, 0);
+    hash_chain_mgr.reset();
+
+    //                 0         1
+    //                 01234567890123
+    uint8_t data[] = "QxyzabcxabcxyzQ";
+
+    offset_type match_offset = 0;
+    for (offset_type offset = 0; offset < 8; offset++) {
+        BOOST_CHECK_EQUAL(0, hash_chain_mgr.find_match(data, offset, 3, match_offset));
+    }
+    hash_chain_mgr.clear_undo_history();
+
+    // offset 11 ("xyz", same bucket as offset 1) is the last offset of the
+    //  match and is not signed
+    BOOST_CHECK_EQUAL(4, hash_chain_mgr.find_match(data, 8, 4, match_offset));
+    BOOST_CHECK_EQUAL(4, match_offset);
+    BOOST_CHECK_EQUAL(0, hash_chain_mgr.find_match(data, 12, 3, match_offset));
+
+    // undoing does not touch the bucket of offset 11, offset 1 is still found
+    BOOST_CHECK_EQUAL(true, hash_chain_mgr.undo_last_changes());
+    BOOST_CHECK_EQUAL(3, hash_chain_mgr.find_match(data, 11, 3, match_offset));
+    BOOST_CHECK_EQUAL(1, match_offset);
+}
+
+template<class Encoder>
+void test_mppc_roundtrip(const uint8_t * data, size_t data_len)
+{
+    Encoder              enc;
+    rdp_mppc_unified_dec dec;
+
+    // several packets, the later ones use the history of the first ones
+    for (size_t offset = 0; offset < data_len; offset += 4000) {
+        const size_t len = std::min<size_t>(4000, data_len - offset);
+
+        uint8_t  compressionFlags;
+        uint16_t datalen;
+        enc.compress(data + offset, len, compressionFlags, datalen,
+            rdp_mppc_enc::MAX_COMPRESSED_DATA_SIZE_UNUSED);
+        BOOST_REQUIRE(0 != (compressionFlags & PACKET_COMPRESSED));
+
+        BStream compressed(65536);
+        enc.get_compressed_data(compressed);
+
+        const uint8_t * rdata;
+        uint32_t        rlen;
+        BOOST_REQUIRE_EQUAL(true, dec.decompress(compressed.get_data(), compressed.get_offset(),
+            compressionFlags, rdata, rlen));
+        BOOST_REQUIRE_EQUAL(len, rlen);
+        BOOST_CHECK_EQUAL(0, memcmp(data + offset, rdata, rlen));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestHashChainEncoders)
+{
+    // Load decompressed_rd5_data
+    #include "../../fixtures/test_mppc_TestMPPC_enc.hpp"
+
+    test_mppc_roundtrip<rdp_mppc_40_enc_hash_chain<4>>(decompressed_rd5_data, sizeof(decompressed_rd5_data));
+    test_mppc_roundtrip<rdp_mppc_50_enc_hash_chain<16>>(decompressed_rd5_data, sizeof(decompressed_rd5_data));
+    test_mppc_roundtrip<rdp_mppc_60_enc_hash_chain<16>>(decompressed_rd5_data, sizeof(decompressed_rd5_data));
+    test_mppc_roundtrip<rdp_mppc_61_enc_hash_chain<64>>(decompressed_rd5_data, sizeof(decompressed_rd5_data));
+}
@@ -116,6 +116,12 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
 
     BOOST_CHECK_EQUAL(0,                                ini.video.wrm_color_depth_selection_strategy);
     BOOST_CHECK_EQUAL(0,                                ini.video.wrm_compression_algorithm);
+    BOOST_CHECK_EQUAL(2,                                ini.video.wrm_encryption_version);
+    BOOST_CHECK_EQUAL(64,                               ini.video.wrm_encryption_block_size);
+    BOOST_CHECK_EQUAL(0,                                ini.video.capture_queue_size);
+    BOOST_CHECK_EQUAL(24,                               ini.video.drawable_color_depth);
+    BOOST_CHECK_EQUAL(6,                                ini.video.png_compression_level);
+    BOOST_CHECK_EQUAL(0,                                ini.video.png_filter);
 
     BOOST_CHECK_EQUAL(900,                              ini.globals.session_timeout);
     BOOST_CHECK_EQUAL(30,                               ini.globals.keepalive_grace_delay);
@@ -180,6 +186,7 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -212,6 +219,7 @@ BOOST_AUTO_TEST_CASE(TestConfigFromFile)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL("",                               ini.context.movie.c_str());
 
@@ -444,6 +452,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefaultEmpty)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -482,6 +491,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefaultEmpty)
     BOOST_CHECK_EQUAL("15",                             ini.context_get_value(AUTHID_OPT_QSCALE));
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(false,                            ini.context_is_asked(AUTHID_OPT_BPP));
     BOOST_CHECK_EQUAL(false,                            ini.context_is_asked(AUTHID_OPT_HEIGHT));
@@ -721,6 +731,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -753,6 +764,7 @@ BOOST_AUTO_TEST_CASE(TestConfigDefault)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -992,6 +1004,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(1,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(true,                             ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(true,                             ini.client.persistent_disk_bitmap_cache);
@@ -1024,6 +1037,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -1083,6 +1097,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
                           "proxy_managed_drives=*docs\n"
                           "[mod_replay]\n"
                           "on_end_of_data=1\n"
+                          "speed=4\n"
                           "[video]\n"
                           "hash_path=/mnt/wab/hash/\n"
                           "record_path=/mnt/wab/recorded/rdp/\n"
@@ -1239,6 +1254,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(8,                                ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -1267,6 +1283,7 @@ BOOST_AUTO_TEST_CASE(TestConfig1bis)
     BOOST_CHECK_EQUAL(1,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(1,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(4,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -1304,6 +1321,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
                           "cache_waiting_list=no\n"
                           "persist_bitmap_cache_on_disk=no\n"
                           "bitmap_compression=false\n"
+                          "rdp_compression_effort=2\n"
                           "[mod_rdp]\n"
                           "rdp_compression=0\n"
                           "bogus_sc_net_size=yes\n"
@@ -1314,6 +1332,12 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
                           "disable_keyboard_log=4\n"
                           "wrm_color_depth_selection_strategy=1\n"
                           "wrm_compression_algorithm=1\n"
+                          "wrm_encryption_version=1\n"
+                          "wrm_encryption_block_size=256\n"
+                          "capture_queue_size=512\n"
+                          "drawable_color_depth=32\n"
+                          "png_compression_level=1\n"
+                          "png_filter=3\n"
                           "\n"
                           );
 
@@ -1398,6 +1422,12 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
 
     BOOST_CHECK_EQUAL(1,                                ini.video.wrm_color_depth_selection_strategy);
     BOOST_CHECK_EQUAL(1,                                ini.video.wrm_compression_algorithm);
+    BOOST_CHECK_EQUAL(1,                                ini.video.wrm_encryption_version);
+    BOOST_CHECK_EQUAL(256,                              ini.video.wrm_encryption_block_size);
+    BOOST_CHECK_EQUAL(512,                              ini.video.capture_queue_size);
+    BOOST_CHECK_EQUAL(32,                               ini.video.drawable_color_depth);
+    BOOST_CHECK_EQUAL(1,                                ini.video.png_compression_level);
+    BOOST_CHECK_EQUAL(3,                                ini.video.png_filter);
 
     BOOST_CHECK_EQUAL(900,                              ini.globals.session_timeout);
     BOOST_CHECK_EQUAL(30,                               ini.globals.keepalive_grace_delay);
@@ -1452,6 +1482,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(2,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(true,                             ini.client.persistent_disk_bitmap_cache);
@@ -1482,6 +1513,7 @@ BOOST_AUTO_TEST_CASE(TestConfig2)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -1674,6 +1706,7 @@ BOOST_AUTO_TEST_CASE(TestConfig3)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(true,                             ini.client.persistent_disk_bitmap_cache);
@@ -1704,6 +1737,7 @@ BOOST_AUTO_TEST_CASE(TestConfig3)
     BOOST_CHECK_EQUAL(2,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -1870,6 +1904,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -1900,6 +1935,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -2066,6 +2102,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -2096,6 +2133,7 @@ BOOST_AUTO_TEST_CASE(TestMultiple)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -2249,6 +2287,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -2279,6 +2318,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
@@ -2432,6 +2472,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(false,                            ini.client.bogus_neg_request);
     BOOST_CHECK_EQUAL(true,                             ini.client.bogus_user_id);
     BOOST_CHECK_EQUAL(4,                                ini.client.rdp_compression);
+    BOOST_CHECK_EQUAL(0,                                ini.client.rdp_compression_effort);
     BOOST_CHECK_EQUAL(false,                            ini.client.disable_tsk_switch_shortcuts.get());
     BOOST_CHECK_EQUAL(24,                               ini.client.max_color_depth);
     BOOST_CHECK_EQUAL(false,                            ini.client.persistent_disk_bitmap_cache);
@@ -2462,6 +2503,7 @@ BOOST_AUTO_TEST_CASE(TestNewConf)
     BOOST_CHECK_EQUAL(0,                                ini.mod_vnc.bogus_clipboard_infinite_loop.get());
 
     BOOST_CHECK_EQUAL(0,                                ini.mod_replay.on_end_of_data);
+    BOOST_CHECK_EQUAL(1,                                ini.mod_replay.speed);
 
     BOOST_CHECK_EQUAL(40000,                            ini.context.opt_bitrate.get());
     BOOST_CHECK_EQUAL(5,                                ini.context.opt_framerate.get());
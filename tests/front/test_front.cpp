@@ -21,12 +21,168 @@
 
 #define BOOST_AUTO_TEST_MAIN
 #define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE TestXXX
+#define BOOST_TEST_MODULE TestFront
 #include <boost/test/auto_unit_test.hpp>
 
 #define LOGNULL
 
+#undef SHARE_PATH
+#define SHARE_PATH "./tests/fixtures"
 
-BOOST_AUTO_TEST_CASE(TestXXX)
+#undef DEFAULT_FONT_NAME
+#define DEFAULT_FONT_NAME "sans-10.fv1"
+
+#include "font.hpp"
+#include "null/null.hpp"
+#include "test_transport.hpp"
+#include "config.hpp"
+#include "front.hpp"
+
+#include <string>
+
+// Replays the client side of a recorded connection and keeps what the front sends.
+class RecordFrontTransport : public Transport
 {
+    GeneratorTransport gen;
+
+public:
+    std::string sent;
+
+    RecordFrontTransport(const char * indata, size_t inlen)
+    : gen(indata, inlen)
+    {}
+
+private:
+    virtual void do_recv(char ** pbuffer, size_t len) override {
+        this->gen.recv(pbuffer, len);
+    }
+
+    virtual void do_send(const char * const buffer, size_t len) override {
+        this->sent.append(buffer, len);
+    }
+};
+
+static bool contains(const std::string & sent, const uint8_t * data, size_t size) {
+    return sent.find(std::string(reinterpret_cast<const char *>(data), size)) != std::string::npos;
+}
+
+BOOST_AUTO_TEST_CASE(TestFrontBitmapUpdatePassThrough)
+{
+    Inifile ini;
+
+    LCGRandom gen(0);
+
+    #include "fixtures/trace_mstsc_client.hpp"
+
+    RecordFrontTransport front_trans(indata, sizeof(indata));
+
+    // TLS is left to the transport, the RDP layer is not encrypted
+    ini.client.tls_support         = true;
+    ini.client.tls_fallback_legacy = false;
+    ini.client.bogus_user_id       = false;
+    ini.client.rdp_compression     = 0;
+
+    const bool fastpath_support = true;
+    const bool mem3blt_support  = false;
+    Front front( front_trans, gen, ini
+               , fastpath_support, mem3blt_support);
+    null_mod no_mod(front);
+
+    while (front.up_and_running == 0) {
+        front.incoming(no_mod);
+    }
+    BOOST_CHECK_EQUAL(1, front.up_and_running);
+    // the orders sent at the end of the connection sequence
+    front.flush();
+
+    const uint8_t bpp = front.client_info.bpp;
+
+    // a server bitmap of the client color depth, compressed with the codec of the client
+    const uint16_t cx = 64;
+    const uint16_t cy = 32;
+    uint8_t raw[cx * cy * 4];
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        raw[i] = (i / 7) * 13 + (i % 3);
+    }
+    const Bitmap bmp(bpp, bpp, nullptr, cx, cy, raw, cx * cy * nbbytes(bpp));
+    BStream compressed(65536);
+    bmp.compress(bpp, compressed);
+    compressed.mark_end();
+
+    // The same pixels as the server may send them: only color image runs of 16
+    //  pixels, which the encoder of the proxy never produces.
+    BStream server_compressed(65536);
+    for (size_t i = 0; i < cx * cy * nbbytes(bpp); i += 16 * nbbytes(bpp)) {
+        server_compressed.out_uint8(0x80 | 16);
+        server_compressed.out_copy_bytes(raw + i, 16 * nbbytes(bpp));
+    }
+    server_compressed.mark_end();
+    BOOST_CHECK(!contains(std::string(reinterpret_cast<const char *>(server_compressed.get_data()),
+                                      server_compressed.size()),
+                          compressed.get_data(), compressed.size()));
+
+    RDPBitmapData bitmap_data;
+    bitmap_data.dest_left      = 10;
+    bitmap_data.dest_top       = 20;
+    bitmap_data.dest_right     = 10 + cx - 1;
+    bitmap_data.dest_bottom    = 20 + cy - 1;
+    bitmap_data.width          = cx;
+    bitmap_data.height         = cy;
+    bitmap_data.bits_per_pixel = bpp;
+    bitmap_data.flags          = BITMAP_COMPRESSION | NO_BITMAP_COMPRESSION_HDR;
+    bitmap_data.bitmap_length  = server_compressed.size();
+
+    BStream header(64);
+    bitmap_data.emit(header);
+    header.mark_end();
+
+    // same codecs: forwarded byte-for-byte
+    {
+        front_trans.sent.clear();
+        BOOST_CHECK(front.forward_bitmap_update(bitmap_data, server_compressed.get_data(),
+                                                server_compressed.size()));
+        front.flush();
+
+        std::string expected(reinterpret_cast<const char *>(header.get_data()), header.size());
+        expected.append(reinterpret_cast<const char *>(server_compressed.get_data()),
+                        server_compressed.size());
+        BOOST_CHECK(front_trans.sent.find(expected) != std::string::npos);
+    }
+
+    // same codecs, drawn after decoding (OSD displayed): still sent as is
+    {
+        front_trans.sent.clear();
+        front.draw(bitmap_data, server_compressed.get_data(), server_compressed.size(), bmp);
+        front.flush();
+        BOOST_CHECK(contains(front_trans.sent, server_compressed.get_data(), server_compressed.size()));
+    }
+
+    // not compressed: the front needs the decoded bitmap and transcodes it
+    {
+        RDPBitmapData raw_bitmap_data = bitmap_data;
+        raw_bitmap_data.flags         = 0;
+        raw_bitmap_data.bitmap_length = cx * cy * nbbytes(bpp);
+
+        front_trans.sent.clear();
+        BOOST_CHECK(!front.forward_bitmap_update(raw_bitmap_data, raw, raw_bitmap_data.bitmap_length));
+        front.flush();
+        BOOST_CHECK(front_trans.sent.empty());
+
+        front.draw(raw_bitmap_data, raw, raw_bitmap_data.bitmap_length, bmp);
+        front.flush();
+        BOOST_CHECK(contains(front_trans.sent, compressed.get_data(), compressed.size()));
+        BOOST_CHECK(!contains(front_trans.sent, raw, raw_bitmap_data.bitmap_length));
+    }
+
+    // other color depth: refused, drawn from the decoded bitmap
+    {
+        RDPBitmapData other_bitmap_data = bitmap_data;
+        other_bitmap_data.bits_per_pixel = (bpp == 8) ? 16 : 8;
+
+        front_trans.sent.clear();
+        BOOST_CHECK(!front.forward_bitmap_update(other_bitmap_data, server_compressed.get_data(),
+                                                 server_compressed.size()));
+        front.flush();
+        BOOST_CHECK(front_trans.sent.empty());
+    }
 }
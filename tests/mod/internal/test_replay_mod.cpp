@@ -26,7 +26,120 @@
 
 #define LOGNULL
 
+#include "internal/replay_pacer.hpp"
+#include "internal/replay_mod.hpp"
+#include "../../front/fake_front.hpp"
 
 BOOST_AUTO_TEST_CASE(TestXXX)
 {
 }
+
+BOOST_AUTO_TEST_CASE(TestReplayPacer)
+{
+    ReplayPacer pacer(1);
+    BOOST_CHECK(!pacer.is_started());
+    BOOST_CHECK_EQUAL(1u, pacer.speed());
+
+    // record time 1000 s played at the wall clock time 50 s
+    pacer.restart(1000000000, 50000000);
+    BOOST_CHECK(pacer.is_started());
+    BOOST_CHECK_EQUAL(50000000u, pacer.due(1000000000));
+    BOOST_CHECK_EQUAL(52500000u, pacer.due(1002500000));
+    BOOST_CHECK_EQUAL(50000000u, pacer.due(999000000));
+    BOOST_CHECK_EQUAL(1002500000u, pacer.record_time_at(52500000));
+    BOOST_CHECK_EQUAL(1000000000u, pacer.record_time_at(40000000));
+
+    BOOST_CHECK_EQUAL(0u, pacer.lateness(1002500000, 52000000));
+    BOOST_CHECK_EQUAL(500000u, pacer.lateness(1002500000, 53000000));
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayPacerSpeed)
+{
+    BOOST_CHECK_EQUAL(1u, ReplayPacer(0).speed());
+    BOOST_CHECK_EQUAL(32u, ReplayPacer(100).speed());
+
+    ReplayPacer pacer(4);
+    pacer.restart(1000000000, 50000000);
+    BOOST_CHECK_EQUAL(50500000u, pacer.due(1002000000));
+
+    // the record time reached is kept, 1 s at x4 then x8
+    pacer.set_speed(8, 51000000);
+    BOOST_CHECK_EQUAL(8u, pacer.speed());
+    BOOST_CHECK_EQUAL(1004000000u, pacer.record_time_at(51000000));
+    BOOST_CHECK_EQUAL(51500000u, pacer.due(1008000000));
+
+    pacer.set_speed(64, 52000000);
+    BOOST_CHECK_EQUAL(32u, pacer.speed());
+    BOOST_CHECK_EQUAL(1012000000u, pacer.record_time_at(52000000));
+
+    pacer.set_speed(0, 52000000);
+    BOOST_CHECK_EQUAL(1u, pacer.speed());
+    BOOST_CHECK_EQUAL(54000000u, pacer.due(1014000000));
+
+    // not started: only the speed changes
+    pacer.stop();
+    pacer.set_speed(2, 60000000);
+    BOOST_CHECK(!pacer.is_started());
+    pacer.restart(2000000000, 70000000);
+    BOOST_CHECK_EQUAL(71000000u, pacer.due(2002000000));
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayModPaced)
+{
+    ClientInfo info;
+    info.keylayout = 0x040C;
+    info.console_session = 0;
+    info.brush_cache_code = 0;
+    info.bpp = 24;
+    info.width = 800;
+    info.height = 600;
+
+    FakeFront front(info, 0);
+
+    Inifile ini;
+    ini.mod_replay.on_end_of_data = 1;
+    ini.mod_replay.speed = 4;
+
+    std::string auth_error_message;
+    ReplayMod mod(front, "./tests/fixtures/", "sample.mwrm", 800, 600, auth_error_message, ini);
+
+    // the orders after a next timestamp are not due yet
+    bool waiting = false;
+    for (int i = 0; (i < 100) && !waiting; i++) {
+        mod.draw_event(0);
+        waiting = (difftimeval(mod.get_event().trigger_time, tvtime()) > 1000);
+    }
+    BOOST_CHECK(waiting);
+
+    // woken up early, the pending timestamp is checked again before reading
+    //  more orders: the wake up time stays the same
+    const timeval due = mod.get_event().trigger_time;
+    mod.get_event().reset();
+    mod.draw_event(0);
+    BOOST_CHECK(difftimeval(mod.get_event().trigger_time, tvtime()) > 1000);
+    const int64_t shift = ustime(mod.get_event().trigger_time) - ustime(due);
+    BOOST_CHECK((shift > -20000) && (shift < 20000));
+
+    // x32 from the start of the last file
+    Keymap2 keymap;
+    keymap.init_layout(info.keylayout);
+    keymap.push_kevent(Keymap2::KEVENT_UP_ARROW);
+    keymap.push_kevent(Keymap2::KEVENT_UP_ARROW);
+    keymap.push_kevent(Keymap2::KEVENT_UP_ARROW);
+    keymap.push_kevent(Keymap2::KEVENT_RIGHT_ARROW);
+    keymap.push_kevent(Keymap2::KEVENT_RIGHT_ARROW);
+    mod.rdp_input_scancode(0, 0, 0, 0, &keymap);
+    mod.get_event().reset();
+
+    // the orders are drawn when due
+    int i;
+    for (i = 0; (i < 100000) && (mod.get_event().signal != BACK_EVENT_STOP); i++) {
+        const uint64_t delay = difftimeval(mod.get_event().trigger_time, tvtime());
+        if (delay < 10000000) {
+            usleep(delay);
+        }
+        mod.draw_event(0);
+    }
+    BOOST_CHECK_EQUAL(BACK_EVENT_STOP, mod.get_event().signal);
+    BOOST_CHECK(auth_error_message.empty());
+}
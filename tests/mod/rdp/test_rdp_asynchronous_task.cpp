@@ -56,73 +56,6 @@ public:
     }
 };
 
-BOOST_AUTO_TEST_CASE(TestRdpdrDriveReadTask)
-{
-    uint32_t verbose = 1;
-
-    int fd = ::open("tests/fixtures/rfc959.txt", O_RDONLY);
-    if (fd == -1) { throw Error(ERR_TRANSPORT_OPEN_FAILED); }
-
-    io::posix::fdbuf fd_wrapper(fd);
-
-    std::unique_ptr<InFileTransport> transport = std::make_unique<InFileTransport>(fd);
-
-    fd_wrapper.release();
-
-    //LogTransport log_transport;
-    //TestToServerSender test_to_server_sender(log_transport);
-
-    #include "fixtures/test_rdpdr_drive_read_task.hpp"
-    CheckTransport check_transport(outdata, sizeof(outdata), verbose);
-    TestToServerSender test_to_server_sender(check_transport);
-
-    const uint32_t DeviceId = 0;
-    const uint32_t CompletionId = 8;
-
-    const uint32_t number_of_bytes_to_read = 2 * 1024;
-
-    RdpdrDriveReadTask rdpdr_drive_read_task(transport.get(), fd,
-        DeviceId, CompletionId, number_of_bytes_to_read, 1024 * 32,
-        test_to_server_sender, verbose);
-
-    bool run_task = true;
-
-    do
-    {
-        wait_obj event;
-
-        rdpdr_drive_read_task.configure_wait_object(event);
-
-        unsigned max = 0;
-        fd_set rfds;
-
-        FD_ZERO(&rfds);
-
-        timeval timeout = { 3, 0 };
-
-        add_to_fd_set(event, rdpdr_drive_read_task.get_file_descriptor(), rfds, max, timeout);
-
-        int num = select(max + 1, &rfds, nullptr, nullptr, &timeout);
-
-        if (num < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-
-            LOG(LOG_ERR, "Task loop raised error %u : %s", errno, strerror(errno));
-            run_task = false;
-        }
-        else {
-            if (is_set(event, rdpdr_drive_read_task.get_file_descriptor(), rfds)) {
-                if (!rdpdr_drive_read_task.run(event)) {
-                    run_task = false;
-                }
-            }
-        }
-    }
-    while (run_task);
-}
-
 BOOST_AUTO_TEST_CASE(TestRdpdrSendDriveIOResponseTask)
 {
     uint32_t verbose = 1;
@@ -0,0 +1,169 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Unit test of the shadow of the screen of a VNC session
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestScreenTileShadow
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "vnc/screen_tile_shadow.hpp"
+
+#include <string>
+#include <vector>
+
+struct TestScreenTileShadowApi : ScreenTileShadowApi
+{
+    std::string events;
+
+    virtual void draw_tile_bitmap(const Rect & rect, const uint8_t * tile_data) {
+        char event[128];
+        snprintf(event, sizeof(event), "bitmap(%d,%d,%d,%d) %02X\n",
+            rect.x, rect.y, rect.cx, rect.cy, tile_data[0]);
+        this->events += event;
+    }
+
+    virtual void draw_solid_rect(const Rect & rect, uint32_t color) {
+        char event[128];
+        snprintf(event, sizeof(event), "solid(%d,%d,%d,%d) %04X\n",
+            rect.x, rect.y, rect.cx, rect.cy, color);
+        this->events += event;
+    }
+};
+
+// 16 bpp screen of 100x70 pixels: 4 columns and 3 rows of tiles, the last ones are cut
+struct Screen
+{
+    std::vector<uint16_t> pixels;
+
+    Screen() : pixels(100 * 70, 0x1234) {
+        // some pattern in the tile (1, 1), and in the tile (3, 2)
+        for (int y = 40; y < 50; y++) {
+            for (int x = 40; x < 50; x++) {
+                this->pixels[y * 100 + x] = x + y;
+            }
+        }
+        this->pixels[69 * 100 + 99] = 0xFFFF;
+    }
+
+    const uint8_t * raw() const {
+        return reinterpret_cast<const uint8_t *>(this->pixels.data());
+    }
+};
+
+BOOST_AUTO_TEST_CASE(TestScreenTileShadowDropUnchanged)
+{
+    Screen screen;
+    ScreenTileShadow shadow;
+    shadow.reset(100, 70, 16);
+
+    TestScreenTileShadowApi api;
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    // the solid tiles of a row are drawn as one rectangle
+    BOOST_CHECK_EQUAL(
+        "solid(0,0,100,32) 1234\n"
+        "bitmap(32,32,32,32) 34\n"
+        "solid(0,32,32,32) 1234\n"
+        "solid(64,32,36,32) 1234\n"
+        "bitmap(96,64,4,6) 34\n"
+        "solid(0,64,96,6) 1234\n"
+      , api.events);
+    BOOST_CHECK_EQUAL(2, shadow.tiles_drawn);
+    BOOST_CHECK_EQUAL(10, shadow.tiles_solid);
+    BOOST_CHECK_EQUAL(0, shadow.tiles_dropped);
+
+    // the same screen again
+    api.events.clear();
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    BOOST_CHECK_EQUAL("", api.events);
+    BOOST_CHECK_EQUAL(12, shadow.tiles_dropped);
+
+    // one pixel changed
+    screen.pixels[33 * 100 + 70] = 0;
+    api.events.clear();
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    BOOST_CHECK_EQUAL("bitmap(64,32,32,32) 34\n", api.events);
+    BOOST_CHECK_EQUAL(23, shadow.tiles_dropped);
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenTileShadowPartialTiles)
+{
+    Screen screen;
+    ScreenTileShadow shadow;
+    shadow.reset(100, 70, 16);
+
+    TestScreenTileShadowApi api;
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+
+    // a rectangle across 4 tiles, its parts are always drawn
+    std::vector<uint16_t> pixels(20 * 10, 0x1234);
+    api.events.clear();
+    shadow.draw(Rect(20, 25, 20, 10), reinterpret_cast<const uint8_t *>(pixels.data()), api);
+    shadow.draw(Rect(20, 25, 20, 10), reinterpret_cast<const uint8_t *>(pixels.data()), api);
+    BOOST_CHECK_EQUAL(
+        "solid(20,25,20,7) 1234\n"
+        "solid(20,32,20,3) 1234\n"
+        "solid(20,25,20,7) 1234\n"
+        "solid(20,32,20,3) 1234\n"
+      , api.events);
+
+    // the 4 tiles are unknown now
+    api.events.clear();
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    BOOST_CHECK_EQUAL(
+        "solid(0,0,64,32) 1234\n"
+        "bitmap(32,32,32,32) 34\n"
+        "solid(0,32,32,32) 1234\n"
+      , api.events);
+
+    // drawn without the shadow
+    shadow.invalidate(Rect(98, 68, 1, 1));
+    api.events.clear();
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    BOOST_CHECK_EQUAL("bitmap(96,64,4,6) 34\n", api.events);
+
+    // after a reset, everything is drawn
+    shadow.reset(100, 70, 16);
+    api.events.clear();
+    shadow.draw(Rect(0, 0, 100, 70), screen.raw(), api);
+    BOOST_CHECK_EQUAL(6, std::count(api.events.begin(), api.events.end(), '\n'));
+}
+
+BOOST_AUTO_TEST_CASE(TestScreenTileShadowOutOfScreen)
+{
+    ScreenTileShadow shadow;
+    shadow.reset(40, 40, 32);
+
+    // the tiles across the border of the screen are drawn each time
+    std::vector<uint32_t> pixels(64 * 64, 0x00FF00);
+    TestScreenTileShadowApi api;
+    shadow.draw(Rect(0, 0, 64, 64), reinterpret_cast<const uint8_t *>(pixels.data()), api);
+    shadow.draw(Rect(0, 0, 64, 64), reinterpret_cast<const uint8_t *>(pixels.data()), api);
+    BOOST_CHECK_EQUAL(
+        "solid(0,0,64,32) FF00\n"
+        "solid(0,32,64,32) FF00\n"
+        "solid(32,0,32,32) FF00\n"
+        "solid(0,32,64,32) FF00\n"
+      , api.events);
+}
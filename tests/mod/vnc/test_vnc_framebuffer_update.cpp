@@ -0,0 +1,504 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    Unit test of the resumable decoder of the VNC FramebufferUpdate message
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVncFrameBufferUpdate
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "vnc/vnc_framebuffer_update.hpp"
+#include "tight_test_encoder.hpp"
+
+#include <string>
+#include <vector>
+
+struct TestFrameBufferUpdateApi : FrameBufferUpdateApi
+{
+    std::string events;
+    uint8_t Bpp;
+
+    std::vector<uint8_t> last_tile;
+
+    TestFrameBufferUpdateApi(uint8_t Bpp) : Bpp(Bpp) {}
+
+    void add_event(const char * name, const Rect & rect, uint32_t crc) {
+        char event[128];
+        snprintf(event, sizeof(event), "%s(%d,%d,%d,%d) %08X\n", name, rect.x, rect.y, rect.cx, rect.cy, crc);
+        this->events += event;
+    }
+
+    virtual void draw_tile(const Rect & rect, const uint8_t * raw) {
+        this->last_tile.assign(raw, raw + rect.cx * rect.cy * this->Bpp);
+        this->add_event("tile", rect, crc32(0, raw, rect.cx * rect.cy * this->Bpp));
+    }
+
+    virtual void draw_copy_rect(const Rect & rect, uint16_t srcx, uint16_t srcy) {
+        this->add_event("copy", rect, (srcx << 16) | srcy);
+    }
+
+    virtual void set_vnc_cursor(const Rect & hotspot, const uint8_t * pixels, const uint8_t * mask) {
+        const uint32_t crc = crc32(0, pixels, hotspot.cx * hotspot.cy * this->Bpp);
+        this->add_event("cursor", hotspot, crc32(crc, mask, nbbytes(hotspot.cx) * hotspot.cy));
+    }
+};
+
+// an update with a rectangle of each encoding, after its message-type, 16 bpp
+static void make_update(Stream & stream)
+{
+    stream.out_uint8(0);            // padding
+    stream.out_uint16_be(7);        // number-of-rectangles
+
+    // raw, drawn by batches ending on lines multiple of 32
+    out_rectangle_header(stream, 10, 20, 40, 20, 0);
+    for (int i = 0; i < 40 * 20; i++) {
+        stream.out_uint16_le(i * 7);
+    }
+
+    out_rectangle_header(stream, 0, 0, 30, 30, 1);
+    stream.out_uint16_be(100);
+    stream.out_uint16_be(200);
+
+    // RRE, a background and 2 subrectangles
+    out_rectangle_header(stream, 100, 100, 20, 10, 2);
+    stream.out_uint32_be(2);
+    stream.out_uint16_le(0x1234);
+    stream.out_uint16_le(0xFFFF);
+    stream.out_uint16_be(2);
+    stream.out_uint16_be(3);
+    stream.out_uint16_be(5);
+    stream.out_uint16_be(4);
+    stream.out_uint16_le(0xF800);
+    stream.out_uint16_be(0);
+    stream.out_uint16_be(9);
+    stream.out_uint16_be(20);
+    stream.out_uint16_be(1);
+
+    // RRE without subrectangle
+    out_rectangle_header(stream, 200, 100, 8, 8, 2);
+    stream.out_uint32_be(0);
+    stream.out_uint16_le(0x07E0);
+
+    // ZRLE, a solid tile and a raw tile
+    {
+        BStream uncompressed(65536);
+        uncompressed.out_uint8(1);
+        uncompressed.out_uint16_le(0x001F);
+        uncompressed.out_uint8(0);
+        for (int i = 0; i < 6 * 10; i++) {
+            uncompressed.out_uint16_le(i * 1000);
+        }
+        uncompressed.mark_end();
+
+        uint8_t compressed[4096];
+        z_stream zstrm;
+        memset(&zstrm, 0, sizeof(zstrm));
+        BOOST_REQUIRE_EQUAL(Z_OK, deflateInit(&zstrm, Z_DEFAULT_COMPRESSION));
+        zstrm.next_in   = uncompressed.get_data();
+        zstrm.avail_in  = uncompressed.size();
+        zstrm.next_out  = compressed;
+        zstrm.avail_out = sizeof(compressed);
+        BOOST_REQUIRE_EQUAL(Z_OK, deflate(&zstrm, Z_SYNC_FLUSH));
+        const uint32_t compressed_length = sizeof(compressed) - zstrm.avail_out;
+        deflateEnd(&zstrm);
+
+        out_rectangle_header(stream, 300, 0, 70, 10, 16);
+        stream.out_uint32_be(compressed_length);
+        stream.out_copy_bytes(compressed, compressed_length);
+    }
+
+    // cursor, 10x2 pixels and their bitmask
+    out_rectangle_header(stream, 1, 1, 10, 2, -239);
+    for (int i = 0; i < 10 * 2; i++) {
+        stream.out_uint16_le(i);
+    }
+    stream.out_copy_bytes("\xFF\xC0\x80\x00", 4);
+
+    // empty cursor
+    out_rectangle_header(stream, 0, 0, 0, 0, -239);
+
+    stream.mark_end();
+    stream.rewind();
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateWhole)
+{
+    BStream update(65536);
+    make_update(update);
+
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(2);
+
+    decoder.start(16);
+    BOOST_CHECK(!decoder.is_done());
+    BOOST_CHECK(decoder.decode(update, api));
+    BOOST_CHECK(decoder.is_done());
+    BOOST_CHECK_EQUAL(0, update.in_remain());
+
+    BOOST_CHECK_EQUAL(
+        "tile(10,20,40,12) CC1FB60A\n"
+        "tile(10,32,40,8) F1D4E83B\n"
+        "copy(0,0,30,30) 006400C8\n"
+        "tile(100,100,20,10) BAC490A9\n"
+        "tile(200,100,8,8) 6B2BC023\n"
+        "tile(300,0,64,10) 50F7C8CE\n"
+        "tile(364,0,6,10) C34571FC\n"
+        "cursor(1,1,10,2) F127D2F8\n"
+      , api.events);
+}
+
+// the bytes of <update> are received one by one, the decoder keeps the incomplete units
+static void check_byte_by_byte(Stream & update, uint8_t bpp)
+{
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(nbbytes(bpp));
+
+    TestFrameBufferUpdateApi whole_api(nbbytes(bpp));
+    {
+        FrameBufferUpdateDecoder whole_decoder(0);
+        whole_decoder.start(bpp);
+        BOOST_CHECK(whole_decoder.decode(update, whole_api));
+        update.rewind();
+    }
+
+    uint8_t * const end = update.end;
+    decoder.start(bpp);
+    bool done = false;
+    for (update.end = update.get_data() + 1; update.end <= end && !done; update.end++) {
+        const uint8_t * p = update.p;
+        done = decoder.decode(update, api);
+        BOOST_CHECK(done || (update.in_remain() < decoder.needed()));
+        BOOST_CHECK(update.p >= p);
+    }
+    BOOST_CHECK(done);
+    BOOST_CHECK(update.end == end + 1);
+    BOOST_CHECK_EQUAL(whole_api.events, api.events);
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateByteByByte)
+{
+    BStream update(65536);
+    make_update(update);
+
+    check_byte_by_byte(update, 16);
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateNeeded)
+{
+    uint8_t data[64];
+    FixedSizeStream stream(data, sizeof(data));
+    stream.out_uint8(0);
+    stream.out_uint16_be(1);
+    out_rectangle_header(stream, 0, 0, 100, 40, 0);
+    stream.mark_end();
+    stream.rewind();
+
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(4);
+
+    decoder.start(32);
+    BOOST_CHECK(!decoder.decode(stream, api));
+    // a batch of 32 lines
+    BOOST_CHECK_EQUAL(32 * 100 * 4, decoder.needed());
+
+    stream.rewind();
+    stream.out_uint8(0);
+    stream.out_uint16_be(1);
+    out_rectangle_header(stream, 0, 0, 8, 8, 0x7FFFFFFF);
+    stream.mark_end();
+    stream.rewind();
+
+    decoder.start(32);
+    BOOST_CHECK_THROW(decoder.decode(stream, api), Error);
+}
+
+static std::string tile_event(uint16_t x, uint16_t y, uint16_t cx, uint16_t cy, const std::vector<uint8_t> & pixels)
+{
+    char event[128];
+    snprintf(event, sizeof(event), "tile(%d,%d,%d,%d) %08X\n", x, y, cx, cy,
+             static_cast<unsigned>(crc32(0, pixels.data(), pixels.size())));
+    return event;
+}
+
+// a rectangle of each kind of Tight compression (16 bpp), with the expected events
+static void make_tight_update(Stream & stream, std::string & events)
+{
+    TightEncoder encoder;
+
+    stream.out_uint8(0);            // padding
+    stream.out_uint16_be(10);       // number-of-rectangles
+
+    // fill
+    out_rectangle_header(stream, 0, 0, 30, 20, 7);
+    stream.out_uint8(0x80);
+    stream.out_uint16_le(0x1234);
+    events += tile_event(0, 0, 30, 20, to_bytes(std::vector<uint16_t>(30 * 20, 0x1234)));
+
+    // copy filter, 8 bytes are not compressed
+    {
+        const std::vector<uint8_t> pixels = to_bytes({ 1, 2, 3, 4 });
+        out_rectangle_header(stream, 30, 0, 2, 2, 7);
+        stream.out_uint8(0x00);
+        encoder.out_data(stream, 0, pixels);
+        events += tile_event(30, 0, 2, 2, pixels);
+    }
+
+    // copy filter, zlib stream 1 reset, 2 bytes of compact length
+    {
+        const std::vector<uint8_t> pixels = to_bytes(make_image(20, 10, 1));
+        out_rectangle_header(stream, 0, 20, 20, 10, 7);
+        stream.out_uint8(0x12);
+        encoder.out_data(stream, 1, pixels);
+        events += tile_event(0, 20, 20, 10, pixels);
+    }
+
+    // palette of 2 colours, 10 bytes are not compressed
+    {
+        out_rectangle_header(stream, 40, 0, 13, 5, 7);
+        stream.out_uint8(0x60);
+        stream.out_uint8(1);
+        stream.out_uint8(1);
+        stream.out_uint16_le(0xF800);
+        stream.out_uint16_le(0x001F);
+        std::vector<uint8_t> data;
+        std::vector<uint16_t> pixels;
+        for (int y = 0; y < 5; y++) {
+            data.push_back(0xA5 ^ y);
+            data.push_back(0xF8);
+            for (int x = 0; x < 13; x++) {
+                pixels.push_back(((data[y * 2 + x / 8] >> (7 - x % 8)) & 1) ? 0x001F : 0xF800);
+            }
+        }
+        encoder.out_data(stream, 2, data);
+        events += tile_event(40, 0, 13, 5, to_bytes(pixels));
+    }
+
+    // palette of 2 colours, zlib stream 2
+    {
+        out_rectangle_header(stream, 40, 10, 20, 8, 7);
+        stream.out_uint8(0x60);
+        stream.out_uint8(1);
+        stream.out_uint8(1);
+        stream.out_uint16_le(0x0000);
+        stream.out_uint16_le(0xFFFF);
+        std::vector<uint8_t> data;
+        std::vector<uint16_t> pixels;
+        for (int y = 0; y < 8; y++) {
+            for (int i = 0; i < 3; i++) {
+                data.push_back(y * 31 + i * 7);
+            }
+            for (int x = 0; x < 20; x++) {
+                pixels.push_back(((data[y * 3 + x / 8] >> (7 - x % 8)) & 1) ? 0xFFFF : 0x0000);
+            }
+        }
+        encoder.out_data(stream, 2, data);
+        events += tile_event(40, 10, 20, 8, to_bytes(pixels));
+    }
+
+    // palette of 5 colours, zlib stream 2 continued
+    {
+        const uint16_t palette[] = { 0x1111, 0x2222, 0x3333, 0x4444, 0x5555 };
+        out_rectangle_header(stream, 60, 0, 10, 10, 7);
+        stream.out_uint8(0x60);
+        stream.out_uint8(1);
+        stream.out_uint8(4);
+        for (uint16_t colour : palette) {
+            stream.out_uint16_le(colour);
+        }
+        std::vector<uint8_t> data;
+        std::vector<uint16_t> pixels;
+        for (int i = 0; i < 10 * 10; i++) {
+            data.push_back((i * i) % 5);
+            pixels.push_back(palette[data.back()]);
+        }
+        encoder.out_data(stream, 2, data);
+        events += tile_event(60, 0, 10, 10, to_bytes(pixels));
+    }
+
+    // gradient filter, zlib stream 3
+    {
+        const std::vector<uint16_t> image = make_image(33, 17, 2);
+        out_rectangle_header(stream, 0, 40, 33, 17, 7);
+        stream.out_uint8(0x70);
+        stream.out_uint8(2);
+        encoder.out_data(stream, 3, gradient_filter(image, 33, 17));
+        events += tile_event(0, 40, 33, 17, to_bytes(image));
+    }
+
+    // copy filter, zlib stream 1 continued
+    {
+        const std::vector<uint8_t> pixels = to_bytes(make_image(20, 10, 3));
+        out_rectangle_header(stream, 0, 60, 20, 10, 7);
+        stream.out_uint8(0x10);
+        encoder.out_data(stream, 1, pixels);
+        events += tile_event(0, 60, 20, 10, pixels);
+    }
+
+    // copy filter, zlib stream 0 reset
+    {
+        deflateReset(&encoder.zstrm[0]);
+        const std::vector<uint8_t> pixels = to_bytes(make_image(64, 64, 4));
+        out_rectangle_header(stream, 100, 100, 64, 64, 7);
+        stream.out_uint8(0x01);
+        encoder.out_data(stream, 0, pixels);
+        events += tile_event(100, 100, 64, 64, pixels);
+    }
+
+    // JPEG of a solid colour
+    {
+        const std::vector<uint8_t> jpeg = compress_jpeg(std::vector<uint8_t>(16 * 8 * 3, 0xFF), 16, 8, 95);
+        out_rectangle_header(stream, 100, 0, 16, 8, 7);
+        stream.out_uint8(0x90);
+        TightEncoder::out_compact_length(stream, jpeg.size());
+        stream.out_copy_bytes(jpeg.data(), jpeg.size());
+        events += tile_event(100, 0, 16, 8, to_bytes(std::vector<uint16_t>(16 * 8, 0xFFFF)));
+    }
+
+    stream.mark_end();
+    stream.rewind();
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateTight)
+{
+    BStream update(65536);
+    std::string events;
+    make_tight_update(update, events);
+
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(2);
+
+    decoder.start(16);
+    BOOST_CHECK(decoder.decode(update, api));
+    BOOST_CHECK_EQUAL(0, update.in_remain());
+    BOOST_CHECK_EQUAL(events, api.events);
+
+    update.rewind();
+    check_byte_by_byte(update, 16);
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateTight24)
+{
+    // 24 bits depth in 32 bpp, the Tight pixels are 3 bytes
+    TightEncoder encoder;
+    BStream stream(256);
+    stream.out_uint8(0);
+    stream.out_uint16_be(2);
+    out_rectangle_header(stream, 0, 0, 2, 1, 7);
+    stream.out_uint8(0x80);
+    stream.out_copy_bytes("\x11\x22\x33", 3);
+    // gradient, 2x2 pixels
+    out_rectangle_header(stream, 0, 0, 2, 2, 7);
+    stream.out_uint8(0x40);
+    stream.out_uint8(2);
+    encoder.out_data(stream, 0, { 0x10, 0x20, 0x30,  0x01, 0x02, 0x03,
+                                  0x01, 0x01, 0x01,  0xFF, 0x00, 0x01 });
+    stream.mark_end();
+    stream.rewind();
+
+    FrameBufferUpdateDecoder decoder(0);
+    decoder.set_pixel_format(24, 0xFF, 0xFF, 0xFF, 16, 8, 0);
+    TestFrameBufferUpdateApi api(4);
+
+    decoder.start(32);
+    BOOST_CHECK(decoder.decode(stream, api));
+    BOOST_CHECK_EQUAL(0, stream.in_remain());
+
+    const uint8_t expected[] = {
+        0x30, 0x20, 0x10, 0x00,     0x33, 0x22, 0x11, 0x00,
+        0x31, 0x21, 0x11, 0x00,     0x35, 0x23, 0x11, 0x00,
+    };
+    BOOST_CHECK_EQUAL(sizeof(expected), api.last_tile.size());
+    BOOST_CHECK(0 == memcmp(expected, api.last_tile.data(), sizeof(expected)));
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateTightErrors)
+{
+    uint8_t data[64];
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(2);
+
+    // unknown compression-control
+    FixedSizeStream stream(data, sizeof(data));
+    stream.out_uint8(0);
+    stream.out_uint16_be(1);
+    out_rectangle_header(stream, 0, 0, 8, 8, 7);
+    stream.out_uint8(0xA0);
+    stream.mark_end();
+    stream.rewind();
+
+    decoder.start(16);
+    BOOST_CHECK_THROW(decoder.decode(stream, api), Error);
+
+    // palette index out of the palette
+    stream.rewind();
+    stream.out_uint8(0);
+    stream.out_uint16_be(1);
+    out_rectangle_header(stream, 0, 0, 2, 2, 7);
+    stream.out_uint8(0x40);
+    stream.out_uint8(1);
+    stream.out_uint8(2);
+    stream.out_copy_bytes("\x00\x00\x01\x00\x02\x00", 6);
+    stream.out_copy_bytes("\x00\x01\x02\x03", 4);
+    stream.mark_end();
+    stream.rewind();
+
+    decoder.start(16);
+    BOOST_CHECK_THROW(decoder.decode(stream, api), Error);
+}
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateTightScreen)
+{
+    // tiles of 64x64 sharing the zlib stream, the first one resets it
+    const uint16_t width  = 256;
+    const uint16_t height = 128;
+
+    TightEncoder encoder;
+    BStream update(4 * width * height);
+    update.out_uint8(0);
+    update.out_uint16_be((width / 64) * (height / 64));
+
+    std::string events;
+    uint32_t seed = 5;
+    for (uint16_t y = 0; y < height; y += 64) {
+        for (uint16_t x = 0; x < width; x += 64) {
+            const std::vector<uint16_t> image = make_image(64, 64, next_random(seed));
+
+            out_rectangle_header(update, x, y, 64, 64, 7);
+            update.out_uint8((x || y) ? 0x40 : 0x4F);
+            update.out_uint8(2);
+            encoder.out_data(update, 0, gradient_filter(image, 64, 64));
+            events += tile_event(x, y, 64, 64, to_bytes(image));
+        }
+    }
+    update.mark_end();
+    update.rewind();
+
+    FrameBufferUpdateDecoder decoder(0);
+    TestFrameBufferUpdateApi api(2);
+
+    decoder.start(16);
+    BOOST_CHECK(decoder.decode(update, api));
+    BOOST_CHECK_EQUAL(0, update.in_remain());
+    BOOST_CHECK_EQUAL(events, api.events);
+}
@@ -0,0 +1,179 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+    VNC rectangles encoded as a server would send them, for the tests of the
+    FramebufferUpdate decoder
+*/
+
+#ifndef REDEMPTION_TESTS_MOD_VNC_TIGHT_TEST_ENCODER_HPP
+#define REDEMPTION_TESTS_MOD_VNC_TIGHT_TEST_ENCODER_HPP
+
+#include "stream.hpp"
+
+#include <zlib.h>
+#include <cstdio>
+#include <jpeglib.h>
+
+#include <algorithm>
+#include <vector>
+
+inline void out_rectangle_header(Stream & stream, uint16_t x, uint16_t y, uint16_t cx, uint16_t cy, int32_t encoding)
+{
+    stream.out_uint16_be(x);
+    stream.out_uint16_be(y);
+    stream.out_uint16_be(cx);
+    stream.out_uint16_be(cy);
+    stream.out_uint32_be(encoding);
+}
+
+// Tight rectangles as a server would send them, with its own zlib streams
+struct TightEncoder
+{
+    z_stream zstrm[4];
+
+    TightEncoder() {
+        for (z_stream & z : this->zstrm) {
+            memset(&z, 0, sizeof(z));
+            deflateInit(&z, Z_DEFAULT_COMPRESSION);
+        }
+    }
+
+    ~TightEncoder() {
+        for (z_stream & z : this->zstrm) {
+            deflateEnd(&z);
+        }
+    }
+
+    static void out_compact_length(Stream & stream, uint32_t length) {
+        stream.out_uint8((length & 0x7F) | (length > 0x7F ? 0x80 : 0));
+        if (length > 0x7F) {
+            stream.out_uint8(((length >> 7) & 0x7F) | (length > 0x3FFF ? 0x80 : 0));
+            if (length > 0x3FFF) {
+                stream.out_uint8(length >> 14);
+            }
+        }
+    }
+
+    // filtered data, compressed from 12 bytes
+    void out_data(Stream & stream, uint8_t stream_id, const std::vector<uint8_t> & data) {
+        if (data.size() < 12) {
+            stream.out_copy_bytes(data.data(), data.size());
+            return;
+        }
+
+        z_stream & z = this->zstrm[stream_id];
+        std::vector<uint8_t> compressed(deflateBound(&z, data.size()) + 64);
+        z.next_in   = const_cast<uint8_t *>(data.data());
+        z.avail_in  = data.size();
+        z.next_out  = compressed.data();
+        z.avail_out = compressed.size();
+        BOOST_REQUIRE_EQUAL(Z_OK, deflate(&z, Z_SYNC_FLUSH));
+        BOOST_REQUIRE_EQUAL(0, z.avail_in);
+        const uint32_t length = compressed.size() - z.avail_out;
+
+        out_compact_length(stream, length);
+        stream.out_copy_bytes(compressed.data(), length);
+    }
+};
+
+inline uint32_t next_random(uint32_t & seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+// RGB 565 pixels, smooth with some noise
+inline std::vector<uint16_t> make_image(uint16_t cx, uint16_t cy, uint32_t seed)
+{
+    std::vector<uint16_t> image(cx * cy);
+    for (uint16_t y = 0; y < cy; y++) {
+        for (uint16_t x = 0; x < cx; x++) {
+            const uint16_t red   = ((x + y) / 4 + next_random(seed) % 2) & 0x1F;
+            const uint16_t green = (x / 2 + y + next_random(seed) % 3) & 0x3F;
+            const uint16_t blue  = (y / 3) & 0x1F;
+            image[y * cx + x] = (red << 11) | (green << 5) | blue;
+        }
+    }
+    return image;
+}
+
+inline std::vector<uint8_t> to_bytes(const std::vector<uint16_t> & pixels)
+{
+    std::vector<uint8_t> bytes;
+    for (uint16_t pixel : pixels) {
+        bytes.push_back(pixel & 0xFF);
+        bytes.push_back(pixel >> 8);
+    }
+    return bytes;
+}
+
+// the difference of each component with its prediction up + left - up_left (RGB 565)
+inline std::vector<uint8_t> gradient_filter(const std::vector<uint16_t> & image, uint16_t cx, uint16_t cy)
+{
+    const uint16_t max[3]   = { 0x1F, 0x3F, 0x1F };
+    const uint8_t  shift[3] = { 11, 5, 0 };
+
+    std::vector<uint16_t> residuals(cx * cy);
+    for (int y = 0; y < cy; y++) {
+        for (int x = 0; x < cx; x++) {
+            uint16_t residual = 0;
+            for (int c = 0; c < 3; c++) {
+                const int up      = (y     ? (image[(y - 1) * cx + x] >> shift[c]) & max[c] : 0);
+                const int left    = (x     ? (image[y * cx + x - 1] >> shift[c]) & max[c] : 0);
+                const int up_left = (x && y ? (image[(y - 1) * cx + x - 1] >> shift[c]) & max[c] : 0);
+                const int prediction = std::min<int>(std::max<int>(up + left - up_left, 0), max[c]);
+                residual |= ((((image[y * cx + x] >> shift[c]) & max[c]) - prediction) & max[c]) << shift[c];
+            }
+            residuals[y * cx + x] = residual;
+        }
+    }
+    return to_bytes(residuals);
+}
+
+inline std::vector<uint8_t> compress_jpeg(const std::vector<uint8_t> & rgb, uint16_t cx, uint16_t cy, int quality)
+{
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr       jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char * buffer = nullptr;
+    unsigned long   size   = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+
+    cinfo.image_width      = cx;
+    cinfo.image_height     = cy;
+    cinfo.input_components = 3;
+    cinfo.in_color_space   = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = const_cast<uint8_t *>(rgb.data()) + cinfo.next_scanline * cx * 3;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(buffer, buffer + size);
+    free(buffer);
+    return jpeg;
+}
+
+#endif
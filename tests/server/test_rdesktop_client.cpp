@@ -109,7 +109,7 @@ BOOST_AUTO_TEST_CASE(TestIncomingConnection)
 
     const bool fastpath_support = false;
     const bool mem3blt_support  = false;
-    Front front( front_trans, SHARE_PATH "/" DEFAULT_FONT_NAME, gen, ini
+    Front front( front_trans, gen, ini
                , fastpath_support, mem3blt_support);
     null_mod no_mod(front);
 
@@ -133,3 +133,121 @@ BOOST_AUTO_TEST_CASE(TestBitmapCompressPerformancePNG)
         BOOST_CHECK(0 == memcmp(bmp2.data(), bigbmp.data(), bigbmp.bmp_size()));
     }
 }
+
+BOOST_AUTO_TEST_CASE(TestBitmapConvertPerformance)
+{
+    const uint8_t bpps[] = {8, 15, 16, 24, 32};
+    const uint16_t cx = 256;
+    const uint16_t cy = 256;
+    const unsigned count = 20;
+
+    uint8_t data[cx * cy * 4];
+    uint32_t rnd = 12345;
+    for (uint8_t & c : data) {
+        rnd = rnd * 1103515245 + 12345;
+        c = rnd >> 16;
+    }
+
+    for (uint8_t in_bpp : bpps) {
+        Bitmap bmp(in_bpp, in_bpp, nullptr, cx, cy, data, cx * cy * nbbytes(in_bpp));
+        for (uint8_t out_bpp : bpps) {
+            if (in_bpp == out_bpp) {
+                continue;
+            }
+            uint64_t usec = ustime();
+            uint64_t cycles = rdtsc();
+            for (unsigned i = 0; i < count; ++i) {
+                Bitmap converted(out_bpp, bmp);
+                BOOST_CHECK_EQUAL(out_bpp, converted.bpp());
+            }
+            uint64_t elapusec = ustime() - usec;
+            uint64_t elapcyc = rdtsc() - cycles;
+            printf("convert %2u -> %2u bpp: elapsed time = %" PRIuLEAST64 " %" PRIuLEAST64 " %f (%f cycles per pixel)\n",
+                unsigned(in_bpp), unsigned(out_bpp), elapusec, elapcyc,
+                static_cast<double>(elapcyc) / elapusec, static_cast<double>(elapcyc) / (count * cx * cy));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressTilesPerformance)
+{
+    // screen capture cut in 64x64 tiles, as sent in bitmap updates
+    Bitmap screen(FIXTURES_PATH "/win2008capture10.png");
+    const uint8_t bpps[] = {8, 15, 16, 24};
+    const uint16_t tile_size = 64;
+
+    for (uint8_t bpp : bpps) {
+        Bitmap screen_bpp(bpp, screen);
+        uint64_t elapusec = 0;
+        uint64_t elapcyc = 0;
+        size_t raw_size = 0;
+        size_t compressed_size = 0;
+        for (uint16_t y = 0; y < screen.cy(); y += tile_size) {
+            for (uint16_t x = 0; x < screen.cx(); x += tile_size) {
+                const Rect r = Rect(x, y, tile_size, tile_size).intersect(Rect(0, 0, screen.cx(), screen.cy()));
+                Bitmap tile(screen_bpp, r);
+                BStream out(2 * tile.bmp_size() + 64);
+                uint64_t usec = ustime();
+                uint64_t cycles = rdtsc();
+                tile.compress(bpp, out);
+                elapusec += ustime() - usec;
+                elapcyc += rdtsc() - cycles;
+                raw_size += tile.bmp_size();
+                compressed_size += out.p - out.get_data();
+
+                Bitmap decompressed(bpp, bpp, &tile.palette(), tile.cx(), tile.cy(), out.get_data(), out.p - out.get_data(), true);
+                BOOST_CHECK(0 == memcmp(decompressed.data(), tile.data(), tile.bmp_size()));
+            }
+        }
+        printf("compress %2u bpp tiles: initial_size = %zu, compressed size: %zu\n"
+            "elapsed time = %" PRIuLEAST64 " %" PRIuLEAST64 " %f (%f cycles per byte)\n",
+            unsigned(bpp), raw_size, compressed_size, elapusec, elapcyc,
+            static_cast<double>(elapcyc) / elapusec, static_cast<double>(elapcyc) / raw_size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressPerformance)
+{
+    // fixtures compressed as 64x64 tiles with RLE (8 to 24 bpp) or RDP 6.0 planar codec (32 bpp)
+    const char * fixtures[] = {
+        FIXTURES_PATH "/win2008capture10.png",
+        FIXTURES_PATH "/color_image.png",
+        FIXTURES_PATH "/logo-redemption.png",
+    };
+    const uint8_t bpps[] = {8, 15, 16, 24, 32};
+    const uint16_t tile_size = 64;
+    const unsigned count = 10;
+
+    for (const char * fixture : fixtures) {
+        Bitmap image(fixture);
+        for (uint8_t bpp : bpps) {
+            Bitmap image_bpp(bpp, image);
+            uint64_t elapusec = 0;
+            uint64_t elapcyc = 0;
+            size_t raw_size = 0;
+            for (uint16_t y = 0; y < image.cy(); y += tile_size) {
+                for (uint16_t x = 0; x < image.cx(); x += tile_size) {
+                    const Rect r = Rect(x, y, tile_size, tile_size).intersect(Rect(0, 0, image.cx(), image.cy()));
+                    Bitmap tile(image_bpp, r);
+                    BStream out(2 * tile.bmp_size() + 64);
+                    tile.compress(bpp, out);
+                    // planar codec works on the whole aligned width
+                    const uint16_t cx = (bpp == 32) ? tile.cx() : r.cx;
+
+                    uint64_t usec = ustime();
+                    uint64_t cycles = rdtsc();
+                    for (unsigned i = 0; i < count; ++i) {
+                        Bitmap decompressed(bpp, bpp, &tile.palette(), cx, tile.cy(), out.get_data(), out.p - out.get_data(), true);
+                        BOOST_CHECK_EQUAL(tile.bmp_size(), decompressed.bmp_size());
+                    }
+                    elapusec += ustime() - usec;
+                    elapcyc += rdtsc() - cycles;
+                    raw_size += count * tile.bmp_size();
+                }
+            }
+            printf("decompress %s %2u bpp tiles: elapsed time = %" PRIuLEAST64 " %" PRIuLEAST64 " %f (%f cycles per byte)\n",
+                strrchr(fixture, '/') + 1, unsigned(bpp), elapusec, elapcyc,
+                static_cast<double>(elapcyc) / elapusec, static_cast<double>(elapcyc) / raw_size);
+        }
+    }
+}
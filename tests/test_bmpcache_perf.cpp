@@ -0,0 +1,89 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *   Product name: redemption, a FLOSS RDP proxy
+ *   Copyright (C) Wallix 2015
+ *   Author(s): Christophe Grosjean
+ *
+ *   Unit test for bitmap cache, lookup and eviction performance
+ */
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestBmpCachePerf
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "RDP/caches/bmpcache.hpp"
+#include "core/RDP/caches/make_test_bitmap.hpp"
+#include "difftimeval.hpp"
+#include "rdtsc.hpp"
+
+#include <vector>
+#include <cinttypes>
+
+namespace {
+    // Working set twice as large as the cache, accessed with a skewed
+    // distribution: about half of the requests hit.
+    void bench(const char * name, BmpCache & bmp_cache, uint16_t entries)
+    {
+        std::vector<Bitmap> bitmaps;
+        for (uint32_t i = 0; i < entries * 2u; ++i) {
+            bitmaps.push_back(make_test_bitmap(i));
+            // the fingerprint is computed once per bitmap, like for bitmaps received from mod
+            bitmaps.back().compute_fingerprint();
+        }
+
+        const unsigned count = 500000;
+        uint32_t rnd = 12345;
+        unsigned found = 0;
+
+        uint64_t usec = ustime();
+        uint64_t cycles = rdtsc();
+        for (unsigned i = 0; i < count; ++i) {
+            rnd = rnd * 1103515245 + 12345;
+            const uint32_t r = (rnd >> 8) % bitmaps.size();
+            const uint32_t res = bmp_cache.cache_bitmap(bitmaps[(rnd & 0x80) ? r / 2 : r]);
+            found += ((res >> 24) == BmpCache::FOUND_IN_CACHE);
+        }
+        uint64_t elapusec = ustime() - usec;
+        uint64_t elapcyc = rdtsc() - cycles;
+
+        printf("%s: entries=%u cache_bitmap=%u found=%u\n"
+            "elapsed time = %" PRIuLEAST64 " %" PRIuLEAST64 " %f (%f cycles per call)\n",
+            name, entries, count, found, elapusec, elapcyc,
+            static_cast<double>(elapcyc) / elapusec, static_cast<double>(elapcyc) / count);
+        BOOST_CHECK(found > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBmpCachePerformance)
+{
+    {
+        // bitmap cache rev 1
+        BmpCache bmp_cache(BmpCache::Front, 24, 1, false, BmpCache::CacheOption(600, 768, false));
+        bench("Cache rev1", bmp_cache, 600);
+    }
+    {
+        // bitmap cache rev 2, persistent with waiting list
+        BmpCache bmp_cache(BmpCache::Front, 24, 1, true, BmpCache::CacheOption(2553, 768, true));
+        bench("Cache rev2 persistent", bmp_cache, 2553);
+    }
+    {
+        BmpCache bmp_cache(BmpCache::Recorder, 24, 1, false, BmpCache::CacheOption(8192, 768, false));
+        bench("Cache 8192 entries", bmp_cache, 8192);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+    This program is free software; you can redistribute it and/or modify it
+     under the terms of the GNU General Public License as published by the
+     Free Software Foundation; either version 2 of the License, or (at your
+     option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+     Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+     with this program; if not, write to the Free Software Foundation, Inc.,
+     675 Mass Ave, Cambridge, MA 02139, USA.
+
+    Product name: redemption, a FLOSS RDP proxy
+    Copyright (C) Wallix 2015
+    Author(s): Christophe Grosjean, Raphael Zhou
+
+
+    Unit test of the VNC Tight decoder, decoding performance
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestVncTightPerf
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "vnc/vnc_framebuffer_update.hpp"
+#include "mod/vnc/tight_test_encoder.hpp"
+#include "difftimeval.hpp"
+
+#include <cinttypes>
+
+struct NullFrameBufferUpdateApi : FrameBufferUpdateApi
+{
+    virtual void draw_tile(const Rect & rect, const uint8_t * raw) {}
+
+    virtual void draw_copy_rect(const Rect & rect, uint16_t srcx, uint16_t srcy) {}
+
+    virtual void set_vnc_cursor(const Rect & hotspot, const uint8_t * pixels, const uint8_t * mask) {}
+};
+
+BOOST_AUTO_TEST_CASE(TestFrameBufferUpdateTightPerformance)
+{
+    // a 1024x768 screen in tiles of 64x64, the first one resets the zlib streams
+    const uint16_t width  = 1024;
+    const uint16_t height = 768;
+
+    TightEncoder encoder;
+    BStream gradient_update(4 * width * height);
+    BStream jpeg_update(4 * width * height);
+    gradient_update.out_uint8(0);
+    gradient_update.out_uint16_be((width / 64) * (height / 64));
+    jpeg_update.out_uint8(0);
+    jpeg_update.out_uint16_be((width / 64) * (height / 64));
+
+    uint32_t seed = 5;
+    for (uint16_t y = 0; y < height; y += 64) {
+        for (uint16_t x = 0; x < width; x += 64) {
+            const std::vector<uint16_t> image = make_image(64, 64, next_random(seed));
+
+            out_rectangle_header(gradient_update, x, y, 64, 64, 7);
+            gradient_update.out_uint8((x || y) ? 0x40 : 0x4F);
+            gradient_update.out_uint8(2);
+            encoder.out_data(gradient_update, 0, gradient_filter(image, 64, 64));
+
+            std::vector<uint8_t> rgb;
+            for (uint16_t pixel : image) {
+                rgb.push_back((pixel >> 11) << 3);
+                rgb.push_back(((pixel >> 5) & 0x3F) << 2);
+                rgb.push_back((pixel & 0x1F) << 3);
+            }
+            const std::vector<uint8_t> jpeg = compress_jpeg(rgb, 64, 64, 80);
+            out_rectangle_header(jpeg_update, x, y, 64, 64, 7);
+            jpeg_update.out_uint8(0x90);
+            TightEncoder::out_compact_length(jpeg_update, jpeg.size());
+            jpeg_update.out_copy_bytes(jpeg.data(), jpeg.size());
+        }
+    }
+    gradient_update.mark_end();
+    jpeg_update.mark_end();
+
+    FrameBufferUpdateDecoder decoder(0);
+    NullFrameBufferUpdateApi api;
+
+    Stream * updates[] = { &gradient_update, &jpeg_update };
+    const char * names[] = { "gradient+zlib", "jpeg" };
+    for (int i = 0; i < 2; i++) {
+        const int repeat = 20;
+        const uint64_t usec = ustime();
+        for (int r = 0; r < repeat; r++) {
+            updates[i]->rewind();
+            decoder.start(16);
+            BOOST_CHECK(decoder.decode(*updates[i], api));
+        }
+        const uint64_t elapusec = std::max<uint64_t>(ustime() - usec, 1);
+        printf("Tight %s: %zu bytes by update, %" PRIuLEAST64 " us for %d updates, %.1f Mpixels/s\n",
+            names[i], updates[i]->size(), elapusec, repeat,
+            static_cast<double>(width) * height * repeat / elapusec);
+    }
+}
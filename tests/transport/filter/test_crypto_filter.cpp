@@ -0,0 +1,228 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean, Raphael Zhou
+
+   Unit test of the versions of the encrypted files
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestCryptoFilter
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "filter/crypto_filter.hpp"
+
+#include <string>
+
+struct MemorySink {
+    std::string data;
+
+    ssize_t write(const void * data, size_t len) {
+        this->data.append(static_cast<const char *>(data), len);
+        return len;
+    }
+};
+
+struct MemorySource {
+    const std::string & data;
+    size_t pos = 0;
+
+    MemorySource(const std::string & data) : data(data) {}
+
+    ssize_t read(void * data, size_t len) {
+        len = std::min(len, this->data.size() - this->pos);
+        memcpy(data, this->data.data() + this->pos, len);
+        this->pos += len;
+        return len;
+    }
+};
+
+static unsigned char trace_key[CRYPTO_KEY_LENGTH] = {
+     0,  1,  2,  3,  4,  5,  6,  7,
+     8,  9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23,
+    24, 25, 26, 27, 28, 29, 30, 31
+};
+
+static const unsigned char iv[32] = {
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+};
+
+static std::string make_content()
+{
+    std::string content(50000, '\0');
+    for (size_t i = 0; i < content.size(); i++) {
+        content[i] = (i % 251) ^ (i >> 12);
+    }
+    return content;
+}
+
+static int encrypt(CryptoContext & cctx, const std::string & content, MemorySink & sink,
+                   unsigned char (&hash)[HASH_LEN])
+{
+    transfil::encrypt_filter encrypt;
+    if (encrypt.open(sink, trace_key, &cctx, iv)) {
+        return -1;
+    }
+    // several writes by block
+    for (size_t i = 0; i < content.size(); i += 1000) {
+        const size_t len = std::min<size_t>(1000, content.size() - i);
+        if (encrypt.write(sink, content.data() + i, len) != ssize_t(len)) {
+            return -1;
+        }
+    }
+    return encrypt.close(sink, hash, cctx.hmac_key);
+}
+
+static ssize_t decrypt(const std::string & file, std::string & content)
+{
+    MemorySource source(file);
+    transfil::decrypt_filter decrypt;
+    if (const int err = decrypt.open(source, trace_key)) {
+        return err;
+    }
+    char buf[3000];
+    ssize_t res;
+    while ((res = decrypt.read(source, buf, sizeof(buf))) > 0) {
+        content.append(buf, res);
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(TestCryptoFilterVersions)
+{
+    OpenSSL_add_all_digests();
+
+    const std::string content = make_content();
+
+    CryptoContext cctx;
+    memset(&cctx, 0, sizeof(cctx));
+
+    // version 1 is still written on demand
+    cctx.file_version = WABCRYPTOFILE_VERSION_CBC;
+    MemorySink file_v1;
+    unsigned char hash_v1[HASH_LEN];
+    BOOST_REQUIRE_EQUAL(0, encrypt(cctx, content, file_v1, hash_v1));
+    BOOST_CHECK_EQUAL(1, file_v1.data[4]);
+
+    // version 2, blocks of 4 KiB written by the writer thread
+    cctx.file_version = 0;
+    cctx.block_size   = CRYPTO_MIN_BLOCK_SIZE;
+    MemorySink file_v2;
+    unsigned char hash_v2[HASH_LEN];
+    BOOST_REQUIRE_EQUAL(0, encrypt(cctx, content, file_v2, hash_v2));
+    BOOST_CHECK_EQUAL(2, file_v2.data[4]);
+    BOOST_CHECK_EQUAL(CRYPTO_MIN_BLOCK_SIZE >> 8, uint8_t(file_v2.data[41]));
+
+    // the same iv with the same data, only the cipher changes
+    BOOST_CHECK(!memcmp(file_v1.data.data() + 8, file_v2.data.data() + 8, 32));
+    BOOST_CHECK(memcmp(hash_v1, hash_v2, HASH_LEN));
+
+    std::string content_v1;
+    BOOST_CHECK_EQUAL(0, decrypt(file_v1.data, content_v1));
+    BOOST_CHECK(content == content_v1);
+
+    std::string content_v2;
+    BOOST_CHECK_EQUAL(0, decrypt(file_v2.data, content_v2));
+    BOOST_CHECK(content == content_v2);
+
+    // the default block size
+    cctx.block_size = 0;
+    MemorySink file_default;
+    BOOST_REQUIRE_EQUAL(0, encrypt(cctx, content, file_default, hash_v2));
+    BOOST_CHECK_EQUAL(CRYPTO_DEFAULT_BLOCK_SIZE >> 16, uint8_t(file_default.data[42]));
+    std::string content_default;
+    BOOST_CHECK_EQUAL(0, decrypt(file_default.data, content_default));
+    BOOST_CHECK(content == content_default);
+
+    cctx.file_version = WABCRYPTOFILE_VERSION + 1;
+    BOOST_CHECK_EQUAL(-1, encrypt(cctx, content, file_default, hash_v2));
+    cctx.file_version = 0;
+    cctx.block_size   = CRYPTO_MAX_BLOCK_SIZE + 1;
+    BOOST_CHECK_EQUAL(-1, encrypt(cctx, content, file_default, hash_v2));
+}
+
+BOOST_AUTO_TEST_CASE(TestCryptoFilterIntegrity)
+{
+    OpenSSL_add_all_digests();
+
+    const std::string content = make_content();
+
+    CryptoContext cctx;
+    memset(&cctx, 0, sizeof(cctx));
+    cctx.block_size = CRYPTO_MIN_BLOCK_SIZE;
+
+    MemorySink sink;
+    unsigned char hash[HASH_LEN];
+    BOOST_REQUIRE_EQUAL(0, encrypt(cctx, content, sink, hash));
+    const std::string & file = sink.data;
+
+    // a modified block
+    {
+        std::string modified_file = file;
+        modified_file[WABCRYPTOFILE_HEADER_SIZE_V2 + 100] ^= 1;
+        std::string modified_content;
+        BOOST_CHECK_EQUAL(-1, decrypt(modified_file, modified_content));
+        BOOST_CHECK_EQUAL(0, modified_content.size());
+    }
+
+    // a modified header
+    {
+        std::string modified_file = file;
+        modified_file[8] ^= 1;
+        std::string modified_content;
+        BOOST_CHECK_EQUAL(-1, decrypt(modified_file, modified_content));
+    }
+
+    // the second block replaced by the third one
+    {
+        const size_t first_block = WABCRYPTOFILE_HEADER_SIZE_V2;
+        auto chunk_size = [&file](size_t offset) -> size_t {
+            return 4 + (uint8_t(file[offset]) | (uint8_t(file[offset + 1]) << 8));
+        };
+        const size_t second_block = first_block + chunk_size(first_block);
+        const size_t third_block  = second_block + chunk_size(second_block);
+        std::string modified_file = file.substr(0, second_block)
+                                  + file.substr(third_block, chunk_size(third_block))
+                                  + file.substr(third_block);
+        std::string modified_content;
+        BOOST_CHECK_EQUAL(-1, decrypt(modified_file, modified_content));
+        // the second read fails in the second block
+        BOOST_CHECK_EQUAL(3000, modified_content.size());
+    }
+
+    // the end of file of a shorter file
+    {
+        const size_t eof_size = 8 + CRYPTO_GCM_TAG_SIZE;
+        const size_t last_block = file.size() - eof_size;
+        std::string modified_file = file.substr(0, WABCRYPTOFILE_HEADER_SIZE_V2)
+                                  + file.substr(last_block);
+        std::string modified_content;
+        BOOST_CHECK_EQUAL(-1, decrypt(modified_file, modified_content));
+    }
+
+    // a truncated file
+    {
+        std::string modified_file = file.substr(0, file.size() - 1);
+        std::string modified_content;
+        BOOST_CHECK_EQUAL(-1, decrypt(modified_file, modified_content));
+    }
+}
@@ -226,3 +226,90 @@ BOOST_AUTO_TEST_CASE(TestSequenceFollowedTransportWRM3)
     BOOST_CHECK_EQUAL(3, mwrm_trans.get_seqno());
 
 }
+
+BOOST_AUTO_TEST_CASE(TestSequenceSeekToTime)
+{
+//        "./tests/fixtures/sample0.wrm 1352304810 1352304870\n",
+//        "./tests/fixtures/sample1.wrm 1352304870 1352304930\n",
+//        "./tests/fixtures/sample2.wrm 1352304930 1352304990\n",
+
+    InMetaSequenceTransport mwrm_trans("./tests/fixtures/sample", ".mwrm");
+
+    // file of the last keyframe before the given time
+    mwrm_trans.seek_to_time(1352304900);
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample1.wrm", mwrm_trans.path());
+    BOOST_CHECK_EQUAL(1352304870, mwrm_trans.begin_chunk_time());
+    BOOST_CHECK_EQUAL(1352304930, mwrm_trans.end_chunk_time());
+    BOOST_CHECK_EQUAL(2, mwrm_trans.get_seqno());
+
+    // backward, before the recording
+    mwrm_trans.seek_to_time(0);
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample0.wrm", mwrm_trans.path());
+    BOOST_CHECK_EQUAL(1, mwrm_trans.get_seqno());
+
+    // after the recording, nothing changes
+    try {
+        mwrm_trans.seek_to_time(1352304990);
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e){
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, e.id);
+    };
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample0.wrm", mwrm_trans.path());
+    BOOST_CHECK_EQUAL(1, mwrm_trans.get_seqno());
+
+    mwrm_trans.seek_to_time(1352304930);
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample2.wrm", mwrm_trans.path());
+    BOOST_CHECK_EQUAL(3, mwrm_trans.get_seqno());
+
+    // the file is read from its beginning
+    char buffer[10000];
+    char * pbuffer = buffer;
+    size_t total = 0;
+    try {
+        for (size_t i = 0; i < 221 ; i++){
+            pbuffer = buffer;
+            mwrm_trans.recv(&pbuffer, sizeof(buffer));
+            total += pbuffer - buffer;
+        }
+    } catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, (unsigned)e.id);
+        total += pbuffer - buffer;
+    };
+    BOOST_CHECK_EQUAL(290245, total);
+
+    // still possible at the end of data
+    mwrm_trans.seek_to_time(1352304810);
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample0.wrm", mwrm_trans.path());
+    pbuffer = buffer;
+    mwrm_trans.recv(&pbuffer, 8);
+    BOOST_CHECK_EQUAL(0x03ee, (buffer[0] & 0xff) | ((buffer[1] & 0xff) << 8));
+}
+
+BOOST_AUTO_TEST_CASE(TestSequenceEndTime)
+{
+    InMetaSequenceTransport mwrm_trans("./tests/fixtures/sample", ".mwrm");
+
+    // sample2.wrm begins at the end time, it is not read
+    mwrm_trans.set_end_time(1352304930);
+    mwrm_trans.seek_to_time(1352304900);
+    BOOST_CHECK_EQUAL("./tests/fixtures/sample1.wrm", mwrm_trans.path());
+
+    char buffer[10000];
+    char * pbuffer = buffer;
+    size_t total = 0;
+    try {
+        for (size_t i = 0; i < 221 ; i++){
+            pbuffer = buffer;
+            mwrm_trans.recv(&pbuffer, sizeof(buffer));
+            total += pbuffer - buffer;
+        }
+    } catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, (unsigned)e.id);
+        total += pbuffer - buffer;
+    };
+    BOOST_CHECK_EQUAL(444578, total);
+
+    BOOST_CHECK_THROW(mwrm_trans.next(), Error);
+    BOOST_CHECK_EQUAL(2, mwrm_trans.get_seqno());
+}
@@ -0,0 +1,206 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of the recording read ahead by a worker thread
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestReadAheadTransport
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "read_ahead_transport.hpp"
+#include "in_meta_sequence_transport.hpp"
+#include "error.hpp"
+
+#include <string>
+
+//        "./tests/fixtures/sample0.wrm 1352304810 1352304870\n",
+//        "./tests/fixtures/sample1.wrm 1352304870 1352304930\n",
+//        "./tests/fixtures/sample2.wrm 1352304930 1352304990\n",
+
+// reads the transport until its end by pieces of <piece_size> bytes
+static std::string read_all(Transport & trans, size_t piece_size, unsigned & error_id)
+{
+    std::string data;
+    char buffer[10000];
+    error_id = NO_ERROR;
+    try {
+        for (;;) {
+            char * pbuffer = buffer;
+            try {
+                trans.recv(&pbuffer, piece_size);
+            }
+            catch (...) {
+                data.append(buffer, pbuffer - buffer);
+                throw;
+            }
+            data.append(buffer, pbuffer - buffer);
+        }
+    }
+    catch (const Error & e) {
+        error_id = e.id;
+    }
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(TestReadAheadTransportSameData)
+{
+    InMetaSequenceTransport direct_trans("./tests/fixtures/sample", ".mwrm");
+    unsigned direct_error = NO_ERROR;
+    const std::string expected = read_all(direct_trans, 10000, direct_error);
+    BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, direct_error);
+    BOOST_CHECK_EQUAL(1471394 + 444578 + 290245, expected.size());
+
+    // pieces smaller and larger than the blocks read ahead
+    const size_t piece_sizes[] = { 1, 8, 9999 };
+    for (size_t piece_size : piece_sizes) {
+        ReadAheadTransport<InMetaSequenceTransport> trans("./tests/fixtures/sample", ".mwrm");
+        unsigned error = NO_ERROR;
+        const std::string data = read_all(trans, piece_size, error);
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, error);
+        BOOST_CHECK_EQUAL(expected.size(), data.size());
+        BOOST_CHECK(expected == data);
+        BOOST_CHECK_EQUAL(expected.size(), trans.get_last_quantum_received());
+
+        // the end of data is thrown again
+        char buffer[8];
+        char * pbuffer = buffer;
+        try {
+            trans.recv(&pbuffer, sizeof(buffer));
+            BOOST_CHECK(false);
+        }
+        catch (const Error & e) {
+            BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, e.id);
+        }
+        BOOST_CHECK_EQUAL(0, pbuffer - buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestReadAheadTransportChunkTime)
+{
+    ReadAheadTransport<InMetaSequenceTransport> trans("./tests/fixtures/sample", ".mwrm");
+
+    char buffer[8];
+    char * pbuffer = buffer;
+    trans.recv(&pbuffer, sizeof(buffer));
+    BOOST_CHECK_EQUAL(1352304810, trans.begin_chunk_time());
+    BOOST_CHECK_EQUAL(1352304870, trans.end_chunk_time());
+
+    // the blocks read in sample2.wrm, after the block spanning sample1.wrm and sample2.wrm
+    char piece[10000];
+    const size_t sample2_begin = 1471394 + 444578 + ReadAheadTransportBase::BLOCK_SIZE;
+    for (size_t total = 8; total < sample2_begin; ) {
+        pbuffer = piece;
+        trans.recv(&pbuffer, std::min(sizeof(piece), sample2_begin - total));
+        total += pbuffer - piece;
+    }
+    BOOST_CHECK_EQUAL(1352304930, trans.begin_chunk_time());
+    BOOST_CHECK_EQUAL(1352304990, trans.end_chunk_time());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadAheadTransportSeekToTime)
+{
+    InMetaSequenceTransport direct_trans("./tests/fixtures/sample", ".mwrm");
+    direct_trans.seek_to_time(1352304900);
+    unsigned direct_error = NO_ERROR;
+    const std::string expected = read_all(direct_trans, 10000, direct_error);
+    BOOST_CHECK_EQUAL(444578 + 290245, expected.size());
+
+    ReadAheadTransport<InMetaSequenceTransport> trans("./tests/fixtures/sample", ".mwrm");
+
+    char buffer[10000];
+    char * pbuffer = buffer;
+    trans.recv(&pbuffer, sizeof(buffer));
+
+    // the blocks read ahead in sample0.wrm are dropped
+    trans.seek_to_time(1352304900);
+    unsigned error = NO_ERROR;
+    const std::string data = read_all(trans, 4096, error);
+    BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, error);
+    BOOST_CHECK(expected == data);
+
+    // after the recording, nothing changes
+    try {
+        trans.seek_to_time(1352304990);
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, e.id);
+    }
+    pbuffer = buffer;
+    try {
+        trans.recv(&pbuffer, sizeof(buffer));
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, e.id);
+    }
+
+    // still possible at the end of data
+    trans.seek_to_time(1352304810);
+    pbuffer = buffer;
+    trans.recv(&pbuffer, 8);
+    BOOST_CHECK_EQUAL(0x03ee, (buffer[0] & 0xff) | ((buffer[1] & 0xff) << 8));
+    BOOST_CHECK_EQUAL(1352304810, trans.begin_chunk_time());
+    BOOST_CHECK_EQUAL(1352304870, trans.end_chunk_time());
+}
+
+BOOST_AUTO_TEST_CASE(TestReadAheadTransportOpenFailed)
+{
+    // the meta file is opened before the worker is started
+    try {
+        ReadAheadTransport<InMetaSequenceTransport> trans("./tests/fixtures/TESTOFS_NO_SUCH_FILE", ".mwrm");
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_OPEN_FAILED, e.id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestReadAheadTransportSeekAfterEnd)
+{
+    InMetaSequenceTransport direct_trans("./tests/fixtures/sample", ".mwrm");
+    unsigned direct_error = NO_ERROR;
+    const std::string expected = read_all(direct_trans, 10000, direct_error);
+
+    ReadAheadTransport<InMetaSequenceTransport> trans("./tests/fixtures/sample", ".mwrm");
+
+    char buffer[10000];
+    char * pbuffer = buffer;
+    trans.recv(&pbuffer, sizeof(buffer));
+
+    // the blocks read ahead are kept, the reading goes on from where it was
+    try {
+        trans.seek_to_time(1352304990);
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e) {
+        BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, e.id);
+    }
+
+    unsigned error = NO_ERROR;
+    const std::string data = read_all(trans, 4096, error);
+    BOOST_CHECK_EQUAL((unsigned)ERR_TRANSPORT_NO_MORE_DATA, error);
+    BOOST_CHECK_EQUAL(expected.size() - sizeof(buffer), data.size());
+    BOOST_CHECK(expected.compare(sizeof(buffer), std::string::npos, data) == 0);
+}
@@ -29,6 +29,9 @@
 #include "listen.hpp"
 #include "server.hpp"
 
+#include <thread>
+#include <vector>
+
 
 // This test is somewhat tricky
 // The goal is to check that SocketTransport objects are working as expected
@@ -210,3 +213,111 @@ BOOST_AUTO_TEST_CASE(TestSocketTransport)
     }
     delete client_trans;
 }
+
+BOOST_AUTO_TEST_CASE(TestSocketTransportSendVector)
+{
+    int sck[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sck));
+    // the socket buffer is filled, writev() sends the buffers in several parts
+    fcntl(sck[0], F_SETFL, fcntl(sck[0], F_GETFL) | O_NONBLOCK);
+
+    // more buffers than given to one writev()
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<iovec> iov;
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 20; i++) {
+        buffers.emplace_back((i % 3) ? 100000 + i * 1000 : i);
+        for (size_t k = 0; k < buffers.back().size(); k++) {
+            buffers.back()[k] = i * 31 + k * 7 + (k >> 8);
+        }
+        iovec part = { buffers.back().data(), buffers.back().size() };
+        iov.push_back(part);
+        expected.insert(expected.end(), buffers.back().begin(), buffers.back().end());
+    }
+
+    std::vector<uint8_t> received(expected.size());
+    std::thread reader([&]{
+        SocketTransport trans("Reader", sck[1], "", 0, 0);
+        uint8_t * p = received.data();
+        trans.recv(&p, received.size());
+    });
+
+    {
+        SocketTransport trans("Writer", sck[0], "", 0, 0);
+        trans.send(iov.data(), iov.size());
+        BOOST_CHECK_EQUAL(expected.size(), trans.get_last_quantum_sent());
+    }
+    reader.join();
+
+    BOOST_CHECK(expected == received);
+}
+
+BOOST_AUTO_TEST_CASE(TestSocketTransportGatherPdu)
+{
+    int sck[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sck));
+    fcntl(sck[1], F_SETFL, fcntl(sck[1], F_GETFL) | O_NONBLOCK);
+
+    SocketTransport trans("Reader", sck[1], "", 0, 0);
+
+    // nothing received yet
+    BOOST_CHECK(!trans.gather_pdu());
+
+    // a TPKT of 9 bytes followed by a fast-path PDU with a 2 bytes length (300 bytes)
+    uint8_t tpkt[9] = { 3, 0, 0, 9, 2, 0xF0, 0x80, 0x11, 0x22 };
+    uint8_t fast_path[300];
+    fast_path[0] = 0x04;
+    fast_path[1] = 0x80 | (sizeof(fast_path) >> 8);
+    fast_path[2] = sizeof(fast_path) & 0xFF;
+    for (size_t i = 3; i < sizeof(fast_path); i++) {
+        fast_path[i] = i;
+    }
+
+    // the PDU is resumed where it stopped, whatever the pieces sent
+    BOOST_CHECK_EQUAL(1, ::send(sck[0], tpkt, 1, 0));
+    BOOST_CHECK(!trans.gather_pdu());
+    BOOST_CHECK_EQUAL(2, ::send(sck[0], tpkt + 1, 2, 0));
+    BOOST_CHECK(!trans.gather_pdu());
+    BOOST_CHECK_EQUAL(5, ::send(sck[0], tpkt + 3, 5, 0));
+    BOOST_CHECK(!trans.gather_pdu());
+    BOOST_CHECK_EQUAL(1, ::send(sck[0], tpkt + 8, 1, 0));
+    BOOST_CHECK_EQUAL(1, ::send(sck[0], fast_path, 1, 0));
+    BOOST_CHECK(trans.gather_pdu());
+    BOOST_CHECK_EQUAL(sizeof(tpkt), trans.get_last_quantum_received());
+
+    // the next PDU is not read before the first one is received
+    uint8_t buffer[sizeof(fast_path)];
+    uint8_t * p = buffer;
+    trans.recv(&p, 4);
+    p = buffer + 4;
+    trans.recv(&p, 5);
+    BOOST_CHECK_EQUAL(0, memcmp(tpkt, buffer, sizeof(tpkt)));
+    BOOST_CHECK_EQUAL(sizeof(tpkt), trans.get_last_quantum_received());
+
+    BOOST_CHECK(!trans.gather_pdu());
+    BOOST_CHECK_EQUAL(100, ::send(sck[0], fast_path + 1, 100, 0));
+    BOOST_CHECK(!trans.gather_pdu());
+    BOOST_CHECK_EQUAL(sizeof(fast_path) - 101, ::send(sck[0], fast_path + 101, sizeof(fast_path) - 101, 0));
+    BOOST_CHECK(trans.gather_pdu());
+    BOOST_CHECK(trans.gather_pdu());
+
+    // read partly from the gathered PDU, partly from the socket
+    const uint8_t tail[3] = { 7, 8, 9 };
+    BOOST_CHECK_EQUAL(3, ::send(sck[0], tail, sizeof(tail), 0));
+    uint8_t all[sizeof(fast_path) + sizeof(tail)];
+    p = all;
+    trans.recv(&p, sizeof(all));
+    BOOST_CHECK_EQUAL(0, memcmp(fast_path, all, sizeof(fast_path)));
+    BOOST_CHECK_EQUAL(0, memcmp(tail, all + sizeof(fast_path), sizeof(tail)));
+    BOOST_CHECK_EQUAL(sizeof(tpkt) + sizeof(all), trans.get_last_quantum_received());
+
+    // the peer closed the connection
+    ::close(sck[0]);
+    try {
+        trans.gather_pdu();
+        BOOST_CHECK(false);
+    }
+    catch (const Error & e) {
+        BOOST_CHECK_EQUAL(static_cast<int>(ERR_TRANSPORT_NO_MORE_DATA), e.id);
+    }
+}
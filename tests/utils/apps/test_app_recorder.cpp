@@ -0,0 +1,167 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of redrec transcoding with several processes
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestAppRecorder
+#include <boost/test/auto_unit_test.hpp>
+
+#undef SHARE_PATH
+#define SHARE_PATH FIXTURES_PATH
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "capture.hpp"
+#include "apps/app_recorder.hpp"
+
+struct CaptureMaker {
+    Capture capture;
+
+    CaptureMaker( const timeval & now, uint16_t width, uint16_t height, int order_bpp
+                , const char * path, const char * basename, const char * /*extension*/
+                , Inifile & ini, bool /*clear*/, uint32_t /*verbose*/)
+    : capture( now, width, height, order_bpp
+             , ini.video.wrm_color_depth_selection_strategy
+             , path, path, ini.video.hash_path, basename
+             , false, false, nullptr, ini, true)
+    {}
+};
+
+BOOST_AUTO_TEST_CASE(TestSplitRecordSegments)
+{
+    std::vector<RecordSegment> segments = {
+        {100, 160, 1000}, {160, 220, 100}, {220, 280, 100}, {280, 340, 800}, {340, 400, 100}
+    };
+
+    // the processes get about the same amount of data
+    std::vector<size_t> parts = split_record_segments(segments, 2);
+    BOOST_REQUIRE_EQUAL(2, parts.size());
+    BOOST_CHECK_EQUAL(0, parts[0]);
+    BOOST_CHECK_EQUAL(1, parts[1]);
+
+    parts = split_record_segments(segments, 3);
+    BOOST_REQUIRE_EQUAL(3, parts.size());
+    BOOST_CHECK_EQUAL(0, parts[0]);
+    BOOST_CHECK_EQUAL(1, parts[1]);
+    BOOST_CHECK_EQUAL(3, parts[2]);
+
+    // at most one process by file
+    BOOST_CHECK_EQUAL(5, split_record_segments(segments, 8).size());
+    BOOST_CHECK_EQUAL(1, split_record_segments(segments, 1).size());
+    BOOST_CHECK_EQUAL(0, split_record_segments(std::vector<RecordSegment>(), 4).size());
+}
+
+static void play_to_the_end(const char * mwrm_prefix, RDPDrawable & drawable)
+{
+    InMetaSequenceTransport in_wrm_trans(mwrm_prefix, ".mwrm");
+    const timeval begin_capture = {0, 0};
+    const timeval end_capture   = {0, 0};
+    FileToGraphic player(&in_wrm_trans, begin_capture, end_capture, false, 0);
+    player.add_consumer(&drawable, &drawable);
+    bool requested_to_stop = false;
+    player.play(requested_to_stop);
+}
+
+static void init_ini(Inifile & ini)
+{
+    ini.video.frame_interval = 100;
+    ini.video.break_interval = 86400;
+    ini.video.png_limit      = 3;
+    ini.video.png_interval   = 100;
+    ini.video.capture_wrm    = true;
+    ini.video.capture_png    = true;
+    ini.video.rt_display.set(1);
+    ini.video.wrm_compression_algorithm          = USE_ORIGINAL_COMPRESSION_ALGORITHM;
+    ini.video.wrm_color_depth_selection_strategy = USE_ORIGINAL_COLOR_DEPTH;
+    ini.globals.enable_file_encryption.set(false);
+}
+
+BOOST_AUTO_TEST_CASE(TestParallelRecord)
+{
+    // one process by file of the movie
+    Inifile ini;
+    init_ini(ini);
+    std::string output_filename = "/tmp/test_app_recorder_parallel.mwrm";
+    BOOST_CHECK_EQUAL(0, recompress_or_record<CaptureMaker>(
+        "./tests/fixtures/sample.mwrm", output_filename, ini
+      , false, false, false, 0, 0, 0, 1, 100, false, false, true, 3, 0));
+
+    Inifile ini_serial;
+    init_ini(ini_serial);
+    std::string output_filename_serial = "/tmp/test_app_recorder_serial.mwrm";
+    BOOST_CHECK_EQUAL(0, recompress_or_record<CaptureMaker>(
+        "./tests/fixtures/sample.mwrm", output_filename_serial, ini_serial
+      , false, false, false, 0, 0, 0, 1, 100, false, false, true, 1, 0));
+
+    // the wrm files are renamed in order, the first file of the last processes are the
+    // keyframes of the input files
+    std::string header;
+    std::vector<std::pair<std::string, std::string>> files;
+    BOOST_REQUIRE(read_meta_file(output_filename, header, files));
+    BOOST_CHECK_EQUAL("800 600\n\n\n", header);
+    BOOST_REQUIRE_EQUAL(3, files.size());
+    BOOST_CHECK_EQUAL("/tmp/test_app_recorder_parallel-000000.wrm", files[0].first);
+    BOOST_CHECK_EQUAL(" 1352304810 1352304871", files[0].second);
+    BOOST_CHECK_EQUAL("/tmp/test_app_recorder_parallel-000001.wrm", files[1].first);
+    BOOST_CHECK_EQUAL(" 1352304870 1352304929", files[1].second);
+    BOOST_CHECK_EQUAL("/tmp/test_app_recorder_parallel-000002.wrm", files[2].first);
+    BOOST_CHECK_EQUAL(" 1352304930 1352304939", files[2].second);
+
+    // same images as one process
+    RDPDrawable drawable(800, 600, 24);
+    RDPDrawable drawable_serial(800, 600, 24);
+    play_to_the_end("/tmp/test_app_recorder_parallel", drawable);
+    play_to_the_end("/tmp/test_app_recorder_serial", drawable_serial);
+    BOOST_CHECK_EQUAL(0, memcmp( drawable.impl().data(), drawable_serial.impl().data()
+                               , drawable.impl().pix_len()));
+
+    // the last png_limit images are kept, the files of the processes are removed
+    FilenameGenerator png_seq( FilenameGenerator::PATH_FILE_COUNT_EXTENSION
+                             , "/tmp/", "test_app_recorder_parallel", ".png", 0);
+    const std::vector<unsigned> pngs = get_sequence_numbers("/tmp/", "test_app_recorder_parallel", ".png");
+    BOOST_REQUIRE_EQUAL(3, pngs.size());
+    BOOST_CHECK_EQUAL(pngs[0] + 2, pngs[2]);
+    BOOST_CHECK(!file_exist(png_seq.get(pngs[0] - 1)));
+    BOOST_CHECK_EQUAL(0, get_sequence_numbers("/tmp/", "test_app_recorder_parallel-part1", ".png").size());
+    BOOST_CHECK_EQUAL(0, get_sequence_numbers("/tmp/", "test_app_recorder_parallel-part1", ".wrm").size());
+    BOOST_CHECK(!file_exist("/tmp/test_app_recorder_parallel-part1.mwrm"));
+    BOOST_CHECK(!file_exist("/tmp/test_app_recorder_parallel-part1.pgs"));
+
+    char progress[64] = {};
+    int fd = ::open("/tmp/test_app_recorder_parallel.pgs", O_RDONLY);
+    BOOST_CHECK_EQUAL(5, ::read(fd, progress, sizeof(progress)));
+    ::close(fd);
+    BOOST_CHECK_EQUAL("100 0", progress);
+
+    for (const char * basename : {"test_app_recorder_parallel", "test_app_recorder_serial"}) {
+        std::string meta_filename = std::string("/tmp/") + basename + ".mwrm";
+        header.clear();
+        files.clear();
+        read_meta_file(meta_filename, header, files);
+        for (auto & file : files) {
+            ::unlink(file.first.c_str());
+        }
+        ::unlink(meta_filename.c_str());
+        clear_files_flv_meta_png("/tmp/", basename);
+    }
+}
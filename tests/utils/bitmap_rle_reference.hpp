@@ -0,0 +1,618 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Pixel by pixel RLE bitmap encoder and decoder, as Bitmap had them before
+   they worked by runs. Kept for the tests: the output of Bitmap must be the
+   same byte for byte.
+*/
+
+#ifndef _REDEMPTION_TESTS_UTILS_BITMAP_RLE_REFERENCE_HPP_
+#define _REDEMPTION_TESTS_UTILS_BITMAP_RLE_REFERENCE_HPP_
+
+#include "bitmap.hpp"
+
+class ReferenceBitmapRLE
+{
+    const uint8_t   Bpp;
+    const size_t    line_size;
+    const uint8_t * pmin;
+
+    enum {
+        FLAG_NONE = 0,
+        FLAG_FILL = 1,
+        FLAG_MIX  = 2,
+        FLAG_FOM  = 3,
+        FLAG_MIX_SET = 6,
+        FLAG_FOM_SET = 7,
+        FLAG_COLOR = 8,
+        FLAG_BICOLOR = 9
+    };
+
+    ReferenceBitmapRLE(uint8_t Bpp, size_t line_size, const uint8_t * pmin)
+    : Bpp(Bpp)
+    , line_size(line_size)
+    , pmin(pmin)
+    {}
+
+public:
+    // compressed data of <bmp> (RLE, whatever the color depth of the session)
+    static void compress(const Bitmap & bmp, Stream & outbuffer)
+    {
+        ReferenceBitmapRLE(nbbytes(bmp.bpp()), bmp.line_size(), bmp.data())
+            .compress(bmp.bmp_size(), outbuffer);
+    }
+
+    // <out> holds cy lines of align4(cx) pixels
+    static void decompress(uint8_t bpp, uint16_t cx, uint16_t cy, const uint8_t * input, size_t size,
+                           uint8_t * out)
+    {
+        ReferenceBitmapRLE(nbbytes(bpp), align4(cx) * nbbytes(bpp), out)
+            .decompress(out, out + align4(cx) * nbbytes(bpp) * cy, input, size);
+    }
+
+private:
+    unsigned get_pixel(const uint8_t * const p) const
+    {
+        return in_uint32_from_nb_bytes_le(this->Bpp, p);
+    }
+
+    unsigned get_pixel_above(const uint8_t * const p) const
+    {
+        return ((p - this->line_size) < this->pmin) ? 0 : this->get_pixel(p - this->line_size);
+    }
+
+    unsigned get_color_count(const uint8_t * pmax, const uint8_t * p, unsigned color) const
+    {
+        unsigned acc = 0;
+        while (p < pmax && this->get_pixel(p) == color){
+            acc++;
+            p = p + this->Bpp;
+        }
+        return acc;
+    }
+
+    unsigned get_bicolor_count(const uint8_t * pmax, const uint8_t * p, unsigned color1, unsigned color2) const
+    {
+        unsigned acc = 0;
+        while ((p < pmax)
+            && (color1 == this->get_pixel(p))
+            && (p + this->Bpp < pmax)
+            && (color2 == this->get_pixel(p + this->Bpp))) {
+                acc = acc + 2;
+                p = p + 2 * this->Bpp;
+        }
+        return acc;
+    }
+
+    unsigned get_fill_count(const uint8_t * pmax, const uint8_t * p) const
+    {
+        unsigned acc = 0;
+        while (p + this->Bpp <= pmax) {
+            if (this->get_pixel_above(p) != this->get_pixel(p)){
+                break;
+            }
+            p += this->Bpp;
+            acc += 1;
+        }
+        return acc;
+    }
+
+    unsigned get_mix_count(const uint8_t * pmax, const uint8_t * p, unsigned foreground) const
+    {
+        unsigned acc = 0;
+        while (p + this->Bpp <= pmax){
+            if (this->get_pixel_above(p) ^ foreground ^ this->get_pixel(p)){
+                break;
+            }
+            p += this->Bpp;
+            acc += 1;
+        }
+        return acc;
+    }
+
+    unsigned get_fom_count(const uint8_t * pmax, const uint8_t * p, unsigned foreground, bool fill) const
+    {
+        unsigned acc = 0;
+        while (true){
+            unsigned count = 0;
+            while (p + this->Bpp <= pmax) {
+                if (this->get_pixel_above(p) ^ this->get_pixel(p) ^ (fill?0:foreground)){
+                    break;
+                }
+                p += this->Bpp;
+                count += 1;
+                if (count >= 9) {
+                    return acc;
+                }
+            }
+            if (!count){
+                break;
+            }
+            acc += count;
+            fill ^= true;
+        }
+        return acc;
+    }
+
+    void get_fom_masks(const uint8_t * p, uint8_t * mask, const unsigned count) const
+    {
+        for (unsigned i = 0; i < count; i += 8) {
+            mask[i>>3] = 0;
+        }
+        for (unsigned i = 0 ; i < count; i++, p += this->Bpp) {
+            if (this->get_pixel(p) != this->get_pixel_above(p)){
+                mask[i>>3] |= static_cast<uint8_t>(0x01 << (i & 7));
+            }
+        }
+    }
+
+    unsigned get_fom_count_set(const uint8_t * pmax, const uint8_t * p, unsigned & foreground, unsigned & flags) const
+    {
+        flags = FLAG_FILL;
+        unsigned fill_count = this->get_fill_count(pmax, p);
+        if (fill_count) {
+            if (fill_count < 8) {
+                unsigned fom_count = this->get_fom_count(pmax, p + fill_count * this->Bpp, foreground, false);
+                if (fom_count){
+                    flags = FLAG_FOM;
+                    fill_count += fom_count;
+                }
+            }
+            return fill_count;
+        }
+        if (p + this->Bpp <= pmax) {
+            flags = FLAG_MIX;
+            foreground = this->get_pixel_above(p) ^ this->get_pixel(p);
+            unsigned mix_count = 1 + this->get_mix_count(pmax, p + this->Bpp, foreground);
+            if (mix_count < 8) {
+                unsigned fom_count = this->get_fom_count(pmax, p + mix_count * this->Bpp, foreground, true);
+                if (fom_count){
+                    flags = FLAG_FOM;
+                    mix_count += fom_count;
+                }
+            }
+            return mix_count;
+        }
+        flags = FLAG_NONE;
+        return 0;
+    }
+
+    static void out_count(Stream & stream, const int in_count, const int mask)
+    {
+        if (in_count < 32) {
+            stream.out_uint8(static_cast<uint8_t>((mask << 5) | in_count));
+        }
+        else if (in_count < 256 + 32){
+            stream.out_uint8(static_cast<uint8_t>(mask << 5));
+            stream.out_uint8(static_cast<uint8_t>(in_count - 32));
+        }
+        else {
+            stream.out_uint8(static_cast<uint8_t>(0xf0 | mask));
+            stream.out_uint16_le(in_count);
+        }
+    }
+
+    void out_mix_count_set(Stream & stream, const int in_count, unsigned new_foreground) const
+    {
+        if (in_count < 16) {
+            stream.out_uint8(static_cast<uint8_t>(0xc0 | in_count));
+        }
+        else if (in_count < 256 + 16){
+            stream.out_uint8(0xc0);
+            stream.out_uint8(static_cast<uint8_t>(in_count - 16));
+        }
+        else {
+            stream.out_uint8(0xf6);
+            stream.out_uint16_le(in_count);
+        }
+        stream.out_bytes_le(this->Bpp, new_foreground);
+    }
+
+    static void out_fom_count(Stream & stream, const int in_count)
+    {
+        if (in_count < 256){
+            if (in_count & 7){
+                stream.out_uint8(0x40);
+                stream.out_uint8(static_cast<uint8_t>(in_count - 1));
+            }
+            else{
+                stream.out_uint8(static_cast<uint8_t>(0x40 | (in_count >> 3)));
+            }
+        }
+        else{
+            stream.out_uint8(0xf2);
+            stream.out_uint16_le(in_count);
+        }
+    }
+
+    static void out_fom_count_set(Stream & stream, const int in_count)
+    {
+        if (in_count < 256){
+            if (in_count & 0x87){
+                stream.out_uint8(0xD0);
+                stream.out_uint8(static_cast<uint8_t>(in_count - 1));
+            }
+            else{
+                stream.out_uint8(static_cast<uint8_t>(0xD0 | (in_count >> 3)));
+            }
+        }
+        else{
+            stream.out_uint8(0xf7);
+            stream.out_uint16_le(in_count);
+        }
+    }
+
+    static void out_bicolor_count(Stream & stream, const int in_count)
+    {
+        if (in_count / 2 < 16){
+            stream.out_uint8(static_cast<uint8_t>(0xe0 | (in_count / 2)));
+        }
+        else if (in_count / 2 < 256 + 16){
+            stream.out_uint8(static_cast<uint8_t>(0xe0));
+            stream.out_uint8(static_cast<uint8_t>(in_count / 2 - 16));
+        }
+        else{
+            stream.out_uint8(0xf8);
+            stream.out_uint16_le(in_count / 2);
+        }
+    }
+
+    void out_copy_sequence(Stream & stream, const int count, const uint8_t * data) const
+    {
+        out_count(stream, count, 0x04);
+        stream.out_copy_bytes(data, count * this->Bpp);
+    }
+
+    void compress(size_t bmp_size, Stream & out) const
+    {
+        const uint8_t Bpp = this->Bpp;
+        const uint8_t * p = this->pmin;
+
+        // white, ~(-1 << (Bpp*8)) before, which overflowed for 32 bpp
+        unsigned foreground = 0xFFFFFFFFu >> (32 - Bpp * 8);
+        unsigned new_foreground = foreground;
+        unsigned flags = 0;
+        uint8_t masks[512];
+        unsigned copy_count = 0;
+        const uint8_t * pmax = nullptr;
+
+        uint32_t color = 0;
+        uint32_t color2 = 0;
+
+        for (int part = 0 ; part < 2 ; part++){
+            // the fills of the first scanline and the ones of the others are split
+            pmax = this->pmin + (part ? bmp_size : this->line_size);
+            while (p < pmax)
+            {
+                uint32_t fom_count = this->get_fom_count_set(pmax, p, new_foreground, flags);
+                if (nbbytes_large(fom_count) > sizeof(masks)) {
+                    fom_count = sizeof(masks) * 8;
+                }
+                uint32_t color_count = 0;
+                uint32_t bicolor_count = 0;
+
+                if (p + Bpp < pmax){
+                    color = this->get_pixel(p);
+                    color2 = this->get_pixel(p + Bpp);
+
+                    if (color == color2){
+                        color_count = this->get_color_count(pmax, p, color);
+                    }
+                    else {
+                        bicolor_count = this->get_bicolor_count(pmax, p, color, color2);
+                    }
+                }
+
+                const unsigned fom_cost = 1
+                    + (foreground != new_foreground) * Bpp
+                    + (flags == FLAG_FOM) * nbbytes_large(fom_count);
+                const unsigned copy_fom_cost = 1 * (copy_count == 0) + fom_count * Bpp;
+                const unsigned color_cost = 1 + Bpp;
+                const unsigned bicolor_cost = 1 + 2*Bpp;
+
+                if ((fom_count >= color_count || (color_count == 0))
+                && ((fom_count >= bicolor_count) || (bicolor_count == 0) || (bicolor_count < 4))
+                && fom_cost < copy_fom_cost) {
+                    switch (flags){
+                        case FLAG_FOM:
+                            this->get_fom_masks(p, masks, fom_count);
+                            if (new_foreground != foreground){
+                                flags = FLAG_FOM_SET;
+                            }
+                        break;
+                        case FLAG_MIX:
+                            if (new_foreground != foreground){
+                                flags = FLAG_MIX_SET;
+                            }
+                        break;
+                        default:
+                        break;
+                    }
+                }
+                else {
+                    unsigned copy_color_cost = (copy_count == 0) + color_count * Bpp;
+                    unsigned copy_bicolor_cost = (copy_count == 0) + bicolor_count * Bpp;
+
+                    if ((color_cost < copy_color_cost) && (color_count > 0)){
+                        flags = FLAG_COLOR;
+                    }
+                    else if ((bicolor_cost < copy_bicolor_cost) && (bicolor_count > 0)){
+                        flags = FLAG_BICOLOR;
+                    }
+                    else {
+                        flags = FLAG_NONE;
+                        copy_count++;
+                    }
+                }
+
+                if (flags && copy_count > 0){
+                    this->out_copy_sequence(out, copy_count, p - copy_count * Bpp);
+                    copy_count = 0;
+                }
+
+                switch (flags){
+                    case FLAG_BICOLOR:
+                        out_bicolor_count(out, bicolor_count);
+                        out.out_bytes_le(Bpp, color);
+                        out.out_bytes_le(Bpp, color2);
+                        p+= bicolor_count * Bpp;
+                    break;
+                    case FLAG_COLOR:
+                        out_count(out, color_count, 0x03);
+                        out.out_bytes_le(Bpp, color);
+                        p+= color_count * Bpp;
+                    break;
+                    case FLAG_FOM_SET:
+                        out_fom_count_set(out, fom_count);
+                        out.out_bytes_le(Bpp, new_foreground);
+                        out.out_copy_bytes(masks, nbbytes_large(fom_count));
+                        foreground = new_foreground;
+                        p+= fom_count * Bpp;
+                    break;
+                    case FLAG_MIX_SET:
+                        this->out_mix_count_set(out, fom_count, new_foreground);
+                        foreground = new_foreground;
+                        p+= fom_count * Bpp;
+                    break;
+                    case FLAG_FOM:
+                        out_fom_count(out, fom_count);
+                        out.out_copy_bytes(masks, nbbytes_large(fom_count));
+                        p+= fom_count * Bpp;
+                    break;
+                    case FLAG_MIX:
+                        out_count(out, fom_count, 0x01);
+                        p+= fom_count * Bpp;
+                    break;
+                    case FLAG_FILL:
+                        out_count(out, fom_count, 0x00);
+                        p+= fom_count * Bpp;
+                    break;
+                    default: // copy, but wait until next good sequence before actual sending
+                        p += Bpp;
+                    break;
+                }
+            }
+
+            if (copy_count > 0){
+                this->out_copy_sequence(out, copy_count, p - copy_count * Bpp);
+                copy_count = 0;
+            }
+        }
+    }
+
+    void decompress(uint8_t * out, uint8_t * pmax, const uint8_t * input, size_t size) const
+    {
+        const uint8_t Bpp = this->Bpp;
+        const uint8_t * end = input + size;
+        unsigned color1 = 0;
+        unsigned color2 = 0;
+        unsigned mix = 0xFFFFFFFF;
+        unsigned mask = 0;
+        unsigned fom_mask = 0;
+        unsigned count = 0;
+        int bicolor = 0;
+
+        enum {
+            FILL    = 0,
+            MIX     = 1,
+            FOM     = 2,
+            COLOR   = 3,
+            COPY    = 4,
+            MIX_SET = 6,
+            FOM_SET = 7,
+            BICOLOR = 8,
+            SPECIAL_FGBG_1 = 9,
+            SPECIAL_FGBG_2 = 10,
+            WHITE = 13,
+            BLACK = 14
+        };
+
+        uint8_t opcode;
+        uint8_t lastopcode = 0xFF;
+
+        while (input < end) {
+            uint8_t code = input[0]; input++;
+
+            switch (code >> 4) {
+            case 0xf:
+                switch (code){
+                    case 0xFD: opcode = WHITE;          count = 1; break;
+                    case 0xFE: opcode = BLACK;          count = 1; break;
+                    case 0xFA: opcode = SPECIAL_FGBG_2; count = 8; break;
+                    case 0xF9: opcode = SPECIAL_FGBG_1; count = 8; break;
+                    case 0xF8:
+                        opcode = code & 0xf;
+                        count = input[0]|(input[1] << 8);
+                        count += count;
+                        input += 2;
+                    break;
+                    default:
+                        opcode = code & 0xf;
+                        count = input[0]|(input[1] << 8);
+                        input += 2;
+                    break;
+                }
+            break;
+            case 0x0e:
+                opcode = BICOLOR;
+                count = code & 0xf;
+                if (!count){
+                    count = input[0] + 16; input++;
+                }
+                count += count;
+                break;
+            case 0x0d:
+                opcode = FOM_SET;
+                count = code & 0x0F;
+                if (count){
+                    count <<= 3;
+                }
+                else {
+                    count = input[0] + 1; input++;
+                }
+            break;
+            case 0x05:
+            case 0x04:
+                opcode = FOM;
+                count = code & 0x1F;
+                if (count){
+                    count <<= 3;
+                }
+                else {
+                    count = input[0] + 1; input++;
+                }
+            break;
+            case 0x0c:
+                opcode = MIX_SET;
+                count = code & 0x0f;
+                if (!count){
+                    count = input[0] + 16; input++;
+                }
+            break;
+            default:
+                opcode = static_cast<uint8_t>(code >> 5);
+                count = code & 0x1f;
+                if (!count){
+                    count = input[0] + 32; input++;
+                }
+                break;
+            }
+
+            switch (opcode) {
+            case FOM:
+                mask = 1;
+                fom_mask = input[0]; input++;
+            break;
+            case SPECIAL_FGBG_1:
+                mask = 1;
+                fom_mask = 3;
+            break;
+            case SPECIAL_FGBG_2:
+                mask = 1;
+                fom_mask = 5;
+            break;
+            case BICOLOR:
+                bicolor = 0;
+                color1 = this->get_pixel(input);
+                input += Bpp;
+                color2 = this->get_pixel(input);
+                input += Bpp;
+                break;
+            case COLOR:
+                color2 = this->get_pixel(input);
+                input += Bpp;
+                break;
+            case MIX_SET:
+                mix = this->get_pixel(input);
+                input += Bpp;
+            break;
+            case FOM_SET:
+                mix = this->get_pixel(input);
+                input += Bpp;
+                mask = 1;
+                fom_mask = input[0]; input++;
+                break;
+            default:
+                break;
+            }
+
+            // one pixel of mix between two fills, except at the start of the second scanline
+            if ((opcode == FILL)
+            && (opcode == lastopcode)
+            && (out != this->pmin + this->line_size)){
+                out_bytes_le(out, Bpp, this->get_pixel_above(out) ^ mix);
+                count--;
+                out += Bpp;
+            }
+            lastopcode = opcode;
+
+            while (count > 0) {
+                if (out >= pmax) {
+                    throw Error(ERR_BITMAP_DECOMPRESSED_DATA_TOO_LARGE);
+                }
+                const unsigned yprev = this->get_pixel_above(out);
+
+                switch (opcode) {
+                case FILL:
+                    out_bytes_le(out, Bpp, yprev);
+                    break;
+                case MIX_SET:
+                case MIX:
+                    out_bytes_le(out, Bpp, yprev ^ mix);
+                    break;
+                case FOM_SET:
+                case FOM:
+                    if (mask == 0x100){
+                        mask = 1;
+                        fom_mask = input[0]; input++;
+                    }
+                    // fall through
+                case SPECIAL_FGBG_1:
+                case SPECIAL_FGBG_2:
+                    out_bytes_le(out, Bpp, (mask & fom_mask) ? (yprev ^ mix) : yprev);
+                    mask <<= 1;
+                    break;
+                case COLOR:
+                    out_bytes_le(out, Bpp, color2);
+                    break;
+                case COPY:
+                    out_bytes_le(out, Bpp, this->get_pixel(input));
+                    input += Bpp;
+                    break;
+                case BICOLOR:
+                    out_bytes_le(out, Bpp, bicolor ? color2 : color1);
+                    bicolor = !bicolor;
+                break;
+                case WHITE:
+                    out_bytes_le(out, Bpp, 0xFFFFFFFF);
+                break;
+                case BLACK:
+                    out_bytes_le(out, Bpp, 0);
+                break;
+                default:
+                    break;
+                }
+                count--;
+                out += Bpp;
+            }
+        }
+    }
+};
+
+#endif
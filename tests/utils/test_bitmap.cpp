@@ -31,6 +31,9 @@
 
 #include "bitmap.hpp"
 #include "drawable.hpp"
+#include "bitmap_rle_reference.hpp"
+
+#include <vector>
 
 BOOST_AUTO_TEST_CASE(TestBitmapCompressHardenned)
 {
@@ -4530,3 +4533,469 @@ BOOST_AUTO_TEST_CASE(TestBogusRLEDecompression1) {
 }
 
 
+
+BOOST_AUTO_TEST_CASE(TestBitmapConvertColorDepth) {
+    const uint8_t bpps[] = {8, 15, 16, 24, 32};
+    const uint16_t cx = 12;
+    const uint16_t cy = 5;
+
+    uint8_t data[cx * cy * 4];
+    uint32_t rnd = 1;
+    for (uint8_t & c : data) {
+        rnd = rnd * 1103515245 + 12345;
+        c = rnd >> 16;
+    }
+
+    BGRPalette palette(nullptr);
+    for (unsigned i = 0; i < 256; ++i) {
+        palette.set_color(i, (i * 0x010307) & 0xFFFFFF);
+    }
+
+    for (uint8_t in_bpp : bpps) {
+        Bitmap bmp(in_bpp, in_bpp, &palette, cx, cy, data, cx * cy * nbbytes(in_bpp));
+        for (uint8_t out_bpp : bpps) {
+            Bitmap converted(out_bpp, bmp);
+            BOOST_CHECK_EQUAL(out_bpp, converted.bpp());
+            BOOST_CHECK_EQUAL(cx, converted.cx());
+            BOOST_CHECK_EQUAL(cy, converted.cy());
+
+            const uint8_t * src = bmp.data();
+            const uint8_t * dest = converted.data();
+            for (size_t i = 0; i < size_t(cx) * cy; ++i) {
+                uint32_t pixel = color_decode(in_uint32_from_nb_bytes_le(nbbytes(in_bpp), src), in_bpp, palette);
+                if (in_bpp != out_bpp) {
+                    if (out_bpp == 16 || out_bpp == 15 || out_bpp == 8){
+                        pixel = RGBtoBGR(pixel);
+                    }
+                    pixel = color_encode(pixel, out_bpp);
+                }
+                else {
+                    pixel = in_uint32_from_nb_bytes_le(nbbytes(in_bpp), src);
+                }
+                if (pixel != in_uint32_from_nb_bytes_le(nbbytes(out_bpp), dest)) {
+                    BOOST_CHECK_MESSAGE(false, "convert " << int(in_bpp) << " -> " << int(out_bpp) << " pixel " << i);
+                    break;
+                }
+                src += nbbytes(in_bpp);
+                dest += nbbytes(out_bpp);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapFingerprint) {
+    const uint16_t cx = 16;
+    const uint16_t cy = 7;
+
+    uint8_t data[cx * cy * 3];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = i * 7;
+    }
+
+    Bitmap bmp(24, 24, nullptr, cx, cy, data, sizeof(data));
+    const Fingerprint fp = bmp.compute_fingerprint();
+
+    // same pixels
+    Bitmap other(24, 24, nullptr, cx, cy, data, sizeof(data));
+    BOOST_CHECK(fp == other.compute_fingerprint());
+
+    // one bit of one pixel
+    data[sizeof(data) - 1] ^= 1;
+    Bitmap modified(24, 24, nullptr, cx, cy, data, sizeof(data));
+    BOOST_CHECK(fp != modified.compute_fingerprint());
+    data[sizeof(data) - 1] ^= 1;
+
+    // same bytes, other dimensions
+    Bitmap resized(24, 24, nullptr, cx * 2, cy / 2, data, cx * 2 * (cy / 2) * 3);
+    BOOST_CHECK(compute_fingerprint(bmp.data(), cx * 2 * (cy / 2) * 3) == compute_fingerprint(resized.data(), resized.bmp_size()));
+    BOOST_CHECK(fp != resized.compute_fingerprint());
+
+    // the signatures are kept by the copies
+    uint8_t sha1[20];
+    bmp.compute_sha1(sha1);
+    Bitmap cloned = bmp.clone();
+    BOOST_CHECK(bmp.data() != cloned.data());
+    BOOST_CHECK(fp == cloned.compute_fingerprint());
+    uint8_t cloned_sha1[20];
+    cloned.compute_sha1(cloned_sha1);
+    BOOST_CHECK(!memcmp(sha1, cloned_sha1, sizeof(sha1)));
+
+    // 8 bpp, the palette is part of the fingerprint
+    BGRPalette palette(nullptr);
+    for (unsigned i = 0; i < 256; ++i) {
+        palette.set_color(i, i);
+    }
+    Bitmap bmp8(8, 8, &palette, cx, cy, data, cx * cy);
+    palette.set_color(255, 0);
+    Bitmap other_palette(8, 8, &palette, cx, cy, data, cx * cy);
+    BOOST_CHECK(bmp8.compute_fingerprint() != other_palette.compute_fingerprint());
+}
+
+namespace {
+    // pixels of the RLE tests, the same at each run
+    struct TestRandom {
+        uint32_t seed;
+
+        explicit TestRandom(uint32_t seed) : seed(seed) {}
+
+        uint32_t next() {
+            this->seed = this->seed * 1103515245 + 12345;
+            return this->seed >> 8;
+        }
+    };
+
+    enum RLETestPattern {
+        RLE_RANDOM,         // copy
+        RLE_SOLID,          // color runs, mega form when long
+        RLE_DITHERED,       // bicolor runs
+        RLE_SAME_LINES,     // fill, the first scanline is copied
+        RLE_BLACK,          // fill on the first scanline, magic mix between fills
+        RLE_XOR_LINES,      // mix, a foreground by scanline
+        RLE_FOM,            // fill or mix by pixel
+        RLE_RUNS,           // short runs of all the kinds, one after the other
+        RLE_NB_PATTERNS
+    };
+
+    // cy lines of cx pixels (cx * Bpp bytes)
+    std::vector<uint8_t> rle_test_pixels(uint8_t bpp, uint16_t cx, uint16_t cy, int pattern, uint32_t seed)
+    {
+        const uint8_t  Bpp   = nbbytes(bpp);
+        const uint32_t mask  = 0xFFFFFFFFu >> (32 - Bpp * 8);
+        const size_t   count = size_t(cx) * cy;
+        TestRandom     random(seed);
+
+        const uint32_t color1 = random.next() & mask;
+        const uint32_t color2 = random.next() & mask;
+
+        std::vector<uint32_t> pixels(count);
+        auto above = [&](size_t i) { return (i < cx) ? 0 : pixels[i - cx]; };
+        uint32_t foreground = random.next() & mask;
+        for (size_t i = 0; i < count; ) {
+            switch (pattern) {
+            case RLE_RANDOM:
+                pixels[i++] = random.next() & mask;
+                break;
+            case RLE_SOLID:
+                pixels[i++] = color1;
+                break;
+            case RLE_DITHERED:
+                pixels[i] = (i & 1) ? color2 : color1;
+                i++;
+                break;
+            case RLE_SAME_LINES:
+                pixels[i] = (i < cx) ? random.next() & mask : above(i);
+                i++;
+                break;
+            case RLE_BLACK:
+                pixels[i++] = 0;
+                break;
+            case RLE_XOR_LINES:
+                if (i % cx == 0) {
+                    foreground = random.next() & mask;
+                }
+                pixels[i] = above(i) ^ foreground;
+                i++;
+                break;
+            case RLE_FOM:
+                pixels[i] = (random.next() & 0x100) ? above(i) ^ foreground : above(i);
+                i++;
+                break;
+            default: {
+                // run of 1 to 40 pixels
+                const uint32_t r    = random.next();
+                const size_t   end  = std::min<size_t>(count, i + 1 + (r >> 8) % 40);
+                const uint32_t kind = r % 7;
+                if (kind == 5) {
+                    foreground = random.next() & mask;
+                }
+                for (; i < end; i++) {
+                    switch (kind) {
+                    case 0:  pixels[i] = random.next() & mask;                 break;
+                    case 1:  pixels[i] = i ? pixels[i - 1] : color1;           break;
+                    case 2:  pixels[i] = (i > 1) ? pixels[i - 2] : color2;     break;
+                    case 3:  pixels[i] = above(i);                             break;
+                    case 4:  pixels[i] = 0;                                    break;
+                    default: pixels[i] = above(i) ^ foreground;                break;
+                    }
+                }
+            }
+            break;
+            }
+        }
+
+        std::vector<uint8_t> data(count * Bpp);
+        for (size_t i = 0; i < count; i++) {
+            out_bytes_le(&data[i * Bpp], Bpp, pixels[i]);
+        }
+        return data;
+    }
+
+    // the session color depth selecting RLE for bpp
+    uint8_t rle_session_color_depth(uint8_t bpp)
+    {
+        return (bpp == 32) ? 24 : bpp;
+    }
+
+    bool check_rle_compress(uint8_t bpp, uint16_t cx, uint16_t cy, std::vector<uint8_t> const & data)
+    {
+        const uint8_t session_bpp = rle_session_color_depth(bpp);
+        Bitmap bmp(session_bpp, bpp, nullptr, cx, cy, data.data(), data.size());
+
+        BStream out(65536);
+        bmp.compress(session_bpp, out);
+        out.mark_end();
+
+        BStream expected(65536);
+        ReferenceBitmapRLE::compress(bmp, expected);
+        expected.mark_end();
+
+        if ((out.size() != expected.size()) || memcmp(out.get_data(), expected.get_data(), out.size())) {
+            return false;
+        }
+
+        Bitmap decompressed(session_bpp, bpp, nullptr, cx, cy, out.get_data(), out.size(), true);
+        return (decompressed.bmp_size() == bmp.bmp_size())
+            && !memcmp(decompressed.data(), bmp.data(), bmp.bmp_size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressLikeReference)
+{
+    const uint8_t  bpps[]    = { 8, 15, 16, 24, 32 };
+    const uint16_t widths[]  = { 1, 2, 3, 5, 7, 9, 13, 17, 31, 33, 63, 65 };
+    const uint16_t heights[] = { 1, 2, 3, 7, 16 };
+
+    for (uint8_t bpp : bpps) {
+        for (uint16_t cx : widths) {
+            for (uint16_t cy : heights) {
+                for (int pattern = 0; pattern < RLE_NB_PATTERNS; pattern++) {
+                    const uint32_t seed = bpp * 1000003 + cx * 1009 + cy * 17 + pattern;
+                    BOOST_CHECK_MESSAGE(check_rle_compress(bpp, cx, cy, rle_test_pixels(bpp, cx, cy, pattern, seed)),
+                        "bpp=" << int(bpp) << " cx=" << cx << " cy=" << cy << " pattern=" << pattern);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapCompressLongRuns)
+{
+    // runs beyond 256 pixels (MEGA_MEGA orders), in bitmaps of at most 4096
+    //  pixels like the ones sent (a run stops at 4096 pixels, the size of
+    //  the masks of a FOM, two fills in a row would get a magic mix pixel)
+    const uint8_t bpps[] = { 8, 15, 16, 24, 32 };
+
+    for (uint8_t bpp : bpps) {
+        for (int pattern = 0; pattern < RLE_NB_PATTERNS; pattern++) {
+            BOOST_CHECK_MESSAGE(check_rle_compress(bpp, 255, 16, rle_test_pixels(bpp, 255, 16, pattern, bpp + pattern)),
+                "bpp=" << int(bpp) << " pattern=" << pattern);
+        }
+
+        // a long FOM: one pixel in two differs from the pixel above
+        std::vector<uint8_t> data(rle_test_pixels(bpp, 64, 63, RLE_RANDOM, bpp));
+        const uint8_t Bpp = nbbytes(bpp);
+        for (size_t i = 64; i < size_t(64) * 63; i++) {
+            const unsigned above = in_uint32_from_nb_bytes_le(Bpp, &data[(i - 64) * Bpp]);
+            out_bytes_le(&data[i * Bpp], Bpp, (i & 1) ? (above ^ 0x5A) : above);
+        }
+        BOOST_CHECK_MESSAGE(check_rle_compress(bpp, 64, 63, data), "fom bpp=" << int(bpp));
+    }
+}
+
+namespace {
+    // RLE orders, the pixels in Bpp bytes
+    struct RLEOrders {
+        const uint8_t        Bpp;
+        std::vector<uint8_t> bytes;
+
+        explicit RLEOrders(uint8_t Bpp) : Bpp(Bpp) {}
+
+        RLEOrders & operator()(std::initializer_list<uint8_t> codes) {
+            this->bytes.insert(this->bytes.end(), codes.begin(), codes.end());
+            return *this;
+        }
+
+        RLEOrders & pixel(unsigned pixel) {
+            uint8_t p[4];
+            out_bytes_le(p, this->Bpp, pixel);
+            this->bytes.insert(this->bytes.end(), p, p + this->Bpp);
+            return *this;
+        }
+    };
+
+    // pixels expected from RLEOrders, written order after order
+    struct RLEPixels {
+        const uint16_t        cx;
+        std::vector<unsigned> pixels;
+
+        explicit RLEPixels(uint16_t cx) : cx(cx) {}
+
+        unsigned above() const {
+            return (this->pixels.size() < this->cx) ? 0 : this->pixels[this->pixels.size() - this->cx];
+        }
+
+        // FOM: bit i of masks gives pixel i, above ^ foreground when set
+        void fom(unsigned count, unsigned foreground, std::initializer_list<uint8_t> masks) {
+            for (unsigned i = 0; i < count; i++) {
+                const bool set = (masks.begin()[i / 8] >> (i % 8)) & 1;
+                this->pixels.push_back(this->above() ^ (set ? foreground : 0));
+            }
+        }
+
+        void fill(unsigned count) { this->mix(count, 0); }
+
+        void mix(unsigned count, unsigned foreground) {
+            while (count--) {
+                this->pixels.push_back(this->above() ^ foreground);
+            }
+        }
+
+        void color(unsigned count, unsigned color) {
+            this->pixels.insert(this->pixels.end(), count, color);
+        }
+
+        void bicolor(unsigned count, unsigned color1, unsigned color2) {
+            for (unsigned i = 0; i < count; i++) {
+                this->pixels.push_back((i & 1) ? color2 : color1);
+            }
+        }
+    };
+
+    void check_rle_decompress(uint8_t bpp, uint16_t cx, uint16_t cy, RLEOrders const & orders,
+                              RLEPixels const & expected)
+    {
+        BOOST_REQUIRE_EQUAL(size_t(cx) * cy, expected.pixels.size());
+
+        const uint8_t Bpp = nbbytes(bpp);
+        const uint8_t session_bpp = rle_session_color_depth(bpp);
+        Bitmap bmp(session_bpp, bpp, nullptr, cx, cy, orders.bytes.data(), orders.bytes.size(), true);
+
+        std::vector<uint8_t> reference(bmp.bmp_size());
+        ReferenceBitmapRLE::decompress(bpp, cx, cy, orders.bytes.data(), orders.bytes.size(), reference.data());
+        BOOST_CHECK_MESSAGE(!memcmp(bmp.data(), reference.data(), bmp.bmp_size()), "reference bpp=" << int(bpp));
+
+        for (size_t i = 0; i < expected.pixels.size(); i++) {
+            const unsigned pixel = in_uint32_from_nb_bytes_le(Bpp, bmp.data() + (i / cx) * bmp.line_size() + (i % cx) * Bpp);
+            if (pixel != expected.pixels[i]) {
+                BOOST_CHECK_MESSAGE(false, "bpp=" << int(bpp) << " pixel " << i << ": " << pixel << " != " << expected.pixels[i]);
+                break;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressOrders)
+{
+    const uint8_t bpps[] = { 8, 15, 16, 24, 32 };
+
+    for (uint8_t bpp : bpps) {
+        const uint8_t  Bpp   = nbbytes(bpp);
+        const unsigned white = 0xFFFFFFFFu >> (32 - Bpp * 8);
+        const unsigned c1    = 0x92A5C3u & white;
+        const unsigned c2    = 0x1F3D5Bu & white;
+        const unsigned c3    = 0x6E0847u & white;
+        const unsigned fg1   = 0x3C5A96u & white;
+        const unsigned fg2   = 0xC0FFEEu & white;
+        const unsigned fg3   = 0x0F1E2Du & white;
+
+        const uint16_t cx = 8;
+        RLEOrders orders(Bpp);
+        RLEPixels expected(cx);
+
+        // first scanline: FILL and MIX against black
+        orders({0x03});                 expected.fill(3);
+        orders({0x22});                 expected.mix(2, white);
+        orders({0x63}).pixel(c1);       expected.color(3, c1);
+
+        // two FILL in a row: one pixel of MIX between them
+        orders({0x02});                 expected.fill(2);
+        orders({0x03});                 expected.mix(1, white); expected.fill(2);
+        orders({0xE1}).pixel(c1).pixel(c2); expected.bicolor(2, c1, c2);
+        orders({0x81}).pixel(c3);       expected.color(1, c3);
+
+        // lite forms
+        orders({0xC3}).pixel(fg1);      expected.mix(3, fg1);
+        orders({0x41, 0xA5});           expected.fom(8, fg1, {0xA5});
+        orders({0xFD});                 expected.color(1, white);
+        orders({0xFE});                 expected.color(1, 0);
+        orders({0xF9});                 expected.fom(8, fg1, {0x03});
+        orders({0xD0, 10}).pixel(fg2)({0x5C, 0x06}); expected.fom(11, fg2, {0x5C, 0x06});
+        orders({0xFA});                 expected.fom(8, fg2, {0x05});
+
+        // MEGA_MEGA forms
+        orders({0xF3, 2, 0}).pixel(c2); expected.color(2, c2);
+        orders({0xF8, 1, 0}).pixel(c1).pixel(c2); expected.bicolor(2, c1, c2);
+        orders({0xF4, 1, 0}).pixel(c1); expected.color(1, c1);
+        orders({0xF1, 1, 0});           expected.mix(1, fg2);
+        orders({0xF6, 1, 0}).pixel(fg3); expected.mix(1, fg3);
+        orders({0xF0, 1, 0});           expected.fill(1);
+
+        // regular forms with the count in the next byte
+        orders({0x60, 2}).pixel(c3);    expected.color(34, c3);
+        orders({0x40, 11, 0x33, 0x0F}); expected.fom(12, fg3, {0x33, 0x0F});
+        orders({0xF2, 12, 0, 0xF0, 0x0A}); expected.fom(12, fg3, {0xF0, 0x0A});
+        orders({0xF7, 10, 0}).pixel(fg1)({0x81, 0x03}); expected.fom(10, fg1, {0x81, 0x03});
+        orders({0xE0, 0}).pixel(c1).pixel(c2); expected.bicolor(32, c1, c2);
+        orders({0xC0, 1}).pixel(fg2);   expected.mix(17, fg2);
+        orders({0x20, 0});              expected.mix(32, fg2);
+        orders({0x80, 0});
+        for (unsigned i = 0; i < 32; i++) {
+            const unsigned pixel = (i * 0x0B1D3Fu) & white;
+            orders.pixel(pixel);        expected.color(1, pixel);
+        }
+        orders({0x00, 0});              expected.fill(32);
+        orders({0x03});                 expected.mix(1, fg2); expected.fill(2);
+        orders({0xD1}).pixel(fg1)({0x3C}); expected.fom(8, fg1, {0x3C});
+
+        check_rle_decompress(bpp, cx, 36, orders, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressFillsAtSecondScanline)
+{
+    // a FILL starting the second scanline after a FILL gets no MIX pixel
+    const uint8_t bpps[] = { 8, 15, 16, 24, 32 };
+
+    for (uint8_t bpp : bpps) {
+        RLEOrders orders(nbbytes(bpp));
+        RLEPixels expected(8);
+        orders({0x08});                 expected.fill(8);
+        orders({0x08});                 expected.fill(8);
+        orders({0x03});                 expected.mix(1, 0xFFFFFFFFu >> (32 - nbbytes(bpp) * 8)); expected.fill(2);
+        orders({0x85}).pixel(1).pixel(2).pixel(3).pixel(4).pixel(5);
+        expected.color(1, 1); expected.color(1, 2); expected.color(1, 3); expected.color(1, 4); expected.color(1, 5);
+
+        check_rle_decompress(bpp, 8, 3, orders, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestBitmapDecompressOddWidths)
+{
+    // the encoder output of every pattern decoded like the reference, the
+    //  runs go over the padding at the end of the scanlines
+    const uint8_t  bpps[]   = { 8, 15, 16, 24, 32 };
+    const uint16_t widths[] = { 1, 3, 5, 7, 13, 33, 63 };
+
+    for (uint8_t bpp : bpps) {
+        const uint8_t session_bpp = rle_session_color_depth(bpp);
+        for (uint16_t cx : widths) {
+            for (int pattern = 0; pattern < RLE_NB_PATTERNS; pattern++) {
+                const uint16_t cy = 9;
+                const std::vector<uint8_t> data(rle_test_pixels(bpp, cx, cy, pattern, cx * 31 + pattern));
+                Bitmap bmp(session_bpp, bpp, nullptr, cx, cy, data.data(), data.size());
+
+                BStream out(65536);
+                ReferenceBitmapRLE::compress(bmp, out);
+                out.mark_end();
+
+                Bitmap decompressed(session_bpp, bpp, nullptr, cx, cy, out.get_data(), out.size(), true);
+                std::vector<uint8_t> reference(bmp.bmp_size());
+                ReferenceBitmapRLE::decompress(bpp, cx, cy, out.get_data(), out.size(), reference.data());
+
+                BOOST_CHECK_MESSAGE(!memcmp(decompressed.data(), reference.data(), bmp.bmp_size())
+                                 && !memcmp(decompressed.data(), bmp.data(), bmp.bmp_size()),
+                    "bpp=" << int(bpp) << " cx=" << cx << " pattern=" << pattern);
+            }
+        }
+    }
+}
@@ -1112,3 +1112,208 @@ BOOST_AUTO_TEST_CASE(TestMemblt3)
     // uncomment to see result in png file
     //dump_png("./test_memblt3_", gd.impl());
 }
+
+BOOST_AUTO_TEST_CASE(TestDirtyArea)
+{
+    uint16_t width = 640;
+    uint16_t height = 480;
+    Rect screen_rect(0, 0, width, height);
+    RDPDrawable gd(width, height, 24);
+
+    // a new drawable was never captured
+    BOOST_CHECK_EQUAL(screen_rect, gd.impl().dirty_area);
+    gd.impl().reset_dirty_area();
+    BOOST_CHECK(gd.impl().dirty_area.isempty());
+
+    gd.draw(RDPOpaqueRect(Rect(10, 20, 30, 40), RED), screen_rect);
+    gd.draw(RDPOpaqueRect(Rect(600, 470, 100, 100), BLUE), screen_rect);
+    BOOST_CHECK_EQUAL(Rect(10, 20, 630, 460), gd.impl().dirty_area);
+
+    // trace_mouse() and timestamp for the snapshots are not changes
+    gd.impl().reset_dirty_area();
+    gd.impl().trace_mouse();
+    gd.impl().clear_mouse();
+    BOOST_CHECK(gd.impl().dirty_area.isempty());
+
+    // cursor moved (default pointer hotspot is 0, 0)
+    gd.set_mouse_cursor_pos(100, 100);
+    BOOST_CHECK_EQUAL(Rect(100, 100, 32, 32).enlarge_to(Rect(320, 240, 32, 32)), gd.impl().dirty_area);
+    gd.impl().reset_dirty_area();
+    gd.set_mouse_cursor_pos(100, 100);
+    BOOST_CHECK(gd.impl().dirty_area.isempty());
+
+    gd.show_mouse_cursor(false);
+    gd.set_mouse_cursor_pos(200, 200);
+    BOOST_CHECK(gd.impl().dirty_area.isempty());
+}
+
+class StringTransport : public Transport {
+public:
+    std::string data;
+
+    virtual void do_send(const char * const buffer, size_t len) {
+        this->data.append(buffer, len);
+    }
+};
+
+static void check_same_images(RDPDrawable & gd24, RDPDrawable & gd32)
+{
+    std::vector<uint8_t> row24(gd24.width() * 3);
+    std::vector<uint8_t> row32(gd32.width() * 3);
+    unsigned bad_rows = 0;
+    for (size_t y = 0; y < gd24.height(); y++) {
+        gd24.impl().get_row24(y, row24.data());
+        gd32.impl().get_row24(y, row32.data());
+        bad_rows += (row24 != row32);
+    }
+    BOOST_CHECK_EQUAL(0, bad_rows);
+}
+
+BOOST_AUTO_TEST_CASE(TestDrawable32)
+{
+    // 700 * 4 bytes rows are padded to 2816 bytes
+    uint16_t width = 700;
+    uint16_t height = 500;
+    Rect screen_rect(0, 0, width, height);
+    RDPDrawable gd24(width, height, 24);
+    RDPDrawable gd32(width, height, 24, DepthColor::color32);
+
+    BOOST_CHECK_EQUAL(24, gd24.impl().bpp());
+    BOOST_CHECK_EQUAL(32, gd32.impl().bpp());
+    BOOST_CHECK_EQUAL(2100, gd24.rowsize());
+    BOOST_CHECK_EQUAL(2816, gd32.rowsize());
+    BOOST_CHECK_EQUAL(0, reinterpret_cast<uintptr_t>(gd32.data()) % 64);
+
+    uint32_t seed = 1;
+    auto random = [&seed](uint32_t max) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 8) % max;
+    };
+    auto random_rect = [&]() {
+        return Rect(random(width + 50) - 20, random(height + 50) - 20, random(200), random(150));
+    };
+
+    // bitmaps of each color depth converted by mem_blt
+    BGRPalette const & palette332 = BGRPalette::classic_332();
+    std::vector<Bitmap> bitmaps;
+    for (uint8_t bpp : {8, 15, 16, 24}) {
+        std::vector<uint8_t> raw(64 * 64 * nbbytes(bpp));
+        for (uint8_t & c : raw) {
+            c = random(256);
+        }
+        bitmaps.emplace_back(24, bpp, &palette332, 64, 64, raw.data(), raw.size());
+    }
+
+    const uint8_t patblt_rops[] = {0x00, 0x05, 0x0F, 0x50, 0x55, 0x5A, 0x5F, 0xA0, 0xA5, 0xAF,
+                                   0xF0, 0xF5, 0xFA, 0xFF};
+    const uint8_t scrblt_rops[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99,
+                                   0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+    const uint8_t memblt_rops[] = {0x00, 0x22, 0x55, 0x66, 0x88, 0xBB, 0xCC, 0xEE, 0xFF};
+    const uint8_t brush_extra[] = {0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA};
+
+    for (int i = 0; i < 3000; i++) {
+        const Rect r = random_rect();
+        const uint32_t color = random(0x1000000);
+        const uint32_t color2 = random(0x1000000);
+        switch (random(10)) {
+        case 0:
+            gd24.draw(RDPOpaqueRect(r, color), screen_rect);
+            gd32.draw(RDPOpaqueRect(r, color), screen_rect);
+            break;
+        case 1: {
+            const uint8_t rop = patblt_rops[random(sizeof(patblt_rops))];
+            gd24.draw(RDPPatBlt(r, rop, color, color2, RDPBrush()), screen_rect);
+            gd32.draw(RDPPatBlt(r, rop, color, color2, RDPBrush()), screen_rect);
+            break;
+        }
+        case 2: {
+            const uint8_t rop = random(2) ? 0xF0 : 0x5A;
+            const RDPBrush brush(random(8), random(8), 3, 0xAA, brush_extra);
+            gd24.draw(RDPPatBlt(r, rop, color, color2, brush), screen_rect);
+            gd32.draw(RDPPatBlt(r, rop, color, color2, brush), screen_rect);
+            break;
+        }
+        case 3: {
+            const uint8_t rop = scrblt_rops[random(sizeof(scrblt_rops))];
+            gd24.draw(RDPDestBlt(r, rop), screen_rect);
+            gd32.draw(RDPDestBlt(r, rop), screen_rect);
+            break;
+        }
+        case 4: {
+            // overlapping sources included
+            const uint8_t rop = scrblt_rops[random(sizeof(scrblt_rops))];
+            const uint16_t srcx = std::max(0, std::min<int>(r.x + random(41) - 20, width - r.cx));
+            const uint16_t srcy = std::max(0, std::min<int>(r.y + random(41) - 20, height - r.cy));
+            const Rect dr = r.intersect(screen_rect);
+            gd24.draw(RDPScrBlt(dr, rop, srcx, srcy), screen_rect);
+            gd32.draw(RDPScrBlt(dr, rop, srcx, srcy), screen_rect);
+            break;
+        }
+        case 5: case 6: {
+            const uint8_t rop = memblt_rops[random(sizeof(memblt_rops))];
+            const Bitmap & bmp = bitmaps[random(bitmaps.size())];
+            const RDPMemBlt cmd(0, r, rop, random(32), random(32), 0);
+            gd24.draw(cmd, screen_rect, bmp);
+            gd32.draw(cmd, screen_rect, bmp);
+            break;
+        }
+        case 7: {
+            const Bitmap & bmp = bitmaps[random(bitmaps.size())];
+            const RDPMem3Blt cmd(0, r, 0xB8, random(32), random(32), color, color2, RDPBrush(), 0);
+            gd24.draw(cmd, screen_rect, bmp);
+            gd32.draw(cmd, screen_rect, bmp);
+            break;
+        }
+        case 8: {
+            const uint8_t rop2 = random(2) ? 0x06 : 0x0D;
+            const RDPLineTo cmd(0, r.x, r.y, random(width), random(2) ? r.y : random(height),
+                                color2, rop2, RDPPen(0, 1, color));
+            gd24.draw(cmd, screen_rect);
+            gd32.draw(cmd, screen_rect);
+            break;
+        }
+        case 9: {
+            // the ellipses are not clipped
+            const Rect er(random(width - 200), random(height - 150), 2 + random(198), 2 + random(148));
+            const RDPEllipseSC cmd(er, color, 1 + random(16), random(2));
+            gd24.draw(cmd, screen_rect);
+            gd32.draw(cmd, screen_rect);
+            break;
+        }
+        }
+    }
+    check_same_images(gd24, gd32);
+
+    // rows given in 24 bpp
+    std::vector<uint8_t> row(width * 3);
+    for (size_t x = 0; x < row.size(); x++) {
+        row[x] = x * 7;
+    }
+    gd24.impl().set_row(10, row.data());
+    gd32.impl().set_row(10, row.data());
+
+    // mouse and timestamp
+    time_t t = 1400000000;
+    tm now;
+    localtime_r(&t, &now);
+    gd24.set_mouse_cursor_pos(width - 10, 2);
+    gd32.set_mouse_cursor_pos(width - 10, 2);
+    gd24.impl().trace_mouse();
+    gd32.impl().trace_mouse();
+    gd24.impl().trace_timestamp(now);
+    gd32.impl().trace_timestamp(now);
+    check_same_images(gd24, gd32);
+
+    // same png images
+    StringTransport png24;
+    StringTransport png32;
+    gd24.dump_png24(png24, true);
+    gd32.dump_png24(png32, true);
+    BOOST_CHECK(png24.data == png32.data);
+
+    gd24.impl().clear_timestamp();
+    gd32.impl().clear_timestamp();
+    gd24.impl().clear_mouse();
+    gd32.impl().clear_mouse();
+    check_same_images(gd24, gd32);
+}
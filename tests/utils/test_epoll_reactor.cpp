@@ -0,0 +1,90 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of the epoll reactor
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestEpollReactor
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "epoll_reactor.hpp"
+
+#include <sys/socket.h>
+
+BOOST_AUTO_TEST_CASE(TestEpollReactor)
+{
+    int a[2];
+    int b[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, b));
+
+    EpollReactor reactor(3);
+    reactor.watch(0, a[1]);
+    reactor.watch(1, b[1]);
+    reactor.watch(2, -1);
+
+    BOOST_CHECK_EQUAL(0, reactor.wait(0));
+
+    BOOST_CHECK_EQUAL(1, ::write(b[0], "x", 1));
+    BOOST_CHECK_EQUAL(1, reactor.wait(1000));
+    BOOST_CHECK(!reactor.is_ready(0));
+    BOOST_CHECK(reactor.is_ready(1));
+    BOOST_CHECK(!reactor.is_ready(2));
+
+    // level triggered: ready until read
+    BOOST_CHECK_EQUAL(1, reactor.wait(0));
+    BOOST_CHECK(reactor.is_ready(1));
+    char c;
+    BOOST_CHECK_EQUAL(1, ::read(b[1], &c, 1));
+    BOOST_CHECK_EQUAL(0, reactor.wait(0));
+    BOOST_CHECK(!reactor.is_ready(1));
+
+    // no longer watched
+    reactor.watch(1, -1);
+    BOOST_CHECK_EQUAL(1, ::write(b[0], "x", 1));
+    BOOST_CHECK_EQUAL(0, reactor.wait(0));
+
+    // a closed socket whose number is given to a new one: the generation
+    //  changes and the new socket is registered
+    const int old_fd = a[1];
+    ::close(a[0]);
+    ::close(a[1]);
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+    BOOST_REQUIRE(a[0] == old_fd || a[1] == old_fd);
+    const int reader = old_fd;
+    const int writer = (a[0] == old_fd) ? a[1] : a[0];
+    reactor.watch(0, reader, 1);
+    BOOST_CHECK_EQUAL(1, ::write(writer, "x", 1));
+    BOOST_CHECK_EQUAL(1, reactor.wait(1000));
+    BOOST_CHECK(reactor.is_ready(0));
+
+    // a hang up wakes up
+    BOOST_CHECK_EQUAL(1, ::read(reader, &c, 1));
+    ::close(writer);
+    BOOST_CHECK_EQUAL(1, reactor.wait(1000));
+    BOOST_CHECK(reactor.is_ready(0));
+
+    ::close(reader);
+    ::close(b[0]);
+    ::close(b[1]);
+}
@@ -311,6 +311,11 @@ BOOST_AUTO_TEST_CASE(TestRect)
     BOOST_CHECK_EQUAL(Rect(10, 10, 91, 91), Rect(10, 10, 1, 1).enlarge_to(100, 100));
     BOOST_CHECK_EQUAL(Rect(10, 10, 91, 91), Rect(100, 100, 1, 1).enlarge_to(10, 10));
 
+    BOOST_CHECK_EQUAL(Rect(10, 20, 30, 40), Rect().enlarge_to(Rect(10, 20, 30, 40)));
+    BOOST_CHECK_EQUAL(Rect(10, 20, 30, 40), Rect(10, 20, 30, 40).enlarge_to(Rect()));
+    BOOST_CHECK_EQUAL(Rect(10, 20, 30, 40), Rect(10, 20, 30, 40).enlarge_to(Rect(15, 25, 5, 5)));
+    BOOST_CHECK_EQUAL(Rect(5, 20, 95, 80), Rect(10, 20, 30, 40).enlarge_to(Rect(5, 90, 95, 10)));
+
     BOOST_CHECK_EQUAL(Rect(10, 10, 20, 45).getCenteredX(), 20);
 
     BOOST_CHECK_EQUAL(Rect(10, 10, 100, 50).getCenteredY(), 35);
@@ -0,0 +1,134 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of the size class free lists of the stream buffers
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestStreamBufferAllocator
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+//#define LOGPRINT
+
+#include "stream.hpp"
+
+BOOST_AUTO_TEST_CASE(TestStreamBufferAllocatorSizeClass)
+{
+    aux_::StreamBufferAlloc allocator;
+
+    size_t size = 1;
+    uint8_t * p1 = allocator.alloc(size);
+    BOOST_CHECK_EQUAL(256, size);
+    size = 257;
+    uint8_t * p2 = allocator.alloc(size);
+    BOOST_CHECK_EQUAL(512, size);
+    size = 65536 + 1024;
+    uint8_t * p3 = allocator.alloc(size);
+    BOOST_CHECK_EQUAL(131072, size);
+    size = 131073;
+    uint8_t * p4 = allocator.alloc(size);
+    BOOST_CHECK_EQUAL(131073, size);
+
+    allocator.dealloc(p1, 256);
+    allocator.dealloc(p2, 512);
+    allocator.dealloc(p3, 131072);
+    allocator.dealloc(p4, 131073);
+
+    aux_::StreamBufferAlloc::Counters counters = allocator.get_counters();
+    BOOST_CHECK_EQUAL(4, counters.allocations);
+    BOOST_CHECK_EQUAL(0, counters.reused);
+    BOOST_CHECK_EQUAL(4, counters.heap_allocations);
+    BOOST_CHECK_EQUAL(1, counters.heap_releases);
+    BOOST_CHECK_EQUAL(256 + 512 + 131072, counters.free_bytes);
+
+    // the last released buffer of the class is given back
+    size = 200;
+    BOOST_CHECK(p1 == allocator.alloc(size));
+    size = 66000;
+    BOOST_CHECK(p3 == allocator.alloc(size));
+    allocator.dealloc(p1, 256);
+    allocator.dealloc(p3, 131072);
+
+    counters = allocator.get_counters();
+    BOOST_CHECK_EQUAL(6, counters.allocations);
+    BOOST_CHECK_EQUAL(2, counters.reused);
+    BOOST_CHECK_EQUAL(4, counters.heap_allocations);
+    BOOST_CHECK_EQUAL(256 + 512 + 131072, counters.free_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(TestStreamBufferAllocatorFreeListLimit)
+{
+    aux_::StreamBufferAlloc allocator;
+
+    uint8_t * buffers[10];
+    for (uint8_t * & p : buffers) {
+        size_t size = 1000;
+        p = allocator.alloc(size);
+    }
+    for (uint8_t * p : buffers) {
+        allocator.dealloc(p, 1024);
+    }
+
+    // only 8 buffers are kept by class
+    aux_::StreamBufferAlloc::Counters counters = allocator.get_counters();
+    BOOST_CHECK_EQUAL(2, counters.heap_releases);
+    BOOST_CHECK_EQUAL(8 * 1024, counters.free_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(TestBStreamRecycledBuffer)
+{
+    const aux_::StreamBufferAlloc::Counters before
+      = aux_::stream_buffer_allocator().get_counters();
+
+    uint8_t * data;
+    {
+        BStream stream(1000);
+        stream.out_copy_bytes("abcdef", 6);
+        data = stream.get_data();
+    }
+    {
+        // same size class, the buffer is reused and cleared
+        BStream stream(600);
+        BOOST_CHECK(data == stream.get_data());
+        BOOST_CHECK_EQUAL(600, stream.get_capacity());
+        BOOST_CHECK_EQUAL(0, stream.get_data()[0]);
+        BOOST_CHECK_EQUAL(0, stream.get_data()[5]);
+
+        // a smaller capacity keeps the buffer
+        stream.init(100);
+        BOOST_CHECK(data == stream.get_data());
+        BOOST_CHECK_EQUAL(100, stream.get_capacity());
+
+        stream.init(5000);
+        BOOST_CHECK(data != stream.get_data());
+        BOOST_CHECK_EQUAL(5000, stream.get_capacity());
+    }
+    {
+        HStream stream(1024, 1024 + 65536);
+        BOOST_CHECK_EQUAL(1024, stream.headroom());
+        BOOST_CHECK_EQUAL(65536, stream.get_capacity());
+    }
+
+    const aux_::StreamBufferAlloc::Counters after
+      = aux_::stream_buffer_allocator().get_counters();
+    BOOST_CHECK_EQUAL(4, after.allocations - before.allocations);
+    BOOST_CHECK_EQUAL(1, after.reused - before.reused);
+}
@@ -0,0 +1,126 @@
+/*
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   Product name: redemption, a FLOSS RDP proxy
+   Copyright (C) Wallix 2015
+   Author(s): Christophe Grosjean
+
+   Unit test of the timer wheel
+*/
+
+#define BOOST_AUTO_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE TestTimerWheel
+#include <boost/test/auto_unit_test.hpp>
+
+#define LOGNULL
+
+#include "timer_wheel.hpp"
+
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(TestTimerWheelExpiry)
+{
+    const time_t now = 1000000;
+    TimerWheel wheel(4, now);
+    BOOST_CHECK_EQUAL(0, wheel.next_expiry());
+
+    wheel.arm(0, now + 10);
+    wheel.arm(1, now + 3);
+    wheel.arm(2, now + 3);
+    BOOST_CHECK_EQUAL(now + 3, wheel.next_expiry());
+
+    std::vector<unsigned> expired;
+    auto on_expiry = [&expired](unsigned id) { expired.push_back(id); };
+
+    wheel.advance(now + 2, on_expiry);
+    BOOST_CHECK(expired.empty());
+
+    // timers moved and cancelled
+    wheel.arm(2, now + 5);
+    wheel.cancel(1);
+    BOOST_CHECK(!wheel.is_armed(1));
+    BOOST_CHECK_EQUAL(now + 5, wheel.next_expiry());
+
+    wheel.advance(now + 7, on_expiry);
+    BOOST_REQUIRE_EQUAL(1, expired.size());
+    BOOST_CHECK_EQUAL(2, expired[0]);
+    BOOST_CHECK(!wheel.is_armed(2));
+    BOOST_CHECK_EQUAL(now + 10, wheel.next_expiry());
+
+    // an expired timer may be armed again from the callback
+    expired.clear();
+    wheel.advance(now + 10, [&](unsigned id) {
+        expired.push_back(id);
+        wheel.arm(id, now + 12);
+    });
+    BOOST_REQUIRE_EQUAL(1, expired.size());
+    BOOST_CHECK_EQUAL(0, expired[0]);
+    BOOST_CHECK_EQUAL(now + 12, wheel.next_expiry());
+
+    wheel.rearm(0, 0);
+    BOOST_CHECK_EQUAL(0, wheel.next_expiry());
+}
+
+BOOST_AUTO_TEST_CASE(TestTimerWheelPastDeadline)
+{
+    const time_t now = 1000000;
+    TimerWheel wheel(2, now);
+
+    std::vector<unsigned> expired;
+    auto on_expiry = [&expired](unsigned id) { expired.push_back(id); };
+
+    wheel.advance(now + 5, on_expiry);
+
+    // a passed deadline is due at the next second
+    wheel.arm(1, now);
+    BOOST_CHECK_EQUAL(now + 6, wheel.next_expiry());
+
+    wheel.advance(now + 6, on_expiry);
+    BOOST_REQUIRE_EQUAL(1, expired.size());
+    BOOST_CHECK_EQUAL(1, expired[0]);
+}
+
+BOOST_AUTO_TEST_CASE(TestTimerWheelBeyondOneTurn)
+{
+    const time_t now = 1000000;
+    TimerWheel wheel(3, now);
+
+    std::vector<unsigned> expired;
+    auto on_expiry = [&expired](unsigned id) { expired.push_back(id); };
+
+    // same slot, one and two turns later
+    wheel.arm(0, now + TimerWheel::NB_SLOTS + 4);
+    wheel.arm(1, now + 2 * TimerWheel::NB_SLOTS + 4);
+
+    // the wait stops at the end of the turn
+    BOOST_CHECK_EQUAL(now + TimerWheel::NB_SLOTS, wheel.next_expiry());
+
+    wheel.advance(now + 4, on_expiry);
+    BOOST_CHECK(expired.empty());
+
+    wheel.advance(now + TimerWheel::NB_SLOTS, on_expiry);
+    BOOST_CHECK(expired.empty());
+    BOOST_CHECK_EQUAL(now + TimerWheel::NB_SLOTS + 4, wheel.next_expiry());
+
+    // several turns at once
+    wheel.arm(2, now + 3 * TimerWheel::NB_SLOTS);
+    wheel.advance(now + 5 * TimerWheel::NB_SLOTS, on_expiry);
+    BOOST_REQUIRE_EQUAL(3, expired.size());
+    BOOST_CHECK_EQUAL(0, expired[0]);
+    BOOST_CHECK_EQUAL(1, expired[1]);
+    BOOST_CHECK_EQUAL(2, expired[2]);
+    BOOST_CHECK_EQUAL(0, wheel.next_expiry());
+}